@@ -0,0 +1,26 @@
+#include "backend/Backend.h"
+
+namespace prm
+{
+    void Backend::UpdateDisplay()
+    {
+        if (!m_frameMailbox.Fetch()) { return; }
+
+        const auto imageWidth = m_frameMailbox.GetReadWidth();
+        const auto imageHeight = m_frameMailbox.GetReadHeight();
+
+        m_displayConverter.SetBitDepth(m_sensorBitDepth);
+        m_displayConverter.SetWindow(m_minDisplayValue, m_maxDisplayValue,
+                                     m_displayCurve, m_displayGamma);
+        const auto* rgba = m_displayConverter.Convert(
+                m_frameMailbox.GetReadBuffer(), imageWidth, imageHeight);
+        const auto& stats = m_displayConverter.GetStats();
+
+        std::scoped_lock lock(m_textureMutex);
+        DisplayConverter::UpdateTexture(m_currentTexture, rgba, imageWidth,
+                                        imageHeight);
+        m_frameStats = stats;
+        m_minCurrentValue = stats.min;
+        m_maxCurrentValue = stats.max;
+    }
+}// namespace prm
@@ -1,12 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+
 #include <SFML/Graphics.hpp>
 #include <imgui-SFML.h>
 #include <spdlog/spdlog.h>
 
+#include "capture/FrameMailbox.h"
+#include "capture/FramePool.h"
 #include "messages/MessageQueue.h"
 #include "messages/messages.h"
 #include "misc/Log.h"
+#include "utils/DisplayConverter.h"
 #include "utils/FileUtils.h"
 
 namespace prm
@@ -42,6 +48,22 @@ namespace prm
         {
         }
 
+        /**
+         * Constructs a backend that runs next to another one and draws to its own texture
+         *
+         * @param other unique_ptr to a Backend to take the app state from
+         * @param texture Texture to draw the captured frames to
+         * @param mutex Mutex guarding the texture
+         */
+        Backend(const std::unique_ptr<Backend>& other, sf::Texture& texture,
+                std::mutex& mutex)
+            : m_argc(other->m_argc), m_argv(other->m_argv),
+              m_saveDirPath(other->m_saveDirPath), m_window(other->m_window),
+              m_currentTexture(texture), m_textureMutex(mutex),
+              m_dt(other->m_dt)
+        {
+        }
+
         /**
          * Handles generic camera initialization
          */
@@ -69,6 +91,17 @@ namespace prm
 
         [[nodiscard]] bool IsCapturing() const { return m_isCapturing; }
 
+        /**
+         * Gives the RAM budget for waiting frames, at least one megabyte
+         *
+         * @return Budget in bytes
+         */
+        [[nodiscard]] std::size_t GetCaptureBudgetBytes() const
+        {
+            return static_cast<std::size_t>(std::max(m_captureBudgetMb, 1)) *
+                   1024 * 1024;
+        }
+
         [[nodiscard]] const std::string& GetDirPath() const { return m_saveDirPath; }
         void SetDirPath(std::string_view dirPath)
         {
@@ -80,8 +113,59 @@ namespace prm
          */
         virtual void TerminateCapture() {}
 
+        /**
+         * Converts the latest published frame for display and uploads it to
+         * the texture, does nothing if no new frame arrived since the last call
+         * Called from the GUI thread once per rendered frame
+         */
+        virtual void UpdateDisplay();
+
         virtual ~Backend() = default;
 
+        /// Minimum brightness value to display in the GUI
+        int m_minDisplayValue = 0;
+        /// Maximum brightness value to display in the GUI
+        int m_maxDisplayValue = 4096;// 12 bits
+        /// Curve mapping the display range to screen brightness
+        DisplayCurve m_displayCurve = LINEAR;
+        /// Gamma value for the GAMMA display curve
+        float m_displayGamma = 2.2f;
+
+        /// Minimum brightness value in the current frame
+        uint16_t m_minCurrentValue = 0;
+        /// Maximum brightness value in the current frame
+        uint16_t m_maxCurrentValue = 0;
+        /// Statistics of the currently displayed frame, guarded by the texture mutex
+        FrameStats m_frameStats{};
+        /// Frames of the current capture lost to gaps in the frame numbers
+        std::atomic<uint64_t> m_droppedFrames = 0;
+        /// Frames reported by the camera but not yet taken by the capture loop
+        std::atomic<uint32_t> m_frameLag = 0;
+        /// Compression ratio of the frames in the compressed capture buffer
+        std::atomic<float> m_bufferRatio = 0.f;
+        /// Frames that still fit in the compressed capture buffer
+        std::atomic<uint64_t> m_bufferFramesLeft = 0;
+        /// Number of significant bits in the captured pixels
+        int m_sensorBitDepth = 16;
+
+        /// RAM budget for the frames waiting to be written in megabytes
+        int m_captureBudgetMb = DEFAULT_CAPTURE_BUDGET_MB;
+        /// Compression of saved stacks
+        Compression m_stackCompression = NO_COMPRESSION;
+        /// Pixels above it keep their surroundings in patch stacks
+        int m_patchThreshold = DEFAULT_PATCH_THRESHOLD;
+        /// Write uncompressed raw stacks past the OS file cache
+        bool m_bUnbufferedSaving = true;
+        /// Sync saved stacks to disk every second so a crash loses at most that
+        bool m_bJournaledSaving = false;
+        /// Keep frames of up to 12 bits packed in the capture buffer and raw stacks
+        bool m_bPackedSaving = false;
+        /// Keep the frames waiting to be written compressed in the capture buffer
+        bool m_bCompressedBuffer = false;
+
+        /// Only every Nth captured frame is published for display
+        int m_previewEveryNth = 1;
+
     protected:
         /// Command line argument count
         int m_argc;
@@ -106,6 +190,46 @@ namespace prm
         /// Delta time for last frame
         sf::Time& m_dt;
 
+        /// Latest captured mono frame waiting to be displayed
+        FrameMailbox m_frameMailbox{};
+        /// Converter turning the displayed frames into texture pixels
+        DisplayConverter m_displayConverter{};
+
+        /**
+         * Publishes a captured frame for display, honoring the preview decimation
+         * Called from the capture thread, never blocks
+         *
+         * @param frame Frame data
+         * @param imageWidth Width of the frame
+         * @param imageHeight Height of the frame
+         * @param frameIndex Index of the frame in the current capture
+         */
+        void PublishFrame(const uint16_t* frame, uint16_t imageWidth,
+                          uint16_t imageHeight, uint64_t frameIndex)
+        {
+            PublishFrame(m_frameMailbox, frame, imageWidth, imageHeight,
+                         frameIndex);
+        }
+
+        /**
+         * Publishes a captured frame into a given mailbox, honoring the preview decimation
+         *
+         * @param mailbox Mailbox of the viewport to show the frame in
+         * @param frame Frame data
+         * @param imageWidth Width of the frame
+         * @param imageHeight Height of the frame
+         * @param frameIndex Index of the frame in the current capture
+         */
+        void PublishFrame(FrameMailbox& mailbox, const uint16_t* frame,
+                          uint16_t imageWidth, uint16_t imageHeight,
+                          uint64_t frameIndex) const
+        {
+            const auto everyNth = static_cast<uint64_t>(
+                    std::max(m_previewEveryNth, 1));
+            if (frameIndex % everyNth != 0) { return; }
+            mailbox.Publish(frame, imageWidth, imageHeight);
+        }
+
         /**
          * Generic error printing function
          *
@@ -2,6 +2,7 @@
 
 #include "OpencvBackend.h"
 #include "PhotometricsBackend.h"
+#include "SimulatedBackend.h"
 
 namespace prm
 {
@@ -10,5 +11,6 @@ namespace prm
     {
         OPENCV = 0, ///< Backend for webcams
         PVCAM = 1, ///< Backend for connected Teledyne Photometrics cameras
+        SIMULATED = 2, ///< Hardware-free backend generating synthetic frames
     };
 }
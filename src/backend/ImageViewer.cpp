@@ -1,8 +1,16 @@
 #include <OpenImageIO/imageio.h>
+#include <atomic>
+#include <filesystem>
 #include <opencv2/opencv.hpp>
 #include <range/v3/all.hpp>
 
 #include "ImageViewer.h"
+#include "utils/ChunkedStack.h"
+#include "utils/FileUtils.h"
+#include "utils/RawStack.h"
+#include "utils/StripCodec.h"
+#include "utils/WorkerPool.h"
+#include "utils/TiffStackWriter.h"
 
 namespace prm
 {
@@ -14,39 +22,61 @@ namespace prm
                 {
                     using namespace OIIO;
                     spdlog::info("{}", filePath);
+                    if (std::filesystem::path{filePath}.extension() ==
+                        RAW_STACK_EXTENSION)
+                    {
+                        if (LoadRawStack_(filePath, maxImages))
+                        {
+                            SelectImage(m_currentFrame);
+                        }
+                        return;
+                    }
+                    if (ChunkedStackReader::IsChunkedStack(filePath))
+                    {
+                        if (LoadChunkedStack_(filePath, maxImages))
+                        {
+                            SelectImage(m_currentFrame);
+                        }
+                        return;
+                    }
+
                     auto inp = ImageInput::open(filePath);
                     if (!inp) { return; }
                     const ImageSpec& spec = inp->spec();
                     m_imageWidth = spec.width;
                     m_imageHeight = spec.height;
 
+                    // Frames past the limit are not counted, walking the
+                    // directories of a long stack takes a while
                     m_numFrames = 1;
-                    while (inp->seek_subimage(m_numFrames, 0))
+                    while (m_numFrames < maxImages &&
+                           inp->seek_subimage(static_cast<int>(m_numFrames), 0))
                     {
                         ++m_numFrames;
                     }
-                    m_numFrames = std::min(
-                            maxImages, static_cast<std::size_t>(m_numFrames));
 
                     spdlog::info("Num images: {}", m_numFrames);
 
-                    m_pixels = std::vector<uint16_t>(
-                            m_imageWidth * m_imageHeight * m_numFrames);
+                    m_modifiedPixels = std::vector<uint16_t>(
+                            std::size_t{m_imageWidth} * m_imageHeight *
+                            m_numFrames);
 
                     for (std::size_t i = 0;
-                         i < m_numFrames && inp->seek_subimage(i, 0); ++i)
+                         i < m_numFrames &&
+                         inp->seek_subimage(static_cast<int>(i), 0);
+                         ++i)
                     {
                         spdlog::info("Loading subimage {}", i);
                         inp->read_image(
                                 TypeDesc::UINT16,
-                                &m_pixels[i * m_imageWidth * m_imageHeight]);
+                                &m_modifiedPixels[i * m_imageWidth *
+                                                  m_imageHeight]);
                     }
 
                     //inp->read_image(TypeDesc::UINT16, &m_pixels[0]);
                     inp->close();
 
-                    std::copy(m_pixels.begin(), m_pixels.end(),
-                              std::back_inserter(m_modifiedPixels));
+                    KeepOriginal_();
 
                     spdlog::info("Loading complete");
 
@@ -57,66 +87,123 @@ namespace prm
         return true;
     }
 
-    void ImageViewer::SelectImage(std::size_t index)
+    bool ImageViewer::LoadRawStack_(const std::string& filePath,
+                                    std::size_t maxImages)
     {
-        if (!m_isImageLoaded) { return; }
-        m_currentFrame = index;
-        auto* backend = dynamic_cast<PhotometricsBackend*>(m_backend.get());
-
-        const auto beginIt = m_modifiedPixels.begin() +
-                             m_currentFrame * m_imageWidth * m_imageHeight;
-        const auto [itMin, itMax] = std::minmax_element(
-                beginIt, beginIt + m_imageWidth * m_imageHeight);
-
-        backend->m_minCurrentValue = *itMin;
-        backend->m_maxCurrentValue = *itMax;
+        RawStackReader reader{};
+        if (!reader.Open(filePath)) { return false; }
+
+        const auto& header = reader.GetHeader();
+        m_imageWidth = static_cast<uint16_t>(header.imageWidth);
+        m_imageHeight = static_cast<uint16_t>(header.imageHeight);
+        m_numFrames = std::min<std::size_t>(maxImages, reader.GetNumFrames());
+        spdlog::info("Num images: {}", m_numFrames);
+
+        // Uncompressed frames are copied straight from the mapping or
+        // unpacked, the strips of compressed ones are decoded on all cores
+        const auto frameSize = std::size_t{m_imageWidth} * m_imageHeight;
+        m_modifiedPixels = std::vector<uint16_t>(frameSize * m_numFrames);
+        WorkerPool pool{StripCodec::DefaultNumThreads()};
+        RawDecodeState state{};
+        for (std::size_t i = 0; i < m_numFrames; ++i)
+        {
+            if (!reader.ReadFrame(i, m_modifiedPixels.data() + i * frameSize,
+                                  state, &pool))
+            {
+                spdlog::error("Couldn't read frame {} of {}", i, filePath);
+                return false;
+            }
+        }
+        KeepOriginal_();
 
-        UpdateImage();
+        spdlog::info("Loading complete");
+        m_isImageLoaded = true;
+        return true;
     }
 
-    void ImageViewer::UpdateImage()
+    bool ImageViewer::LoadChunkedStack_(const std::string& filePath,
+                                        std::size_t maxImages)
     {
-        if (!m_isImageLoaded) { return; }
-        auto* backend = dynamic_cast<PhotometricsBackend*>(m_backend.get());
-        const auto image = MyImageToSfImage(
-                m_modifiedPixels, m_currentFrame, m_imageWidth, m_imageHeight,
-                backend->m_minDisplayValue, backend->m_maxDisplayValue);
+        ChunkedStackReader reader{};
+        if (!reader.Open(filePath)) { return false; }
+
+        m_imageWidth = static_cast<uint16_t>(reader.GetImageWidth());
+        m_imageHeight = static_cast<uint16_t>(reader.GetImageHeight());
+        m_numFrames = std::min<std::size_t>(maxImages, reader.GetNumFrames());
+        spdlog::info("Num images: {}", m_numFrames);
+
+        const auto frameSize = std::size_t{m_imageWidth} * m_imageHeight;
+        const auto framesPerChunk = reader.GetFramesPerChunk();
+        m_modifiedPixels = std::vector<uint16_t>(frameSize * m_numFrames);
+
+        // Chunks are independent files, each task decodes one of them
+        std::atomic<bool> success = true;
+        WorkerPool pool{StripCodec::DefaultNumThreads()};
+        pool.ParallelFor(
+                (m_numFrames + framesPerChunk - 1) / framesPerChunk,
+                [&](std::size_t chunk)
+                {
+                    std::vector<uint16_t> pixels{};
+                    if (!reader.ReadChunk(chunk, pixels))
+                    {
+                        success = false;
+                        return;
+                    }
+                    const auto first = chunk * framesPerChunk;
+                    const auto count = std::min<std::size_t>(
+                            framesPerChunk, m_numFrames - first);
+                    std::copy_n(pixels.begin(), count * frameSize,
+                                m_modifiedPixels.begin() + first * frameSize);
+                });
+        if (!success) { return false; }
+        KeepOriginal_();
 
-        const auto beginIt = m_modifiedPixels.begin() +
-                             m_currentFrame * m_imageWidth * m_imageHeight;
-        const auto [itMin, itMax] = std::minmax_element(
-                beginIt, beginIt + m_imageWidth * m_imageHeight);
+        spdlog::info("Loading complete");
+        m_isImageLoaded = true;
+        return true;
+    }
 
-        backend->m_minCurrentValue = *itMin;
-        backend->m_maxCurrentValue = *itMax;
+    void ImageViewer::KeepOriginal_()
+    {
+        // Filters run on the 16 bit frames, the originals are only read back
+        // on reset
+        const auto numPixels = m_modifiedPixels.size();
+        m_pixelPacking = FitsPacked12(m_modifiedPixels.data(), numPixels)
+                                 ? PACKED_12
+                                 : UNPACKED_16;
+        m_pixels = std::vector<uint8_t>(PackedBytes(m_pixelPacking, numPixels));
+        PackPixels(m_pixelPacking, m_modifiedPixels.data(), numPixels,
+                   m_pixels.data());
+    }
 
-        std::scoped_lock lock(m_textureMutex);
-        m_currentTexture.loadFromImage(image);
+    void ImageViewer::SelectImage(std::size_t index)
+    {
+        if (!m_isImageLoaded) { return; }
+        m_currentFrame = index;
+        UpdateImage();
     }
 
-    sf::Image
-    ImageViewer::MyImageToSfImage(const std::vector<uint16_t>& imageData,
-                                  std::size_t idx, uint16_t imageWidth,
-                                  uint16_t imageHeight, uint32_t minVal,
-                                  uint32_t maxVal)
+    void ImageViewer::UpdateImage()
     {
-        sf::Image image{};
+        if (!m_isImageLoaded) { return; }
+        auto* backend = m_backend.get();
+        m_displayConverter.SetBitDepth(backend->m_sensorBitDepth);
+        m_displayConverter.SetWindow(
+                backend->m_minDisplayValue, backend->m_maxDisplayValue,
+                backend->m_displayCurve, backend->m_displayGamma);
+        const auto* rgba = m_displayConverter.Convert(
+                m_modifiedPixels.data() +
+                        m_currentFrame * m_imageWidth * m_imageHeight,
+                m_imageWidth, m_imageHeight);
+
+        const auto& stats = m_displayConverter.GetStats();
 
-        image.create(imageWidth, imageHeight);
-        for (std::size_t y = 0; y < imageHeight; ++y)
-        {
-            for (std::size_t x = 0; x < imageWidth; ++x)
-            {
-                auto val = imageData[idx * imageWidth * imageHeight +
-                                     y * imageWidth + x];
-                val = std::clamp(val, (uint16_t) minVal, (uint16_t) maxVal);
-                auto val8 =
-                        static_cast<uint8_t>(static_cast<float>(val - minVal) /
-                                             (maxVal - minVal + 1) * 256.f);
-                image.setPixel(x, y, sf::Color{val8, val8, val8});
-            }
-        }
-        return image;
+        std::scoped_lock lock(m_textureMutex);
+        DisplayConverter::UpdateTexture(m_currentTexture, rgba, m_imageWidth,
+                                        m_imageHeight);
+        backend->m_frameStats = stats;
+        backend->m_minCurrentValue = stats.min;
+        backend->m_maxCurrentValue = stats.max;
     }
 
     bool ImageViewer::MedianFilter_(std::vector<uint16_t>& bytes,
@@ -193,30 +280,114 @@ namespace prm
 
     void ImageViewer::SaveImage_(const std::string& path)
     {
-        using namespace OIIO;
-
-        std::unique_ptr<ImageOutput> out = ImageOutput::create(path);
-        if (!out) return;
-
-        const auto frameSizeU16 = m_imageWidth * m_imageHeight;
-        ImageSpec spec(m_imageWidth, m_imageHeight, 1, TypeDesc::UINT16);
-        spec.attribute("compression", "none");
+        const auto frameSizeU16 = std::size_t{m_imageWidth} * m_imageHeight;
 
-        if (!out->supports("multiimage") || !out->supports("appendsubimage"))
+        TiffStackWriter writer{};
+        if (!writer.Open(path, m_imageWidth, m_imageHeight, m_numFrames))
         {
             return;
         }
-
-        ImageOutput::OpenMode appendmode = ImageOutput::Create;
-
         for (std::size_t s = 0; s < m_numFrames; ++s)
         {
-            out->open(path, spec, appendmode);
-            out->write_image(TypeDesc::UINT16,
-                             (uint8_t*) m_modifiedPixels.data() +
-                                     2 * frameSizeU16 * s);
-            appendmode = ImageOutput::AppendSubimage;
+            if (!writer.WriteFrame(m_modifiedPixels.data() + frameSizeU16 * s))
+            {
+                break;
+            }
+        }
+        if (writer.Close())
+        {
+            spdlog::info("Saved modified stack to {}", path);
         }
-        spdlog::info("Saved modified stack to {}", path);
+    }
+
+    void ImageViewer::ExportMp4(const std::string& path, double fps)
+    {
+        if (!m_isImageLoaded) { return; }
+        m_workerThread = std::jthread(
+                [&, path, options = MakeExportOptions(fps)]()
+                {
+                    Mp4Exporter::Export(m_modifiedPixels.data(), m_imageWidth,
+                                        m_imageHeight, m_numFrames, path,
+                                        options);
+                });
+    }
+
+    void ImageViewer::ExportFileToMp4(const std::string& tifPath,
+                                      const std::string& path, double fps)
+    {
+        m_workerThread = std::jthread(
+                [tifPath, path, options = MakeExportOptions(fps)]()
+                {
+                    if (std::filesystem::path{tifPath}.extension() ==
+                        RAW_STACK_EXTENSION)
+                    {
+                        Mp4Exporter::ExportRawStack(tifPath, path, options);
+                    }
+                    else if (ChunkedStackReader::IsChunkedStack(tifPath))
+                    {
+                        Mp4Exporter::ExportChunkedStack(tifPath, path, options);
+                    }
+                    else { Mp4Exporter::ExportTifStack(tifPath, path, options); }
+                });
+    }
+
+    void ImageViewer::ConvertStack(const std::string& path)
+    {
+        m_workerThread = std::jthread(
+                [path]()
+                {
+                    auto target = std::filesystem::path{path};
+                    const bool fromChunked =
+                            ChunkedStackReader::IsChunkedStack(path);
+                    if (target.filename() == CHUNKED_STACK_ARRAY_FILE)
+                    {
+                        target = target.parent_path();
+                    }
+                    const bool fromRaw = target.extension() == RAW_STACK_EXTENSION;
+                    target.replace_extension(fromRaw || fromChunked
+                                                     ? ".tif"
+                                                     : RAW_STACK_EXTENSION);
+                    if (std::filesystem::exists(target))
+                    {
+                        spdlog::error("{} already exists", target.string());
+                        return;
+                    }
+
+                    bool success = false;
+                    if (fromChunked)
+                    {
+                        success = FileUtils::ConvertChunkedToTif(
+                                path, target.string());
+                    }
+                    else if (fromRaw)
+                    {
+                        success = FileUtils::ConvertRawToTif(path,
+                                                             target.string());
+                    }
+                    else
+                    {
+                        success = FileUtils::ConvertTifToRaw(path,
+                                                             target.string());
+                    }
+                    if (success)
+                    {
+                        spdlog::info("Converted {} to {}", path,
+                                     target.string());
+                    }
+                    else { spdlog::error("Couldn't convert {}", path); }
+                });
+    }
+
+    Mp4ExportOptions ImageViewer::MakeExportOptions(double fps) const
+    {
+        const auto* backend = m_backend.get();
+        return Mp4ExportOptions{
+                .minValue = static_cast<uint32_t>(backend->m_minDisplayValue),
+                .maxValue = static_cast<uint32_t>(backend->m_maxDisplayValue),
+                .curve = backend->m_displayCurve,
+                .gamma = backend->m_displayGamma,
+                .bitDepth = backend->m_sensorBitDepth,
+                .fps = fps > 0.0 ? fps : EXPORT_DEFAULT_FPS,
+                .numSegments = 0};
     }
 }// namespace prm
\ No newline at end of file
@@ -6,6 +6,8 @@
 
 #include "Backend.h"
 #include "PhotometricsBackend.h"
+#include "utils/Mp4Exporter.h"
+#include "utils/PixelPacking.h"
 
 namespace prm
 {
@@ -69,9 +71,11 @@ namespace prm
             m_workerThread = std::jthread(
                     [&]()
                     {
-                        m_modifiedPixels.clear();
-                        std::copy(m_pixels.begin(), m_pixels.end(),
-                                  std::back_inserter(m_modifiedPixels));
+                        m_modifiedPixels.resize(std::size_t{m_imageWidth} *
+                                                m_imageHeight * m_numFrames);
+                        UnpackPixels(m_pixelPacking, m_pixels.data(),
+                                     m_modifiedPixels.size(),
+                                     m_modifiedPixels.data());
                         UpdateImage();
                     });
         }
@@ -80,14 +84,61 @@ namespace prm
 
         void SaveImage(const std::string& path) { SaveImage_(path); }
 
+        /**
+         * Exports the loaded stack with its modifications to mp4, tone mapped
+         * with the current display settings
+         *
+         * @param path Path of the mp4 file
+         * @param fps Frame rate stored in the video
+         */
+        void ExportMp4(const std::string& path, double fps);
+
+        /**
+         * Exports a whole tif, raw or chunked stack to mp4 without loading it
+         * into memory
+         *
+         * @param tifPath Path of the stack
+         * @param path Path of the mp4 file
+         * @param fps Frame rate stored in the video
+         */
+        void ExportFileToMp4(const std::string& tifPath,
+                             const std::string& path, double fps);
+
+        /**
+         * Converts a tif stack to a raw stack next to it or the other way round,
+         * chunked stacks are converted to tif
+         *
+         * @param path Path of the stack to convert
+         */
+        void ConvertStack(const std::string& path);
+
         bool m_isImageLoaded;
 
     private:
-        static sf::Image
-        MyImageToSfImage(const std::vector<uint16_t>& imageData,
-                         std::size_t idx, uint16_t imageWidth,
-                         uint16_t imageHeight, uint32_t minVal,
-                         uint32_t maxVal);
+        /**
+         * Loads the first frames of a raw stack
+         *
+         * @param filePath Path of the raw stack
+         * @param maxImages Maximum number of frames to load
+         * @return true on success
+         */
+        bool LoadRawStack_(const std::string& filePath, std::size_t maxImages);
+
+        /**
+         * Loads the first frames of a chunked stack, decoding chunks in parallel
+         *
+         * @param filePath Path of the chunked stack or its array description
+         * @param maxImages Maximum number of frames to load
+         * @return true on success
+         */
+        bool LoadChunkedStack_(const std::string& filePath,
+                               std::size_t maxImages);
+
+        /**
+         * Keeps a copy of the freshly loaded frames for resets, packed if
+         * every pixel fits in 12 bits
+         */
+        void KeepOriginal_();
 
         bool TopHatFilter_(std::vector<uint16_t>& bytes, uint16_t width,
                            uint16_t height, uint32_t nFrames,
@@ -102,12 +153,23 @@ namespace prm
 
         void SaveImage_(const std::string& path);
 
-        std::vector<uint16_t> m_pixels;
+        /**
+         * Gives the export settings matching the current display settings
+         *
+         * @param fps Frame rate stored in the video
+         * @return Export settings
+         */
+        Mp4ExportOptions MakeExportOptions(double fps) const;
+
+        /// Frames as loaded, in m_pixelPacking
+        std::vector<uint8_t> m_pixels;
+        PixelPacking m_pixelPacking = UNPACKED_16;
+        /// Frames with the filters applied, shown and saved
         std::vector<uint16_t> m_modifiedPixels;
 
         uint16_t m_imageWidth;
         uint16_t m_imageHeight;
-        uint16_t m_numFrames;
+        std::size_t m_numFrames;
         std::size_t m_currentFrame;
 
         std::unique_ptr<Backend>& m_backend;
@@ -115,6 +177,8 @@ namespace prm
         sf::Texture& m_currentTexture;
         /// Mutex for texture synchronisation
         std::mutex& m_textureMutex;
+        /// Converter turning the selected frame into texture pixels
+        DisplayConverter m_displayConverter{};
 
         std::jthread m_workerThread;
     };
@@ -1,24 +1,19 @@
 #include <spdlog/spdlog.h>
-#include <OpenImageIO/imageio.h>
 
 #include "OpencvBackend.h"
+#include "capture/FramePacer.h"
 
-sf::Image prm::OpencvBackend::MatToImage(const cv::Mat& mat)
+void prm::OpencvBackend::ShowFrame(const cv::Mat& mat)
 {
-    sf::Image image;
-
-    image.create(mat.size().width, mat.size().height);
-    for (std::size_t x = 0; x < mat.size().width; ++x)
-    {
-        for (std::size_t y = 0; y < mat.size().height; ++y)
-        {
-            image.setPixel(x, y,
-                           sf::Color{mat.at<cv::Vec3b>(y, x)[0],
-                                     mat.at<cv::Vec3b>(y, x)[1],
-                                     mat.at<cv::Vec3b>(y, x)[2]});
-        }
-    }
-    return image;
+    // cvtColor only reallocates the destination when the frame size changes
+    cv::cvtColor(mat, m_rgbaFrame,
+                 mat.channels() == 1 ? cv::COLOR_GRAY2RGBA
+                                     : cv::COLOR_BGR2RGBA);
+
+    std::scoped_lock lock(m_textureMutex);
+    DisplayConverter::UpdateTexture(m_currentTexture, m_rgbaFrame.data,
+                                    static_cast<uint16_t>(m_rgbaFrame.cols),
+                                    static_cast<uint16_t>(m_rgbaFrame.rows));
 }
 
 void prm::OpencvBackend::Init()
@@ -78,10 +73,23 @@ void prm::OpencvBackend::TerminateCapture() { m_isCapturing = false; }
 
 void prm::OpencvBackend::Init_(prm::OpencvCameraCtx& ctx)
 {
-    spdlog::info("Opening camera");
-
-    ctx.camera = std::make_unique<cv::VideoCapture>(0);
-    if (!ctx.camera->isOpened())
+    switch (ctx.sourceType)
+    {
+        case CV_DEVICE:
+            spdlog::info("Opening camera {}", ctx.deviceIndex);
+            ctx.camera = std::make_unique<cv::VideoCapture>(ctx.deviceIndex);
+            break;
+        case CV_VIDEO_FILE:
+            spdlog::info("Opening video file {}", ctx.sourcePath);
+            ctx.camera = std::make_unique<cv::VideoCapture>(ctx.sourcePath);
+            break;
+        case CV_IMAGE_SEQUENCE:
+            spdlog::info("Opening image sequence {}", ctx.sourcePath);
+            ctx.camera = std::make_unique<cv::VideoCapture>(ctx.sourcePath,
+                                                            cv::CAP_IMAGES);
+            break;
+    }
+    if (!ctx.camera || !ctx.camera->isOpened())
     {
         PrintError("ERROR: Could not open camera");
         return;
@@ -110,16 +118,20 @@ void prm::OpencvBackend::Capture_(OpencvCameraCtx& ctx, SAVE_FORMAT format,
         return;
     }
 
-    const int xres = ctx.camera->get(cv::CAP_PROP_FRAME_WIDTH);
-    const int yres = ctx.camera->get(cv::CAP_PROP_FRAME_HEIGHT);
-    const int channels =
-            ctx.camera->get(cv::CAP_PROP_XI_IMAGE_IS_COLOR) ? 3 : 1;
-
-    const int singleFrameSize = xres * yres * channels;
-
-    std::vector<std::uint8_t> pixels;
+    // Let the camera drop to the target rate itself where it can, the pacer
+    // holds the rate for the cameras that ignore the request
+    if (ctx.sourceType == CV_DEVICE && ctx.framerate > 0)
+    {
+        ctx.camera->set(cv::CAP_PROP_FPS, static_cast<double>(ctx.framerate));
+    }
+    FramePacer pacer{};
+    pacer.Start(static_cast<double>(ctx.framerate));
 
+    // Reused by every retrieve, so the decoder only allocates on the first frame
+    cv::Mat frame{};
     auto counter = 0;
+    uint64_t skippedFrames = 0;
+    uint64_t unsavedFrames = 0;
     while (m_isCapturing)
     {
         // Condition to quit sequence capture
@@ -128,92 +140,129 @@ void prm::OpencvBackend::Capture_(OpencvCameraCtx& ctx, SAVE_FORMAT format,
             m_isCapturing = false;
             break;
         }
+
+        pacer.Pace();
+        ctx.deliveredFps = static_cast<float>(pacer.GetDeliveredFps());
+
+        // Grab every frame to keep up with the source, decoding waits until
+        // we know the frame is needed
+        if (!ctx.camera->grab())
+        {
+            if (ctx.sourceType == CV_DEVICE)
+            {
+                spdlog::error("Got empty frame. Stopping capture...");
+            }
+            else { spdlog::info("End of source reached"); }
+            break;
+        }
+
+        const auto everyNth =
+                static_cast<uint64_t>(std::max(m_previewEveryNth, 1));
+        const bool show = static_cast<uint64_t>(counter) % everyNth == 0;
         ++counter;
+        if (!save && !show)
+        {
+            ++skippedFrames;
+            continue;
+        }
 
-        cv::Mat frame;
-        *ctx.camera >> frame;
-        if (frame.empty())
+        if (!ctx.camera->retrieve(frame) || frame.empty())
         {
-            spdlog::error("Got empty frame. Stopping capture...");
-            m_isCapturing = false;
-            ctx.camera->release();
-            ctx.isCamOpen = false;
+            spdlog::error("Couldn't decode frame. Stopping capture...");
             break;
         }
         spdlog::debug("Frame no {}", counter);
 
-        cv::cvtColor(frame, frame, cv::COLOR_BGR2RGB);
-        if (save)
+        // The encoder learns the frame layout from the first decoded frame
+        if (save && !ctx.encoder.IsOpen() &&
+            !StartEncoding(ctx, videoPath, format, frame, nFrames))
         {
-            std::copy(frame.data, frame.data + singleFrameSize,
-                      std::back_inserter(pixels));
+            save = false;
         }
 
-        const auto image = MatToImage(frame);
+        if (save)
+        {
+            // Sequence capture waits for the encoder to make the frame count,
+            // live capture drops the frame to keep up with the camera
+            auto* slot = nFrames > 0 ? ctx.framePool.Acquire(
+                                               std::chrono::milliseconds{5000})
+                                     : ctx.framePool.Acquire();
+            if (slot)
+            {
+                // Frames are kept in the native BGR order
+                frame.copyTo(cv::Mat(frame.rows, frame.cols, frame.type(),
+                                     slot));
+                ctx.encoder.Push(slot);
+            }
+            else
+            {
+                if (unsavedFrames == 0)
+                {
+                    spdlog::warn("Encoder fell behind, frame #{} not saved",
+                                 counter);
+                }
+                ++unsavedFrames;
+            }
+        }
 
-        std::scoped_lock lock(m_textureMutex);
-        m_currentTexture.loadFromImage(image);
-        std::this_thread::sleep_for(std::chrono::milliseconds(
-                static_cast<uint64_t>(1.f / static_cast<float>(ctx.framerate)) *
-                1000));
+        if (show) { ShowFrame(frame); }
     }
     ctx.camera->release();
     m_isCapturing = false;
     ctx.isCamOpen = false;
+    ctx.deliveredFps = 0.f;
+
+    spdlog::info("Captured {} frames\nAvg fps: {}", pacer.GetNumFrames(),
+                 pacer.GetAverageFps());
+    spdlog::info("{} frames were grabbed but not decoded", skippedFrames);
 
-    if (save)
+    if (ctx.encoder.IsOpen())
     {
-        switch (format)
+        if (!ctx.encoder.Close())
         {
-            case TIF:
-            {
-                using namespace OIIO;
-
-                std::unique_ptr<ImageOutput> out =
-                        ImageOutput::create(videoPath);
-                if (!out) return;
-                ImageSpec spec(xres, yres, channels, TypeDesc::UINT8);
-
-                if (!out->supports("multiimage") ||
-                    !out->supports("appendsubimage"))
-                {
-                    spdlog::error(
-                            "Current plugin doesn't support tif subimages");
-                    return;
-                }
-
-                ImageOutput::OpenMode appendmode = ImageOutput::Create;
+            spdlog::error("Failed encoding to {}", videoPath);
+        }
+        ctx.framePool.Free();
+        spdlog::info("File written to {}", videoPath);
+    }
+    if (unsavedFrames > 0)
+    {
+        spdlog::warn("{} frames were not saved because the encoder fell "
+                     "behind",
+                     unsavedFrames);
+    }
+}
 
-                for (int s = 0; s < counter; ++s)
-                {
-                    out->open(videoPath, spec, appendmode);
-                    out->write_image(TypeDesc::UINT8,
-                                     pixels.data() + singleFrameSize * s);
-                    appendmode = ImageOutput::AppendSubimage;
-                }
-                break;
-            }
+bool prm::OpencvBackend::StartEncoding(OpencvCameraCtx& ctx,
+                                       std::string_view videoPath,
+                                       SAVE_FORMAT format,
+                                       const cv::Mat& frame, int32_t nFrames)
+{
+    const auto frameBytes = frame.total() * frame.elemSize();
+    const auto budgetBytes = GetCaptureBudgetBytes();
+    const auto budgetSlots = budgetBytes / FramePool::SlotBytesFor(frameBytes);
+    const auto numSlots =
+            nFrames > 0 ? std::min<std::size_t>(nFrames, budgetSlots)
+                        : budgetSlots;
+
+    if (!ctx.framePool.Allocate(frameBytes, numSlots))
+    {
+        spdlog::error("Unable to allocate encoder buffer");
+        return false;
+    }
 
-            case MP4:
-            {
-                cv::VideoWriter writer{
-                        videoPath, cv::VideoWriter::fourcc('X', '2', '6', '4'),
-                        static_cast<double>(ctx.framerate),
-                        cv::Size{xres, yres}};
+    // The video has to know its frame rate up front, so take the target
+    // rate or the rate the source reports
+    auto fps = static_cast<double>(ctx.framerate);
+    if (fps <= 0.0) { fps = ctx.camera->get(cv::CAP_PROP_FPS); }
+    if (fps <= 0.0) { fps = CV_DEFAULT_FPS; }
 
-                for (int s = 0; s < counter; ++s)
-                {
-                    auto mat = cv::Mat(yres, xres, CV_8UC3,
-                                       pixels.data() + singleFrameSize * s);
-                    cv::cvtColor(mat, mat, cv::COLOR_RGB2BGR);
-                    writer.write(mat);
-                }
-                writer.release();
-                break;
-            }
-            default:
-                spdlog::error("Undefined format");
-        }
-        spdlog::info("File written to {}", videoPath);
+    if (!ctx.encoder.Open(videoPath, format, frame.cols, frame.rows,
+                          frame.channels(), fps, ctx.framePool))
+    {
+        spdlog::error("Couldn't start encoding to {}", videoPath);
+        ctx.framePool.Free();
+        return false;
     }
+    return true;
 }
\ No newline at end of file
@@ -1,19 +1,31 @@
 #pragma once
 
+#include <atomic>
 #include <opencv2/opencv.hpp>
+#include <string>
 #include <string_view>
 
 #include "Backend.h"
+#include "capture/FramePool.h"
+#include "capture/VideoEncoder.h"
 
 namespace prm
 {
+    /// Where the OpenCV backend takes its frames from
+    enum CvSourceType
+    {
+        CV_DEVICE = 0,        ///< Camera device by index
+        CV_VIDEO_FILE = 1,    ///< Recorded video file
+        CV_IMAGE_SEQUENCE = 2,///< Numbered images, e.g. frame_%04d.png
+    };
+
     /// Struct that groups camera related info
     struct OpencvCameraCtx
     {
         /// unique_ptr to the OpenCV VideoCapture device(camera)
         std::unique_ptr<cv::VideoCapture> camera;
-        /// Target capture framerate
-        uint16_t framerate;
+        /// Target capture framerate, 0 captures as fast as the camera delivers
+        int framerate;
 
         /// Specifies if the camera is open
         bool isCamOpen;
@@ -23,6 +35,21 @@ namespace prm
 
         ///  unique_ptr to a worker jthread, that hanldes the capture
         std::unique_ptr<std::jthread> thread{nullptr};
+
+        /// Frame rate actually delivered by the running capture
+        std::atomic<float> deliveredFps{0.f};
+
+        /// Kind of source opened on init
+        CvSourceType sourceType{CV_DEVICE};
+        /// Device index for CV_DEVICE sources
+        int deviceIndex{0};
+        /// File path or printf style image pattern for the other sources
+        std::string sourcePath{};
+
+        /// Preallocated slots that hold the frames waiting to be encoded
+        FramePool framePool{};
+        /// Encoder that saves the frames while the capture runs
+        VideoEncoder encoder{};
     };
 
     /// Default capture framerate
@@ -57,6 +84,21 @@ namespace prm
             Init();
         }
 
+        /**
+         * Constructs a webcam backend that runs next to another backend
+         *
+         * @param other unique_ptr to a Backend to take the app state from
+         * @param texture Texture to draw the captured frames to
+         * @param mutex Mutex guarding the texture
+         */
+        OpencvBackend(const std::unique_ptr<Backend>& other,
+                      sf::Texture& texture, std::mutex& mutex)
+            : Backend(other, texture, mutex),
+              m_context(OpencvCameraCtx{nullptr, CV_DEFAULT_FPS, false})
+        {
+            Init();
+        }
+
         /**
          * Handles generic camera initialization
          */
@@ -85,6 +127,13 @@ namespace prm
          */
         void TerminateCapture() override;
 
+        /**
+         * Returns a pointer to the camera context
+         *
+         * @return Raw pointer to the camera context
+         */
+        OpencvCameraCtx* GetCameraContext() { return &m_context; }
+
         ~OpencvBackend() override { OpencvBackend::TerminateCapture(); };
 
     private:
@@ -97,7 +146,9 @@ namespace prm
 
         /**
          * Generic internal capture function to send to the worker thread,
-         * handles common functionality of live and sequence capture
+         * handles common functionality of live and sequence capture.
+         * Grabs every frame at the source rate, but only decodes the frames
+         * that are saved or shown
          *
          * @param ctx Context of the capturing camera
          * @param format Save file format
@@ -108,14 +159,31 @@ namespace prm
                       int32_t nFrames, bool save);
 
         /**
-         * Helper function to convert an OpenCV Mat to an SFML Image
+         * Sets up the frame pool and the encoder for the current capture
+         *
+         * @param ctx Context of the capturing camera
+         * @param videoPath Output file path
+         * @param format Save file format
+         * @param frame First decoded frame, gives the frame layout
+         * @param nFrames Image sequence length (-1 for live capture)
+         * @return true on success
+         */
+        bool StartEncoding(OpencvCameraCtx& ctx, std::string_view videoPath,
+                           SAVE_FORMAT format, const cv::Mat& frame,
+                           int32_t nFrames);
+
+        /**
+         * Converts a captured frame into the display buffer and uploads it to the texture
+         * The buffer is reused between frames, so nothing is allocated per frame
          *
-         * @param mat Mat to convert
-         * @return Resulting SFML Image
+         * @param mat BGR or mono frame to show
          */
-        static sf::Image MatToImage(const cv::Mat& mat);
+        void ShowFrame(const cv::Mat& mat);
 
         /// Current camera context
         OpencvCameraCtx m_context;
+
+        /// RGBA copy of the latest shown frame, reused between frames
+        cv::Mat m_rgbaFrame{};
     };
 }// namespace prm
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <filesystem>
 #include <fmt/format.h>
 #include <iomanip>
@@ -8,7 +9,6 @@
 #include "backend/PhotometricsBackend.h"
 #include "misc/Meta.h"
 #include "utils/FileUtils.h"
-#include "utils/Timer.h"
 
 namespace prm
 {
@@ -30,30 +30,6 @@ namespace prm
         spdlog::error("{}{}{}", str, str1, str2);
     }
 
-    sf::Image PhotometricsBackend::PVCamImageToSfImage(uint16_t* imageData,
-                                                       uint16_t imageWidth,
-                                                       uint16_t imageHeight,
-                                                       uint32_t minVal,
-                                                       uint32_t maxVal)
-    {
-        sf::Image image{};
-
-        image.create(imageWidth, imageHeight);
-        for (std::size_t y = 0; y < imageHeight; ++y)
-        {
-            for (std::size_t x = 0; x < imageWidth; ++x)
-            {
-                uint16_t val = *(imageData + y * imageWidth + x);
-                val = std::clamp(val, (uint16_t) minVal, (uint16_t) maxVal);
-                auto val8 =
-                        static_cast<uint8_t>(static_cast<float>(val - minVal) /
-                                             (maxVal - minVal + 1) * 256.f);
-                image.setPixel(x, y, sf::Color{val8, val8, val8});
-            }
-        }
-        return image;
-    }
-
     bool PhotometricsBackend::ShowAppInfo(int argc, char* argv[])
     {
         auto appName = "<unable to get name>";
@@ -600,25 +576,50 @@ namespace prm
                 &PhotometricsBackend::Init_, this);
     }
 
-    bool PhotometricsBackend::InitAndOpenOneCamera()
+    bool PhotometricsBackend::InitAndOpenAllCameras()
     {
-        if (m_cameraIndex >= m_cameraContexts.size())
+        bool anyOpen = false;
+        for (uns16 i = 0; i < m_cameraContexts.size(); ++i)
         {
-            PrintError("Camera index #{} is invalid", m_cameraIndex);
-            UninitPVCAM();
-            return false;
+            auto& ctx = m_cameraContexts[i];
+            if (!OpenCamera(ctx))
+            {
+                CloseCamera(ctx);
+                continue;
+            }
+
+            // The first camera that opens goes to the main viewport
+            if (!anyOpen) { m_cameraIndex = i; }
+            anyOpen = true;
         }
 
-        if (!OpenCamera(m_cameraContexts.at(m_cameraIndex)))
+        if (!anyOpen)
         {
-            CloseCamera(m_cameraContexts.at(m_cameraIndex));
+            spdlog::error("Couldn't open any camera");
             UninitPVCAM();
             return false;
         }
-
         return true;
     }
 
+    void PhotometricsBackend::SetCurrentCameraIndex(uns16 index)
+    {
+        if (index >= m_cameraContexts.size() ||
+            !m_cameraContexts[index]->isCamOpen)
+        {
+            spdlog::warn("Camera {} is not open", index);
+            return;
+        }
+        // Only the main camera publishes into the main mailbox, which takes
+        // one producer
+        if (m_isCapturing || m_numCapturingCameras > 0)
+        {
+            spdlog::warn("Can't switch the main camera while capturing");
+            return;
+        }
+        m_cameraIndex = index;
+    }
+
     bool PhotometricsBackend::ReadEnumeration(int16 hcam, NVPC* pNvpc,
                                               uns32 paramID,
                                               const char* paramName)
@@ -778,6 +779,18 @@ namespace prm
 
     void PhotometricsBackend::SequenceCapture(uint32_t nFrames,
                                               SAVE_FORMAT format, bool save)
+    {
+        m_stackFormat = format == RAW || format == CHUNKED ? format : DIR;
+        StartCapture(nFrames, save);
+    }
+
+    void PhotometricsBackend::LiveCapture(SAVE_FORMAT format, bool save)
+    {
+        m_stackFormat = format == RAW || format == CHUNKED ? format : DIR;
+        StartCapture(0, save);
+    }
+
+    void PhotometricsBackend::StartCapture(uint32_t nFrames, bool save)
     {
         if (!m_isPvcamInitialized)
         {
@@ -785,49 +798,121 @@ namespace prm
             return;
         }
 
-        auto& ctx = m_cameraContexts[m_cameraIndex];
-        if (!ctx->isCamOpen)
+        if (!m_cameraContexts[m_cameraIndex]->isCamOpen)
         {
             spdlog::warn("Camera not opened");
             return;
         }
 
-        if (m_isCapturing)
+        if (m_isCapturing || m_numCapturingCameras > 0)
         {
             spdlog::warn("Already capturing");
             return;
         }
 
-        ctx->threadAbortFlag = false;
-        ctx->thread = std::make_unique<std::jthread>(
-                &PhotometricsBackend::SequenceCapture_, this, nFrames, format,
-                save);
+        // One time stamp for all cameras so their captures can be matched
+        const auto videoPath = FileUtils::GenerateVideoPath(
+                m_saveDirPath,
+                nFrames > 0 ? SEQ_CAPTURE_PREFIX : LIVE_CAPTURE_PREFIX, DIR);
+        if (videoPath.empty())
+        {
+            spdlog::error("Couldn't generate videopath");
+            return;
+        }
+
+        m_droppedFrames = 0;
+        m_frameLag = 0;
+        m_bufferRatio = 0.f;
+        m_bufferFramesLeft = 0;
+        // Every camera counts as capturing before its thread runs, so a second
+        // start can't slip in. A thread that fails to start releases its camera
+        m_numCapturingCameras = static_cast<int>(std::count_if(
+                m_cameraContexts.begin(), m_cameraContexts.end(),
+                [](const auto& ctx) { return ctx->isCamOpen; }));
+        m_isCapturing = true;
+        for (uns16 i = 0; i < m_cameraContexts.size(); ++i)
+        {
+            auto& ctx = m_cameraContexts[i];
+            if (!ctx->isCamOpen) { continue; }
+
+            ctx->threadAbortFlag = false;
+            // Drop the notifications left over from the previous capture
+            while (ctx->eofEvent.frameReady.try_acquire()) {}
+            ctx->eofEvent.numNotified = 0;
+            ctx->eofEvent.numConsumed = 0;
+            ctx->thread = std::make_unique<std::jthread>(
+                    [this, i, nFrames, save,
+                     cameraPath = CameraVideoPath(videoPath, i)]
+                    {
+                        const bool started =
+                                nFrames > 0
+                                        ? SequenceCapture_(i, nFrames,
+                                                           cameraPath, save)
+                                        : LiveCapture_(i, cameraPath, save);
+                        if (!started) { EndCameraCapture(); }
+                    });
+        }
     }
 
-    void PhotometricsBackend::LiveCapture(SAVE_FORMAT format, bool save)
+    std::string
+    PhotometricsBackend::CameraVideoPath(const std::string& videoPath,
+                                         uns16 camIndex) const
     {
-        if (!m_isPvcamInitialized)
+        const auto numOpen = std::count_if(
+                m_cameraContexts.begin(), m_cameraContexts.end(),
+                [](const auto& ctx) { return ctx->isCamOpen; });
+        if (numOpen <= 1) { return videoPath; }
+        return fmt::format("{}_cam{}", videoPath, camIndex);
+    }
+
+    void PhotometricsBackend::EndCameraCapture()
+    {
+        if (--m_numCapturingCameras == 0) { m_isCapturing = false; }
+    }
+
+    void PhotometricsBackend::PublishCameraFrame(uns16 camIndex,
+                                                 const uint16_t* frame,
+                                                 uint16_t imageWidth,
+                                                 uint16_t imageHeight,
+                                                 uint64_t frameIndex)
+    {
+        if (camIndex == m_cameraIndex)
         {
-            spdlog::warn("Initialize PVCAM first");
-            return;
+            PublishFrame(frame, imageWidth, imageHeight, frameIndex);
         }
-
-        auto& ctx = m_cameraContexts[m_cameraIndex];
-        if (!ctx->isCamOpen)
+        else
         {
-            spdlog::warn("Camera not opened");
-            return;
+            PublishFrame(m_cameraContexts[camIndex]->displayMailbox, frame,
+                         imageWidth, imageHeight, frameIndex);
         }
+    }
 
-        if (m_isCapturing)
+    void PhotometricsBackend::UpdateDisplay()
+    {
+        // Capture threads only write the bit depth of their own camera
+        if (m_cameraIndex < m_cameraContexts.size())
         {
-            spdlog::warn("Already capturing");
-            return;
+            m_sensorBitDepth = m_cameraContexts[m_cameraIndex]->bitDepth;
         }
+        Backend::UpdateDisplay();
 
-        ctx->threadAbortFlag = false;
-        ctx->thread = std::make_unique<std::jthread>(
-                &PhotometricsBackend::LiveCapture_, this, format, save);
+        for (uns16 i = 0; i < m_cameraContexts.size(); ++i)
+        {
+            auto& ctx = m_cameraContexts[i];
+            if (i == m_cameraIndex || !ctx->displayMailbox.Fetch()) { continue; }
+
+            const auto imageWidth = ctx->displayMailbox.GetReadWidth();
+            const auto imageHeight = ctx->displayMailbox.GetReadHeight();
+            ctx->displayConverter.SetBitDepth(ctx->bitDepth);
+            ctx->displayConverter.SetWindow(m_minDisplayValue,
+                                            m_maxDisplayValue, m_displayCurve,
+                                            m_displayGamma);
+            const auto* rgba = ctx->displayConverter.Convert(
+                    ctx->displayMailbox.GetReadBuffer(), imageWidth,
+                    imageHeight);
+            DisplayConverter::UpdateTexture(ctx->displayTexture, rgba,
+                                            imageWidth, imageHeight);
+        }
     }
 
     void PhotometricsBackend::TerminateCapture()
@@ -838,14 +923,10 @@ namespace prm
         for (auto& ctx: m_cameraContexts)
         {
             if (!ctx || !ctx->isCamOpen) { continue; }
+            if (ctx->threadAbortFlag.exchange(true)) { continue; }
 
-            {
-                std::scoped_lock lock(ctx->eofEvent.mutex);
-                if (ctx->threadAbortFlag) { continue; }
-                ctx->threadAbortFlag = true;
-                spdlog::info(">>> Requesting ABORT on camera {}\n", ctx->hcam);
-            }
-            ctx->eofEvent.cond.notify_all();
+            spdlog::info(">>> Requesting ABORT on camera {}\n", ctx->hcam);
+            ctx->eofEvent.frameReady.release();
         }
         m_isCapturing = false;
         spdlog::info(">>>\n\n");
@@ -857,53 +938,33 @@ namespace prm
         if (!pFrameInfo || !pContext) return;
         auto ctx = static_cast<CameraContext*>(pContext);
 
-        // Store the frame information for later use on the main thread
-        ctx->eofFrameInfo = *pFrameInfo;
-
-        // Obtain a pointer to the last acquired frame
-        if (PV_OK != pl_exp_get_latest_frame(ctx->hcam, &ctx->eofFrame))
-        {
-            PrintError("pl_exp_get_latest_frame() error");
-            ctx->eofFrame = nullptr;
-        }
-
-        // Unblock the acquisition thread
-        {
-            std::lock_guard<std::mutex> lock(ctx->eofEvent.mutex);
-            ctx->eofEvent.flag = true;
-        }
-        ctx->eofEvent.cond.notify_all();
+        // The acquisition thread takes the frames itself in arrival order,
+        // so all the callback does is count the frame and wake the thread up
+        ctx->eofHostTime = std::chrono::steady_clock::now();
+        ctx->eofEvent.numNotified.fetch_add(1, std::memory_order_relaxed);
+        ctx->eofEvent.frameReady.release();
     }
 
     bool PhotometricsBackend::WaitForEofEvent(CameraContext* ctx,
                                               uns32 timeoutMs,
                                               bool& errorOccurred)
     {
-        std::unique_lock<std::mutex> lock(ctx->eofEvent.mutex);
-
         errorOccurred = false;
-        ctx->eofEvent.cond.wait_for(
-                lock, std::chrono::milliseconds(timeoutMs),
-                [ctx]() { return ctx->eofEvent.flag || ctx->threadAbortFlag; });
+        const bool notified = ctx->eofEvent.frameReady.try_acquire_for(
+                std::chrono::milliseconds(timeoutMs));
         if (ctx->threadAbortFlag)
         {
             spdlog::info("Processing aborted on camera {}\n", ctx->hcam);
             return false;
         }
-        if (!ctx->eofEvent.flag)
+        if (!notified)
         {
             spdlog::error("Camera {} timed out waiting for a frame\n",
                           ctx->hcam);
             errorOccurred = true;
             return false;
         }
-        ctx->eofEvent.flag = false;// Reset flag
-
-        if (!ctx->eofFrame)
-        {
-            errorOccurred = true;
-            return false;
-        }
+        ++ctx->eofEvent.numConsumed;
 
         return true;
     }
@@ -911,31 +972,22 @@ namespace prm
     void PhotometricsBackend::Init_()
     {
         spdlog::info("Starting init");
-        InitAndOpenOneCamera();
+        InitAndOpenAllCameras();
     }
 
-    void PhotometricsBackend::SequenceCapture_(uint32_t nFrames,
-                                               SAVE_FORMAT format, bool save)
+    bool PhotometricsBackend::SequenceCapture_(uns16 camIndex,
+                                               uint32_t nFrames,
+                                               std::string videoPath, bool save)
     {
-        const auto videoPath = FileUtils::GenerateVideoPath(
-                m_saveDirPath, SEQ_CAPTURE_PREFIX, format);
-        if (videoPath.empty())
-        {
-            spdlog::error("Couldn't generate videopath");
-            return;
-        }
-
-        auto& ctx = m_cameraContexts[0];
-
-        std::vector<uint8_t> bytes;
+        auto& ctx = m_cameraContexts[camIndex];
 
         if (PV_OK != pl_cam_register_callback_ex3(ctx->hcam, PL_CALLBACK_EOF,
                                                   (void*) CustomEofHandler,
                                                   (void*) ctx.get()))
         {
             PrintError("pl_cam_register_callback() error");
-            CloseAllCamerasAndUninit();
-            return;
+            CloseCamera(ctx);
+            return false;
         }
 
         uns32 exposureBytes;
@@ -943,8 +995,8 @@ namespace prm
         int16 expMode;
         if (!SelectCameraExpMode(ctx, expMode, TIMED_MODE, EXT_TRIG_INTERNAL))
         {
-            CloseAllCamerasAndUninit();
-            return;
+            CloseCamera(ctx);
+            return false;
         }
 
         /**
@@ -956,8 +1008,8 @@ namespace prm
                                       ctx->exposureTime, &exposureBytes))
         {
             PrintError("pl_exp_setup_seq() error");
-            CloseAllCamerasAndUninit();
-            return;
+            CloseCamera(ctx);
+            return false;
         }
         UpdateCtxImageFormat(ctx);
 
@@ -968,25 +1020,33 @@ namespace prm
 
         const auto bitDepth = ctx->speedTable[0].speeds[0].gains[0].bitDepth;
         spdlog::info("Bit depth for camera: {}", bitDepth);
+        ctx->bitDepth = bitDepth;
         // Allocate a buffer of the size reported by the pl_exp_setup_seq() function.
         uns8* frameInMemory = new (std::nothrow) uns8[exposureBytes];
         if (!frameInMemory)
         {
             spdlog::error("Unable to allocate buffer for camera {}\n",
                           ctx->hcam);
-            CloseAllCamerasAndUninit();
-            return;
+            CloseCamera(ctx);
+            return false;
+        }
+
+        if (save && !StartSaving(ctx, videoPath, exposureBytes, nFrames))
+        {
+            delete[] frameInMemory;
+            return false;
         }
 
         bool errorOccurred = false;
         uns32 imageCounter = 0;
-        m_isCapturing = true;
+        uint32_t unsavedSinceLastSaved = 0;
 
         spdlog::info("Starting sequence capture loop on cam {}\n", ctx->hcam);
-        std::vector<double> captureTimes{};
+        // Every frame is a separate single frame sequence that restarts the
+        // camera frame counter, so time the frames by their EOF arrival
+        ctx->frameTimeStats.Reset();
         while (imageCounter < nFrames)
         {
-            Timer timer{};
             /**
         Start the acquisition. Since the pl_exp_setup_seq() was configured to use
         the internal camera trigger, the acquisition is started immediately.
@@ -1002,11 +1062,15 @@ namespace prm
             /**
         Here we need to wait for a frame readout notification signaled by the eofEvent
         in the CameraContext which is raised in the callback handler we registered.
-        If the frame does not arrive within 5 seconds, or if the user aborts the acquisition
+        If the frame does not arrive in time, or if the user aborts the acquisition
         with ctrl+c shortcut, the main 'while' loop is interrupted and the acquisition is
         aborted.
         */
-            if (!WaitForEofEvent(ctx.get(), 5000, errorOccurred)) break;
+            if (!WaitForEofEvent(ctx.get(), FrameTimeoutMs(*ctx),
+                                 errorOccurred))
+            {
+                break;
+            }
 
             void* frame;
             if (pl_exp_get_latest_frame(ctx->hcam, &frame) != PV_OK)
@@ -1017,32 +1081,50 @@ namespace prm
             }
 
             spdlog::info("Frame #{} acquired", imageCounter);
-
-            const auto [itMin, itMax] = std::minmax_element(
-                    (uint16_t*) ctx->eofFrame,
-                    (uint16_t*) ctx->eofFrame +
-                            actualImageHeight * actualImageWidth);
-
-            m_minCurrentValue = *itMin;
-            m_maxCurrentValue = *itMax;
+            ctx->frameTimeStats.AddFrame(
+                    imageCounter,
+                    std::chrono::duration<double>(
+                            ctx->eofHostTime.time_since_epoch())
+                            .count());
 
             if (save)
             {
-                std::copy((uint8_t*) ctx->eofFrame,
-                          (uint8_t*) ctx->eofFrame + exposureBytes,
-                          std::back_inserter(bytes));
+                // Sequence capture is paced by us, so wait for the writer
+                // instead of losing the frame
+                if (auto* slot = ctx->framePool.Acquire(
+                            std::chrono::milliseconds{5000}))
+                {
+                    PackPixels(ctx->writer.GetPacking(),
+                               static_cast<const uint16_t*>(frame),
+                               exposureBytes / sizeof(uint16_t), slot);
+                    // Single frame sequences have no camera time stamps worth
+                    // keeping, the host EOF time stands in for both
+                    const std::chrono::duration<double> latency =
+                            std::chrono::steady_clock::now() -
+                            ctx->eofHostTime;
+                    ctx->writer.Push(
+                            slot,
+                            FrameRecord{
+                                    .frameNr = imageCounter,
+                                    .bofTime = 0.0,
+                                    .eofTime = std::chrono::duration<double>(
+                                                       ctx->eofHostTime
+                                                               .time_since_epoch())
+                                                       .count(),
+                                    .loopLatency = latency.count(),
+                                    .droppedBefore = unsavedSinceLastSaved});
+                    unsavedSinceLastSaved = 0;
+                }
+                else
+                {
+                    spdlog::error("Writer stalled, frame #{} not saved",
+                                  imageCounter);
+                    ++unsavedSinceLastSaved;
+                }
             }
 
-            sf::Image image = PVCamImageToSfImage(
-                    (uint16_t*) ctx->eofFrame, actualImageWidth,
-                    actualImageHeight, m_minDisplayValue, m_maxDisplayValue);
-
-            std::scoped_lock lock(m_textureMutex);
-            if (m_currentTexture.getSize() == sf::Vector2u{0, 0}) {
-                m_currentTexture.loadFromImage(image);
-            } else {
-                m_currentTexture.update(image);
-            }
+            PublishCameraFrame(camIndex, (uint16_t*) frame, actualImageWidth,
+                               actualImageHeight, imageCounter);
             //TODO sleep from framerate
             /**
         When acquiring sequences, call the pl_exp_finish_seq() after the entire sequence
@@ -1058,17 +1140,9 @@ namespace prm
             }
 
             imageCounter++;
-            captureTimes.push_back(timer.stop());
         }
-        m_isCapturing = false;
-
-        const auto totalCaptureTime =
-                std::accumulate(captureTimes.begin(), captureTimes.end(), 0.0);
-        const auto fps = captureTimes.size() / totalCaptureTime;
-
-        const auto frametimeAvg = 1 / fps;
-        spdlog::info("Captured {} frames in {} seconds\nAvg fps: {}",
-                     imageCounter, totalCaptureTime, fps);
+        EndCameraCapture();
+        ctx->frameTimeStats.LogSummary();
         /**
     Here the pl_exp_abort() is not strictly required as correctly acquired sequence does not
     need to be aborted. However, it is kept here for situations where the acquisition
@@ -1084,74 +1158,30 @@ namespace prm
 
         if (save)
         {
-            if (m_bSubtractBackground)
-            {
-                SubtractBackground(bytes.data(), actualImageWidth,
-                                   actualImageHeight, imageCounter);
-            }
+            auto meta = MakeStackMeta(*ctx);
+            ctx->frameTimeStats.FillMeta(meta);
 
-            if (!std::filesystem::create_directory(
-                        std::filesystem::path{videoPath}))
-            {
-                spdlog::error("Couldn't create a directory");
-            }
-
-            auto meta = TifStackMeta{
-                    .numFrames = imageCounter,
-                    .exposure = ctx->exposureTime,
-                    .fps = fps,
-                    .frametimeAvg = frametimeAvg,
-                    .frametimeMin = *std::min_element(captureTimes.begin(),
-                                                      captureTimes.end()),
-                    .frametimeMax = *std::max_element(captureTimes.begin(),
-                                                      captureTimes.end()),
-                    .binning = ctx->region.pbin == 1 ? ONE : TWO,
-                    .lens = ctx->lens};
-
-            meta.frametimeStd = std::sqrt(
-                    std::accumulate(
-                            captureTimes.begin(), captureTimes.end(), 0.0,
-                            [&meta](double a, double b) {
-                                return a + (b - meta.frametimeAvg) *
-                                                   (b - meta.frametimeAvg);
-                            }) /
-                    captureTimes.size());
-
-            if (!FileUtils::WriteTifMetadata(videoPath, meta) ||
-                !FileUtils::WritePvcamStack(bytes.data(), actualImageWidth,
-                                            actualImageHeight, exposureBytes,
-                                            videoPath, imageCounter))
+            if (!ctx->writer.Close(meta))
             {
                 spdlog::error("Failed writing stack to {}", videoPath);
             }
-            else
-            {
-                spdlog::info("Stack written to {}", videoPath);
-            }
+            ctx->framePool.Free();
         }
+        return true;
     }
 
-    void PhotometricsBackend::LiveCapture_(SAVE_FORMAT format, bool save)
+    bool PhotometricsBackend::LiveCapture_(uns16 camIndex,
+                                           std::string videoPath, bool save)
     {
-        const auto videoPath = FileUtils::GenerateVideoPath(
-                m_saveDirPath, LIVE_CAPTURE_PREFIX, format);
-        if (videoPath.empty())
-        {
-            spdlog::error("Couldn't generate videopath");
-            return;
-        }
-
-        auto& ctx = m_cameraContexts[0];
-
-        std::vector<uint8_t> bytes;
+        auto& ctx = m_cameraContexts[camIndex];
 
         if (PV_OK != pl_cam_register_callback_ex3(ctx->hcam, PL_CALLBACK_EOF,
                                                   (void*) CustomEofHandler,
                                                   (void*) ctx.get()))
         {
             PrintError("pl_cam_register_callback() error");
-            CloseAllCamerasAndUninit();
-            return;
+            CloseCamera(ctx);
+            return false;
         }
         spdlog::info("EOF callback handler registered on camera {}\n",
                      ctx->hcam);
@@ -1165,8 +1195,8 @@ namespace prm
         int16 expMode;
         if (!SelectCameraExpMode(ctx, expMode, TIMED_MODE, EXT_TRIG_INTERNAL))
         {
-            CloseAllCamerasAndUninit();
-            return;
+            CloseCamera(ctx);
+            return false;
         }
         /**
         Prepare the continuous acquisition with circular buffer mode. The
@@ -1178,8 +1208,8 @@ namespace prm
                                        bufferMode))
         {
             PrintError("pl_exp_setup_cont() error\n");
-            CloseAllCamerasAndUninit();
-            return;
+            CloseCamera(ctx);
+            return false;
         }
         spdlog::info("Acquisition setup successful on camera {}\n", ctx->hcam);
         UpdateCtxImageFormat(ctx);
@@ -1189,6 +1219,8 @@ namespace prm
         uint16_t actualImageHeight =
                 (ctx->region.p2 - ctx->region.p1 + 1) / ctx->region.pbin;
 
+        ctx->bitDepth = ctx->speedTable[0].speeds[0].gains[0].bitDepth;
+
         const uns32 circBufferBytes = circBufferFrames * exposureBytes;
         /**
         Now allocate the buffer memory. The application is in control of the
@@ -1198,8 +1230,8 @@ namespace prm
         if (!circBufferInMemory)
         {
             PrintError("Unable to allocate buffer for camera {}\n", ctx->hcam);
-            CloseAllCamerasAndUninit();
-            return;
+            CloseCamera(ctx);
+            return false;
         }
         /**
         Start the continuous acquisition. By passing the entire size of the buffer
@@ -1209,76 +1241,132 @@ namespace prm
             pl_exp_start_cont(ctx->hcam, circBufferInMemory, circBufferBytes))
         {
             PrintError("pl_exp_start_cont() error\n");
-            CloseAllCamerasAndUninit();
+            CloseCamera(ctx);
             delete[] circBufferInMemory;
-            return;
+            return false;
         }
         spdlog::info("Acquisition started on camera {}\n", ctx->hcam);
 
+        if (save && !StartSaving(ctx, videoPath, exposureBytes, 0))
+        {
+            pl_exp_abort(ctx->hcam, CCS_HALT);
+            delete[] circBufferInMemory;
+            return false;
+        }
+
         uns32 imageCounter = 0;
         bool errorOccurred = false;
-        m_isCapturing = true;
+        uns32 unsavedFrames = 0;
+        uint32_t lostSinceLastSaved = 0;
 
-        std::vector<double> captureTimes{};
+        ctx->frameTimeStats.Reset();
+        int32 lastFrameNr = 0;
+        uint64_t maxLag = 0;
         while (true)
         {
-            Timer timer{};
             /**
         Here we need to wait for a frame readout notification signaled by the eofEvent
         in the CameraContext which is raised in the callback handler we registered.
-        If the frame does not arrive within 5 seconds or if user aborts the acquisition
+        If the frame does not arrive in time or if user aborts the acquisition
         with ctrl+c keyboard shortcut, the main 'while' loop is interrupted and the
         acquisition is aborted.
         */
-            if (!WaitForEofEvent(ctx.get(), 5000, errorOccurred)) break;
+            if (!WaitForEofEvent(ctx.get(), FrameTimeoutMs(*ctx),
+                                 errorOccurred))
+            {
+                break;
+            }
 
+            /**
+        Take the oldest unread frame rather than the latest one, so a loop that
+        falls behind for a while catches up on the buffered frames instead of
+        skipping them. Frames overwritten in the circular buffer before we got
+        to them show up as gaps in the frame numbers.
+        */
             void* frame;
-            if (pl_exp_get_latest_frame(ctx->hcam, &frame) != PV_OK)
+            FRAME_INFO frameInfo{};
+            if (PV_OK !=
+                pl_exp_get_oldest_frame_ex(ctx->hcam, &frame, &frameInfo))
             {
-                PrintError("Couldn't get latest frame");
+                // Notifications of overwritten frames have no frame left
                 continue;
             }
-
-            // Timestamp is in hundreds of microseconds
-            spdlog::info("Frame #{} acquired", ctx->eofFrameInfo.FrameNr);
-
-            const auto [itMin, itMax] = std::minmax_element(
-                    (uint16_t*) frame,
-                    (uint16_t*) frame + actualImageHeight * actualImageWidth);
-
-            m_minCurrentValue = *itMin;
-            m_maxCurrentValue = *itMax;
+            if (frameInfo.FrameNr <= lastFrameNr)
+            {
+                pl_exp_unlock_oldest_frame(ctx->hcam);
+                continue;
+            }
+            lostSinceLastSaved +=
+                    static_cast<uint32_t>(frameInfo.FrameNr - lastFrameNr - 1);
+            lastFrameNr = frameInfo.FrameNr;
+
+            const auto lag = ctx->eofEvent.numNotified.load() -
+                             ctx->eofEvent.numConsumed;
+            maxLag = std::max(maxLag, lag);
+
+            // Time the frames by their start of readout, so the statistics
+            // show the camera frame rate rather than the rate of this loop
+            spdlog::info("Frame #{} acquired", frameInfo.FrameNr);
+            ctx->frameTimeStats.AddFrame(
+                    frameInfo.FrameNr,
+                    static_cast<double>(frameInfo.TimeStampBOF) *
+                            PVCAM_TIMESTAMP_UNIT);
 
             if (save)
             {
-                std::copy((uint8_t*) frame, (uint8_t*) frame + exposureBytes,
-                          std::back_inserter(bytes));
+                if (auto* slot = ctx->framePool.Acquire())
+                {
+                    PackPixels(ctx->writer.GetPacking(),
+                               static_cast<const uint16_t*>(frame),
+                               exposureBytes / sizeof(uint16_t), slot);
+                    // The latest EOF notification may belong to a newer
+                    // frame when the loop lags, so this is a lower bound
+                    const std::chrono::duration<double> latency =
+                            std::chrono::steady_clock::now() -
+                            ctx->eofHostTime;
+                    ctx->writer.Push(
+                            slot,
+                            FrameRecord{
+                                    .frameNr = frameInfo.FrameNr,
+                                    .bofTime = static_cast<double>(
+                                                       frameInfo.TimeStampBOF) *
+                                               PVCAM_TIMESTAMP_UNIT,
+                                    .eofTime = static_cast<double>(
+                                                       frameInfo.TimeStamp) *
+                                               PVCAM_TIMESTAMP_UNIT,
+                                    .loopLatency = latency.count(),
+                                    .droppedBefore = lostSinceLastSaved});
+                    lostSinceLastSaved = 0;
+                }
+                else
+                {
+                    // The writer can't keep up with the camera
+                    if (unsavedFrames == 0)
+                    {
+                        spdlog::warn("Capture buffer is full, frame #{} not "
+                                     "saved",
+                                     frameInfo.FrameNr);
+                    }
+                    ++unsavedFrames;
+                    ++lostSinceLastSaved;
+                }
             }
 
-            sf::Image image = PVCamImageToSfImage(
-                    (uint16_t*) frame, actualImageWidth, actualImageHeight,
-                    m_minDisplayValue, m_maxDisplayValue);
+            PublishCameraFrame(camIndex, (uint16_t*) frame, actualImageWidth,
+                               actualImageHeight, imageCounter);
 
-            std::scoped_lock lock(m_textureMutex);
-
-            if (m_currentTexture.getSize() == sf::Vector2u{0, 0}) {
-                m_currentTexture.loadFromImage(image);
-            } else {
-                m_currentTexture.update(image);
+            if (PV_OK != pl_exp_unlock_oldest_frame(ctx->hcam))
+            {
+                PrintError("pl_exp_unlock_oldest_frame() error");
             }
 
+            UpdateCaptureHealth(camIndex);
             imageCounter++;
-            captureTimes.push_back(timer.stop());
         }
-        m_isCapturing = false;
-
-        const auto totalCaptureTime =
-                std::accumulate(captureTimes.begin(), captureTimes.end(), 0.0);
-        const auto fps = captureTimes.size() / totalCaptureTime;
-
-        const auto frametimeAvg = 1 / fps;
-        spdlog::info("Captured {} frames in {} seconds\nAvg fps: {}",
-                     imageCounter, totalCaptureTime, fps);
+        EndCameraCapture();
+        ctx->frameTimeStats.LogSummary();
+        spdlog::info("Capture loop lagged at most {} frames behind camera {}",
+                     maxLag, ctx->hcam);
 
         if (PV_OK != pl_exp_abort(ctx->hcam, CCS_HALT))
         {
@@ -1291,74 +1379,133 @@ namespace prm
 
         delete[] circBufferInMemory;
 
+        if (unsavedFrames > 0)
+        {
+            spdlog::warn("{} frames were not saved because the writer fell "
+                         "behind",
+                         unsavedFrames);
+        }
 
         if (save)
         {
-            if (m_bSubtractBackground)
-            {
-                SubtractBackground(bytes.data(), actualImageWidth,
-                                   actualImageHeight, imageCounter);
-            }
-
-            if (!std::filesystem::create_directory(
-                        std::filesystem::path{videoPath}))
-            {
-                spdlog::error("Couldn't create a directory");
-            }
+            auto meta = MakeStackMeta(*ctx);
+            ctx->frameTimeStats.FillMeta(meta);
 
-            auto meta = TifStackMeta{
-                    .numFrames = imageCounter,
-                    .exposure = ctx->exposureTime,
-                    .fps = fps,
-                    .frametimeAvg = frametimeAvg,
-                    .frametimeMin = *std::min_element(captureTimes.begin(),
-                                                      captureTimes.end()),
-                    .frametimeMax = *std::max_element(captureTimes.begin(),
-                                                      captureTimes.end()),
-                    .binning = ctx->region.pbin == 1 ? ONE : TWO,
-                    .lens = ctx->lens};
-
-            meta.frametimeStd = std::sqrt(
-                    std::accumulate(
-                            captureTimes.begin(), captureTimes.end(), 0.0,
-                            [&meta](double a, double b) {
-                                return a + (b - meta.frametimeAvg) *
-                                                   (b - meta.frametimeAvg);
-                            }) /
-                    captureTimes.size());
-
-            if (!FileUtils::WriteTifMetadata(videoPath, meta) ||
-                !FileUtils::WritePvcamStack(bytes.data(), actualImageWidth,
-                                            actualImageHeight, exposureBytes,
-                                            videoPath, imageCounter))
+            if (!ctx->writer.Close(meta))
             {
                 spdlog::error("Failed writing stack to {}", videoPath);
             }
-            else
-            {
-                spdlog::info("Stack written to {}", videoPath);
-            }
+            ctx->framePool.Free();
         }
+        return true;
+    }
+
+    void PhotometricsBackend::UpdateCaptureHealth(uns16 camIndex)
+    {
+        if (camIndex != m_cameraIndex) { return; }
+
+        const auto& ctx = m_cameraContexts[camIndex];
+        const auto lag = ctx->eofEvent.numNotified.load() -
+                         ctx->eofEvent.numConsumed;
+        m_droppedFrames = ctx->frameTimeStats.GetNumDropped();
+        m_frameLag = static_cast<uint32_t>(lag);
+
+        const auto buffer = ctx->writer.GetBufferStats();
+        m_bufferRatio = static_cast<float>(buffer.compressionRatio);
+        m_bufferFramesLeft = buffer.framesLeft;
     }
 
-    bool PhotometricsBackend::SubtractBackground(uint8_t* bytes, uint16_t width,
-                                                 uint16_t height,
-                                                 uint32_t nFrames)
+    bool PhotometricsBackend::AllocateFramePool(
+            std::unique_ptr<CameraContext>& ctx, uns32 frameBytes,
+            uint32_t nFrames) const
     {
-        const auto frameSizeU16 = width * height;
-        for (std::size_t i = 0; i < nFrames; ++i)
+        const auto budgetBytes = GetCaptureBudgetBytes();
+        const auto budgetSlots =
+                budgetBytes / FramePool::SlotBytesFor(frameBytes);
+
+        // Slots are recycled by the writer, so a sequence never needs more
+        // than one slot per frame
+        auto numSlots =
+                nFrames > 0 ? std::min<std::size_t>(nFrames, budgetSlots)
+                            : budgetSlots;
+        // A compressed buffer takes the rest of the budget
+        if (m_bCompressedBuffer)
         {
-            cv::Mat mat{height, width, CV_16U,
-                        (uint16_t*) bytes + i * frameSizeU16};
-            cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE,
-                                                        cv::Size{15, 15});
-            cv::morphologyEx(mat, mat, cv::MORPH_TOPHAT, element,
-                             cv::Point{-1, -1});
+            numSlots = std::min(numSlots, COMPRESSED_STORE_STAGING_SLOTS);
+        }
 
-            std::copy(mat.data, mat.data + 2 * frameSizeU16,
-                      bytes + i * 2 * frameSizeU16);
+        if (!ctx->framePool.Allocate(frameBytes, numSlots))
+        {
+            spdlog::error("Unable to allocate capture buffer for camera {}",
+                          ctx->hcam);
+            return false;
         }
+        return true;
+    }
 
+    bool PhotometricsBackend::StartSaving(std::unique_ptr<CameraContext>& ctx,
+                                          std::string_view videoPath,
+                                          uns32 frameBytes, uint32_t nFrames)
+    {
+        const uint16_t imageWidth =
+                (ctx->region.s2 - ctx->region.s1 + 1) / ctx->region.sbin;
+        const uint16_t imageHeight =
+                (ctx->region.p2 - ctx->region.p1 + 1) / ctx->region.pbin;
+
+        // Frames of up to 12 bits can wait in the pool packed
+        const auto bitDepth = ctx->speedTable[0].speeds[0].gains[0].bitDepth;
+        const auto packing = PackingFor(bitDepth, m_bPackedSaving);
+        if (!AllocateFramePool(
+                    ctx,
+                    static_cast<uns32>(PackedBytes(
+                            packing, frameBytes / sizeof(uint16_t))),
+                    nFrames))
+        {
+            return false;
+        }
+        // The compressed buffer gets whatever the staging slots leave over
+        std::size_t bufferBytes = 0;
+        if (m_bCompressedBuffer)
+        {
+            const auto budgetBytes = GetCaptureBudgetBytes();
+            const auto poolBytes = ctx->framePool.GetNumSlots() *
+                                   ctx->framePool.GetSlotBytes();
+            bufferBytes = budgetBytes - std::min(budgetBytes, poolBytes);
+        }
+
+        const StackOptions options{
+                .format = m_stackFormat,
+                .compression = m_stackCompression,
+                .patchThreshold = static_cast<uint16_t>(m_patchThreshold),
+                .bitDepth = bitDepth,
+                .packing = packing,
+                .subtractBackground = m_bSubtractBackground,
+                .unbuffered = m_bUnbufferedSaving,
+                .journaled = m_bJournaledSaving,
+                .compressedBufferBytes = bufferBytes};
+        if (!ctx->writer.Open(videoPath, imageWidth, imageHeight,
+                              ctx->framePool, MakeStackMeta(*ctx), options))
+        {
+            spdlog::error("Couldn't start writing to {}", videoPath);
+            ctx->framePool.Free();
+            return false;
+        }
         return true;
     }
+
+    TifStackMeta PhotometricsBackend::MakeStackMeta(const CameraContext& ctx)
+    {
+        return TifStackMeta{.numFrames = 0,
+                            .exposure = ctx.exposureTime,
+                            .fps = 0.0,
+                            .frametimeAvg = 0.0,
+                            .frametimeMin = 0.0,
+                            .frametimeMax = 0.0,
+                            .frametimeStd = 0.0,
+                            .droppedFrames = 0,
+                            .binning = ctx.region.pbin == 1 ? ONE : TWO,
+                            .lens = ctx.lens,
+                            .compression = NO_COMPRESSION,
+                            .patchThreshold = 0};
+    }
 }// namespace prm
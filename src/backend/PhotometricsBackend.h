@@ -2,7 +2,10 @@
 
 #include <SFML/Graphics.hpp>
 
+#include <atomic>
+#include <chrono>
 #include <mutex>
+#include <semaphore>
 #include <string>
 #include <vector>
 
@@ -10,11 +13,22 @@
 #include <pvcam.h>
 
 #include "Backend.h"
+#include "capture/FrameMailbox.h"
+#include "capture/FramePool.h"
+#include "capture/FrameTimeStats.h"
+#include "capture/StackWriter.h"
 #include "misc/Log.h"
 #include "misc/Meta.h"
+#include "utils/DisplayConverter.h"
 
 namespace prm
 {
+    /// Duration of one FRAME_INFO time stamp tick in seconds
+    const double PVCAM_TIMESTAMP_UNIT = 100e-6;
+
+    /// Shortest time to wait for a frame before the camera is considered stalled
+    const uns32 MIN_FRAME_TIMEOUT_MS = 1000;
+
     /// Name-Value Pair Container type - an enumeration type
     struct NVP
     {
@@ -76,12 +90,12 @@ namespace prm
     /// Struct for camera event synchronisation
     struct Event
     {
-        /// Mutex that guards all other members
-        std::mutex mutex{};
-        /// Condition that any thread could wait on
-        std::condition_variable cond{};
-        /// A flag that helps with spurious wakeups
-        bool flag{false};
+        /// Released once for every frame and once more to wake up an abort
+        std::counting_semaphore<> frameReady{0};
+        /// Number of frames reported by the EOF callback during the capture
+        std::atomic<uint64_t> numNotified{0};
+        /// Number of notifications taken by the acquisition loop
+        uint64_t numConsumed{0};
     };
 
     /// Struct grouping camera related info
@@ -129,18 +143,33 @@ namespace prm
         /// Flag marking the camera as Smart Streaming capable
         bool isSmartStreaming{false};
 
-        /// Frame info structure used to store data, for example, in EOF callback handlers
-        FRAME_INFO eofFrameInfo{};
-        /// The address of latest frame stored, for example, in EOF callback handlers
-        void* eofFrame{nullptr};
+        /// Host time at which the latest EOF callback arrived
+        std::chrono::steady_clock::time_point eofHostTime{};
 
         /// Used as an acquisition thread or for other independent tasks
         std::unique_ptr<std::jthread> thread{nullptr};
         /// Flag to be set to abort thread (used, for example, in multi-camera code samples)
-        bool threadAbortFlag{false};
+        std::atomic<bool> threadAbortFlag{false};
 
         /// Lens used on the camera during capture
         Lens lens = X20;
+
+        /// Preallocated slots that hold the frames to be saved
+        FramePool framePool{};
+        /// Writer that streams saved frames to disk during capture
+        StackWriter writer{};
+        /// Frame time statistics of the current capture
+        FrameTimeStats frameTimeStats{};
+
+        /// Number of significant bits in the pixels of the current capture,
+        /// written by the capture thread and read by the display
+        std::atomic<int> bitDepth{16};
+        /// Latest frame for this camera's own viewport
+        FrameMailbox displayMailbox{};
+        /// Converter for this camera's own viewport
+        DisplayConverter displayConverter{};
+        /// Texture of this camera's own viewport, only touched on the GUI thread
+        sf::Texture displayTexture{};
     };
 
     /**
@@ -205,6 +234,11 @@ namespace prm
          */
         void TerminateCapture() override;
 
+        /**
+         * Updates the main viewport and the viewports of the other cameras
+         */
+        void UpdateDisplay() override;
+
         /**
          * Returns a pointer to the current camera context
          *
@@ -216,19 +250,32 @@ namespace prm
         }
 
         /**
-         * Converts byte array captured by PVCAM to SFML Image
+         * Returns a pointer to the context of a given camera
          *
-         * @param imageData Byte array
-         * @param imageWidth Image width
-         * @param imageHeight Image height
-         * @param minVal Minimum brightness value to display
-         * @param maxVal Maximum brightness value to display
-         * @return Resulting SFML Image
-         */
-        static sf::Image PVCamImageToSfImage(uint16_t* imageData,
-                                             uint16_t imageWidth,
-                                             uint16_t imageHeight,
-                                             uint32_t minVal, uint32_t maxVal);
+         * @param index Camera index
+         * @return Raw pointer to the camera context
+         */
+        CameraContext* GetCameraContext(std::size_t index)
+        {
+            return m_cameraContexts[index].get();
+        }
+
+        [[nodiscard]] std::size_t GetNumCameras() const
+        {
+            return m_cameraContexts.size();
+        }
+
+        [[nodiscard]] uns16 GetCurrentCameraIndex() const
+        {
+            return m_cameraIndex;
+        }
+
+        /**
+         * Selects the camera shown in the main viewport and edited by the GUI
+         *
+         * @param index Camera index
+         */
+        void SetCurrentCameraIndex(uns16 index);
 
         ~PhotometricsBackend() override { CloseAllCamerasAndUninit(); }
 
@@ -240,25 +287,68 @@ namespace prm
         /**
          * Internal live capture implementation to send to the worker thread
          *
-         * @param format Save file format from the SAVE_FORMAT enum
+         * @param camIndex Index of the camera to capture from
+         * @param videoPath Capture directory path
          * @param save Flag indicating the need to save the captured sequence
+         * @return false if the capture failed before it started
          */
-        void LiveCapture_(SAVE_FORMAT format, bool save);
+        bool LiveCapture_(uns16 camIndex, std::string videoPath, bool save);
         /**
          * Internal sequence capture implementation to send to the worker thread
          *
+         * @param camIndex Index of the camera to capture from
          * @param nFrames Image sequence length
-         * @param format Save file format from the SAVE_FORMAT enum
+         * @param videoPath Capture directory path
          * @param save Flag indicating the need to save the captured sequence
+         * @return false if the capture failed before it started
          */
-        void SequenceCapture_(uint32_t nFrames, SAVE_FORMAT format, bool save);
+        bool SequenceCapture_(uns16 camIndex, uint32_t nFrames,
+                              std::string videoPath, bool save);
 
         /**
          * Initializes PVCAM library, obtains basic camera availability information,
-         * opens one camera and retrieves basic camera parameters and characteristics.
-         * @return true if camera opened successfully
+         * opens all cameras and retrieves basic camera parameters and characteristics.
+         * @return true if at least one camera opened successfully
+         */
+        bool InitAndOpenAllCameras();
+
+        /**
+         * Starts a capture thread for every open camera
+         *
+         * @param nFrames Image sequence length (0 for live capture)
+         * @param save Flag indicating the need to save the captured sequence
+         */
+        void StartCapture(uint32_t nFrames, bool save);
+
+        /**
+         * Gives the capture directory of one camera, cameras capturing together
+         * share the time stamp and get a _camN suffix
+         *
+         * @param videoPath Capture directory path shared by all cameras
+         * @param camIndex Camera index
+         * @return Capture directory of the camera
          */
-        bool InitAndOpenOneCamera();
+        [[nodiscard]] std::string CameraVideoPath(const std::string& videoPath,
+                                                  uns16 camIndex) const;
+
+        /**
+         * Marks a camera as done capturing, the backend stops capturing with the last one
+         * StartCapture counts every camera as capturing before its thread starts
+         */
+        void EndCameraCapture();
+
+        /**
+         * Publishes a frame to the viewport the camera is shown in
+         *
+         * @param camIndex Camera index
+         * @param frame Frame data
+         * @param imageWidth Width of the frame
+         * @param imageHeight Height of the frame
+         * @param frameIndex Index of the frame in the current capture
+         */
+        void PublishCameraFrame(uns16 camIndex, const uint16_t* frame,
+                                uint16_t imageWidth, uint16_t imageHeight,
+                                uint64_t frameIndex);
 
         /**
          * PVCam error printing function
@@ -389,6 +479,8 @@ namespace prm
 
         /**
          * Waits for a notification that is usually sent by EOF callback handler.
+         * Every frame gives exactly one notification, so frames that arrive
+         * while the caller is busy are waited for without blocking.
          *
          * @param[in] ctx Pointer to the camera context
          * @param[in] timeoutMs Time to wait for in milliseconds
@@ -399,21 +491,61 @@ namespace prm
                                     bool& errorOccurred);
 
         /**
-         * Subtracts image background by calculating morphological opening
+         * Gives the time after which a missing frame means the camera stalled
+         *
+         * @param ctx Camera context
+         * @return Timeout in milliseconds
+         */
+        static uns32 FrameTimeoutMs(const CameraContext& ctx)
+        {
+            return MIN_FRAME_TIMEOUT_MS + 10u * ctx.exposureTime;
+        }
+
+        /**
+         * Publishes the drop count and the lag of a camera to the GUI
+         *
+         * @param camIndex Camera index
+         */
+        void UpdateCaptureHealth(uns16 camIndex);
+
+        /**
+         * Allocates the camera frame pool for an upcoming capture
+         *
+         * @param ctx Camera context whose pool to allocate
+         * @param frameBytes Size of one frame in bytes
+         * @param nFrames Number of frames to capture (0 for live capture)
+         * @return true on success
+         */
+        bool AllocateFramePool(std::unique_ptr<CameraContext>& ctx,
+                               uns32 frameBytes, uint32_t nFrames) const;
+
+        /**
+         * Sets up the frame pool and the streaming writer for an upcoming capture
          *
-         * @param bytes Image byte array
-         * @param width Image width
-         * @param height Image height
-         * @param nFrames Number of images in the array
+         * @param ctx Camera context to capture from
+         * @param videoPath Capture directory path
+         * @param frameBytes Size of one frame in bytes
+         * @param nFrames Number of frames to capture (0 for live capture)
          * @return true on success
          */
-        static bool SubtractBackground(uint8_t* bytes,
-                                       uint16_t width, uint16_t height,
-                                       uint32_t nFrames);
+        bool StartSaving(std::unique_ptr<CameraContext>& ctx,
+                         std::string_view videoPath, uns32 frameBytes,
+                         uint32_t nFrames);
+
+        /**
+         * Gives the capture metadata known before the capture starts
+         *
+         * @param ctx Camera context to capture from
+         * @return Metadata struct with the frame statistics zeroed
+         */
+        static TifStackMeta MakeStackMeta(const CameraContext& ctx);
 
     private:
-        /// Index of the current camera
-        const uns16 m_cameraIndex = 0;
+        /// Index of the camera shown in the main viewport and edited by the GUI,
+        /// read by the capture threads and fixed while they run
+        std::atomic<uns16> m_cameraIndex = 0;
+        /// Number of cameras whose capture threads are running or starting
+        std::atomic<int> m_numCapturingCameras = 0;
 
         /// Vector of all camera contexts
         std::vector<std::unique_ptr<CameraContext>> m_cameraContexts;
@@ -422,16 +554,10 @@ namespace prm
         /// Shows if PVCam environment is initialized
         bool m_isPvcamInitialized = false;
 
-        /// Minimum brightness value to display in the GUI
-        int m_minDisplayValue = 0;
-        /// Maximum brightness value to display in the GUI
-        int m_maxDisplayValue = 4096;// 12 bits
-
-        /// Minimum brightness value in the current frame
-        uint16_t m_minCurrentValue = 0;
-        /// Maximum brightness value in the current frame
-        uint16_t m_maxCurrentValue = 0;
-
         bool m_bSubtractBackground = false;
+
+    private:
+        /// Stack container of the current capture, DIR, RAW or CHUNKED
+        SAVE_FORMAT m_stackFormat = DIR;
     };
 }// namespace prm
\ No newline at end of file
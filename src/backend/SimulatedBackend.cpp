@@ -0,0 +1,364 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+
+#include "backend/SimulatedBackend.h"
+#include "capture/FramePacer.h"
+#include "utils/FileUtils.h"
+
+namespace prm
+{
+    void SimulatedBackend::Init()
+    {
+        if (m_context.isCamOpen)
+        {
+            spdlog::info("Camera already initialized");
+            return;
+        }
+
+        m_context.isCamOpen = true;
+        spdlog::info("Simulated camera ready");
+    }
+
+    void SimulatedBackend::LiveCapture(SAVE_FORMAT format, bool save)
+    {
+        m_stackFormat = format == RAW || format == CHUNKED ? format : DIR;
+        StartCapture(0, save);
+    }
+
+    void SimulatedBackend::SequenceCapture(uint32_t nFrames, SAVE_FORMAT format,
+                                           bool save)
+    {
+        if (nFrames == 0)
+        {
+            spdlog::warn("Nothing to capture");
+            return;
+        }
+        m_stackFormat = format == RAW || format == CHUNKED ? format : DIR;
+        StartCapture(nFrames, save);
+    }
+
+    void SimulatedBackend::TerminateCapture()
+    {
+        m_context.threadAbortFlag = true;
+        if (m_context.thread && m_context.thread->joinable())
+        {
+            m_context.thread->join();
+        }
+        m_isCapturing = false;
+    }
+
+    void SimulatedBackend::StartCapture(uint32_t nFrames, bool save)
+    {
+        if (!m_context.isCamOpen)
+        {
+            spdlog::warn("No cam is open\n Please init first");
+            return;
+        }
+
+        if (m_isCapturing)
+        {
+            spdlog::warn(
+                    "Already capturing, please stop current acquisition first");
+            return;
+        }
+
+        // Reap the previous capture thread, it has finished by now
+        if (m_context.thread && m_context.thread->joinable())
+        {
+            m_context.thread->join();
+        }
+
+        m_context.width = std::max(m_context.width, 1);
+        m_context.height = std::max(m_context.height, 1);
+        m_context.bitDepth = std::clamp(m_context.bitDepth, 8, 16);
+        m_context.framerate = std::max(m_context.framerate, 1);
+        m_context.numParticles = std::max(m_context.numParticles, 0);
+
+        m_context.threadAbortFlag = false;
+        m_isCapturing = true;
+        m_context.thread = std::make_unique<std::jthread>(
+                &SimulatedBackend::Capture_, this, nFrames, save);
+    }
+
+    void SimulatedBackend::ResetScene()
+    {
+        std::normal_distribution<float> noise{0.f, m_context.noiseStd};
+        m_noiseTable.resize(SIM_NOISE_TABLE_SIZE);
+        for (auto& sample: m_noiseTable)
+        {
+            sample = static_cast<int16_t>(std::lround(noise(m_rng)));
+        }
+
+        std::uniform_real_distribution<float> xDist{
+                0.f, static_cast<float>(m_context.width - 1)};
+        std::uniform_real_distribution<float> yDist{
+                0.f, static_cast<float>(m_context.height - 1)};
+        // Spread of particle sizes
+        std::uniform_real_distribution<float> ampDist{0.3f, 1.f};
+
+        m_particles.clear();
+        for (int i = 0; i < m_context.numParticles; ++i)
+        {
+            m_particles.push_back(SimulatedParticle{
+                    xDist(m_rng), yDist(m_rng),
+                    ampDist(m_rng) * m_context.spotAmplitude});
+        }
+    }
+
+    void SimulatedBackend::GenerateFrame(uint16_t* frame)
+    {
+        const int width = m_context.width;
+        const int height = m_context.height;
+        const int maxVal = (1 << m_context.bitDepth) - 1;
+
+        // A random window into the noise table is much cheaper than drawing
+        // fresh samples for every pixel
+        const auto numPixels = static_cast<std::size_t>(width) * height;
+        const auto mask = SIM_NOISE_TABLE_SIZE - 1;
+        const auto offset = static_cast<std::size_t>(m_rng()) & mask;
+        for (std::size_t i = 0; i < numPixels; ++i)
+        {
+            const int val =
+                    m_context.background + m_noiseTable[(offset + i) & mask];
+            frame[i] = static_cast<uint16_t>(std::clamp(val, 0, maxVal));
+        }
+
+        const float sigma = std::max(m_context.spotSigma, 0.1f);
+        const float invTwoSigmaSq = 1.f / (2.f * sigma * sigma);
+        const int radius = static_cast<int>(std::ceil(3.f * sigma));
+
+        std::normal_distribution<float> step{0.f, m_context.diffusion};
+        for (auto& particle: m_particles)
+        {
+            const int cx = static_cast<int>(std::lround(particle.x));
+            const int cy = static_cast<int>(std::lround(particle.y));
+            for (int y = std::max(cy - radius, 0);
+                 y <= std::min(cy + radius, height - 1); ++y)
+            {
+                const float dy = static_cast<float>(y) - particle.y;
+                for (int x = std::max(cx - radius, 0);
+                     x <= std::min(cx + radius, width - 1); ++x)
+                {
+                    const float dx = static_cast<float>(x) - particle.x;
+                    const int val =
+                            frame[y * width + x] +
+                            static_cast<int>(
+                                    particle.amplitude *
+                                    std::exp(-(dx * dx + dy * dy) *
+                                             invTwoSigmaSq));
+                    frame[y * width + x] =
+                            static_cast<uint16_t>(std::min(val, maxVal));
+                }
+            }
+
+            // Brownian step, reflected off the frame borders
+            const auto reflect = [](float v, float hi) {
+                if (v < 0.f) { v = -v; }
+                if (v > hi) { v = 2.f * hi - v; }
+                return std::clamp(v, 0.f, hi);
+            };
+            particle.x = reflect(particle.x + step(m_rng),
+                                 static_cast<float>(width - 1));
+            particle.y = reflect(particle.y + step(m_rng),
+                                 static_cast<float>(height - 1));
+        }
+    }
+
+    void SimulatedBackend::Capture_(uint32_t nFrames, bool save)
+    {
+        const auto videoPath = FileUtils::GenerateVideoPath(
+                m_saveDirPath,
+                nFrames > 0 ? SEQ_CAPTURE_PREFIX : LIVE_CAPTURE_PREFIX, DIR);
+        if (videoPath.empty())
+        {
+            spdlog::error("Couldn't generate videopath");
+            m_isCapturing = false;
+            return;
+        }
+
+        ResetScene();
+        m_sensorBitDepth = m_context.bitDepth;
+        m_bufferRatio = 0.f;
+        m_bufferFramesLeft = 0;
+
+        const auto imageWidth = static_cast<uint16_t>(m_context.width);
+        const auto imageHeight = static_cast<uint16_t>(m_context.height);
+        const auto frameBytes = static_cast<std::size_t>(imageWidth) *
+                                imageHeight * sizeof(uint16_t);
+        std::vector<uint16_t> frame(frameBytes / sizeof(uint16_t));
+
+        if (save && !StartSaving(videoPath, frameBytes, nFrames))
+        {
+            m_isCapturing = false;
+            return;
+        }
+
+        FramePacer pacer{};
+        pacer.Start(static_cast<double>(m_context.framerate));
+
+        spdlog::info("Starting simulated capture {}x{} {} bit at {} fps",
+                     imageWidth, imageHeight, m_context.bitDepth,
+                     m_context.framerate);
+
+        uint32_t imageCounter = 0;
+        uint32_t unsavedFrames = 0;
+        uint32_t unsavedSinceLastSaved = 0;
+        m_context.frameTimeStats.Reset();
+        while (!m_context.threadAbortFlag &&
+               (nFrames == 0 || imageCounter < nFrames))
+        {
+            pacer.Pace();
+
+            // The wake up time plays the part of the hardware time stamp
+            const auto timestamp =
+                    std::chrono::duration<double>(
+                            std::chrono::steady_clock::now().time_since_epoch())
+                            .count();
+            m_context.frameTimeStats.AddFrame(imageCounter, timestamp);
+            GenerateFrame(frame.data());
+
+            if (save)
+            {
+                // Sequence capture waits for the writer like a paced camera,
+                // live capture drops the frame like a free running one
+                auto* slot = nFrames > 0 ? m_context.framePool.Acquire(
+                                                   std::chrono::milliseconds{5000})
+                                         : m_context.framePool.Acquire();
+                if (slot)
+                {
+                    PackPixels(m_context.writer.GetPacking(), frame.data(),
+                               frame.size(), slot);
+                    const auto now =
+                            std::chrono::duration<double>(
+                                    std::chrono::steady_clock::now()
+                                            .time_since_epoch())
+                                    .count();
+                    m_context.writer.Push(
+                            slot, FrameRecord{.frameNr = imageCounter,
+                                              .bofTime = 0.0,
+                                              .eofTime = timestamp,
+                                              .loopLatency = now - timestamp,
+                                              .droppedBefore =
+                                                      unsavedSinceLastSaved});
+                    unsavedSinceLastSaved = 0;
+
+                    const auto buffer = m_context.writer.GetBufferStats();
+                    m_bufferRatio =
+                            static_cast<float>(buffer.compressionRatio);
+                    m_bufferFramesLeft = buffer.framesLeft;
+                }
+                else
+                {
+                    if (unsavedFrames == 0)
+                    {
+                        spdlog::warn("Capture buffer is full, frame #{} not "
+                                     "saved",
+                                     imageCounter);
+                    }
+                    ++unsavedFrames;
+                    ++unsavedSinceLastSaved;
+                }
+            }
+
+            PublishFrame(frame.data(), imageWidth, imageHeight, imageCounter);
+
+            ++imageCounter;
+        }
+        m_isCapturing = false;
+
+        m_context.frameTimeStats.LogSummary();
+
+        if (unsavedFrames > 0)
+        {
+            spdlog::warn("{} frames were not saved because the writer fell "
+                         "behind",
+                         unsavedFrames);
+        }
+
+        if (save)
+        {
+            auto meta = MakeStackMeta();
+            m_context.frameTimeStats.FillMeta(meta);
+
+            if (!m_context.writer.Close(meta))
+            {
+                spdlog::error("Failed writing stack to {}", videoPath);
+            }
+            m_context.framePool.Free();
+        }
+    }
+
+    bool SimulatedBackend::StartSaving(std::string_view videoPath,
+                                       std::size_t frameBytes, uint32_t nFrames)
+    {
+        // Frames of up to 12 bits can wait in the pool packed
+        const auto packing = PackingFor(m_context.bitDepth, m_bPackedSaving);
+        const auto slotFrameBytes =
+                PackedBytes(packing, frameBytes / sizeof(uint16_t));
+        const auto budgetBytes = GetCaptureBudgetBytes();
+        const auto budgetSlots =
+                budgetBytes / FramePool::SlotBytesFor(slotFrameBytes);
+        auto numSlots =
+                nFrames > 0 ? std::min<std::size_t>(nFrames, budgetSlots)
+                            : budgetSlots;
+
+        // A compressed buffer takes the budget, the pool only stages the
+        // frames on their way into it
+        std::size_t bufferBytes = 0;
+        if (m_bCompressedBuffer)
+        {
+            numSlots = std::min(numSlots, COMPRESSED_STORE_STAGING_SLOTS);
+            bufferBytes = budgetBytes -
+                          std::min(budgetBytes,
+                                   numSlots * FramePool::SlotBytesFor(
+                                                      slotFrameBytes));
+        }
+
+        if (!m_context.framePool.Allocate(slotFrameBytes, numSlots))
+        {
+            spdlog::error("Unable to allocate capture buffer");
+            return false;
+        }
+        const StackOptions options{
+                .format = m_stackFormat,
+                .compression = m_stackCompression,
+                .patchThreshold = static_cast<uint16_t>(m_patchThreshold),
+                .bitDepth = m_context.bitDepth,
+                .packing = packing,
+                .subtractBackground = m_bSubtractBackground,
+                .unbuffered = m_bUnbufferedSaving,
+                .journaled = m_bJournaledSaving,
+                .compressedBufferBytes = bufferBytes};
+        if (!m_context.writer.Open(videoPath,
+                                   static_cast<uint16_t>(m_context.width),
+                                   static_cast<uint16_t>(m_context.height),
+                                   m_context.framePool, MakeStackMeta(),
+                                   options))
+        {
+            spdlog::error("Couldn't start writing to {}", videoPath);
+            m_context.framePool.Free();
+            return false;
+        }
+        return true;
+    }
+
+    TifStackMeta SimulatedBackend::MakeStackMeta() const
+    {
+        return TifStackMeta{
+                .numFrames = 0,
+                .exposure = static_cast<uint16_t>(1000 / m_context.framerate),
+                .fps = 0.0,
+                .frametimeAvg = 0.0,
+                .frametimeMin = 0.0,
+                .frametimeMax = 0.0,
+                .frametimeStd = 0.0,
+                .droppedFrames = 0,
+                .binning = ONE,
+                .lens = m_context.lens,
+                .compression = NO_COMPRESSION,
+                .patchThreshold = 0};
+    }
+}// namespace prm
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <atomic>
+#include <random>
+#include <vector>
+
+#include "Backend.h"
+#include "capture/FramePool.h"
+#include "capture/FrameTimeStats.h"
+#include "capture/StackWriter.h"
+#include "misc/Meta.h"
+
+namespace prm
+{
+    /// Default simulated frame width
+    const uint16_t SIM_DEFAULT_WIDTH = 1024;
+    /// Default simulated frame height
+    const uint16_t SIM_DEFAULT_HEIGHT = 1024;
+    /// Default simulated frame rate
+    const uint16_t SIM_DEFAULT_FPS = 100;
+    /// Number of precomputed noise samples, must be a power of two
+    const std::size_t SIM_NOISE_TABLE_SIZE = 1 << 20;
+
+    /// Single simulated particle
+    struct SimulatedParticle
+    {
+        float x;
+        float y;
+        /// Peak brightness above the background
+        float amplitude;
+    };
+
+    /// Struct grouping simulated camera parameters and state
+    struct SimulatedCameraCtx
+    {
+        /// Frame width in pixels
+        int width = SIM_DEFAULT_WIDTH;
+        /// Frame height in pixels
+        int height = SIM_DEFAULT_HEIGHT;
+        /// Number of significant bits in each pixel
+        int bitDepth = 12;
+        /// Target capture framerate
+        int framerate = SIM_DEFAULT_FPS;
+
+        /// Number of particles in the field of view
+        int numParticles = 50;
+        /// Standard deviation of a single Brownian step in pixels
+        float diffusion = 1.5f;
+        /// Standard deviation of the particle spot in pixels
+        float spotSigma = 1.5f;
+        /// Mean particle peak brightness above the background
+        float spotAmplitude = 1500.f;
+        /// Constant background level
+        int background = 100;
+        /// Standard deviation of the background noise
+        float noiseStd = 20.f;
+
+        /// Lens recorded in the capture metadata
+        Lens lens = X20;
+
+        /// Specifies if the camera is open
+        bool isCamOpen{false};
+
+        /// unique_ptr to a worker jthread, that handles the capture
+        std::unique_ptr<std::jthread> thread{nullptr};
+        /// Flag to be set to abort the capture thread
+        std::atomic<bool> threadAbortFlag{false};
+
+        /// Preallocated slots that hold the frames to be saved
+        FramePool framePool{};
+        /// Writer that streams saved frames to disk during capture
+        StackWriter writer{};
+        /// Frame time statistics of the current capture
+        FrameTimeStats frameTimeStats{};
+    };
+
+    /**
+     * Backend implementation that needs no hardware
+     * Generates 16 bit mono frames of Brownian particles on a noisy background
+     * with the same capture and save path as the PVCAM backend, which makes it
+     * usable for benchmarking the capture, display and save stages
+     */
+    class SimulatedBackend : public Backend
+    {
+    public:
+        SimulatedBackend(int argc, char** argv, sf::RenderWindow& window,
+                         sf::Texture& currentTexture, sf::Time& dt,
+                         std::mutex& mutex)
+            : Backend(argc, argv, window, currentTexture, dt, mutex)
+        {
+            Init();
+        }
+
+        /**
+         * Explicit "copy" constructor from a unique_ptr
+         *
+         * @param other unique_ptr to a Backend from which to construct a new one
+         */
+        explicit SimulatedBackend(const std::unique_ptr<Backend>& other)
+            : Backend(other)
+        {
+            Init();
+        }
+
+        /**
+         * Handles generic camera initialization
+         */
+        void Init() override;
+
+        /**
+         * Captures live image sequence
+         *
+         * @param format Save file format from the SAVE_FORMAT enum
+         * @param save Flag indicating the need to save the captured sequence
+         */
+        void LiveCapture(SAVE_FORMAT format, bool save) override;
+
+        /**
+         * Captures image sequence of specified length
+         *
+         * @param nFrames Image sequence length
+         * @param format Save file format from the SAVE_FORMAT enum
+         * @param save Flag indicating the need to save the captured sequence
+         */
+        void SequenceCapture(uint32_t nFrames, SAVE_FORMAT format,
+                             bool save) override;
+
+        /**
+         * Stops the ongoing capture process
+         */
+        void TerminateCapture() override;
+
+        /**
+         * Returns a pointer to the simulated camera context
+         * Parameters should only be changed while not capturing
+         *
+         * @return Raw pointer to the camera context
+         */
+        SimulatedCameraCtx* GetCameraContext() { return &m_context; }
+
+        ~SimulatedBackend() override { SimulatedBackend::TerminateCapture(); }
+
+    private:
+        /**
+         * Generic internal capture function to send to the worker thread,
+         * handles common functionality of live and sequence capture
+         *
+         * @param nFrames Image sequence length (0 for live capture)
+         * @param save Specifies whether to save the captured sequence
+         */
+        void Capture_(uint32_t nFrames, bool save);
+
+        /**
+         * Starts the capture thread after checking the backend state
+         *
+         * @param nFrames Image sequence length (0 for live capture)
+         * @param save Specifies whether to save the captured sequence
+         */
+        void StartCapture(uint32_t nFrames, bool save);
+
+        /**
+         * Prepares the noise table and scatters the particles for a new capture
+         */
+        void ResetScene();
+
+        /**
+         * Renders the current scene into a frame and moves the particles one step
+         *
+         * @param frame Output buffer of width * height pixels
+         */
+        void GenerateFrame(uint16_t* frame);
+
+        /**
+         * Sets up the frame pool and the streaming writer for an upcoming capture
+         *
+         * @param videoPath Capture directory path
+         * @param frameBytes Size of one frame in bytes
+         * @param nFrames Number of frames to capture (0 for live capture)
+         * @return true on success
+         */
+        bool StartSaving(std::string_view videoPath, std::size_t frameBytes,
+                         uint32_t nFrames);
+
+        /**
+         * Gives the capture metadata known before the capture starts
+         *
+         * @return Metadata struct with the frame statistics zeroed
+         */
+        [[nodiscard]] TifStackMeta MakeStackMeta() const;
+
+        /// Simulated camera context
+        SimulatedCameraCtx m_context{};
+
+        /// Particles currently in the field of view
+        std::vector<SimulatedParticle> m_particles{};
+        /// Precomputed gaussian background noise samples
+        std::vector<int16_t> m_noiseTable{};
+        /// Generator for the particle motion and noise offsets
+        std::mt19937 m_rng{std::random_device{}()};
+        /// Stack container of the current capture, DIR, RAW or CHUNKED
+        SAVE_FORMAT m_stackFormat = DIR;
+
+    public:
+        bool m_bSubtractBackground = false;
+    };
+}// namespace prm
@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "CaptureJournal.h"
+#include "capture/FrameTimeStats.h"
+#include "utils/ChunkedStack.h"
+#include "utils/FrameSidecar.h"
+#include "utils/RawStack.h"
+#include "utils/TiffStackWriter.h"
+
+namespace prm
+{
+    namespace
+    {
+        std::uint64_t Checksum(const CaptureJournalRecord& record)
+        {
+            const auto* bytes = reinterpret_cast<const uint8_t*>(&record);
+            std::uint64_t hash = 14695981039346656037ull;
+            for (std::size_t i = 0; i < offsetof(CaptureJournalRecord, checksum);
+                 ++i)
+            {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            }
+            return hash;
+        }
+    }// namespace
+
+    bool CaptureJournal::Open(std::string_view dirPath, SAVE_FORMAT format,
+                              const TifStackMeta& meta)
+    {
+        if (IsOpen())
+        {
+            spdlog::error("Capture journal is already open");
+            return false;
+        }
+
+        m_path = fmt::format("{}\\{}", dirPath, CAPTURE_JOURNAL_FILE);
+        m_ofs.open(m_path, std::ios::binary | std::ios::trunc);
+        if (!m_ofs)
+        {
+            spdlog::error("Couldn't create {}", m_path);
+            return false;
+        }
+
+        m_record = CaptureJournalRecord{};
+        std::memcpy(m_record.magic, CAPTURE_JOURNAL_MAGIC,
+                    sizeof(CAPTURE_JOURNAL_MAGIC));
+        m_record.version = CAPTURE_JOURNAL_VERSION;
+        m_record.format = format;
+        m_record.exposure = meta.exposure;
+        m_record.binning = meta.binning;
+        m_record.lens = meta.lens;
+        m_record.compression = meta.compression;
+        m_record.patchThreshold = meta.patchThreshold;
+        if (!Commit(0, 0, 0))
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    bool CaptureJournal::Commit(std::uint64_t numFrames, std::uint64_t dataEnd,
+                                std::uint64_t lastFrameOffset)
+    {
+        if (!IsOpen()) { return false; }
+
+        ++m_record.sequence;
+        m_record.numFrames = numFrames;
+        m_record.dataEnd = dataEnd;
+        m_record.lastFrameOffset = lastFrameOffset;
+        m_record.checksum = Checksum(m_record);
+
+        m_ofs.seekp(static_cast<std::streamoff>(m_record.sequence % 2 *
+                                                CAPTURE_JOURNAL_SLOT_SIZE));
+        m_ofs.write(reinterpret_cast<const char*>(&m_record), sizeof(m_record));
+        m_ofs.flush();
+        if (!m_ofs || !FileUtils::SyncFile(m_path))
+        {
+            spdlog::error("Failed committing {}", m_path);
+            m_ofs.clear();
+            return false;
+        }
+        return true;
+    }
+
+    void CaptureJournal::Close()
+    {
+        if (!IsOpen()) { return; }
+        m_ofs.close();
+        m_ofs.clear();
+    }
+
+    bool CaptureJournal::Remove()
+    {
+        if (!IsOpen()) { return true; }
+        Close();
+
+        std::error_code ec;
+        std::filesystem::remove(m_path, ec);
+        if (ec)
+        {
+            spdlog::error("Couldn't remove {}: {}", m_path, ec.message());
+            return false;
+        }
+        return true;
+    }
+
+    bool CaptureJournal::Read(const std::string& path,
+                              CaptureJournalRecord& record)
+    {
+        std::ifstream ifs{path, std::ios::binary};
+        bool found = false;
+        for (std::size_t slot = 0; slot < 2; ++slot)
+        {
+            CaptureJournalRecord candidate{};
+            ifs.seekg(static_cast<std::streamoff>(slot *
+                                                  CAPTURE_JOURNAL_SLOT_SIZE));
+            ifs.read(reinterpret_cast<char*>(&candidate), sizeof(candidate));
+            if (!ifs)
+            {
+                ifs.clear();
+                continue;
+            }
+            if (std::memcmp(candidate.magic, CAPTURE_JOURNAL_MAGIC,
+                            sizeof(CAPTURE_JOURNAL_MAGIC)) != 0 ||
+                candidate.version != CAPTURE_JOURNAL_VERSION ||
+                candidate.checksum != Checksum(candidate))
+            {
+                continue;
+            }
+            if (!found || candidate.sequence > record.sequence)
+            {
+                record = candidate;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    bool CaptureJournal::Recover(std::string_view dirPath)
+    {
+        const std::filesystem::path dir{dirPath};
+        const auto journalPath = (dir / CAPTURE_JOURNAL_FILE).string();
+        CaptureJournalRecord record{};
+        if (!Read(journalPath, record))
+        {
+            spdlog::error("{} has no intact record", journalPath);
+            return false;
+        }
+
+        auto numFrames = record.numFrames;
+        std::filesystem::path stackPath{};
+        switch (record.format)
+        {
+            case RAW:
+                stackPath = dir / fmt::format("stack{}", RAW_STACK_EXTENSION);
+                break;
+            case CHUNKED:
+            {
+                stackPath = dir / fmt::format("stack{}",
+                                              CHUNKED_STACK_EXTENSION);
+                // The array description is newer than the last commit
+                ChunkedStackReader reader{};
+                if (reader.Open(stackPath.string()))
+                {
+                    numFrames = reader.GetNumFrames();
+                }
+                break;
+            }
+            case DIR:
+                stackPath = dir / "stack.tif";
+                break;
+            default:
+                spdlog::error("{} names an unknown save format {}",
+                              journalPath, record.format);
+                return false;
+        }
+
+        TifStackMeta meta{
+                .numFrames = static_cast<std::uint32_t>(numFrames),
+                .exposure = static_cast<std::uint16_t>(record.exposure),
+                .fps = 0.0,
+                .frametimeAvg = 0.0,
+                .frametimeMin = 0.0,
+                .frametimeMax = 0.0,
+                .frametimeStd = 0.0,
+                .droppedFrames = 0,
+                .binning = static_cast<Binning>(record.binning),
+                .lens = static_cast<Lens>(record.lens),
+                .compression = static_cast<Compression>(record.compression),
+                .patchThreshold =
+                        static_cast<std::uint16_t>(record.patchThreshold)};
+
+        // Frame times come from the sidecar, which may run past the commit
+        FrameColumns columns{};
+        if (!FileUtils::ReadFrameSidecar(dir.string(), columns))
+        {
+            spdlog::warn("Recovering {} without per frame metadata",
+                         dir.string());
+        }
+        const auto numRecords =
+                std::min<std::uint64_t>(columns.Size(), numFrames);
+        FrameTimeStats stats{};
+        std::vector<double> timestamps{};
+        for (std::uint64_t i = 0; i < numRecords; ++i)
+        {
+            stats.AddFrame(columns.frameNr[i], columns.eofTime[i]);
+            timestamps.push_back(columns.bofTime[i] > 0.0 ? columns.bofTime[i]
+                                                          : columns.eofTime[i]);
+        }
+        stats.FillMeta(meta);
+
+        // A stack that never got a frame is left as it was created
+        bool recovered = false;
+        switch (record.format)
+        {
+            case RAW:
+                recovered = numFrames == 0 ||
+                            RawStackWriter::Recover(stackPath.string(),
+                                                    numFrames, record.dataEnd,
+                                                    meta, timestamps);
+                break;
+            case CHUNKED:
+                recovered = ChunkedStackWriter::Recover(stackPath.string(),
+                                                        meta);
+                break;
+            default:
+                recovered = numFrames == 0 ||
+                            TiffStackWriter::Recover(stackPath.string(),
+                                                     record.lastFrameOffset,
+                                                     record.dataEnd);
+                break;
+        }
+        if (!recovered)
+        {
+            spdlog::error("Couldn't recover {}, the journal is kept",
+                          dir.string());
+            return false;
+        }
+
+        // Records of frames that didn't make it into the stack are dropped
+        if (columns.Size() > numFrames)
+        {
+            FrameSidecarWriter sidecar{};
+            if (sidecar.Open((dir / FRAME_SIDECAR_FILE).string()))
+            {
+                for (std::uint64_t i = 0; i < numFrames; ++i)
+                {
+                    sidecar.Append(columns.Get(i));
+                }
+                sidecar.Close();
+            }
+        }
+        FileUtils::WriteTifMetadata(dir.string(), meta);
+
+        std::error_code ec;
+        std::filesystem::remove(journalPath, ec);
+        spdlog::info("Recovered {} frames of the unfinished capture in {}",
+                     numFrames, dir.string());
+        return true;
+    }
+
+    std::size_t CaptureJournal::RecoverAll(std::string_view saveDirPath)
+    {
+        std::size_t numRecovered = 0;
+        std::error_code ec;
+        for (const auto& entry: std::filesystem::directory_iterator{
+                     std::filesystem::path{saveDirPath}, ec})
+        {
+            if (entry.is_directory(ec) &&
+                std::filesystem::exists(entry.path() / CAPTURE_JOURNAL_FILE,
+                                        ec) &&
+                Recover(entry.path().string()))
+            {
+                ++numRecovered;
+            }
+        }
+        return numRecovered;
+    }
+}// namespace prm
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "misc/Meta.h"
+#include "utils/FileUtils.h"
+
+namespace prm
+{
+    /// Name of the journal in a capture directory, it only exists while the capture is unfinished
+    const char CAPTURE_JOURNAL_FILE[] = "capture.journal";
+    /// Identifies journal files, the line break catches text mode transfers
+    const char CAPTURE_JOURNAL_MAGIC[8] = {'P', 'R', 'M', 'J', 'R', 'N', '\r', '\n'};
+    /// Version 2 added the patch threshold
+    const uint32_t CAPTURE_JOURNAL_VERSION = 2;
+    /// Distance between the two record slots, a sector so a slot is written whole
+    const std::size_t CAPTURE_JOURNAL_SLOT_SIZE = 512;
+
+    /**
+     * Progress record of a capture, describes the part of the stack that is
+     * known to be on disk
+     */
+    struct CaptureJournalRecord
+    {
+        char magic[8];
+        uint32_t version;
+        /// Save format from the SAVE_FORMAT enum
+        uint32_t format;
+        /// Increases with every commit, the newer valid slot wins
+        std::uint64_t sequence;
+        /// Frames on disk at the commit
+        std::uint64_t numFrames;
+        /// End of the frame data on disk, unused for chunked stacks
+        std::uint64_t dataEnd;
+        /// Directory offset of the last frame of tif stacks
+        std::uint64_t lastFrameOffset;
+
+        // Capture metadata known up front, same meaning as in TifStackMeta
+        uint32_t exposure;
+        uint32_t binning;
+        uint32_t lens;
+        uint32_t compression;
+        uint32_t patchThreshold;
+        /// Keeps the checksum aligned, always 0
+        uint32_t reserved;
+
+        /// FNV-1a hash of all the fields above, catches torn slot writes
+        std::uint64_t checksum;
+    };
+    static_assert(std::is_trivially_copyable_v<CaptureJournalRecord> &&
+                          sizeof(CaptureJournalRecord) == 80,
+                  "Journal record layout is part of the file format");
+
+    /**
+     * Journal of a capture in progress
+     * The stack writer syncs its frames to disk and then commits how much of
+     * the stack is there. Commits alternate between two slots, so a crash in
+     * the middle of one leaves the previous commit intact. A journal left in a
+     * capture directory marks a capture that never finished, Recover turns
+     * it into a valid stack from the last commit without reading the frames
+     */
+    class CaptureJournal
+    {
+    public:
+        CaptureJournal() = default;
+
+        CaptureJournal(const CaptureJournal&) = delete;
+        CaptureJournal& operator=(const CaptureJournal&) = delete;
+
+        /**
+         * Creates the journal and commits an empty stack
+         *
+         * @param dirPath Capture directory
+         * @param format Save format of the stack
+         * @param meta Capture metadata known up front
+         * @return true on success
+         */
+        bool Open(std::string_view dirPath, SAVE_FORMAT format,
+                  const TifStackMeta& meta);
+
+        /**
+         * Records the synced state of the stack and forces it onto the disk
+         *
+         * @param numFrames Frames on disk
+         * @param dataEnd End of the frame data on disk
+         * @param lastFrameOffset Directory offset of the last frame of tif stacks
+         * @return true once the record is durable
+         */
+        bool Commit(std::uint64_t numFrames, std::uint64_t dataEnd,
+                    std::uint64_t lastFrameOffset);
+
+        /**
+         * Closes the journal and leaves it for recovery
+         */
+        void Close();
+
+        /**
+         * Closes and deletes the journal once the stack is finalised
+         *
+         * @return true on success
+         */
+        bool Remove();
+
+        [[nodiscard]] bool IsOpen() const { return m_ofs.is_open(); }
+
+        /**
+         * Finalises the capture in a directory from its journal
+         * The stack is cut back to the last commit, its frame count, index
+         * and time stamps are written, frame time statistics are rebuilt from
+         * the per frame sidecar and meta.json is rewritten. The journal is
+         * deleted on success
+         *
+         * @param dirPath Capture directory with a journal
+         * @return true on success
+         */
+        static bool Recover(std::string_view dirPath);
+
+        /**
+         * Recovers every unfinished capture directly inside a directory
+         *
+         * @param saveDirPath Directory the captures are saved to
+         * @return Number of recovered captures
+         */
+        static std::size_t RecoverAll(std::string_view saveDirPath);
+
+        ~CaptureJournal() { Close(); }
+
+    private:
+        /**
+         * Reads the newest intact record of a journal
+         *
+         * @param path Path of the journal
+         * @param record Filled with the record
+         * @return true if a record was found
+         */
+        static bool Read(const std::string& path, CaptureJournalRecord& record);
+
+        std::string m_path{};
+        std::ofstream m_ofs{};
+        /// Last committed record
+        CaptureJournalRecord m_record{};
+    };
+}// namespace prm
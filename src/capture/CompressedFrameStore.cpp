@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "CompressedFrameStore.h"
+
+namespace prm
+{
+    namespace
+    {
+        /// Page size for touching the store memory up front
+        const std::size_t STORE_PAGE_BYTES = 4096;
+    }// namespace
+
+    bool CompressedFrameStore::Open(Compression compression,
+                                    uint32_t imageWidth, uint32_t imageHeight,
+                                    std::size_t capacityBytes,
+                                    unsigned numThreads)
+    {
+        Free();
+        if (capacityBytes == 0 || !StripCodec::IsSupported(compression))
+        {
+            return false;
+        }
+
+        auto data = std::unique_ptr<uint8_t[]>(
+                new (std::nothrow) uint8_t[capacityBytes]);
+        if (!data)
+        {
+            spdlog::error("Unable to allocate a compressed capture buffer of "
+                          "{} MB",
+                          capacityBytes / (1024 * 1024));
+            return false;
+        }
+
+        // Touch every page now so the compressor never takes a page fault
+        for (std::size_t offset = 0; offset < capacityBytes;
+             offset += STORE_PAGE_BYTES)
+        {
+            data[offset] = 0;
+        }
+
+        std::scoped_lock lock(m_mutex);
+        m_compression = compression;
+        m_imageWidth = imageWidth;
+        m_imageHeight = imageHeight;
+        m_numStrips = (imageHeight + COMPRESSION_ROWS_PER_STRIP - 1) /
+                      COMPRESSION_ROWS_PER_STRIP;
+        m_data = std::move(data);
+        m_capacityBytes = capacityBytes;
+        m_writeOffset = 0;
+        m_entries.clear();
+        m_usedBytes = 0;
+        m_rawBytesPushed = 0;
+        m_storedBytesPushed = 0;
+        m_framesPushed = 0;
+        m_isClosed = false;
+
+        if (!m_pool || m_pool->GetNumThreads() != numThreads)
+        {
+            m_pool = std::make_unique<WorkerPool>(std::max(numThreads, 1u));
+        }
+
+        spdlog::info("Compressed capture buffer: {} MB",
+                     capacityBytes / (1024 * 1024));
+        return true;
+    }
+
+    bool CompressedFrameStore::Push(const StripCodec& codec,
+                                    const FrameRecord& record)
+    {
+        const auto numStrips = codec.GetNumStrips();
+        const auto bytes = numStrips * sizeof(uint32_t) +
+                           static_cast<std::size_t>(codec.GetEncodedBytes());
+        if (bytes > m_capacityBytes)
+        {
+            spdlog::error("Compressed frame of {} bytes doesn't fit in the "
+                          "capture buffer",
+                          bytes);
+            return false;
+        }
+
+        std::optional<std::size_t> offset;
+        {
+            std::unique_lock lock(m_mutex);
+            m_framePopped.wait(lock,
+                               [&]
+                               {
+                                   offset = FindRoom(bytes);
+                                   return offset || m_isClosed;
+                               });
+            if (m_isClosed) { return false; }
+        }
+
+        // Only this thread writes and the room isn't visible to Pop yet
+        auto* dst = m_data.get() + *offset;
+        for (uint32_t i = 0; i < numStrips; ++i)
+        {
+            const auto stripBytes =
+                    static_cast<uint32_t>(codec.GetStripSize(i));
+            std::memcpy(dst, &stripBytes, sizeof(stripBytes));
+            dst += sizeof(stripBytes);
+        }
+        for (uint32_t i = 0; i < numStrips; ++i)
+        {
+            std::memcpy(dst, codec.GetStripData(i), codec.GetStripSize(i));
+            dst += codec.GetStripSize(i);
+        }
+
+        {
+            std::scoped_lock lock(m_mutex);
+            m_entries.push_back(Entry{*offset, bytes, record});
+            m_writeOffset = *offset + bytes;
+            m_usedBytes += bytes;
+            m_rawBytesPushed += std::uint64_t{m_imageWidth} * m_imageHeight *
+                                sizeof(uint16_t);
+            m_storedBytesPushed += bytes;
+            ++m_framesPushed;
+        }
+        m_framePushed.notify_one();
+        return true;
+    }
+
+    std::optional<StoredFrame> CompressedFrameStore::Pop(uint16_t* pixels)
+    {
+        Entry entry{};
+        {
+            std::unique_lock lock(m_mutex);
+            m_framePushed.wait(lock,
+                               [&] { return !m_entries.empty() || m_isClosed; });
+            if (m_entries.empty()) { return std::nullopt; }
+            entry = m_entries.front();
+        }
+
+        // The oldest frame stays in the store while it is read, so Push
+        // can't write over it
+        const bool decoded = Decode(entry, pixels);
+        {
+            std::scoped_lock lock(m_mutex);
+            m_entries.pop_front();
+            m_usedBytes -= entry.bytes;
+        }
+        m_framePopped.notify_one();
+        return StoredFrame{entry.record, decoded};
+    }
+
+    void CompressedFrameStore::Close()
+    {
+        {
+            std::scoped_lock lock(m_mutex);
+            m_isClosed = true;
+        }
+        m_framePushed.notify_all();
+        m_framePopped.notify_all();
+    }
+
+    void CompressedFrameStore::Free()
+    {
+        std::scoped_lock lock(m_mutex);
+        m_data.reset();
+        m_capacityBytes = 0;
+        m_entries.clear();
+        m_usedBytes = 0;
+        m_rawBytesPushed = 0;
+        m_storedBytesPushed = 0;
+        m_framesPushed = 0;
+    }
+
+    FrameStoreStats CompressedFrameStore::GetStats()
+    {
+        std::scoped_lock lock(m_mutex);
+        FrameStoreStats stats{.numFrames = m_entries.size(),
+                              .usedBytes = m_usedBytes,
+                              .capacityBytes = m_capacityBytes};
+        if (m_framesPushed > 0 && m_storedBytesPushed > 0)
+        {
+            stats.compressionRatio = static_cast<double>(m_rawBytesPushed) /
+                                     static_cast<double>(m_storedBytesPushed);
+            const auto averageBytes = m_storedBytesPushed / m_framesPushed;
+            stats.framesLeft = static_cast<std::size_t>(
+                    (m_capacityBytes - m_usedBytes) /
+                    std::max<std::uint64_t>(averageBytes, 1));
+        }
+        return stats;
+    }
+
+    std::optional<std::size_t> CompressedFrameStore::FindRoom(
+            std::size_t bytes) const
+    {
+        if (m_entries.empty()) { return 0; }
+
+        const auto oldest = m_entries.front().offset;
+        if (m_writeOffset > oldest)
+        {
+            // Free bytes after the newest frame, then before the oldest one
+            if (m_writeOffset + bytes <= m_capacityBytes)
+            {
+                return m_writeOffset;
+            }
+            if (bytes <= oldest) { return 0; }
+            return std::nullopt;
+        }
+        if (m_writeOffset + bytes <= oldest) { return m_writeOffset; }
+        return std::nullopt;
+    }
+
+    bool CompressedFrameStore::Decode(const Entry& entry, uint16_t* pixels)
+    {
+        const auto* record = m_data.get() + entry.offset;
+        const auto sizesBytes = m_numStrips * sizeof(uint32_t);
+
+        std::vector<uint32_t> stripBytes(m_numStrips);
+        std::memcpy(stripBytes.data(), record, sizesBytes);
+        std::vector<std::size_t> stripOffsets(m_numStrips);
+        std::size_t offset = sizesBytes;
+        for (uint32_t i = 0; i < m_numStrips; ++i)
+        {
+            stripOffsets[i] = offset;
+            offset += stripBytes[i];
+        }
+        if (offset != entry.bytes) { return false; }
+
+        std::atomic<bool> success = true;
+        m_pool->ParallelFor(
+                m_numStrips,
+                [&](std::size_t index)
+                {
+                    const auto firstRow =
+                            static_cast<uint32_t>(index) *
+                            COMPRESSION_ROWS_PER_STRIP;
+                    const auto numRows = std::min(COMPRESSION_ROWS_PER_STRIP,
+                                                  m_imageHeight - firstRow);
+                    if (!StripCodec::DecodeStrip(
+                                m_compression, record + stripOffsets[index],
+                                stripBytes[index],
+                                pixels + std::size_t{m_imageWidth} * firstRow,
+                                m_imageWidth, numRows))
+                    {
+                        success = false;
+                    }
+                });
+        return success;
+    }
+}// namespace prm
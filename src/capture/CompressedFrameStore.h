@@ -0,0 +1,169 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+#include "utils/FrameSidecar.h"
+#include "utils/StripCodec.h"
+#include "utils/WorkerPool.h"
+
+namespace prm
+{
+    /// Frame pool slots kept for frames waiting to be compressed into the store
+    const std::size_t COMPRESSED_STORE_STAGING_SLOTS = 32;
+
+    /// Fill state of a compressed frame store
+    struct FrameStoreStats
+    {
+        /// Frames waiting in the store
+        std::size_t numFrames = 0;
+        /// Bytes taken by the waiting frames
+        std::size_t usedBytes = 0;
+        /// Size of the store
+        std::size_t capacityBytes = 0;
+        /// Raw over compressed size of all the frames pushed so far
+        double compressionRatio = 0.0;
+        /// Frames that still fit at the compression ratio so far
+        std::size_t framesLeft = 0;
+    };
+
+    /// Frame taken out of the store
+    struct StoredFrame
+    {
+        /// Capture conditions of the frame
+        FrameRecord record;
+        /// false if the pixels couldn't be decompressed
+        bool decoded;
+    };
+
+    /**
+     * RAM buffer that holds captured frames compressed instead of in frame
+     * pool slots, so the same budget covers several times more frames
+     * Frames are pushed as the strips of a StripCodec and laid out like the
+     * records of a raw stack, strip sizes first. They go into a ring of
+     * bytes allocated and touched up front and come out decompressed in the
+     * order they went in. One thread pushes and one thread pops
+     */
+    class CompressedFrameStore
+    {
+    public:
+        CompressedFrameStore() = default;
+
+        CompressedFrameStore(const CompressedFrameStore&) = delete;
+        CompressedFrameStore& operator=(const CompressedFrameStore&) = delete;
+
+        /**
+         * Allocates the store and starts the decompression threads
+         *
+         * @param compression Compression of the pushed strips
+         * @param imageWidth Width of each image
+         * @param imageHeight Height of each image
+         * @param capacityBytes Size of the store in bytes
+         * @param numThreads Number of decompression threads
+         * @return true on success
+         */
+        bool Open(Compression compression, uint32_t imageWidth,
+                  uint32_t imageHeight, std::size_t capacityBytes,
+                  unsigned numThreads);
+
+        /**
+         * Copies the frame last encoded by a codec into the store, waiting
+         * for older frames to be popped if it is full
+         *
+         * @param codec Codec holding the compressed strips of the frame
+         * @param record Capture conditions of the frame
+         * @return false if the store is closed or the frame can never fit
+         */
+        bool Push(const StripCodec& codec, const FrameRecord& record);
+
+        /**
+         * Waits for the oldest frame and decompresses it
+         *
+         * @param pixels Pixels of the frame
+         * @return The frame or std::nullopt once the store is closed and drained
+         */
+        [[nodiscard]] std::optional<StoredFrame> Pop(uint16_t* pixels);
+
+        /**
+         * Stops taking frames, Pop drains the remaining ones
+         */
+        void Close();
+
+        /**
+         * Releases the store memory, no thread may be using the store
+         */
+        void Free();
+
+        [[nodiscard]] bool IsOpen() const { return m_data != nullptr; }
+
+        /**
+         * Gives the fill state, safe to call from any thread
+         *
+         * @return Store statistics
+         */
+        [[nodiscard]] FrameStoreStats GetStats();
+
+    private:
+        /// Compressed frame in the store
+        struct Entry
+        {
+            std::size_t offset;
+            std::size_t bytes;
+            FrameRecord record;
+        };
+
+        /**
+         * Finds room for a frame after the newest one, wrapping around to
+         * the start of the store if the end is too short
+         *
+         * @param bytes Size of the frame
+         * @return Offset of the room or std::nullopt if it is taken
+         */
+        [[nodiscard]] std::optional<std::size_t> FindRoom(std::size_t bytes) const;
+
+        /**
+         * Decompresses the strips of a stored frame in parallel
+         *
+         * @param entry Stored frame
+         * @param pixels Pixels of the frame
+         * @return true on success
+         */
+        bool Decode(const Entry& entry, uint16_t* pixels);
+
+        Compression m_compression = NO_COMPRESSION;
+        uint32_t m_imageWidth = 0;
+        uint32_t m_imageHeight = 0;
+        uint32_t m_numStrips = 0;
+
+        /// Ring of compressed frames
+        std::unique_ptr<uint8_t[]> m_data{};
+        std::size_t m_capacityBytes = 0;
+        /// End of the newest frame, where the next one goes if it fits
+        std::size_t m_writeOffset = 0;
+        /// Frames in the store, oldest first
+        std::deque<Entry> m_entries{};
+        /// Bytes taken by the frames in the store
+        std::size_t m_usedBytes = 0;
+        /// Uncompressed and compressed size of all pushed frames
+        std::uint64_t m_rawBytesPushed = 0;
+        std::uint64_t m_storedBytesPushed = 0;
+        std::uint64_t m_framesPushed = 0;
+        /// Set when no more frames will be pushed
+        bool m_isClosed = false;
+
+        /// Mutex for entry synchronisation
+        std::mutex m_mutex;
+        /// Condition signalled when a frame is pushed or the store is closed
+        std::condition_variable m_framePushed;
+        /// Condition signalled when a frame is popped or the store is closed
+        std::condition_variable m_framePopped;
+
+        /// Decompression threads, separate from the ones of the codec
+        std::unique_ptr<WorkerPool> m_pool{};
+    };
+}// namespace prm
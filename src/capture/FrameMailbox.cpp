@@ -0,0 +1,51 @@
+#include <cstring>
+
+#include "FrameMailbox.h"
+
+namespace prm
+{
+    uint16_t* FrameMailbox::BeginWrite(uint16_t imageWidth,
+                                       uint16_t imageHeight)
+    {
+        // The back buffer belongs to the producer alone, so resizing it is
+        // safe. This only allocates when the frame size changes
+        auto& buffer = m_buffers[m_writeIndex];
+        buffer.pixels.resize(static_cast<std::size_t>(imageWidth) *
+                             imageHeight);
+        buffer.width = imageWidth;
+        buffer.height = imageHeight;
+        return buffer.pixels.data();
+    }
+
+    void FrameMailbox::Publish()
+    {
+        const auto previous = m_middleIndex.exchange(
+                m_writeIndex | FRESH_BIT, std::memory_order_acq_rel);
+        m_writeIndex = previous & INDEX_MASK;
+        ++m_publishedCount;
+    }
+
+    void FrameMailbox::Publish(const uint16_t* frame, uint16_t imageWidth,
+                               uint16_t imageHeight)
+    {
+        auto* buffer = BeginWrite(imageWidth, imageHeight);
+        std::memcpy(buffer, frame,
+                    static_cast<std::size_t>(imageWidth) * imageHeight *
+                            sizeof(uint16_t));
+        Publish();
+    }
+
+    bool FrameMailbox::Fetch()
+    {
+        if (!(m_middleIndex.load(std::memory_order_relaxed) & FRESH_BIT))
+        {
+            return false;
+        }
+
+        const auto previous =
+                m_middleIndex.exchange(m_readIndex, std::memory_order_acq_rel);
+        m_readIndex = previous & INDEX_MASK;
+        ++m_fetchedCount;
+        return true;
+    }
+}// namespace prm
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace prm
+{
+    /**
+     * Lock-free single producer, single consumer mailbox holding the latest
+     * 16 bit mono frame
+     * Triple buffered: the producer fills its own back buffer and swaps it with
+     * the shared middle one, the consumer swaps the middle buffer with its
+     * front one only when a fresh frame is there. Neither side ever waits and
+     * frames the consumer didn't get to are simply overwritten
+     */
+    class FrameMailbox
+    {
+    public:
+        FrameMailbox() = default;
+
+        FrameMailbox(const FrameMailbox&) = delete;
+        FrameMailbox& operator=(const FrameMailbox&) = delete;
+
+        /**
+         * Gives the producer buffer to fill with the next frame
+         * Only the producer thread may call this
+         *
+         * @param imageWidth Width of the frame
+         * @param imageHeight Height of the frame
+         * @return Pointer to imageWidth * imageHeight pixels
+         */
+        uint16_t* BeginWrite(uint16_t imageWidth, uint16_t imageHeight);
+
+        /**
+         * Makes the frame filled after BeginWrite() the latest one
+         * Only the producer thread may call this
+         */
+        void Publish();
+
+        /**
+         * Copies a frame into the mailbox and publishes it
+         * Only the producer thread may call this
+         *
+         * @param frame Frame data
+         * @param imageWidth Width of the frame
+         * @param imageHeight Height of the frame
+         */
+        void Publish(const uint16_t* frame, uint16_t imageWidth,
+                     uint16_t imageHeight);
+
+        /**
+         * Takes the latest frame if there is one the consumer hasn't seen yet
+         * Only the consumer thread may call this
+         *
+         * @return true if the read buffer now holds a new frame
+         */
+        bool Fetch();
+
+        /**
+         * Gives the consumer frame, valid until the next Fetch()
+         *
+         * @return Pointer to the frame pixels
+         */
+        [[nodiscard]] const uint16_t* GetReadBuffer() const
+        {
+            return m_buffers[m_readIndex].pixels.data();
+        }
+
+        [[nodiscard]] uint16_t GetReadWidth() const
+        {
+            return m_buffers[m_readIndex].width;
+        }
+        [[nodiscard]] uint16_t GetReadHeight() const
+        {
+            return m_buffers[m_readIndex].height;
+        }
+
+        /**
+         * Gives the number of frames published so far
+         *
+         * @return Published frame count
+         */
+        [[nodiscard]] uint64_t GetPublishedCount() const
+        {
+            return m_publishedCount;
+        }
+
+        /**
+         * Gives the number of frames fetched by the consumer so far
+         *
+         * @return Fetched frame count
+         */
+        [[nodiscard]] uint64_t GetFetchedCount() const
+        {
+            return m_fetchedCount;
+        }
+
+    private:
+        /// Frame buffer along with its dimensions
+        struct Buffer
+        {
+            std::vector<uint16_t> pixels{};
+            uint16_t width = 0;
+            uint16_t height = 0;
+        };
+
+        /// Set in the middle index when it holds a frame not fetched yet
+        static constexpr uint8_t FRESH_BIT = 0x4;
+        /// Mask extracting the buffer index out of the middle index
+        static constexpr uint8_t INDEX_MASK = 0x3;
+
+        std::array<Buffer, 3> m_buffers{};
+
+        /// Buffer owned by the producer
+        uint8_t m_writeIndex = 0;
+        /// Buffer owned by the consumer
+        uint8_t m_readIndex = 1;
+        /// Buffer in between, together with the FRESH_BIT
+        std::atomic<uint8_t> m_middleIndex = 2;
+
+        std::atomic<uint64_t> m_publishedCount = 0;
+        std::atomic<uint64_t> m_fetchedCount = 0;
+    };
+}// namespace prm
@@ -0,0 +1,59 @@
+#include <thread>
+
+#include "FramePacer.h"
+
+namespace prm
+{
+    void FramePacer::Start(double targetFps)
+    {
+        m_isCapped = targetFps > 0.0;
+        m_period = m_isCapped ? std::chrono::duration_cast<clock_t::duration>(
+                                        std::chrono::duration<double>{
+                                                1.0 / targetFps})
+                              : clock_t::duration{};
+
+        const auto now = clock_t::now();
+        m_deadline = now;
+        m_startTime = now;
+        m_lastTime = now;
+        m_numFrames = 0;
+        m_windowStart = now;
+        m_windowFrames = 0;
+        m_deliveredFps = 0.0;
+    }
+
+    void FramePacer::Pace()
+    {
+        if (m_isCapped)
+        {
+            m_deadline += m_period;
+            const auto now = clock_t::now();
+            if (m_deadline < now - m_period) { m_deadline = now; }
+            std::this_thread::sleep_until(m_deadline);
+        }
+
+        const auto now = clock_t::now();
+        if (m_numFrames == 0) { m_startTime = now; }
+        m_lastTime = now;
+        ++m_numFrames;
+        ++m_windowFrames;
+
+        const auto windowTime = now - m_windowStart;
+        if (windowTime >= FPS_MEASURE_WINDOW)
+        {
+            m_deliveredFps =
+                    static_cast<double>(m_windowFrames) /
+                    std::chrono::duration<double>(windowTime).count();
+            m_windowStart = now;
+            m_windowFrames = 0;
+        }
+    }
+
+    double FramePacer::GetAverageFps() const
+    {
+        const auto elapsed =
+                std::chrono::duration<double>(m_lastTime - m_startTime).count();
+        if (m_numFrames < 2 || elapsed <= 0.0) { return 0.0; }
+        return static_cast<double>(m_numFrames - 1) / elapsed;
+    }
+}// namespace prm
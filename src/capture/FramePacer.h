@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace prm
+{
+    /// Time over which the delivered frame rate is averaged
+    const std::chrono::milliseconds FPS_MEASURE_WINDOW{500};
+
+    /**
+     * Paces a capture loop to a target frame rate
+     * Frames are due at absolute steady_clock deadlines, so the time spent
+     * reading and converting a frame comes out of the wait and the sleep
+     * overshoot doesn't accumulate. Also measures the rate actually delivered
+     */
+    class FramePacer
+    {
+    public:
+        using clock_t = std::chrono::steady_clock;
+
+        /**
+         * Starts pacing a new capture
+         *
+         * @param targetFps Target frame rate, 0 or less runs the loop uncapped
+         */
+        void Start(double targetFps);
+
+        /**
+         * Waits until the next frame is due and counts it as delivered
+         * Called once at the top of every capture loop iteration. After a
+         * stall longer than a frame period the schedule restarts from now
+         * instead of bursting to catch up
+         */
+        void Pace();
+
+        [[nodiscard]] bool IsCapped() const { return m_isCapped; }
+
+        /**
+         * Gives the delivered frame rate over the last measurement window
+         *
+         * @return Frames per second
+         */
+        [[nodiscard]] double GetDeliveredFps() const { return m_deliveredFps; }
+
+        /**
+         * Gives the delivered frame rate since Start()
+         *
+         * @return Frames per second or 0 if no frame was delivered yet
+         */
+        [[nodiscard]] double GetAverageFps() const;
+
+        /// Number of frames delivered since Start()
+        [[nodiscard]] uint64_t GetNumFrames() const { return m_numFrames; }
+
+    private:
+        /// Time between two frames when capped
+        clock_t::duration m_period{};
+        /// Specifies if the loop is paced at all
+        bool m_isCapped = false;
+        /// Time at which the next frame is due
+        clock_t::time_point m_deadline{};
+
+        /// Time of the first delivered frame
+        clock_t::time_point m_startTime{};
+        /// Time of the latest delivered frame
+        clock_t::time_point m_lastTime{};
+        /// Number of frames delivered since Start()
+        uint64_t m_numFrames = 0;
+
+        /// Start of the current measurement window
+        clock_t::time_point m_windowStart{};
+        /// Frames delivered in the current measurement window
+        uint64_t m_windowFrames = 0;
+        /// Frame rate measured over the last complete window
+        double m_deliveredFps = 0.0;
+    };
+}// namespace prm
@@ -0,0 +1,119 @@
+#include <new>
+
+#include <spdlog/spdlog.h>
+
+#include "FramePool.h"
+
+namespace prm
+{
+    bool FramePool::Allocate(std::size_t frameBytes, std::size_t numSlots)
+    {
+        Free();
+        if (frameBytes == 0 || numSlots == 0) { return false; }
+
+        const auto slotBytes = SlotBytesFor(frameBytes);
+        auto* data = static_cast<uint8_t*>(::operator new[](
+                slotBytes * numSlots, std::align_val_t{FRAME_SLOT_ALIGNMENT},
+                std::nothrow));
+        if (!data)
+        {
+            spdlog::error("Unable to allocate {} frame slots of {} bytes",
+                          numSlots, slotBytes);
+            return false;
+        }
+
+        // Touch every page now so the capture loop never takes a page fault
+        for (std::size_t offset = 0; offset < slotBytes * numSlots;
+             offset += FRAME_SLOT_ALIGNMENT)
+        {
+            data[offset] = 0;
+        }
+
+        std::scoped_lock lock(m_mutex);
+        m_data = data;
+        m_frameBytes = frameBytes;
+        m_slotBytes = slotBytes;
+        m_numSlots = numSlots;
+
+        m_freeSlots.reserve(numSlots);
+        for (std::size_t i = numSlots; i > 0; --i)
+        {
+            m_freeSlots.push_back(m_data + (i - 1) * m_slotBytes);
+        }
+
+        spdlog::info("Frame pool: {} slots, {} MB", numSlots,
+                     slotBytes * numSlots / (1024 * 1024));
+        return true;
+    }
+
+    bool FramePool::AllocateForBudget(std::size_t frameBytes,
+                                      std::size_t budgetBytes)
+    {
+        if (frameBytes == 0) { return false; }
+        return Allocate(frameBytes, budgetBytes / SlotBytesFor(frameBytes));
+    }
+
+    void FramePool::Free()
+    {
+        std::scoped_lock lock(m_mutex);
+        if (m_data)
+        {
+            ::operator delete[](m_data, std::align_val_t{FRAME_SLOT_ALIGNMENT});
+        }
+        m_data = nullptr;
+        m_frameBytes = 0;
+        m_slotBytes = 0;
+        m_numSlots = 0;
+        m_freeSlots.clear();
+    }
+
+    uint8_t* FramePool::Acquire()
+    {
+        std::scoped_lock lock(m_mutex);
+        if (m_freeSlots.empty()) { return nullptr; }
+
+        auto* slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        return slot;
+    }
+
+    uint8_t* FramePool::Acquire(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock lock(m_mutex);
+        if (!m_slotReleased.wait_for(lock, timeout,
+                                     [&] { return !m_freeSlots.empty(); }))
+        {
+            return nullptr;
+        }
+
+        auto* slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        return slot;
+    }
+
+    void FramePool::Release(uint8_t* slot)
+    {
+        if (!slot) { return; }
+        {
+            std::scoped_lock lock(m_mutex);
+            m_freeSlots.push_back(slot);
+        }
+        m_slotReleased.notify_one();
+    }
+
+    void FramePool::Reset()
+    {
+        std::scoped_lock lock(m_mutex);
+        m_freeSlots.clear();
+        for (std::size_t i = m_numSlots; i > 0; --i)
+        {
+            m_freeSlots.push_back(m_data + (i - 1) * m_slotBytes);
+        }
+    }
+
+    std::size_t FramePool::GetNumFree()
+    {
+        std::scoped_lock lock(m_mutex);
+        return m_freeSlots.size();
+    }
+}// namespace prm
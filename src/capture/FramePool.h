@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace prm
+{
+    /// Alignment of every frame slot, page sized so slots suit unbuffered I/O
+    const std::size_t FRAME_SLOT_ALIGNMENT = 4096;
+
+    /// Default RAM budget for capture buffers in megabytes
+    const std::size_t DEFAULT_CAPTURE_BUDGET_MB = 1024;
+
+    /**
+     * Pool of preallocated fixed-size frame slots
+     * Capture loops acquire a slot, fill it with a frame and pass the slot
+     * pointer on to the writers, which read it in place and release it. All the
+     * memory is allocated and touched up front, so no allocation happens
+     * mid-acquisition
+     */
+    class FramePool
+    {
+    public:
+        FramePool() = default;
+
+        FramePool(const FramePool&) = delete;
+        FramePool& operator=(const FramePool&) = delete;
+
+        /**
+         * Allocates the given number of slots, dropping any previous allocation
+         *
+         * @param frameBytes Size of one frame in bytes
+         * @param numSlots Number of slots to allocate
+         * @return true on success
+         */
+        bool Allocate(std::size_t frameBytes, std::size_t numSlots);
+
+        /**
+         * Allocates as many slots as fit in the given RAM budget
+         *
+         * @param frameBytes Size of one frame in bytes
+         * @param budgetBytes Memory budget for the whole pool in bytes
+         * @return true on success
+         */
+        bool AllocateForBudget(std::size_t frameBytes, std::size_t budgetBytes);
+
+        /**
+         * Releases all the pool memory
+         */
+        void Free();
+
+        /**
+         * Takes a free slot out of the pool
+         *
+         * @return Pointer to the slot memory or nullptr if the pool is exhausted
+         */
+        [[nodiscard]] uint8_t* Acquire();
+
+        /**
+         * Takes a free slot out of the pool, waiting for one to be released if necessary
+         *
+         * @param timeout Maximum time to wait
+         * @return Pointer to the slot memory or nullptr on timeout
+         */
+        [[nodiscard]] uint8_t* Acquire(std::chrono::milliseconds timeout);
+
+        /**
+         * Returns a previously acquired slot back to the pool
+         *
+         * @param slot Slot pointer obtained from Acquire()
+         */
+        void Release(uint8_t* slot);
+
+        /**
+         * Marks all slots as free without touching the memory
+         */
+        void Reset();
+
+        /**
+         * Computes the slot size for a given frame size
+         *
+         * @param frameBytes Size of one frame in bytes
+         * @return Frame size rounded up to the slot alignment
+         */
+        static std::size_t SlotBytesFor(std::size_t frameBytes)
+        {
+            return (frameBytes + FRAME_SLOT_ALIGNMENT - 1) /
+                   FRAME_SLOT_ALIGNMENT * FRAME_SLOT_ALIGNMENT;
+        }
+
+        [[nodiscard]] std::size_t GetFrameBytes() const { return m_frameBytes; }
+        [[nodiscard]] std::size_t GetSlotBytes() const { return m_slotBytes; }
+        [[nodiscard]] std::size_t GetNumSlots() const { return m_numSlots; }
+
+        /**
+         * Gives the current number of free slots
+         *
+         * @return Number of slots available for Acquire()
+         */
+        [[nodiscard]] std::size_t GetNumFree();
+
+        ~FramePool() { Free(); }
+
+    private:
+        /// Start of the slot memory block
+        uint8_t* m_data = nullptr;
+
+        /// Size of the frame payload in each slot
+        std::size_t m_frameBytes = 0;
+        /// Distance between the starts of neighbouring slots
+        std::size_t m_slotBytes = 0;
+        /// Total number of slots
+        std::size_t m_numSlots = 0;
+
+        /// Stack of free slots, lowest address on top
+        std::vector<uint8_t*> m_freeSlots{};
+        /// Mutex for free slot synchronisation
+        std::mutex m_mutex;
+        /// Condition signalled when a slot is released
+        std::condition_variable m_slotReleased;
+    };
+}// namespace prm
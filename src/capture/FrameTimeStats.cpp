@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <cmath>
+
+#include <spdlog/spdlog.h>
+
+#include "FrameTimeStats.h"
+
+namespace prm
+{
+    void FrameTimeStats::Reset() { *this = FrameTimeStats{}; }
+
+    void FrameTimeStats::AddFrame(int64_t frameNr, double timestamp)
+    {
+        const bool isFirst = m_numFrames == 0;
+        const auto frameStep = frameNr - m_lastFrameNr;
+        const auto timeStep = timestamp - m_lastTimestamp;
+
+        ++m_numFrames;
+        m_lastFrameNr = frameNr;
+        m_lastTimestamp = timestamp;
+
+        if (isFirst || frameStep <= 0 || timeStep <= 0.0) { return; }
+
+        m_numDropped += static_cast<uint64_t>(frameStep - 1);
+        m_spannedFrames += static_cast<uint64_t>(frameStep);
+        m_spannedTime += timeStep;
+
+        // Dropped frames stretch one interval over several periods
+        const auto period = timeStep / static_cast<double>(frameStep);
+
+        if (m_numPeriods > 0)
+        {
+            const auto center = static_cast<long>(JITTER_HISTOGRAM_BINS / 2);
+            const auto bin = std::clamp(
+                    center + std::lround((period - m_mean) / JITTER_BIN_WIDTH),
+                    0L, static_cast<long>(JITTER_HISTOGRAM_BINS) - 1);
+            ++m_jitter[static_cast<std::size_t>(bin)];
+
+            m_min = std::min(m_min, period);
+            m_max = std::max(m_max, period);
+        }
+        else
+        {
+            m_min = period;
+            m_max = period;
+        }
+
+        ++m_numPeriods;
+        const auto delta = period - m_mean;
+        m_mean += delta / static_cast<double>(m_numPeriods);
+        m_m2 += delta * (period - m_mean);
+    }
+
+    double FrameTimeStats::GetFps() const
+    {
+        if (m_spannedTime <= 0.0) { return 0.0; }
+        return static_cast<double>(m_spannedFrames) / m_spannedTime;
+    }
+
+    double FrameTimeStats::GetStd() const
+    {
+        if (m_numPeriods == 0) { return 0.0; }
+        return std::sqrt(m_m2 / static_cast<double>(m_numPeriods));
+    }
+
+    void FrameTimeStats::FillMeta(TifStackMeta& meta) const
+    {
+        meta.fps = GetFps();
+        meta.frametimeAvg = m_mean;
+        meta.frametimeMin = m_min;
+        meta.frametimeMax = m_max;
+        meta.frametimeStd = GetStd();
+        meta.droppedFrames = m_numDropped;
+    }
+
+    void FrameTimeStats::LogSummary() const
+    {
+        spdlog::info("Captured {} frames in {} seconds\nAvg fps: {}",
+                     m_numFrames, m_spannedTime, GetFps());
+        spdlog::info("Frame time avg {} min {} max {} std {}", m_mean, m_min,
+                     m_max, GetStd());
+        if (m_numDropped > 0)
+        {
+            spdlog::warn("{} frames were dropped", m_numDropped);
+        }
+
+        const auto center = static_cast<int>(JITTER_HISTOGRAM_BINS / 2);
+        for (std::size_t i = 0; i < JITTER_HISTOGRAM_BINS; ++i)
+        {
+            if (m_jitter[i] == 0) { continue; }
+            spdlog::info("Jitter {:+} us: {}",
+                         (static_cast<int>(i) - center) *
+                                 static_cast<int>(JITTER_BIN_WIDTH * 1e6),
+                         m_jitter[i]);
+        }
+    }
+}// namespace prm
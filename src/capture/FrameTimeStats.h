@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "misc/Meta.h"
+
+namespace prm
+{
+    /// Number of bins in the frame time jitter histogram, the middle one is zero
+    const std::size_t JITTER_HISTOGRAM_BINS = 33;
+
+    /// Width of one jitter histogram bin in seconds
+    const double JITTER_BIN_WIDTH = 100e-6;
+
+    /**
+     * Streaming frame time statistics
+     * Takes the time stamp and number of every frame and keeps the frame period
+     * mean, min, max and std up to date with Welford's algorithm, so the memory
+     * used doesn't grow with the capture length. Gaps in the frame numbers are
+     * spread over the missing frames, so the reported rate is the camera rate
+     */
+    class FrameTimeStats
+    {
+    public:
+        using JitterHistogram = std::array<uint64_t, JITTER_HISTOGRAM_BINS>;
+
+        /**
+         * Clears all the statistics before a new capture
+         */
+        void Reset();
+
+        /**
+         * Adds a frame to the statistics
+         * A frame number or time stamp that doesn't increase starts a new
+         * segment, the interval across the restart is not counted
+         *
+         * @param frameNr Frame number as counted by the source
+         * @param timestamp Frame time stamp in seconds
+         */
+        void AddFrame(int64_t frameNr, double timestamp);
+
+        /// Number of frames added since the last reset
+        [[nodiscard]] uint64_t GetNumFrames() const { return m_numFrames; }
+
+        /// Number of frame periods the statistics are built from
+        [[nodiscard]] uint64_t GetNumPeriods() const { return m_numPeriods; }
+
+        /// Number of frames missing from the gaps in the frame numbers
+        [[nodiscard]] uint64_t GetNumDropped() const { return m_numDropped; }
+
+        /**
+         * Gives the frame rate over all the counted periods
+         *
+         * @return Frames per second or 0 if no period was counted
+         */
+        [[nodiscard]] double GetFps() const;
+
+        [[nodiscard]] double GetMean() const { return m_mean; }
+        [[nodiscard]] double GetMin() const { return m_min; }
+        [[nodiscard]] double GetMax() const { return m_max; }
+
+        /**
+         * Gives the population standard deviation of the frame period
+         *
+         * @return Standard deviation in seconds
+         */
+        [[nodiscard]] double GetStd() const;
+
+        /**
+         * Gives the histogram of frame period deviations from the running mean
+         * Bin i covers deviations around (i - JITTER_HISTOGRAM_BINS / 2) *
+         * JITTER_BIN_WIDTH, the edge bins also hold everything beyond them
+         *
+         * @return Histogram counts
+         */
+        [[nodiscard]] const JitterHistogram& GetJitterHistogram() const
+        {
+            return m_jitter;
+        }
+
+        /**
+         * Copies the frame time statistics into the capture metadata
+         *
+         * @param meta Metadata to fill
+         */
+        void FillMeta(TifStackMeta& meta) const;
+
+        /**
+         * Logs a summary line and the nonzero jitter histogram bins
+         */
+        void LogSummary() const;
+
+    private:
+        /// Number of frames added
+        uint64_t m_numFrames = 0;
+        /// Number of frame periods counted
+        uint64_t m_numPeriods = 0;
+        /// Number of frames missing between the added ones
+        uint64_t m_numDropped = 0;
+
+        /// Frame number of the previous frame
+        int64_t m_lastFrameNr = 0;
+        /// Time stamp of the previous frame in seconds
+        double m_lastTimestamp = 0.0;
+
+        /// Frames spanned by all the counted intervals
+        uint64_t m_spannedFrames = 0;
+        /// Time spanned by all the counted intervals in seconds
+        double m_spannedTime = 0.0;
+
+        /// Running mean of the frame period
+        double m_mean = 0.0;
+        /// Running sum of squared deviations from the mean
+        double m_m2 = 0.0;
+        /// Shortest frame period
+        double m_min = 0.0;
+        /// Longest frame period
+        double m_max = 0.0;
+
+        /// Frame period jitter histogram
+        JitterHistogram m_jitter{};
+    };
+}// namespace prm
@@ -0,0 +1,430 @@
+#include <filesystem>
+
+#include <fmt/format.h>
+#include <opencv2/opencv.hpp>
+#include <spdlog/spdlog.h>
+
+#include "StackWriter.h"
+
+namespace prm
+{
+    bool StackWriter::Open(std::string_view dirPath, uint16_t imageWidth,
+                           uint16_t imageHeight, FramePool& pool,
+                           const TifStackMeta& meta,
+                           const StackOptions& options)
+    {
+        if (m_isOpen)
+        {
+            spdlog::error("Stack writer is already open");
+            return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path{dirPath},
+                                            ec);
+        if (ec)
+        {
+            spdlog::error("Couldn't create a directory: {}", ec.message());
+            return false;
+        }
+
+        m_dirPath = dirPath;
+        m_format = options.format == RAW || options.format == CHUNKED
+                           ? options.format
+                           : DIR;
+        switch (m_format)
+        {
+            case RAW:
+                m_stackPath = fmt::format("{}\\stack{}", dirPath,
+                                          RAW_STACK_EXTENSION);
+                break;
+            case CHUNKED:
+                m_stackPath = fmt::format("{}\\stack{}", dirPath,
+                                          CHUNKED_STACK_EXTENSION);
+                break;
+            default:
+                m_stackPath = fmt::format("{}\\stack.tif", dirPath);
+                break;
+        }
+        m_imageWidth = imageWidth;
+        m_imageHeight = imageHeight;
+        m_bSubtractBackground = options.subtractBackground;
+        m_packing = options.packing;
+        const auto numPixels = std::size_t{imageWidth} * imageHeight;
+        m_unpacked.resize(m_packing != UNPACKED_16 ? numPixels : 0);
+
+        m_compression = options.compression;
+        if (!StripCodec::IsSupported(m_compression))
+        {
+            spdlog::warn("Compression is not available in this build, saving "
+                         "uncompressed");
+            m_compression = NO_COMPRESSION;
+        }
+        if (m_compression == TEMPORAL && m_format != RAW)
+        {
+            spdlog::warn("Temporal compression needs a raw stack, compressing "
+                         "each frame on its own");
+            m_compression = StripCodec::FrameCompression(m_compression);
+        }
+        if (m_compression == PATCHES && m_format != RAW)
+        {
+            spdlog::warn("Patch storage needs a raw stack, saving whole "
+                         "frames compressed");
+            m_compression = StripCodec::FrameCompression(m_compression);
+        }
+        if (m_compression == LZ4)
+        {
+            spdlog::warn("lz4 is meant for the capture buffer, compressing "
+                         "the stack with the regular coder");
+            m_compression = StripCodec::FrameCompression(TEMPORAL);
+        }
+
+        // Frames wait compressed in RAM, the coder is picked for speed since
+        // every frame goes through it twice
+        m_buffered.clear();
+        if (options.compressedBufferBytes > 0)
+        {
+            const auto bufferCompression = StripCodec::BufferCompression();
+            const auto numThreads = StripCodec::DefaultNumThreads();
+            if (!m_bufferCodec.Configure(bufferCompression, imageWidth,
+                                         imageHeight, numThreads) ||
+                !m_store.Open(bufferCompression, imageWidth, imageHeight,
+                              options.compressedBufferBytes,
+                              std::max(numThreads / 2, 1u)))
+            {
+                spdlog::error("Couldn't set up the compressed capture buffer");
+                return false;
+            }
+            m_buffered.resize(numPixels);
+        }
+
+        // Unbuffered frames are written straight from the slots, which have
+        // to span a whole page aligned frame
+        const bool slotsFit = pool.GetSlotBytes() >=
+                              FramePool::SlotBytesFor(
+                                      PackedBytes(m_packing, numPixels));
+        bool opened = false;
+        switch (m_format)
+        {
+            case RAW:
+                opened = m_raw.Open(
+                        m_stackPath, imageWidth, imageHeight,
+                        {.bitDepth = static_cast<uint32_t>(options.bitDepth),
+                         .withTimestamps = true,
+                         .compression = m_compression,
+                         .unbuffered = options.unbuffered && slotsFit,
+                         .packing = m_packing,
+                         .patchThreshold = options.patchThreshold});
+                break;
+            case CHUNKED:
+                opened = m_chunked.Open(m_stackPath, imageWidth, imageHeight,
+                                        m_compression,
+                                        StripCodec::DefaultNumThreads());
+                break;
+            default:
+                opened = m_tiff.Open(m_stackPath, imageWidth, imageHeight, 0,
+                                     m_compression);
+                break;
+        }
+        if (!opened)
+        {
+            m_store.Free();
+            return false;
+        }
+
+        if (!m_sidecar.Open(fmt::format("{}\\{}", dirPath, FRAME_SIDECAR_FILE)))
+        {
+            spdlog::warn("Per frame metadata won't be saved");
+        }
+
+        m_pool = &pool;
+        m_queue.Reset(pool.GetNumSlots());
+        m_meta = meta;
+        m_meta.numFrames = 0;
+        m_meta.compression = m_compression;
+        m_meta.patchThreshold =
+                m_compression == PATCHES ? options.patchThreshold : 0;
+        m_framesWritten = 0;
+        m_errorOccurred = false;
+        m_lastMetaWrite = std::chrono::steady_clock::now();
+        FileUtils::WriteTifMetadata(m_dirPath, m_meta);
+
+        if (options.journaled && !m_journal.Open(dirPath, m_format, m_meta))
+        {
+            spdlog::warn("The capture won't be recoverable after a crash");
+        }
+
+        m_isOpen = true;
+        m_thread = std::jthread(&StackWriter::Main, this);
+        if (m_store.IsOpen())
+        {
+            m_compressThread = std::jthread(&StackWriter::CompressMain, this);
+        }
+        return true;
+    }
+
+    bool StackWriter::Push(uint8_t* slot, const FrameRecord& record)
+    {
+        if (!m_isOpen || !m_queue.TryPush(StackFrame{slot, record}))
+        {
+            m_pool->Release(slot);
+            return false;
+        }
+        return true;
+    }
+
+    bool StackWriter::Close(const TifStackMeta& meta)
+    {
+        if (!m_isOpen) { return true; }
+
+        // The compressor closes the buffer once the queue is drained, then
+        // the writer drains the buffer
+        m_queue.Close();
+        if (m_compressThread.joinable()) { m_compressThread.join(); }
+        if (m_thread.joinable()) { m_thread.join(); }
+        m_isOpen = false;
+        m_store.Free();
+
+        const auto patchThreshold = m_meta.patchThreshold;
+        m_meta = meta;
+        m_meta.numFrames = m_framesWritten;
+        m_meta.compression = m_compression;
+        m_meta.patchThreshold = patchThreshold;
+
+        bool closed = false;
+        switch (m_format)
+        {
+            case RAW:
+                closed = m_raw.Close(m_meta);
+                break;
+            case CHUNKED:
+                closed = m_chunked.Close(m_meta);
+                break;
+            default:
+                closed = m_tiff.Close();
+                break;
+        }
+        if (!closed) { m_errorOccurred = true; }
+        if (!m_sidecar.Close()) { m_errorOccurred = true; }
+        FileUtils::WriteTifMetadata(m_dirPath, m_meta);
+
+        // A stack that failed to finish is left to recovery from the last commit
+        if (!m_errorOccurred) { m_journal.Remove(); }
+        else if (m_journal.IsOpen())
+        {
+            spdlog::warn("Keeping the journal of {} for recovery", m_dirPath);
+            m_journal.Close();
+        }
+
+        spdlog::info("Stack of {} frames written to {}, max writer queue "
+                     "depth {}",
+                     m_meta.numFrames, m_dirPath, m_queue.HighWatermark());
+        return !m_errorOccurred;
+    }
+
+    void StackWriter::Main()
+    {
+        if (m_store.IsOpen())
+        {
+            while (auto frame = m_store.Pop(m_buffered.data()))
+            {
+                if (!m_errorOccurred)
+                {
+                    if (!frame->decoded)
+                    {
+                        spdlog::error("Couldn't decompress frame {} from the "
+                                      "capture buffer",
+                                      frame->record.frameNr);
+                        m_errorOccurred = true;
+                    }
+                    else if (WriteBufferedFrame(m_buffered.data(),
+                                                frame->record))
+                    {
+                        ++m_framesWritten;
+                    }
+                    else { m_errorOccurred = true; }
+                }
+                UpdateProgress();
+            }
+            return;
+        }
+
+        while (auto frame = m_queue.Pop())
+        {
+            if (m_errorOccurred) { m_pool->Release(frame->slot); }
+            else if (WriteFrame(*frame)) { ++m_framesWritten; }
+            else { m_errorOccurred = true; }
+            UpdateProgress();
+        }
+    }
+
+    void StackWriter::CompressMain()
+    {
+        const auto numPixels = std::size_t{m_imageWidth} * m_imageHeight;
+        while (auto frame = m_queue.Pop())
+        {
+            const auto* pixels = reinterpret_cast<const uint16_t*>(frame->slot);
+            if (m_packing != UNPACKED_16)
+            {
+                UnpackPixels(m_packing, frame->slot, numPixels,
+                             m_unpacked.data());
+                pixels = m_unpacked.data();
+            }
+
+            // The slot is free again as soon as its frame is compressed
+            const bool encoded = m_bufferCodec.Encode(pixels);
+            m_pool->Release(frame->slot);
+            if (!encoded || !m_store.Push(m_bufferCodec, frame->record))
+            {
+                spdlog::error("Couldn't put frame {} into the capture buffer",
+                              frame->record.frameNr);
+                m_errorOccurred = true;
+            }
+        }
+        m_store.Close();
+    }
+
+    void StackWriter::UpdateProgress()
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (now - m_lastMetaWrite <= STREAMING_META_INTERVAL) { return; }
+
+        m_meta.numFrames = m_framesWritten;
+        FileUtils::WriteTifMetadata(m_dirPath, m_meta);
+        if (m_journal.IsOpen()) { Checkpoint(); }
+        else { m_sidecar.Flush(); }
+        m_lastMetaWrite = now;
+
+        if (m_raw.IsUnbuffered())
+        {
+            const auto stats = m_raw.GetWriteStats();
+            spdlog::debug("{}: {:.1f} MB/s, {} writes in flight, "
+                          "writer queue {}",
+                          m_stackPath, stats.throughputMBps,
+                          stats.queueDepth, m_queue.Size());
+        }
+        if (m_store.IsOpen())
+        {
+            const auto stats = m_store.GetStats();
+            spdlog::debug("{}: capture buffer holds {} frames in {} MB, "
+                          "ratio {:.2f}, room for {} more",
+                          m_stackPath, stats.numFrames,
+                          stats.usedBytes / (1024 * 1024),
+                          stats.compressionRatio, stats.framesLeft);
+        }
+    }
+
+    bool StackWriter::WriteFrame(const StackFrame& frame)
+    {
+        const auto numPixels = std::size_t{m_imageWidth} * m_imageHeight;
+        auto* pixels = reinterpret_cast<uint16_t*>(frame.slot);
+        if (m_packing != UNPACKED_16)
+        {
+            UnpackPixels(m_packing, frame.slot, numPixels, m_unpacked.data());
+            pixels = m_unpacked.data();
+        }
+
+        // Statistics of the saved pixels, taken before the slot is handed on
+        const auto record = PrepareFrame(pixels, frame.record);
+
+        bool written = false;
+        const auto timestamp =
+                record.bofTime > 0.0 ? record.bofTime : record.eofTime;
+        if (m_format == RAW && m_raw.GetPacking() == m_packing)
+        {
+            // The slot is laid out like the stack and goes out as it is
+            auto* slot = frame.slot;
+            if (m_packing != UNPACKED_16 && m_bSubtractBackground)
+            {
+                PackPixels(m_packing, pixels, numPixels, slot);
+            }
+            written = m_raw.SubmitFrame(slot, timestamp,
+                                        [this, slot] { m_pool->Release(slot); });
+        }
+        else
+        {
+            written = WritePixels(pixels, timestamp);
+            m_pool->Release(frame.slot);
+        }
+
+        if (written && m_sidecar.IsOpen()) { m_sidecar.Append(record); }
+        return written;
+    }
+
+    bool StackWriter::WriteBufferedFrame(uint16_t* pixels,
+                                         const FrameRecord& record)
+    {
+        const auto prepared = PrepareFrame(pixels, record);
+        const bool written = WritePixels(
+                pixels, prepared.bofTime > 0.0 ? prepared.bofTime
+                                               : prepared.eofTime);
+        if (written && m_sidecar.IsOpen()) { m_sidecar.Append(prepared); }
+        return written;
+    }
+
+    FrameRecord StackWriter::PrepareFrame(uint16_t* pixels,
+                                          const FrameRecord& record)
+    {
+        cv::Mat mat{m_imageHeight, m_imageWidth, CV_16U, pixels};
+        if (m_bSubtractBackground)
+        {
+            static const cv::Mat element = cv::getStructuringElement(
+                    cv::MORPH_ELLIPSE, cv::Size{15, 15});
+            cv::morphologyEx(mat, mat, cv::MORPH_TOPHAT, element,
+                             cv::Point{-1, -1});
+        }
+
+        auto prepared = record;
+        double minValue = 0.0;
+        double maxValue = 0.0;
+        cv::minMaxLoc(mat, &minValue, &maxValue);
+        prepared.minValue = static_cast<uint16_t>(minValue);
+        prepared.maxValue = static_cast<uint16_t>(maxValue);
+        prepared.meanValue = static_cast<float>(cv::mean(mat)[0]);
+        return prepared;
+    }
+
+    bool StackWriter::WritePixels(const uint16_t* pixels, double timestamp)
+    {
+        switch (m_format)
+        {
+            case RAW:
+                return m_raw.WriteFrame(pixels, timestamp);
+            case CHUNKED:
+                return m_chunked.WriteFrame(pixels);
+            default:
+                return m_tiff.WriteFrame(pixels);
+        }
+    }
+
+    bool StackWriter::Checkpoint()
+    {
+        // The sidecar only feeds the rebuilt statistics, it doesn't hold up a commit
+        if (m_sidecar.IsOpen()) { m_sidecar.Sync(); }
+
+        std::uint64_t numFrames = 0;
+        std::uint64_t dataEnd = 0;
+        std::uint64_t lastFrameOffset = 0;
+        bool synced = false;
+        switch (m_format)
+        {
+            case RAW:
+                synced = m_raw.Sync();
+                numFrames = m_raw.GetFramesWritten();
+                dataEnd = m_raw.GetDataEnd();
+                break;
+            case CHUNKED:
+                synced = m_chunked.Sync(numFrames);
+                break;
+            default:
+                synced = m_tiff.Sync();
+                numFrames = m_tiff.GetFramesWritten();
+                dataEnd = m_tiff.GetDataEnd();
+                lastFrameOffset = m_tiff.GetLastFrameOffset();
+                break;
+        }
+        // The journal never claims frames that aren't on disk
+        if (!synced) { return false; }
+        return m_journal.Commit(numFrames, dataEnd, lastFrameOffset);
+    }
+}// namespace prm
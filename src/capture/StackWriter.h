@@ -0,0 +1,281 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture/CaptureJournal.h"
+#include "capture/CompressedFrameStore.h"
+#include "capture/FramePool.h"
+#include "messages/BoundedQueue.h"
+#include "misc/Meta.h"
+#include "utils/ChunkedStack.h"
+#include "utils/FileUtils.h"
+#include "utils/FrameSidecar.h"
+#include "utils/RawStack.h"
+#include "utils/TiffStackWriter.h"
+
+namespace prm
+{
+    /// Interval between metadata rewrites while the capture is running
+    const std::chrono::seconds STREAMING_META_INTERVAL{1};
+
+    /// How a StackWriter lays out and writes a stack
+    struct StackOptions
+    {
+        /// DIR for stack.tif, RAW for stack.raw with time stamps, CHUNKED for
+        /// the stack.zarr directory
+        SAVE_FORMAT format = DIR;
+        /// Compression of the stack, replaced by one the format can hold
+        Compression compression = NO_COMPRESSION;
+        /// Pixels above it keep their surroundings with PATCHES compression
+        uint16_t patchThreshold = DEFAULT_PATCH_THRESHOLD;
+        /// Number of significant bits in each pixel
+        int bitDepth = 16;
+        /// Layout of the frames in the pool slots, uncompressed raw stacks
+        /// keep it on disk
+        PixelPacking packing = UNPACKED_16;
+        /// Apply top hat filtering before writing
+        bool subtractBackground = false;
+        /// Write uncompressed raw stacks straight from the pool slots, past
+        /// the OS file cache
+        bool unbuffered = false;
+        /// Sync the stack to disk every metadata interval and keep a journal,
+        /// so an interrupted capture can be recovered
+        bool journaled = false;
+        /// Size of a compressed buffer that holds the frames waiting to be
+        /// written, 0 leaves them in the pool slots
+        std::size_t compressedBufferBytes = 0;
+    };
+
+    /// Captured frame waiting to be written
+    struct StackFrame
+    {
+        /// Frame pool slot with the pixels
+        uint8_t* slot;
+        /// Capture conditions, the pixel statistics are filled in by the writer
+        FrameRecord record;
+    };
+
+    /**
+     * Writer stage that streams captured 16 bit frames to a tif, raw or chunked stack on disk
+     * Capture loops push filled frame pool slots, the writer thread appends them
+     * to the stack, keeps meta.json and the per frame sidecar up to date and
+     * returns the slots to the pool
+     * With a compressed buffer a compressor thread moves the frames from the
+     * slots into a CompressedFrameStore first, so the pool only stages a few
+     * of them and the writer decompresses each frame on its way to disk
+     */
+    class StackWriter
+    {
+    public:
+        StackWriter() = default;
+
+        StackWriter(const StackWriter&) = delete;
+        StackWriter& operator=(const StackWriter&) = delete;
+
+        /**
+         * Creates the capture directory and starts the writer thread
+         *
+         * @param dirPath Capture directory where the stack and meta.json go
+         * @param imageWidth Width of each image
+         * @param imageHeight Height of each image
+         * @param pool Frame pool the pushed slots come from
+         * @param meta Capture metadata known up front, the compression and
+         * patch threshold recorded in it come from the options
+         * @param options Format, compression and buffering of the stack
+         * @return true on success
+         */
+        bool Open(std::string_view dirPath, uint16_t imageWidth,
+                  uint16_t imageHeight, FramePool& pool,
+                  const TifStackMeta& meta, const StackOptions& options);
+
+        /**
+         * Hands a filled slot over to the writer thread
+         * Raw stacks store the start of readout as the frame time stamp, or
+         * the end of readout if there is no start
+         *
+         * @param slot Frame pool slot with a captured frame
+         * @param record Capture conditions of the frame for the sidecar
+         * @return false if the writer is not running, the slot is released then
+         */
+        bool Push(uint8_t* slot, const FrameRecord& record = {});
+
+        /**
+         * Waits until all pushed frames are written and stops the writer thread
+         *
+         * @param meta Final capture metadata, the frame count is filled in by the writer
+         * @return true if every pushed frame made it to disk
+         */
+        bool Close(const TifStackMeta& meta);
+
+        [[nodiscard]] bool IsOpen() const { return m_isOpen; }
+
+        /**
+         * Gives the layout capture loops have to fill the slots in
+         *
+         * @return Pixel packing of the pool slots
+         */
+        [[nodiscard]] PixelPacking GetPacking() const { return m_packing; }
+
+        /**
+         * Gives the number of frames waiting to be written
+         *
+         * @return Writer queue depth
+         */
+        [[nodiscard]] std::size_t GetQueueDepth() { return m_queue.Size(); }
+
+        /**
+         * Gives the number of frames written so far
+         *
+         * @return Written frame count
+         */
+        [[nodiscard]] uint32_t GetFramesWritten() const
+        {
+            return m_framesWritten;
+        }
+
+        /**
+         * Gives the disk metrics of an unbuffered raw stack
+         *
+         * @return Async writer metrics, all zero for other stacks
+         */
+        [[nodiscard]] AsyncWriteStats GetWriteStats()
+        {
+            return m_raw.GetWriteStats();
+        }
+
+        /**
+         * Gives the fill state of the compressed buffer
+         *
+         * @return Buffer statistics, all zero without a compressed buffer
+         */
+        [[nodiscard]] FrameStoreStats GetBufferStats()
+        {
+            return m_store.GetStats();
+        }
+
+        ~StackWriter() { Close(m_meta); }
+
+    private:
+        /**
+         * Writer thread function, drains the queue or the compressed buffer
+         * until it is closed
+         */
+        void Main();
+
+        /**
+         * Compressor thread function, moves the queued slots into the
+         * compressed buffer and closes it once the queue is drained
+         */
+        void CompressMain();
+
+        /**
+         * Rewrites meta.json and commits the journal every metadata interval
+         */
+        void UpdateProgress();
+
+        /**
+         * Appends one frame to the stack
+         * The slot goes back to the pool once its pixels are written, for
+         * unbuffered stacks that happens later on an I/O thread
+         *
+         * @param frame Frame to write
+         * @return true on success
+         */
+        bool WriteFrame(const StackFrame& frame);
+
+        /**
+         * Appends one frame taken out of the compressed buffer to the stack
+         *
+         * @param pixels Decompressed pixels, filtered in place
+         * @param record Capture conditions of the frame
+         * @return true on success
+         */
+        bool WriteBufferedFrame(uint16_t* pixels, const FrameRecord& record);
+
+        /**
+         * Subtracts the background if requested and fills in the pixel
+         * statistics of a frame
+         *
+         * @param pixels Pixels of the frame, filtered in place
+         * @param record Capture conditions of the frame
+         * @return Record with the statistics of the saved pixels
+         */
+        FrameRecord PrepareFrame(uint16_t* pixels, const FrameRecord& record);
+
+        /**
+         * Appends 16 bit pixels to the stack through the buffers of the
+         * stack writers
+         *
+         * @param pixels Pixels of the frame
+         * @param timestamp Time stamp for raw stacks
+         * @return true on success
+         */
+        bool WritePixels(const uint16_t* pixels, double timestamp);
+
+        /**
+         * Syncs the stack and the sidecar to disk and commits the synced
+         * state to the journal, in that order
+         *
+         * @return true if the commit went through
+         */
+        bool Checkpoint();
+
+        /// Capture directory path
+        std::string m_dirPath{};
+        /// Path of the stack inside the capture directory
+        std::string m_stackPath{};
+        /// DIR for a tif stack, RAW for a raw stack, CHUNKED for a chunked stack
+        SAVE_FORMAT m_format = DIR;
+        /// Compression of the stack, recorded in meta.json
+        Compression m_compression = NO_COMPRESSION;
+
+        uint16_t m_imageWidth = 0;
+        uint16_t m_imageHeight = 0;
+        bool m_bSubtractBackground = false;
+        /// Layout of the frames in the pool slots
+        PixelPacking m_packing = UNPACKED_16;
+        /// 16 bit copy of packed slots for the thread reading the slots
+        std::vector<uint16_t> m_unpacked{};
+
+        /// Pool the written slots are returned to
+        FramePool* m_pool = nullptr;
+        /// Slots waiting to be written
+        BoundedQueue<StackFrame> m_queue{};
+
+        /// Streaming writer of the tif stack
+        TiffStackWriter m_tiff{};
+        /// Writer of the raw stack
+        RawStackWriter m_raw{};
+        /// Writer of the chunked stack
+        ChunkedStackWriter m_chunked{};
+        /// Compressed frames between the pool and the writer thread
+        CompressedFrameStore m_store{};
+        /// Compressor of the frames going into m_store
+        StripCodec m_bufferCodec{};
+        /// Decompressed frame of m_store
+        std::vector<uint16_t> m_buffered{};
+        /// Writer of the per frame metadata
+        FrameSidecarWriter m_sidecar{};
+        /// Progress journal of journaled captures
+        CaptureJournal m_journal{};
+
+        /// Capture metadata, numFrames follows the written frame count
+        TifStackMeta m_meta{};
+        /// Time of the last meta.json rewrite
+        std::chrono::steady_clock::time_point m_lastMetaWrite{};
+
+        std::atomic<uint32_t> m_framesWritten = 0;
+        std::atomic<bool> m_isOpen = false;
+        std::atomic<bool> m_errorOccurred = false;
+
+        /// Thread that does the actual writing
+        std::jthread m_thread{};
+        /// Thread that fills the compressed buffer
+        std::jthread m_compressThread{};
+    };
+}// namespace prm
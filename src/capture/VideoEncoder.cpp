@@ -0,0 +1,140 @@
+#include <spdlog/spdlog.h>
+
+#include "VideoEncoder.h"
+
+namespace prm
+{
+    bool VideoEncoder::Open(std::string_view path, SAVE_FORMAT format,
+                            int imageWidth, int imageHeight, int channels,
+                            double fps, FramePool& pool)
+    {
+        using namespace OIIO;
+
+        if (m_isOpen)
+        {
+            spdlog::error("Video encoder is already open");
+            return false;
+        }
+
+        m_path = path;
+        m_format = format;
+        m_imageWidth = imageWidth;
+        m_imageHeight = imageHeight;
+        m_channels = channels;
+
+        switch (format)
+        {
+            case TIF:
+            {
+                m_out = ImageOutput::create(m_path);
+                if (!m_out) { return false; }
+                if (!m_out->supports("multiimage") ||
+                    !m_out->supports("appendsubimage"))
+                {
+                    spdlog::error(
+                            "Current plugin doesn't support tif subimages");
+                    m_out.reset();
+                    return false;
+                }
+                m_spec = ImageSpec(imageWidth, imageHeight, channels,
+                                   TypeDesc::UINT8);
+                break;
+            }
+            case MP4:
+            {
+                if (!m_videoWriter.open(
+                            m_path, cv::VideoWriter::fourcc('X', '2', '6', '4'),
+                            fps, cv::Size{imageWidth, imageHeight},
+                            channels == 3))
+                {
+                    spdlog::error("Couldn't open video writer for {}", m_path);
+                    return false;
+                }
+                break;
+            }
+            default:
+                spdlog::error("Undefined format");
+                return false;
+        }
+
+        m_pool = &pool;
+        m_queue.Reset(pool.GetNumSlots());
+        m_framesEncoded = 0;
+        m_errorOccurred = false;
+
+        m_isOpen = true;
+        m_thread = std::jthread(&VideoEncoder::Main, this);
+        return true;
+    }
+
+    bool VideoEncoder::Push(uint8_t* slot)
+    {
+        if (!m_isOpen || !m_queue.TryPush(slot))
+        {
+            m_pool->Release(slot);
+            return false;
+        }
+        return true;
+    }
+
+    bool VideoEncoder::Close()
+    {
+        if (!m_isOpen) { return true; }
+
+        m_queue.Close();
+        if (m_thread.joinable()) { m_thread.join(); }
+        m_isOpen = false;
+
+        if (m_out) { m_out->close(); }
+        m_out.reset();
+        m_videoWriter.release();
+
+        spdlog::info("{} frames encoded to {}, max encoder queue depth {} of "
+                     "{}",
+                     m_framesEncoded, m_path, m_queue.HighWatermark(),
+                     m_queue.Capacity());
+        return !m_errorOccurred;
+    }
+
+    void VideoEncoder::Main()
+    {
+        while (auto slot = m_queue.Pop())
+        {
+            if (!m_errorOccurred && EncodeFrame(*slot)) { ++m_framesEncoded; }
+            else { m_errorOccurred = true; }
+            m_pool->Release(*slot);
+        }
+    }
+
+    bool VideoEncoder::EncodeFrame(uint8_t* frame)
+    {
+        using namespace OIIO;
+
+        const cv::Mat mat{m_imageHeight, m_imageWidth,
+                          m_channels == 3 ? CV_8UC3 : CV_8UC1, frame};
+        if (m_format == MP4)
+        {
+            m_videoWriter.write(mat);
+            return true;
+        }
+
+        // Frames come in the native BGR order, tif wants RGB
+        const auto* pixels = mat.data;
+        if (m_channels == 3)
+        {
+            cv::cvtColor(mat, m_rgbFrame, cv::COLOR_BGR2RGB);
+            pixels = m_rgbFrame.data;
+        }
+
+        const auto mode = m_framesEncoded == 0 ? ImageOutput::Create
+                                               : ImageOutput::AppendSubimage;
+        if (!m_out->open(m_path, m_spec, mode) ||
+            !m_out->write_image(TypeDesc::UINT8, pixels))
+        {
+            spdlog::error("Failed writing frame {} to {}", m_framesEncoded,
+                          m_path);
+            return false;
+        }
+        return true;
+    }
+}// namespace prm
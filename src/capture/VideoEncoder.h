@@ -0,0 +1,141 @@
+#pragma once
+
+#include <OpenImageIO/imageio.h>
+#include <opencv2/opencv.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "capture/FramePool.h"
+#include "messages/BoundedQueue.h"
+#include "utils/FileUtils.h"
+
+namespace prm
+{
+    /**
+     * Encoder stage that streams captured 8 bit BGR or mono frames to an mp4
+     * video or a tif stack while the capture runs
+     * Capture loops push filled frame pool slots, the encoder thread encodes
+     * them in order and returns the slots to the pool. When the encoder falls
+     * behind the pool runs dry and the capture loop decides whether to wait
+     * for a slot or to drop the frame
+     */
+    class VideoEncoder
+    {
+    public:
+        VideoEncoder() = default;
+
+        VideoEncoder(const VideoEncoder&) = delete;
+        VideoEncoder& operator=(const VideoEncoder&) = delete;
+
+        /**
+         * Opens the output file and starts the encoder thread
+         *
+         * @param path Output file path
+         * @param format Output format, TIF or MP4
+         * @param imageWidth Width of each image
+         * @param imageHeight Height of each image
+         * @param channels 3 for BGR frames, 1 for mono frames
+         * @param fps Frame rate stored in the video
+         * @param pool Frame pool the pushed slots come from
+         * @return true on success
+         */
+        bool Open(std::string_view path, SAVE_FORMAT format, int imageWidth,
+                  int imageHeight, int channels, double fps, FramePool& pool);
+
+        /**
+         * Hands a filled slot over to the encoder thread
+         *
+         * @param slot Frame pool slot with a captured frame
+         * @return false if the encoder is not running, the slot is released then
+         */
+        bool Push(uint8_t* slot);
+
+        /**
+         * Waits until all pushed frames are encoded and stops the encoder thread
+         *
+         * @return true if every pushed frame was encoded
+         */
+        bool Close();
+
+        [[nodiscard]] bool IsOpen() const { return m_isOpen; }
+
+        /**
+         * Gives the number of frames waiting to be encoded
+         *
+         * @return Encoder queue depth
+         */
+        [[nodiscard]] std::size_t GetQueueDepth() { return m_queue.Size(); }
+
+        /**
+         * Gives the largest queue depth of the current file
+         *
+         * @return High watermark of the encoder queue depth
+         */
+        [[nodiscard]] std::size_t GetMaxQueueDepth()
+        {
+            return m_queue.HighWatermark();
+        }
+
+        [[nodiscard]] std::size_t GetQueueCapacity() const
+        {
+            return m_queue.Capacity();
+        }
+
+        /**
+         * Gives the number of frames encoded so far
+         *
+         * @return Encoded frame count
+         */
+        [[nodiscard]] uint32_t GetFramesEncoded() const
+        {
+            return m_framesEncoded;
+        }
+
+        ~VideoEncoder() { Close(); }
+
+    private:
+        /**
+         * Encoder thread function, drains the queue until it is closed
+         */
+        void Main();
+
+        /**
+         * Encodes one frame
+         *
+         * @param frame Frame data
+         * @return true on success
+         */
+        bool EncodeFrame(uint8_t* frame);
+
+        /// Output file path
+        std::string m_path{};
+        SAVE_FORMAT m_format = MP4;
+
+        int m_imageWidth = 0;
+        int m_imageHeight = 0;
+        int m_channels = 3;
+
+        /// Pool the encoded slots are returned to
+        FramePool* m_pool = nullptr;
+        /// Slots waiting to be encoded
+        BoundedQueue<uint8_t*> m_queue{};
+
+        /// Video writer for the mp4 output
+        cv::VideoWriter m_videoWriter{};
+        /// OIIO output kept open between tif subimages
+        std::unique_ptr<OIIO::ImageOutput> m_out{};
+        OIIO::ImageSpec m_spec{};
+        /// Channel swapped copy of the current frame for the tif output
+        cv::Mat m_rgbFrame{};
+
+        std::atomic<uint32_t> m_framesEncoded = 0;
+        std::atomic<bool> m_isOpen = false;
+        bool m_errorOccurred = false;
+
+        /// Thread that does the actual encoding
+        std::jthread m_thread{};
+    };
+}// namespace prm
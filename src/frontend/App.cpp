@@ -8,6 +8,7 @@ namespace prm
         while (m_window.isOpen())
         {
             m_dt = m_deltaClock.restart();
+            m_backend->UpdateDisplay();
             m_gui.Update();
             m_renderer.Render();
             m_gui.Render();
@@ -32,7 +32,8 @@ namespace prm
               m_selectedBackend(PVCAM),
               m_gui(m_window, m_dt, m_backend, m_selectedBackend,
                     m_videoProcessor, m_imageViewer, log, m_currentTexture,
-                    m_textureMutex),
+                    m_textureMutex, m_auxBackend, m_auxTexture,
+                    m_auxTextureMutex),
               m_videoProcessor(m_currentTexture, m_textureMutex),
               m_imageViewer(m_backend, m_currentTexture, m_textureMutex)
         {
@@ -80,5 +81,13 @@ namespace prm
         sf::Texture m_currentTexture;
         /// mutex for texture synchronisation
         std::mutex m_textureMutex;
+
+        /// SFML Texture the auxiliary webcam draws to
+        sf::Texture m_auxTexture;
+        /// mutex for auxiliary texture synchronisation
+        std::mutex m_auxTextureMutex;
+        /// unique_ptr to the webcam backend running next to the main one,
+        /// declared after its texture so it stops capturing first
+        std::unique_ptr<Backend> m_auxBackend;
     };
 }// namespace prm
\ No newline at end of file
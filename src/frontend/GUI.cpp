@@ -5,10 +5,13 @@
 #include <range/v3/all.hpp>
 
 #include "../../vendor/ImGuiFileDialog/ImGuiFileDialog.h"
+#include "capture/CaptureJournal.h"
 #include "frontend/GUI.h"
 #include "misc/Meta.h"
+#include "utils/ChunkedStack.h"
 #include "utils/FileUtils.h"
 #include "utils/MySerial.h"
+#include "utils/StripCodec.h"
 
 //TODO Disabled blocks
 namespace prm
@@ -109,6 +112,14 @@ namespace prm
                 }
             }
         }
+
+        // Captures cut short by a crash are finalised before anything else
+        if (const auto numRecovered =
+                    CaptureJournal::RecoverAll(m_backend->GetDirPath()))
+        {
+            spdlog::info("Recovered {} unfinished captures in {}", numRecovered,
+                         m_backend->GetDirPath());
+        }
     }
 
     void GUI::PollEvents()
@@ -250,6 +261,10 @@ namespace prm
                                     &m_bShowSerial))
                 {
                 }
+                if (ImGui::MenuItem("Webcam Channel", nullptr,
+                                    &m_bShowWebcamChannel))
+                {
+                }
                 if (ImGui::MenuItem("App Log", nullptr, &m_bShowAppLog)) {}
                 ImGui::EndMenu();
             }
@@ -259,6 +274,7 @@ namespace prm
             {
                 ImGui::RadioButton("OpenCV", (int*) &m_selectedBackend, 0);
                 ImGui::RadioButton("PVCam", (int*) &m_selectedBackend, 1);
+                ImGui::RadioButton("Simulated", (int*) &m_selectedBackend, 2);
                 ImGui::EndMenu();
             }
 
@@ -267,12 +283,18 @@ namespace prm
                 switch (m_selectedBackend)
                 {
                     case OPENCV:
+                        // Both would fight over the same webcam
+                        m_auxBackend.reset();
                         m_backend = std::make_unique<OpencvBackend>(m_backend);
                         break;
                     case PVCAM:
                         m_backend = std::make_unique<PhotometricsBackend>(
                                 m_backend);
                         break;
+                    case SIMULATED:
+                        m_backend = std::make_unique<SimulatedBackend>(
+                                m_backend);
+                        break;
                 }
             }
 
@@ -321,16 +343,128 @@ namespace prm
             ImGui::Separator();
 
             static auto captureFormat = DIR;
-            if (m_selectedBackend != PVCAM)
+            if (m_selectedBackend == OPENCV)
             {
-                ImGui::RadioButton("tif", (int*) &captureFormat, 0);
+                if (captureFormat != TIF && captureFormat != MP4)
+                {
+                    captureFormat = TIF;
+                }
+                ImGui::RadioButton("tif", (int*) &captureFormat, TIF);
+                ImGui::SameLine();
+                ImGui::RadioButton("mp4", (int*) &captureFormat, MP4);
+            }
+            else
+            {
+                if (captureFormat != DIR && captureFormat != RAW &&
+                    captureFormat != CHUNKED)
+                {
+                    captureFormat = DIR;
+                }
+                ImGui::RadioButton("tif stack", (int*) &captureFormat, DIR);
                 ImGui::SameLine();
-                ImGui::RadioButton("mp4", (int*) &captureFormat, 1);
+                ImGui::RadioButton("raw stack", (int*) &captureFormat, RAW);
+                if (ImGui::IsItemHovered())
+                {
+                    ImGui::SetTooltip("Page aligned frames with time stamps, opens instantly in the image viewer\nConvert to tif from the image viewer");
+                }
+                ImGui::SameLine();
+                ImGui::RadioButton("chunked stack", (int*) &captureFormat,
+                                   CHUNKED);
+                if (ImGui::IsItemHovered())
+                {
+                    ImGui::SetTooltip("Zarr directory of compressed chunks written on several cores\nSurvives a crash up to the last chunk, opens in Python with zarr");
+                }
+
+                // lz4 only serves the capture buffer and isn't offered here
+                const char* compressionItems[] = {"none", "deflate", "zstd",
+                                                  "temporal", "patches"};
+                const Compression compressionValues[] = {
+                        NO_COMPRESSION, DEFLATE, ZSTD, TEMPORAL, PATCHES};
+                int compression = static_cast<int>(
+                        std::find(std::begin(compressionValues),
+                                  std::end(compressionValues),
+                                  m_backend->m_stackCompression) -
+                        std::begin(compressionValues));
+                ImGui::PushItemWidth(m_inputFieldWidth);
+                if (ImGui::Combo("Compression", &compression, compressionItems,
+                                 IM_ARRAYSIZE(compressionItems)))
+                {
+                    if (StripCodec::IsSupported(compressionValues[compression]))
+                    {
+                        m_backend->m_stackCompression =
+                                compressionValues[compression];
+                    }
+                    else { spdlog::warn("zstd is not enabled in this build"); }
+                }
+                ImGui::PopItemWidth();
+                if (ImGui::IsItemHovered())
+                {
+                    ImGui::SetTooltip("Compression of saved stacks, frames are compressed on several cores\nMostly dark frames shrink several times, the choice is recorded in meta.json\nTemporal compresses each frame against a running background, best for static scenes, raw stacks only\nPatches is lossy, it keeps only the surroundings of pixels above the threshold on a background saved now and then, raw stacks only");
+                }
+                if (m_backend->m_stackCompression == PATCHES)
+                {
+                    ImGui::PushItemWidth(m_inputFieldWidth);
+                    if (ImGui::InputInt("Patch threshold",
+                                        &m_backend->m_patchThreshold))
+                    {
+                        m_backend->m_patchThreshold =
+                                std::clamp(m_backend->m_patchThreshold, 0,
+                                           65535);
+                    }
+                    ImGui::PopItemWidth();
+                    if (ImGui::IsItemHovered())
+                    {
+                        ImGui::SetTooltip("Pixels brighter than this keep a patch of their surroundings,\nthe rest of each frame is replaced by the background");
+                    }
+                }
+                ImGui::Checkbox("Crash safe saving",
+                                &m_backend->m_bJournaledSaving);
+                if (ImGui::IsItemHovered())
+                {
+                    ImGui::SetTooltip("Sync saved frames to disk every second and keep a journal\nA capture cut short by a crash is finalised on the next start");
+                }
+                ImGui::Checkbox("12 bit packing", &m_backend->m_bPackedSaving);
+                if (ImGui::IsItemHovered())
+                {
+                    ImGui::SetTooltip("Keep frames of up to 12 bits packed in the capture buffer and uncompressed raw stacks\nFits a third more frames in RAM and writes a quarter less, readers unpack them");
+                }
+                if (captureFormat == RAW &&
+                    m_backend->m_stackCompression == NO_COMPRESSION)
+                {
+                    ImGui::Checkbox("Bypass file cache",
+                                    &m_backend->m_bUnbufferedSaving);
+                    if (ImGui::IsItemHovered())
+                    {
+                        ImGui::SetTooltip("Write frames straight from the capture buffer to disk, several at once\nLong captures don't push other data out of RAM, write rates are logged");
+                    }
+                }
             }
 
             static bool save = false;
             if (m_selectedBackend == PVCAM)
             {
+                auto* pvcamBackend =
+                        dynamic_cast<PhotometricsBackend*>(m_backend.get());
+                if (pvcamBackend->m_isPvcamInitialized &&
+                    pvcamBackend->GetNumCameras() > 1)
+                {
+                    int camIndex = pvcamBackend->GetCurrentCameraIndex();
+                    const bool capturing = pvcamBackend->IsCapturing();
+                    ImGui::PushItemWidth(m_inputFieldWidth);
+                    if (capturing) { ImGui::BeginDisabled(); }
+                    if (ImGui::InputInt("Main camera", &camIndex))
+                    {
+                        pvcamBackend->SetCurrentCameraIndex(
+                                static_cast<uns16>(std::max(camIndex, 0)));
+                    }
+                    if (capturing) { ImGui::EndDisabled(); }
+                    ImGui::PopItemWidth();
+                    if (ImGui::IsItemHovered())
+                    {
+                        ImGui::SetTooltip("Camera shown in the main viewport, the settings below apply to it\nAll open cameras capture together, the main camera is fixed while they do");
+                    }
+                }
+
                 ImGui::BeginGroup();
 
                 const char* items[] = {"1x1", "2x2"};
@@ -406,6 +540,88 @@ namespace prm
                 ImGui::EndGroup();
             }
 
+            if (m_selectedBackend == SIMULATED)
+            {
+                auto* ctx = dynamic_cast<SimulatedBackend*>(m_backend.get())
+                                    ->GetCameraContext();
+                const bool capturing = m_backend->IsCapturing();
+
+                ImGui::BeginGroup();
+                ImGui::PushItemWidth(m_inputFieldWidth);
+                if (capturing) { ImGui::BeginDisabled(); }
+                ImGui::InputInt("Width", &ctx->width, 0);
+                ImGui::InputInt("Height", &ctx->height, 0);
+                ImGui::SliderInt("Bit depth", &ctx->bitDepth, 8, 16);
+                ImGui::SliderInt("Frame rate", &ctx->framerate, 1, 2000);
+                ImGui::EndGroup();
+                ImGui::SameLine();
+
+                ImGui::BeginGroup();
+                ImGui::SliderInt("Particles", &ctx->numParticles, 0, 1000);
+                ImGui::SliderFloat("Diffusion, px", &ctx->diffusion, 0.f, 10.f);
+                ImGui::SliderFloat("Spot size, px", &ctx->spotSigma, 0.5f, 5.f);
+                ImGui::SliderFloat("Noise std", &ctx->noiseStd, 0.f, 500.f);
+                if (capturing) { ImGui::EndDisabled(); }
+                ImGui::PopItemWidth();
+                ImGui::EndGroup();
+            }
+
+            if (m_selectedBackend == OPENCV)
+            {
+                auto* ctx = dynamic_cast<OpencvBackend*>(m_backend.get())
+                                    ->GetCameraContext();
+                const bool capturing = m_backend->IsCapturing();
+
+                ImGui::PushItemWidth(m_inputFieldWidth);
+                if (capturing) { ImGui::BeginDisabled(); }
+                const char* sources[] = {"Device", "Video file",
+                                         "Image sequence"};
+                ImGui::Combo("Source", (int*) &ctx->sourceType, sources,
+                             IM_ARRAYSIZE(sources));
+                ImGui::SameLine();
+                if (ctx->sourceType == CV_DEVICE)
+                {
+                    ImGui::InputInt("Device index", &ctx->deviceIndex);
+                    ctx->deviceIndex = std::max(ctx->deviceIndex, 0);
+                }
+                else
+                {
+                    ImGui::InputTextWithHint("Source path",
+                                             ctx->sourceType == CV_VIDEO_FILE
+                                                     ? "video.mp4"
+                                                     : "frame_%04d.png",
+                                             &ctx->sourcePath);
+                }
+                if (ImGui::IsItemHovered())
+                {
+                    ImGui::SetTooltip("Takes effect on the next Init Camera");
+                }
+                bool uncapped = ctx->framerate == 0;
+                if (ImGui::Checkbox("Uncapped", &uncapped))
+                {
+                    ctx->framerate = uncapped ? 0 : CV_DEFAULT_FPS;
+                }
+                if (!uncapped)
+                {
+                    ImGui::SameLine();
+                    ImGui::SliderInt("Frame rate", &ctx->framerate, 1, 240);
+                }
+                if (capturing) { ImGui::EndDisabled(); }
+                ImGui::PopItemWidth();
+                if (capturing)
+                {
+                    ImGui::Text("Delivered: %.1f fps", ctx->deliveredFps.load());
+                }
+                if (capturing && ctx->encoder.IsOpen())
+                {
+                    ImGui::SameLine();
+                    ImGui::Text("Encoder queue: %zu / %zu (max %zu)",
+                                ctx->encoder.GetQueueDepth(),
+                                ctx->encoder.GetQueueCapacity(),
+                                ctx->encoder.GetMaxQueueDepth());
+                }
+            }
+
             ImGui::Dummy({0.f, 10.f});
             ImGui::Text("File saving");
             ImGui::Separator();
@@ -434,6 +650,7 @@ namespace prm
                     }
 
                     m_backend->SetDirPath(dirPath);
+                    if (m_auxBackend) { m_auxBackend->SetDirPath(dirPath); }
                     m_videoSavePath = dirPath;
                     spdlog::info("Saving to: {}", dirPath);
                 }
@@ -445,6 +662,39 @@ namespace prm
             helpString.append(m_backend->GetDirPath());
             HelpMarker(helpString.c_str());
 
+            if (m_selectedBackend != OPENCV)
+            {
+                ImGui::PushItemWidth(m_inputFieldWidth);
+                if (ImGui::InputInt("Capture buffer, MB",
+                                    &m_backend->m_captureBudgetMb, 0))
+                {
+                    m_backend->m_captureBudgetMb =
+                            std::max(m_backend->m_captureBudgetMb, 1);
+                }
+                if (ImGui::IsItemHovered())
+                {
+                    ImGui::SetTooltip("RAM for captured frames waiting to be written to disk");
+                }
+                ImGui::SameLine();
+                ImGui::Checkbox("Compressed",
+                                &m_backend->m_bCompressedBuffer);
+                if (ImGui::IsItemHovered())
+                {
+                    ImGui::SetTooltip("Keep the waiting frames compressed in the capture buffer, on several cores\nSparse frames take a fraction of the RAM, so the disk can fall behind for much longer");
+                }
+                if (ImGui::InputInt("Preview every Nth frame",
+                                    &m_backend->m_previewEveryNth))
+                {
+                    m_backend->m_previewEveryNth =
+                            std::max(m_backend->m_previewEveryNth, 1);
+                }
+                if (ImGui::IsItemHovered())
+                {
+                    ImGui::SetTooltip("Display only every Nth captured frame,\nsaving still gets every frame");
+                }
+                ImGui::PopItemWidth();
+            }
+
             ImGui::Dummy({0.f, 10.f});
             ImGui::Text("Capture control");
             ImGui::Separator();
@@ -452,6 +702,10 @@ namespace prm
             if (ImGui::Button("Live capture", {200.f, 40.f}))
             {
                 m_backend->LiveCapture(captureFormat, save);
+                if (m_auxBackend && m_bAuxFollowsMain)
+                {
+                    m_auxBackend->LiveCapture(m_auxCaptureFormat, m_bAuxSave);
+                }
             }
             if (ImGui::IsItemHovered())
             {
@@ -462,6 +716,11 @@ namespace prm
             if (ImGui::Button("Sequence capture", {200.f, 40.f}))
             {
                 m_backend->SequenceCapture(nFrames, captureFormat, save);
+                if (m_auxBackend && m_bAuxFollowsMain)
+                {
+                    m_auxBackend->SequenceCapture(nFrames, m_auxCaptureFormat,
+                                                  m_bAuxSave);
+                }
             }
             if (ImGui::IsItemHovered())
             {
@@ -475,6 +734,10 @@ namespace prm
             if (ImGui::Button("Terminate capture", {200.f, 40.f}))
             {
                 m_backend->TerminateCapture();
+                if (m_auxBackend && m_bAuxFollowsMain)
+                {
+                    m_auxBackend->TerminateCapture();
+                }
             }
             if (ImGui::IsItemHovered())
             {
@@ -500,6 +763,8 @@ namespace prm
         if (m_bShowAppLog) ShowAppLog();
         if (m_bShowHelp) ShowHelp();
         if (m_bShowSerial) ShowSerialPort();
+        if (m_bShowWebcamChannel) ShowWebcamChannel();
+        if (m_selectedBackend == PVCAM) ShowCameraViewports();
 
 #ifndef NDEBUG
         ImGui::ShowDemoWindow();
@@ -571,7 +836,7 @@ namespace prm
                     m_videoLoadPath =
                             ImGuiFileDialog::Instance()->GetCurrentPath();
                     isFileLoaded = true;
-                    spdlog::info("Tif file selected: {}", videoPath);
+                    spdlog::info("Stack file selected: {}", videoPath);
 
                     const auto metaPath =
                             std::string{m_videoLoadPath + "\\meta.json"};
@@ -930,7 +1195,9 @@ namespace prm
                     "1. Choose the backend in the Backend section:\n"
                     "   - OpenCV: Captures images from device's webcam\n"
                     "   - PVCam: Captures images from a connected Teledyne "
-                    "camera\n\n"
+                    "camera\n"
+                    "   - Simulated: Generates frames of Brownian particles, "
+                    "no camera needed\n\n"
                     "2. Use the Camera Buttons to capture images:\n"
                     "   - First initialize the camera with the Init button if "
                     "autoinit failed\n"
@@ -938,10 +1205,17 @@ namespace prm
                     "   - Choose the image acquisition mode and specify number "
                     "of frames if necessary\n"
                     "       - For pvcam, Live Capture yields better fps \n"
+                    "       - For pvcam, all connected cameras capture "
+                    "together,\n"
+                    "         the Main camera field picks the one shown in "
+                    "the main view\n"
                     "   - Stop the ongoing image acquisition with Terminate "
                     "Capture\n\n"
                     "3. Use the Video Processor module from the Windows menu \n"
-                    "to analyze the captured image stacks with trackpy\n");
+                    "to analyze the captured image stacks with trackpy\n\n"
+                    "4. Use the Webcam Channel from the Windows menu to record "
+                    "the webcam\n"
+                    "alongside the main camera\n");
         }
         ImGui::End();
     }
@@ -952,10 +1226,9 @@ namespace prm
                 ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize;
         if (ImGui::Begin("Image Info", &m_bShowImageInfo, window_flags))
         {
-            if (m_selectedBackend == PVCAM)
+            if (m_selectedBackend != OPENCV)
             {
-                auto* backend =
-                        dynamic_cast<PhotometricsBackend*>(m_backend.get());
+                auto* backend = m_backend.get();
 
                 ImGui::Text("Brightness range control");
                 ImGui::Separator();
@@ -986,6 +1259,18 @@ namespace prm
                              IM_ARRAYSIZE(items));
                 ImGui::PopItemWidth();
 
+                ImGui::PushItemWidth(m_inputFieldWidth);
+                const char* curves[] = {"Linear", "Gamma", "Log"};
+                ImGui::Combo("Display curve", (int*) &backend->m_displayCurve,
+                             curves, IM_ARRAYSIZE(curves));
+                if (backend->m_displayCurve == GAMMA)
+                {
+                    ImGui::SameLine();
+                    ImGui::SliderFloat("Gamma", &backend->m_displayGamma, 0.2f,
+                                       5.f);
+                }
+                ImGui::PopItemWidth();
+
                 if (ImGui::Button("Full Scale"))
                 {
                     backend->m_minDisplayValue = 0;
@@ -996,22 +1281,88 @@ namespace prm
                     ImGui::SetTooltip("Set brightness limits to the whole range\n of the current bit depth");
                 }
 
+                FrameStats stats{};
+                {
+                    std::scoped_lock lock{m_textureMutex};
+                    stats = backend->m_frameStats;
+                }
+
+                static float lowPercentile = 0.1f;
+                static float highPercentile = 99.9f;
                 ImGui::SameLine();
-                if (ImGui::Button("Auto stretch"))
+                if (ImGui::Button("Auto stretch") && stats.numPixels > 0)
                 {
-                    backend->m_minDisplayValue = backend->m_minCurrentValue;
-                    backend->m_maxDisplayValue = backend->m_maxCurrentValue;
+                    backend->m_minDisplayValue =
+                            stats.Percentile(lowPercentile / 100.0);
+                    backend->m_maxDisplayValue =
+                            stats.Percentile(highPercentile / 100.0);
                 }
                 if (ImGui::IsItemHovered())
                 {
-                    ImGui::SetTooltip("Stretch the brightness limits to the values on the frame");
+                    ImGui::SetTooltip("Stretch the brightness limits to the percentiles of the frame values");
                 }
+                ImGui::SameLine();
+                ImGui::PushItemWidth(m_inputFieldWidth);
+                ImGui::DragFloatRange2("Percentiles", &lowPercentile,
+                                       &highPercentile, 0.05f, 0.f, 100.f,
+                                       "Low: %.2f%%", "High: %.2f%%");
+                ImGui::PopItemWidth();
 
                 ImGui::Dummy({0.f, 5.f});
                 ImGui::Text("Current frame values");
                 ImGui::Separator();
                 ImGui::TextColored({0.f, 0.7, 0.f, 1.f}, "Min: %hu Max: %hu", backend->m_minCurrentValue,
                             backend->m_maxCurrentValue);
+                ImGui::SameLine();
+                ImGui::Text("Mean: %.1f", stats.mean);
+                ImGui::SameLine();
+                ImGui::TextColored(stats.numSaturated > 0
+                                           ? ImVec4{0.9f, 0.2f, 0.2f, 1.f}
+                                           : ImVec4{0.f, 0.7f, 0.f, 1.f},
+                                   "Saturated: %llu",
+                                   static_cast<unsigned long long>(
+                                           stats.numSaturated));
+
+                const auto droppedFrames = backend->m_droppedFrames.load();
+                ImGui::TextColored(droppedFrames > 0
+                                           ? ImVec4{0.9f, 0.2f, 0.2f, 1.f}
+                                           : ImVec4{0.f, 0.7f, 0.f, 1.f},
+                                   "Dropped frames: %llu",
+                                   static_cast<unsigned long long>(
+                                           droppedFrames));
+                ImGui::SameLine();
+                ImGui::Text("Lag: %u frames", backend->m_frameLag.load());
+                const auto bufferRatio = backend->m_bufferRatio.load();
+                if (bufferRatio > 0.f)
+                {
+                    ImGui::SameLine();
+                    ImGui::Text("Buffer: %.1fx, room for %llu frames",
+                                bufferRatio,
+                                static_cast<unsigned long long>(
+                                        backend->m_bufferFramesLeft.load()));
+                }
+
+                // Histogram bins squeezed into fewer bars, log scaled so the
+                // particles stay visible next to the background peak
+                const std::size_t numBars = 256;
+                const std::size_t binsPerBar = HISTOGRAM_BINS / numBars;
+                static std::array<float, numBars> bars{};
+                for (std::size_t bar = 0; bar < numBars; ++bar)
+                {
+                    uint64_t count = 0;
+                    for (std::size_t bin = bar * binsPerBar;
+                         bin < (bar + 1) * binsPerBar; ++bin)
+                    {
+                        count += stats.histogram[bin];
+                    }
+                    bars[bar] = std::log10(1.f + static_cast<float>(count));
+                }
+                const auto histogramLabel = fmt::format(
+                        "0 - {}", (HISTOGRAM_BINS << stats.binShift) - 1);
+                ImGui::PlotHistogram("##Histogram", bars.data(),
+                                     static_cast<int>(bars.size()), 0,
+                                     histogramLabel.c_str(), 0.f, FLT_MAX,
+                                     {400.f, 100.f});
             }
         }
         ImGui::End();
@@ -1033,7 +1384,7 @@ namespace prm
             if (ImGui::Button("Choose video file"))
             {
                 ImGuiFileDialog::Instance()->OpenDialog(
-                        "ChooseFileDlgKeyViewer", "Choose File", ".tif",
+                        "ChooseFileDlgKeyViewer", "Choose File", ".tif,.raw,.zarray",
                         m_videoLoadPath.empty() ? "." : m_videoLoadPath);
             }
 
@@ -1050,7 +1401,7 @@ namespace prm
                         return;
                     }
 
-                    spdlog::info("Tif file selected: {}", videoPath);
+                    spdlog::info("Stack file selected: {}", videoPath);
                 }
 
                 ImGuiFileDialog::Instance()->Close();
@@ -1124,9 +1475,10 @@ namespace prm
             {
                 const auto pathStd = std::filesystem::path{videoPath};
 
+                // Modified stacks are always saved as tif
                 const auto savePath = fmt::format(
-                        "{}\\{}_mod{}", pathStd.parent_path().string(),
-                        pathStd.stem().string(), pathStd.extension().string());
+                        "{}\\{}_mod.tif", pathStd.parent_path().string(),
+                        pathStd.stem().string());
 
                 m_imageViewer.SaveImage(savePath);
             }
@@ -1134,6 +1486,128 @@ namespace prm
             {
                 ImGui::SetTooltip("Save the modified stack");
             }
+
+            ImGui::SameLine();
+            if (ImGui::Button("Convert") && !videoPath.empty())
+            {
+                m_imageViewer.ConvertStack(videoPath);
+            }
+            if (ImGui::IsItemHovered())
+            {
+                ImGui::SetTooltip("Convert the chosen tif stack to a raw stack or the other way round\nChunked stacks are converted to tif");
+            }
+
+            static float exportFps = EXPORT_DEFAULT_FPS;
+            auto pathStd = std::filesystem::path{videoPath};
+            // Chunked stacks are picked by the array description inside them
+            if (pathStd.filename() == CHUNKED_STACK_ARRAY_FILE)
+            {
+                pathStd = pathStd.parent_path();
+            }
+            const auto exportPath =
+                    fmt::format("{}\\{}.mp4", pathStd.parent_path().string(),
+                                pathStd.stem().string());
+            ImGui::SameLine();
+            if (ImGui::Button("Export mp4") && m_imageViewer.m_isImageLoaded)
+            {
+                m_imageViewer.ExportMp4(exportPath, exportFps);
+            }
+            if (ImGui::IsItemHovered())
+            {
+                ImGui::SetTooltip("Export the loaded frames with the current brightness settings");
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Export whole file") && !videoPath.empty())
+            {
+                m_imageViewer.ExportFileToMp4(videoPath, exportPath, exportFps);
+            }
+            if (ImGui::IsItemHovered())
+            {
+                ImGui::SetTooltip("Export every frame of the chosen stack without loading it\nSegments are encoded on all cores and joined with ffmpeg");
+            }
+            ImGui::SameLine();
+            ImGui::PushItemWidth(m_inputFieldWidth);
+            ImGui::DragFloat("Export fps", &exportFps, 1.f, 1.f, 1000.f,
+                             "%.0f");
+            ImGui::PopItemWidth();
+        }
+        ImGui::End();
+    }
+
+    void GUI::ShowCameraViewports()
+    {
+        auto* backend = dynamic_cast<PhotometricsBackend*>(m_backend.get());
+        if (!backend || !backend->m_isPvcamInitialized) { return; }
+
+        for (std::size_t i = 0; i < backend->GetNumCameras(); ++i)
+        {
+            auto* ctx = backend->GetCameraContext(i);
+            if (i == backend->GetCurrentCameraIndex() || !ctx->isCamOpen)
+            {
+                continue;
+            }
+
+            const auto title = fmt::format("Camera {} - {}", i, ctx->camName);
+            if (ImGui::Begin(title.c_str(), nullptr,
+                             ImGuiWindowFlags_HorizontalScrollbar))
+            {
+                // Updated on this thread in UpdateDisplay, no lock needed
+                ImGui::Image(ctx->displayTexture);
+            }
+            ImGui::End();
+        }
+    }
+
+    void GUI::ShowWebcamChannel()
+    {
+        if (ImGui::Begin("Webcam Channel", &m_bShowWebcamChannel))
+        {
+            if (m_selectedBackend == OPENCV)
+            {
+                ImGui::Text("The main backend already uses the webcam");
+            }
+            else
+            {
+                bool enabled = m_auxBackend != nullptr;
+                if (ImGui::Checkbox("Enable webcam", &enabled))
+                {
+                    if (enabled)
+                    {
+                        m_auxBackend = std::make_unique<OpencvBackend>(
+                                m_backend, m_auxTexture, m_auxTextureMutex);
+                    }
+                    else { m_auxBackend.reset(); }
+                }
+            }
+
+            if (m_auxBackend)
+            {
+                ImGui::RadioButton("tif", (int*) &m_auxCaptureFormat, 0);
+                ImGui::SameLine();
+                ImGui::RadioButton("mp4", (int*) &m_auxCaptureFormat, 1);
+                ImGui::SameLine();
+                ImGui::Checkbox("Save to file", &m_bAuxSave);
+                ImGui::SameLine();
+                ImGui::Checkbox("Follow main capture", &m_bAuxFollowsMain);
+                if (ImGui::IsItemHovered())
+                {
+                    ImGui::SetTooltip("Start and stop together with the main camera");
+                }
+
+                if (ImGui::Button("Live capture"))
+                {
+                    m_auxBackend->LiveCapture(m_auxCaptureFormat, m_bAuxSave);
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Terminate capture"))
+                {
+                    m_auxBackend->TerminateCapture();
+                }
+
+                ImGui::Separator();
+                std::scoped_lock lock{m_auxTextureMutex};
+                ImGui::Image(m_auxTexture);
+            }
         }
         ImGui::End();
     }
@@ -25,7 +25,9 @@ namespace prm
         GUI(sf::RenderWindow& window, sf::Time& dt,
             std::unique_ptr<Backend>& backend, BackendOption& curr,
             VideoProcessor& videoproc, ImageViewer& imageViewer, Log& log,
-            sf::Texture& texture, std::mutex& mutex)
+            sf::Texture& texture, std::mutex& mutex,
+            std::unique_ptr<Backend>& auxBackend, sf::Texture& auxTexture,
+            std::mutex& auxMutex)
             : m_window(window), m_dt(dt), m_frameTimeQueue(),
               m_bShowMainMenuBar(true), m_bShowFrameInfoOverlay(false),
               m_bShowAppLog(true), m_bShowVideoProcessor(false),
@@ -35,7 +37,9 @@ namespace prm
               m_selectedBackend(curr), m_imageViewer(imageViewer),
               m_videoProcessor(videoproc), m_appLog(log), m_hubballiFont(),
               m_currentTexture(texture), m_textureMutex(mutex),
-              m_bShowSerial(false)
+              m_bShowSerial(false), m_auxBackend(auxBackend),
+              m_auxTexture(auxTexture), m_auxTextureMutex(auxMutex),
+              m_bShowWebcamChannel(false)
         {
         }
 
@@ -112,6 +116,16 @@ namespace prm
          */
         void ShowSerialPort();
 
+        /**
+         * Draws the viewports of the PVCAM cameras not shown in the main viewport
+         */
+        void ShowCameraViewports();
+
+        /**
+         * Draws the controls and the image of the webcam running next to the main backend
+         */
+        void ShowWebcamChannel();
+
         /**
          * Draws window with Region Of Interes selection sliders
          *
@@ -196,6 +210,20 @@ namespace prm
         bool m_bShowImageViewer;
         bool m_bShowHelp;
         bool m_bShowSerial;
+        bool m_bShowWebcamChannel;
+
+        /// unique_ptr to the webcam backend running next to the main one
+        std::unique_ptr<Backend>& m_auxBackend;
+        /// Texture the auxiliary webcam draws to
+        sf::Texture& m_auxTexture;
+        /// Mutex for auxiliary texture synchronisation
+        std::mutex& m_auxTextureMutex;
+        /// Save format of the auxiliary webcam
+        SAVE_FORMAT m_auxCaptureFormat = MP4;
+        /// Whether the auxiliary webcam saves its captures
+        bool m_bAuxSave = false;
+        /// Whether the auxiliary webcam starts and stops with the main camera
+        bool m_bAuxFollowsMain = true;
 
         /// Width for input fields in the GUI
         const uint16_t m_inputFieldWidth = 150;
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace prm
+{
+    /**
+     * Thread safe queue with a fixed capacity for producer/consumer pipelines
+     * Producers never block, consumers wait until an item arrives or the queue is closed
+     *
+     * @tparam T Item type of the queue
+     */
+    template<typename T>
+    class BoundedQueue
+    {
+    public:
+        explicit BoundedQueue(std::size_t capacity = 1) : m_capacity(capacity)
+        {
+        }
+
+        /**
+         * Tries to put an item into the queue
+         *
+         * @param item Item to put
+         * @return false if the queue is full or closed
+         */
+        bool TryPush(T item);
+
+        /**
+         * Waits for an item to arrive
+         *
+         * @return The oldest item or std::nullopt once the queue is closed and drained
+         */
+        [[nodiscard]] std::optional<T> Pop();
+
+        /**
+         * Wakes up the consumers, letting them drain the remaining items and stop
+         */
+        void Close();
+
+        /**
+         * Reopens the queue with a new capacity, dropping any remaining items
+         *
+         * @param capacity Maximum number of items in the queue
+         */
+        void Reset(std::size_t capacity);
+
+        /**
+         * Gives the current number of items in the queue
+         *
+         * @return Number of items in the queue
+         */
+        [[nodiscard]] std::size_t Size();
+
+        /**
+         * Gives the largest number of items the queue has held since the last reset
+         *
+         * @return High watermark of the queue depth
+         */
+        [[nodiscard]] std::size_t HighWatermark();
+
+        [[nodiscard]] std::size_t Capacity() const { return m_capacity; }
+
+    private:
+        /// Underlying queue
+        std::deque<T> m_queue;
+        /// Maximum number of items
+        std::size_t m_capacity;
+        /// Largest observed number of items
+        std::size_t m_highWatermark = 0;
+        /// Set when no more items will be pushed
+        bool m_isClosed = false;
+        /// Condition variable on which consumers wait
+        std::condition_variable m_condVar;
+        /// Mutex for queue synchronisation
+        std::mutex m_mutex;
+    };
+
+    template<typename T>
+    bool BoundedQueue<T>::TryPush(T item)
+    {
+        {
+            std::scoped_lock lock(m_mutex);
+            if (m_isClosed || m_queue.size() >= m_capacity) { return false; }
+            m_queue.push_back(std::move(item));
+            m_highWatermark = std::max(m_highWatermark, m_queue.size());
+        }
+
+        m_condVar.notify_one();
+        return true;
+    }
+
+    template<typename T>
+    std::optional<T> BoundedQueue<T>::Pop()
+    {
+        std::unique_lock lock(m_mutex);
+        m_condVar.wait(lock, [&] { return !m_queue.empty() || m_isClosed; });
+        if (m_queue.empty()) { return std::nullopt; }
+
+        auto item = std::move(m_queue.front());
+        m_queue.pop_front();
+        return item;
+    }
+
+    template<typename T>
+    void BoundedQueue<T>::Close()
+    {
+        {
+            std::scoped_lock lock(m_mutex);
+            m_isClosed = true;
+        }
+        m_condVar.notify_all();
+    }
+
+    template<typename T>
+    void BoundedQueue<T>::Reset(std::size_t capacity)
+    {
+        std::scoped_lock lock(m_mutex);
+        m_queue.clear();
+        m_capacity = capacity;
+        m_highWatermark = 0;
+        m_isClosed = false;
+    }
+
+    template<typename T>
+    std::size_t BoundedQueue<T>::Size()
+    {
+        std::scoped_lock lock(m_mutex);
+        return m_queue.size();
+    }
+
+    template<typename T>
+    std::size_t BoundedQueue<T>::HighWatermark()
+    {
+        std::scoped_lock lock(m_mutex);
+        return m_highWatermark;
+    }
+}// namespace prm
@@ -15,6 +15,20 @@ enum Lens
     X20
 };
 
+/// Lossless compression of saved stacks
+enum Compression
+{
+    NO_COMPRESSION,
+    DEFLATE, ///< zlib deflate after horizontal differencing
+    ZSTD,    ///< zstd after horizontal differencing
+    TEMPORAL,///< residuals against a running background, raw stacks only
+    LZ4,     ///< lz4 after horizontal differencing, capture buffer only
+    PATCHES  ///< lossy, patches around bright pixels on a background, raw stacks only
+};
+
+/// Default brightness above which patch storage keeps a pixel's surroundings
+const std::uint16_t DEFAULT_PATCH_THRESHOLD = 400;
+
 struct TifStackMeta
 {
     std::uint32_t numFrames;
@@ -24,12 +38,22 @@ struct TifStackMeta
     double frametimeMin;
     double frametimeMax;
     double frametimeStd;
+    std::uint64_t droppedFrames;
     Binning binning;
     Lens lens;
+    Compression compression;
+    /// Pixels above it kept their surroundings in PATCHES stacks, else 0
+    std::uint16_t patchThreshold;
 };
 
 NLOHMANN_JSON_SERIALIZE_ENUM(Binning, {{ONE, "1x1"}, {TWO, "2x2"}})
 NLOHMANN_JSON_SERIALIZE_ENUM(Lens, {{X10, "x10"}, {X20, "x20"}})
+NLOHMANN_JSON_SERIALIZE_ENUM(Compression, {{NO_COMPRESSION, "none"},
+                                           {DEFLATE, "deflate"},
+                                           {ZSTD, "zstd"},
+                                           {TEMPORAL, "temporal"},
+                                           {LZ4, "lz4"},
+                                           {PATCHES, "patches"}})
 
 inline void to_json(json& j, const TifStackMeta& meta)
 {
@@ -40,8 +64,11 @@ inline void to_json(json& j, const TifStackMeta& meta)
              {"frametimeMin", meta.frametimeMin},
              {"frametimeMax", meta.frametimeMax},
              {"frametimeStd", meta.frametimeStd},
+             {"droppedFrames", meta.droppedFrames},
              {"binning", meta.binning},
-             {"lens", meta.lens}};
+             {"lens", meta.lens},
+             {"compression", meta.compression},
+             {"patchThreshold", meta.patchThreshold}};
 }
 
 inline void from_json(const json& j, TifStackMeta& m)
@@ -53,8 +80,12 @@ inline void from_json(const json& j, TifStackMeta& m)
     j[0].at("frametimeMin").get_to(m.frametimeMin);
     j[0].at("frametimeMax").get_to(m.frametimeMax);
     j[0].at("frametimeStd").get_to(m.frametimeStd);
+    // Stacks saved before drop accounting don't have the field
+    m.droppedFrames = j[0].value("droppedFrames", std::uint64_t{0});
     j[0].at("binning").get_to(m.binning);
     j[0].at("lens").get_to(m.lens);
+    m.compression = j[0].value("compression", NO_COMPRESSION);
+    m.patchThreshold = j[0].value("patchThreshold", std::uint16_t{0});
 }
 
 struct VideoProcessorMeta
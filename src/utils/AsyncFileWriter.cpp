@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <cerrno>
+#include <new>
+
+#include <spdlog/spdlog.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "AsyncFileWriter.h"
+
+namespace prm
+{
+    bool AlignedBuffer::Allocate(std::size_t size)
+    {
+        if (m_data)
+        {
+            ::operator delete[](m_data, std::align_val_t{ASYNC_WRITE_ALIGNMENT});
+        }
+        m_size = (size + ASYNC_WRITE_ALIGNMENT - 1) / ASYNC_WRITE_ALIGNMENT *
+                 ASYNC_WRITE_ALIGNMENT;
+        m_data = static_cast<uint8_t*>(::operator new[](
+                m_size, std::align_val_t{ASYNC_WRITE_ALIGNMENT}, std::nothrow));
+        if (!m_data)
+        {
+            m_size = 0;
+            return false;
+        }
+        std::fill_n(m_data, m_size, uint8_t{0});
+        return true;
+    }
+
+    AlignedBuffer::~AlignedBuffer()
+    {
+        if (m_data)
+        {
+            ::operator delete[](m_data, std::align_val_t{ASYNC_WRITE_ALIGNMENT});
+        }
+    }
+
+    bool AsyncFileWriter::Open(std::string_view path, bool unbuffered,
+                               std::size_t maxInFlight, unsigned numThreads)
+    {
+        if (IsOpen())
+        {
+            spdlog::error("Async file writer is already open");
+            return false;
+        }
+
+        m_path = path;
+        if (!OpenHandle(unbuffered))
+        {
+            if (!unbuffered || !OpenHandle(false))
+            {
+                spdlog::error("Couldn't create {}", m_path);
+                return false;
+            }
+            spdlog::warn("Unbuffered writes are not supported for {}, using "
+                         "the file cache",
+                         m_path);
+        }
+
+        m_maxInFlight = std::max<std::size_t>(maxInFlight, 1);
+        m_requests.clear();
+        m_inFlight = 0;
+        m_bStop = false;
+        m_errorOccurred = false;
+        m_bytesWritten = 0;
+        m_writesCompleted = 0;
+        m_maxInFlightSeen = 0;
+        m_maxLatency = {};
+        m_firstSubmit = {};
+        m_lastCompletion = {};
+
+        for (unsigned i = 0; i < std::max(numThreads, 1u); ++i)
+        {
+            m_threads.emplace_back(&AsyncFileWriter::Main, this);
+        }
+        return true;
+    }
+
+    bool AsyncFileWriter::Submit(std::uint64_t offset, const void* data,
+                                 std::size_t size, Completion done)
+    {
+        if (!IsOpen()) { return false; }
+        if (m_bUnbuffered && !IsAligned(offset, data, size))
+        {
+            spdlog::error("Unaligned write of {} bytes at {} to {}", size,
+                          offset, m_path);
+            return false;
+        }
+
+        std::unique_lock lock{m_mutex};
+        m_requestDone.wait(lock, [this]
+                           { return m_inFlight < m_maxInFlight || m_bStop; });
+        if (m_bStop || m_errorOccurred) { return false; }
+
+        const auto now = std::chrono::steady_clock::now();
+        if (m_writesCompleted == 0 && m_inFlight == 0) { m_firstSubmit = now; }
+        m_requests.push_back(Request{offset, data, size, std::move(done), now});
+        m_maxInFlightSeen = std::max(++m_inFlight, m_maxInFlightSeen);
+        lock.unlock();
+
+        m_requestQueued.notify_one();
+        return true;
+    }
+
+    bool AsyncFileWriter::Flush()
+    {
+        std::unique_lock lock{m_mutex};
+        m_requestDone.wait(lock, [this] { return m_inFlight == 0; });
+        return !m_errorOccurred;
+    }
+
+    bool AsyncFileWriter::Sync()
+    {
+        if (!IsOpen() || !Flush()) { return false; }
+        if (!SyncHandle())
+        {
+            spdlog::error("Couldn't sync {}", m_path);
+            return false;
+        }
+        return true;
+    }
+
+    bool AsyncFileWriter::Close()
+    {
+        if (!IsOpen()) { return true; }
+
+        Flush();
+        {
+            std::scoped_lock lock{m_mutex};
+            m_bStop = true;
+        }
+        m_requestQueued.notify_all();
+        m_requestDone.notify_all();
+        m_threads.clear();
+        ReleaseHandle();
+
+        std::scoped_lock lock{m_mutex};
+        return !m_errorOccurred;
+    }
+
+    bool AsyncFileWriter::IsAligned(std::uint64_t offset, const void* data,
+                                    std::size_t size)
+    {
+        return offset % ASYNC_WRITE_ALIGNMENT == 0 &&
+               reinterpret_cast<std::uintptr_t>(data) % ASYNC_WRITE_ALIGNMENT ==
+                       0 &&
+               size % ASYNC_WRITE_ALIGNMENT == 0;
+    }
+
+    AsyncWriteStats AsyncFileWriter::GetStats()
+    {
+        std::scoped_lock lock{m_mutex};
+        const std::chrono::duration<double> elapsed =
+                m_lastCompletion - m_firstSubmit;
+        return AsyncWriteStats{
+                .bytesWritten = m_bytesWritten,
+                .writesCompleted = m_writesCompleted,
+                .queueDepth = m_inFlight,
+                .maxQueueDepth = m_maxInFlightSeen,
+                .throughputMBps =
+                        elapsed.count() > 0.0
+                                ? static_cast<double>(m_bytesWritten) /
+                                          (1024.0 * 1024.0) / elapsed.count()
+                                : 0.0,
+                .maxLatencyMs = std::chrono::duration<double, std::milli>(
+                                        m_maxLatency)
+                                        .count()};
+    }
+
+    void AsyncFileWriter::Main()
+    {
+        std::unique_lock lock{m_mutex};
+        while (true)
+        {
+            m_requestQueued.wait(lock, [this]
+                                 { return m_bStop || !m_requests.empty(); });
+            if (m_requests.empty()) { return; }
+
+            auto request = std::move(m_requests.front());
+            m_requests.pop_front();
+            // A failed write spoils the file, later requests are only completed
+            const bool skip = m_errorOccurred;
+            lock.unlock();
+
+            const bool ok = !skip && WriteAt(request.offset, request.data,
+                                             request.size);
+            if (!ok && !skip)
+            {
+                spdlog::error("Failed writing {} bytes at {} to {}",
+                              request.size, request.offset, m_path);
+            }
+            if (request.done) { request.done(ok); }
+
+            lock.lock();
+            if (ok)
+            {
+                const auto now = std::chrono::steady_clock::now();
+                m_bytesWritten += request.size;
+                ++m_writesCompleted;
+                m_maxLatency = std::max(m_maxLatency, now - request.submitted);
+                m_lastCompletion = now;
+            }
+            else { m_errorOccurred = true; }
+            --m_inFlight;
+            m_requestDone.notify_all();
+        }
+    }
+
+#ifdef _WIN32
+    bool AsyncFileWriter::OpenHandle(bool unbuffered)
+    {
+        // Windows runs one request at a time on a handle opened without
+        // FILE_FLAG_OVERLAPPED, whatever the number of threads issuing them
+        const DWORD flags =
+                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED |
+                (unbuffered ? FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH
+                            : 0);
+        m_file = CreateFileA(m_path.c_str(), GENERIC_WRITE, FILE_SHARE_READ,
+                             nullptr, CREATE_ALWAYS, flags, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+        {
+            m_file = nullptr;
+            return false;
+        }
+        m_bUnbuffered = unbuffered;
+        return true;
+    }
+
+    void AsyncFileWriter::ReleaseHandle()
+    {
+        if (m_file) { ::CloseHandle(m_file); }
+        m_file = nullptr;
+    }
+
+    bool AsyncFileWriter::SyncHandle() { return FlushFileBuffers(m_file) != 0; }
+
+    bool AsyncFileWriter::WriteAt(std::uint64_t offset, const void* data,
+                                  std::size_t size)
+    {
+        // Each I/O thread waits for its own write on its own event, so the
+        // threads keep that many writes in flight on the one handle
+        const auto event = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+        if (!event) { return false; }
+
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        bool success = true;
+        while (success && size > 0)
+        {
+            // Chunks stay aligned and within the DWORD size of WriteFile
+            const auto chunk = static_cast<DWORD>(
+                    (std::min<std::size_t>)(size, 1u << 30));
+            OVERLAPPED overlapped{};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            overlapped.hEvent = event;
+            DWORD written = 0;
+            if (!WriteFile(m_file, bytes, chunk, nullptr, &overlapped) &&
+                GetLastError() != ERROR_IO_PENDING)
+            {
+                success = false;
+            }
+            else if (!GetOverlappedResult(m_file, &overlapped, &written,
+                                          TRUE) ||
+                     written == 0)
+            {
+                success = false;
+            }
+            bytes += written;
+            offset += written;
+            size -= written;
+        }
+        ::CloseHandle(event);
+        return success;
+    }
+#else
+    bool AsyncFileWriter::OpenHandle(bool unbuffered)
+    {
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+        if (unbuffered) { flags |= O_DIRECT; }
+#endif
+        m_fd = open(m_path.c_str(), flags, 0644);
+        if (m_fd < 0) { return false; }
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+        if (unbuffered && fcntl(m_fd, F_NOCACHE, 1) != 0)
+        {
+            ReleaseHandle();
+            return false;
+        }
+#endif
+        m_bUnbuffered = unbuffered;
+        return true;
+    }
+
+    void AsyncFileWriter::ReleaseHandle()
+    {
+        if (m_fd >= 0) { close(m_fd); }
+        m_fd = -1;
+    }
+
+    bool AsyncFileWriter::SyncHandle() { return fsync(m_fd) == 0; }
+
+    bool AsyncFileWriter::WriteAt(std::uint64_t offset, const void* data,
+                                  std::size_t size)
+    {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        while (size > 0)
+        {
+            const auto written = pwrite(m_fd, bytes, size,
+                                        static_cast<off_t>(offset));
+            if (written < 0 && errno == EINTR) { continue; }
+            if (written <= 0) { return false; }
+            bytes += written;
+            offset += static_cast<std::uint64_t>(written);
+            size -= static_cast<std::size_t>(written);
+        }
+        return true;
+    }
+#endif
+}// namespace prm
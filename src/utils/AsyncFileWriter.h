@@ -0,0 +1,236 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace prm
+{
+    /// Offsets, sizes and buffers of unbuffered writes are multiples of this
+    const std::size_t ASYNC_WRITE_ALIGNMENT = 4096;
+    /// Default number of writes in flight at once
+    const std::size_t ASYNC_WRITE_QUEUE_DEPTH = 8;
+    /// Default number of threads issuing the writes
+    const unsigned ASYNC_WRITE_THREADS = 4;
+
+    /// Throughput and queue metrics of an AsyncFileWriter
+    struct AsyncWriteStats
+    {
+        std::uint64_t bytesWritten;
+        std::uint64_t writesCompleted;
+        /// Writes submitted but not completed yet
+        std::size_t queueDepth;
+        /// Largest queueDepth since the file was opened
+        std::size_t maxQueueDepth;
+        /// Average rate from the first submit to the last completion
+        double throughputMBps;
+        /// Longest time a write took from submit to completion
+        double maxLatencyMs;
+    };
+
+    /**
+     * Block of memory aligned for unbuffered writes, zero filled
+     */
+    class AlignedBuffer
+    {
+    public:
+        AlignedBuffer() = default;
+
+        AlignedBuffer(const AlignedBuffer&) = delete;
+        AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+        /**
+         * Drops the previous block and allocates a zeroed one
+         *
+         * @param size Requested size, rounded up to ASYNC_WRITE_ALIGNMENT
+         * @return true on success
+         */
+        bool Allocate(std::size_t size);
+
+        [[nodiscard]] uint8_t* Data() { return m_data; }
+        [[nodiscard]] std::size_t Size() const { return m_size; }
+
+        ~AlignedBuffer();
+
+    private:
+        uint8_t* m_data = nullptr;
+        std::size_t m_size = 0;
+    };
+
+    /**
+     * File writer that issues positional writes on a set of I/O threads
+     * The caller submits blocks with their file offset and goes on, a
+     * completion callback tells when the block is on disk and its memory can
+     * be reused. Several writes are in flight at once, which keeps fast
+     * drives busy. With unbuffered I/O the writes bypass the OS file cache,
+     * so a long capture doesn't evict other data, but every offset, size and
+     * buffer address has to be a multiple of ASYNC_WRITE_ALIGNMENT
+     */
+    class AsyncFileWriter
+    {
+    public:
+        /// Called on an I/O thread once a write is done, false on failure
+        using Completion = std::function<void(bool)>;
+
+        AsyncFileWriter() = default;
+
+        AsyncFileWriter(const AsyncFileWriter&) = delete;
+        AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+        /**
+         * Creates the file and starts the I/O threads
+         * Falls back to buffered writes if the file system refuses unbuffered ones
+         *
+         * @param path Path of the file, truncated if it exists
+         * @param unbuffered Bypass the OS file cache
+         * @param maxInFlight Number of writes in flight before Submit waits
+         * @param numThreads Number of I/O threads
+         * @return true on success
+         */
+        bool Open(std::string_view path, bool unbuffered,
+                  std::size_t maxInFlight = ASYNC_WRITE_QUEUE_DEPTH,
+                  unsigned numThreads = ASYNC_WRITE_THREADS);
+
+        /**
+         * Queues a write, waiting while maxInFlight writes are pending
+         * The memory has to stay untouched until the completion runs
+         *
+         * @param offset File offset of the block
+         * @param data Start of the block
+         * @param size Size of the block
+         * @param done Optional completion, also called if the write fails
+         * @return false if the write was refused, done is not called then
+         */
+        bool Submit(std::uint64_t offset, const void* data, std::size_t size,
+                    Completion done = {});
+
+        /**
+         * Waits until every submitted write is completed
+         *
+         * @return true if all writes so far succeeded
+         */
+        bool Flush();
+
+        /**
+         * Waits for every submitted write and forces the file onto the disk,
+         * including the size and anything the drive still caches
+         *
+         * @return true if all writes so far succeeded and are durable
+         */
+        bool Sync();
+
+        /**
+         * Flushes, stops the I/O threads and closes the file
+         *
+         * @return true if all writes succeeded
+         */
+        bool Close();
+
+        [[nodiscard]] bool IsOpen() const { return !m_threads.empty(); }
+
+        /**
+         * Tells if writes bypass the file cache, they might not after a fallback
+         *
+         * @return true for unbuffered writes
+         */
+        [[nodiscard]] bool IsUnbuffered() const { return m_bUnbuffered; }
+
+        /**
+         * Checks a block against the alignment rules of unbuffered writes
+         *
+         * @param offset File offset of the block
+         * @param data Start of the block
+         * @param size Size of the block
+         * @return true if the block can be written unbuffered
+         */
+        static bool IsAligned(std::uint64_t offset, const void* data,
+                              std::size_t size);
+
+        /**
+         * Gives the throughput and queue metrics
+         *
+         * @return Metrics since the file was opened
+         */
+        [[nodiscard]] AsyncWriteStats GetStats();
+
+        ~AsyncFileWriter() { Close(); }
+
+    private:
+        struct Request
+        {
+            std::uint64_t offset;
+            const void* data;
+            std::size_t size;
+            Completion done;
+            std::chrono::steady_clock::time_point submitted;
+        };
+
+        /**
+         * I/O thread function, runs requests until the writer is closed
+         */
+        void Main();
+
+        /**
+         * Writes a whole block at an offset
+         *
+         * @return true on success
+         */
+        bool WriteAt(std::uint64_t offset, const void* data, std::size_t size);
+
+        /**
+         * Opens the file handle
+         *
+         * @param unbuffered Bypass the OS file cache
+         * @return true on success
+         */
+        bool OpenHandle(bool unbuffered);
+
+        void ReleaseHandle();
+
+        /**
+         * Forces the written data and the file size onto the disk
+         *
+         * @return true on success
+         */
+        bool SyncHandle();
+
+        std::string m_path{};
+        bool m_bUnbuffered = false;
+        std::size_t m_maxInFlight = ASYNC_WRITE_QUEUE_DEPTH;
+
+        std::mutex m_mutex{};
+        /// Wakes the I/O threads when a request is queued or the writer closes
+        std::condition_variable m_requestQueued{};
+        /// Wakes Submit and Flush when a request completes
+        std::condition_variable m_requestDone{};
+        std::deque<Request> m_requests{};
+        /// Requests queued or being written
+        std::size_t m_inFlight = 0;
+        bool m_bStop = false;
+        bool m_errorOccurred = false;
+
+        // Metrics, guarded by m_mutex
+        std::uint64_t m_bytesWritten = 0;
+        std::uint64_t m_writesCompleted = 0;
+        std::size_t m_maxInFlightSeen = 0;
+        std::chrono::steady_clock::duration m_maxLatency{};
+        std::chrono::steady_clock::time_point m_firstSubmit{};
+        std::chrono::steady_clock::time_point m_lastCompletion{};
+
+#ifdef _WIN32
+        void* m_file = nullptr;
+#else
+        int m_fd = -1;
+#endif
+
+        std::vector<std::jthread> m_threads{};
+    };
+}// namespace prm
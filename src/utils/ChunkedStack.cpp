@@ -0,0 +1,469 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+#include "ChunkedStack.h"
+#include "FileUtils.h"
+#include "StripCodec.h"
+
+namespace prm
+{
+    namespace
+    {
+        /// Attributes of the array, holds the capture metadata
+        const char CHUNKED_STACK_ATTRS_FILE[] = ".zattrs";
+
+        /**
+         * Gives the name of a chunk file, chunks span whole frames so only
+         * the index along the frame axis varies
+         */
+        std::string ChunkName(std::uint64_t chunk)
+        {
+            return fmt::format("{}.0.0", chunk);
+        }
+
+        /**
+         * Writes a file under a temporary name and moves it into place, so
+         * readers never see a half written file
+         */
+        bool WriteFileAtomically(const std::filesystem::path& path,
+                                 const void* data, std::size_t size)
+        {
+            auto partPath = path;
+            partPath += ".part";
+            {
+                std::ofstream ofs{partPath, std::ios::binary | std::ios::trunc};
+                ofs.write(static_cast<const char*>(data),
+                          static_cast<std::streamsize>(size));
+                if (!ofs) { return false; }
+            }
+
+            std::error_code ec;
+            std::filesystem::rename(partPath, path, ec);
+            return !ec;
+        }
+
+        bool WriteJsonAtomically(const std::filesystem::path& path,
+                                 const nlohmann::json& j)
+        {
+            const auto text = j.dump(4) + '\n';
+            return WriteFileAtomically(path, text.data(), text.size());
+        }
+
+        bool WriteAttrs(const std::filesystem::path& stackPath,
+                        const TifStackMeta& meta, std::uint64_t numFrames,
+                        Compression compression)
+        {
+            auto attrs = nlohmann::json(meta);
+            attrs["nFrames"] = numFrames;
+            attrs["compression"] = compression;
+            return WriteJsonAtomically(stackPath / CHUNKED_STACK_ATTRS_FILE,
+                                       attrs);
+        }
+    }// namespace
+
+    bool ChunkedStackWriter::Open(std::string_view path, uint32_t imageWidth,
+                                  uint32_t imageHeight, Compression compression,
+                                  unsigned numThreads)
+    {
+        if (IsOpen())
+        {
+            spdlog::error("Chunked stack writer is already open");
+            return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path{path}, ec);
+        if (ec)
+        {
+            spdlog::error("Couldn't create {}: {}", path, ec.message());
+            return false;
+        }
+
+        m_path = path;
+        m_imageWidth = imageWidth;
+        m_imageHeight = imageHeight;
+        m_framePixels = std::size_t{imageWidth} * imageHeight;
+        m_framesPerChunk = static_cast<uint32_t>(std::clamp<std::size_t>(
+                CHUNK_TARGET_BYTES / (m_framePixels * sizeof(uint16_t)), 1,
+                CHUNK_MAX_FRAMES));
+        m_compression = compression;
+        m_numFrames = 0;
+        m_framesInChunk = 0;
+        m_chunkDone.clear();
+        m_leadingChunksDone = 0;
+        m_syncedChunks = 0;
+        m_encodedBytes = 0;
+        m_errorOccurred = false;
+
+        numThreads = std::max(numThreads, 1u);
+        m_buffers.assign(numThreads + 1,
+                         std::vector<uint16_t>(m_framePixels * m_framesPerChunk));
+        m_freeBuffers.Reset(m_buffers.size());
+        for (std::size_t i = 0; i < m_buffers.size(); ++i)
+        {
+            m_freeBuffers.TryPush(i);
+        }
+        m_fullChunks.Reset(m_buffers.size());
+
+        if (!WriteArrayMeta(0)) { return false; }
+        for (unsigned i = 0; i < numThreads; ++i)
+        {
+            m_threads.emplace_back(&ChunkedStackWriter::Main, this);
+        }
+        return true;
+    }
+
+    bool ChunkedStackWriter::WriteFrame(const uint16_t* frame)
+    {
+        if (!IsOpen() || m_errorOccurred) { return false; }
+
+        if (m_framesInChunk == 0)
+        {
+            const auto buffer = m_freeBuffers.Pop();
+            if (!buffer) { return false; }
+            m_currentBuffer = *buffer;
+        }
+
+        std::memcpy(m_buffers[m_currentBuffer].data() +
+                            m_framesInChunk * m_framePixels,
+                    frame, m_framePixels * sizeof(uint16_t));
+        ++m_numFrames;
+        if (++m_framesInChunk == m_framesPerChunk) { SubmitChunk(); }
+        return true;
+    }
+
+    bool ChunkedStackWriter::Close(const TifStackMeta& meta)
+    {
+        if (!IsOpen()) { return true; }
+
+        // Zarr chunks are always whole, the frames past the end read as fill value
+        if (m_framesInChunk > 0)
+        {
+            auto& buffer = m_buffers[m_currentBuffer];
+            std::fill(buffer.data() + m_framesInChunk * m_framePixels,
+                      buffer.data() + buffer.size(), uint16_t{0});
+            SubmitChunk();
+        }
+        m_fullChunks.Close();
+        m_threads.clear();
+        m_freeBuffers.Close();
+
+        if (!m_errorOccurred && !WriteArrayMeta(m_numFrames))
+        {
+            m_errorOccurred = true;
+        }
+        if (!WriteAttrs(m_path, meta, m_numFrames, m_compression))
+        {
+            m_errorOccurred = true;
+        }
+        m_buffers.clear();
+
+        if (m_compression != NO_COMPRESSION && m_encodedBytes > 0)
+        {
+            spdlog::info("Wrote {} frames to {}, compression ratio {:.2f}",
+                         m_numFrames.load(), m_path,
+                         static_cast<double>(m_chunkDone.size() *
+                                             m_framesPerChunk * m_framePixels *
+                                             sizeof(uint16_t)) /
+                                 static_cast<double>(m_encodedBytes));
+        }
+        else { spdlog::info("Wrote {} frames to {}", m_numFrames.load(), m_path); }
+        if (m_errorOccurred) { spdlog::error("Failed finishing {}", m_path); }
+        return !m_errorOccurred;
+    }
+
+    bool ChunkedStackWriter::Sync(std::uint64_t& numFrames)
+    {
+        numFrames = 0;
+        if (!IsOpen() || m_errorOccurred) { return false; }
+
+        std::uint64_t leadingChunks = 0;
+        {
+            std::scoped_lock lock{m_mutex};
+            leadingChunks = m_leadingChunksDone;
+        }
+        bool synced = true;
+        for (; synced && m_syncedChunks < leadingChunks; ++m_syncedChunks)
+        {
+            synced = FileUtils::SyncFile(
+                    (std::filesystem::path{m_path} / ChunkName(m_syncedChunks))
+                            .string());
+        }
+        if (!synced) { return false; }
+
+        // The description is replaced under the lock, never while it's open here
+        std::scoped_lock lock{m_mutex};
+        if (!FileUtils::SyncFile((std::filesystem::path{m_path} /
+                                  CHUNKED_STACK_ARRAY_FILE)
+                                         .string()))
+        {
+            return false;
+        }
+        numFrames = std::min<std::uint64_t>(leadingChunks * m_framesPerChunk,
+                                            m_numFrames);
+        return true;
+    }
+
+    bool ChunkedStackWriter::Recover(std::string_view path,
+                                     const TifStackMeta& meta)
+    {
+        ChunkedStackReader reader{};
+        if (!reader.Open(path)) { return false; }
+
+        // Chunks and descriptions that were being written at the crash
+        std::error_code ec;
+        for (const auto& entry:
+             std::filesystem::directory_iterator{std::filesystem::path{path}, ec})
+        {
+            if (entry.path().extension() == ".part")
+            {
+                std::filesystem::remove(entry.path(), ec);
+            }
+        }
+
+        if (!WriteAttrs(path, meta, reader.GetNumFrames(),
+                        reader.GetCompression()))
+        {
+            spdlog::error("Failed finishing {}", path);
+            return false;
+        }
+        return true;
+    }
+
+    void ChunkedStackWriter::Main()
+    {
+        std::vector<uint8_t> encoded{};
+        while (auto job = m_fullChunks.Pop())
+        {
+            const bool written = !m_errorOccurred && WriteChunk(*job, encoded);
+            m_freeBuffers.TryPush(job->buffer);
+            if (!written)
+            {
+                m_errorOccurred = true;
+                continue;
+            }
+
+            std::scoped_lock lock{m_mutex};
+            m_chunkDone[job->chunk] = true;
+            m_encodedBytes += encoded.size();
+
+            const auto leadingChunks = m_leadingChunksDone;
+            while (m_leadingChunksDone < m_chunkDone.size() &&
+                   m_chunkDone[m_leadingChunksDone])
+            {
+                ++m_leadingChunksDone;
+            }
+            if (m_leadingChunksDone != leadingChunks)
+            {
+                WriteArrayMeta(std::min<std::uint64_t>(
+                        m_leadingChunksDone * m_framesPerChunk, m_numFrames));
+            }
+        }
+    }
+
+    bool ChunkedStackWriter::WriteChunk(const ChunkJob& job,
+                                        std::vector<uint8_t>& encoded)
+    {
+        auto& pixels = m_buffers[job.buffer];
+        if (!StripCodec::EncodeBlock(m_compression, pixels.data(),
+                                     pixels.size(), encoded))
+        {
+            spdlog::error("Failed compressing chunk {} of {}", job.chunk,
+                          m_path);
+            return false;
+        }
+        if (!WriteFileAtomically(std::filesystem::path{m_path} /
+                                         ChunkName(job.chunk),
+                                 encoded.data(), encoded.size()))
+        {
+            spdlog::error("Failed writing chunk {} of {}", job.chunk, m_path);
+            return false;
+        }
+        return true;
+    }
+
+    void ChunkedStackWriter::SubmitChunk()
+    {
+        std::uint64_t chunk = 0;
+        {
+            std::scoped_lock lock{m_mutex};
+            chunk = m_chunkDone.size();
+            m_chunkDone.push_back(false);
+        }
+        // Never full, there are only as many jobs as buffers
+        m_fullChunks.TryPush(ChunkJob{m_currentBuffer, chunk});
+        m_framesInChunk = 0;
+    }
+
+    bool ChunkedStackWriter::WriteArrayMeta(std::uint64_t numFrames)
+    {
+        nlohmann::json compressor = nullptr;
+        nlohmann::json filters = nullptr;
+        if (m_compression != NO_COMPRESSION)
+        {
+            compressor = m_compression == ZSTD
+                                 ? nlohmann::json{{"id", "zstd"},
+                                                  {"level", ZSTD_LEVEL}}
+                                 : nlohmann::json{{"id", "zlib"},
+                                                  {"level", DEFLATE_LEVEL}};
+            filters = nlohmann::json::array(
+                    {{{"id", "delta"}, {"dtype", "<u2"}, {"astype", "<u2"}}});
+        }
+
+        const nlohmann::json array{
+                {"zarr_format", 2},
+                {"shape", {numFrames, m_imageHeight, m_imageWidth}},
+                {"chunks", {m_framesPerChunk, m_imageHeight, m_imageWidth}},
+                {"dtype", "<u2"},
+                {"compressor", compressor},
+                {"filters", filters},
+                {"fill_value", 0},
+                {"order", "C"},
+                {"dimension_separator", "."}};
+        if (!WriteJsonAtomically(std::filesystem::path{m_path} /
+                                         CHUNKED_STACK_ARRAY_FILE,
+                                 array))
+        {
+            spdlog::error("Couldn't write the array description of {}",
+                          m_path);
+            return false;
+        }
+        return true;
+    }
+
+    bool ChunkedStackReader::IsChunkedStack(std::string_view path)
+    {
+        const std::filesystem::path fsPath{path};
+        return fsPath.filename() == CHUNKED_STACK_ARRAY_FILE ||
+               fsPath.extension() == CHUNKED_STACK_EXTENSION;
+    }
+
+    bool ChunkedStackReader::Open(std::string_view path)
+    {
+        std::filesystem::path fsPath{path};
+        if (fsPath.filename() == CHUNKED_STACK_ARRAY_FILE)
+        {
+            fsPath = fsPath.parent_path();
+        }
+        m_path = fsPath.string();
+
+        const auto arrayPath = fsPath / CHUNKED_STACK_ARRAY_FILE;
+        try
+        {
+            const auto array = nlohmann::json::parse(
+                    FileUtils::ReadFileToString(arrayPath.string()));
+            const auto shape = array.at("shape").get<std::vector<std::uint64_t>>();
+            const auto chunks = array.at("chunks").get<std::vector<uint32_t>>();
+            if (array.at("zarr_format") != 2 || array.at("dtype") != "<u2" ||
+                array.value("order", "C") != "C" || shape.size() != 3 ||
+                chunks.size() != 3 || chunks[0] == 0 || chunks[1] != shape[1] ||
+                chunks[2] != shape[2] ||
+                array.value("dimension_separator", ".") != ".")
+            {
+                spdlog::error("{} is not a stack of whole 16 bit frames",
+                              m_path);
+                return false;
+            }
+
+            const auto& compressor = array.at("compressor");
+            const auto& filters = array.at("filters");
+            const bool delta = filters.is_array() && filters.size() == 1 &&
+                               filters[0].at("id") == "delta";
+            if (compressor.is_null() && filters.is_null())
+            {
+                m_compression = NO_COMPRESSION;
+            }
+            else if (delta && compressor.at("id") == "zlib")
+            {
+                m_compression = DEFLATE;
+            }
+            else if (delta && compressor.at("id") == "zstd")
+            {
+                m_compression = ZSTD;
+            }
+            else
+            {
+                spdlog::error("Unsupported codecs in {}", m_path);
+                return false;
+            }
+
+            m_numFrames = shape[0];
+            m_imageHeight = static_cast<uint32_t>(shape[1]);
+            m_imageWidth = static_cast<uint32_t>(shape[2]);
+            m_framesPerChunk = chunks[0];
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::error("Couldn't read {}: {}", arrayPath.string(), e.what());
+            return false;
+        }
+
+        if (!StripCodec::IsSupported(m_compression))
+        {
+            spdlog::error("{} uses a compression this build can't read",
+                          m_path);
+            return false;
+        }
+        return true;
+    }
+
+    bool ChunkedStackReader::ReadChunk(std::uint64_t chunk,
+                                       std::vector<uint16_t>& pixels) const
+    {
+        const auto chunkPath = std::filesystem::path{m_path} / ChunkName(chunk);
+        const auto numPixels =
+                std::size_t{m_imageWidth} * m_imageHeight * m_framesPerChunk;
+        pixels.resize(numPixels);
+
+        std::ifstream ifs{chunkPath, std::ios::binary | std::ios::ate};
+        if (!ifs)
+        {
+            // Chunks never written hold the fill value
+            std::fill(pixels.begin(), pixels.end(), uint16_t{0});
+            return true;
+        }
+        std::vector<uint8_t> encoded(static_cast<std::size_t>(ifs.tellg()));
+        ifs.seekg(0);
+        ifs.read(reinterpret_cast<char*>(encoded.data()),
+                 static_cast<std::streamsize>(encoded.size()));
+        if (!ifs ||
+            !StripCodec::DecodeStrip(m_compression, encoded.data(),
+                                     encoded.size(), pixels.data(),
+                                     static_cast<uint32_t>(numPixels), 1))
+        {
+            spdlog::error("Couldn't decode chunk {} of {}", chunk, m_path);
+            return false;
+        }
+        return true;
+    }
+
+    TifStackMeta ChunkedStackReader::GetMeta() const
+    {
+        TifStackMeta meta{};
+        const auto attrsPath =
+                std::filesystem::path{m_path} / CHUNKED_STACK_ATTRS_FILE;
+        if (std::filesystem::exists(attrsPath))
+        {
+            try
+            {
+                nlohmann::json{nlohmann::json::parse(
+                                       FileUtils::ReadFileToString(
+                                               attrsPath.string()))}
+                        .get_to(meta);
+            }
+            catch (const std::exception& e)
+            {
+                spdlog::warn("Ignoring unreadable {}: {}", attrsPath.string(),
+                             e.what());
+            }
+        }
+        meta.numFrames = static_cast<std::uint32_t>(m_numFrames);
+        meta.compression = m_compression;
+        return meta;
+    }
+}// namespace prm
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "messages/BoundedQueue.h"
+#include "misc/Meta.h"
+
+namespace prm
+{
+    /// Directory extension of chunked stacks
+    const char CHUNKED_STACK_EXTENSION[] = ".zarr";
+    /// Array description inside a chunked stack directory
+    const char CHUNKED_STACK_ARRAY_FILE[] = ".zarray";
+    /// Most frames in one chunk
+    const uint32_t CHUNK_MAX_FRAMES = 64;
+    /// Chunks hold fewer frames if they would grow past this size
+    const std::size_t CHUNK_TARGET_BYTES = 64 * 1024 * 1024;
+
+    /**
+     * Writer of chunked stacks of 16 bit mono frames
+     * The stack is a zarr v2 array of shape frames x height x width in a
+     * directory, every chunk of consecutive full frames is compressed into a
+     * file of its own. Full chunks are compressed and written by a set of
+     * threads while the next chunk is filled. The array description is
+     * rewritten whenever the leading chunks are complete, so a capture that
+     * ends in a crash still opens with every finished chunk
+     */
+    class ChunkedStackWriter
+    {
+    public:
+        ChunkedStackWriter() = default;
+
+        ChunkedStackWriter(const ChunkedStackWriter&) = delete;
+        ChunkedStackWriter& operator=(const ChunkedStackWriter&) = delete;
+
+        /**
+         * Creates the stack directory and starts the chunk threads
+         *
+         * @param path Path of the stack directory
+         * @param imageWidth Width of each image
+         * @param imageHeight Height of each image
+         * @param compression Lossless compression of the chunks
+         * @param numThreads Number of chunk threads
+         * @return true on success
+         */
+        bool Open(std::string_view path, uint32_t imageWidth,
+                  uint32_t imageHeight, Compression compression,
+                  unsigned numThreads);
+
+        /**
+         * Appends one frame to the current chunk
+         * Waits for a chunk buffer if all of them are being written
+         *
+         * @param frame Pixels of the frame
+         * @return true on success
+         */
+        bool WriteFrame(const uint16_t* frame);
+
+        /**
+         * Writes the last partial chunk, the final array description and the
+         * capture metadata as array attributes
+         *
+         * @param meta Capture metadata
+         * @return true if every chunk made it to disk
+         */
+        bool Close(const TifStackMeta& meta);
+
+        /**
+         * Forces the chunks finished so far and the array description onto
+         * the disk, frames of unfinished chunks are not covered
+         *
+         * @param numFrames Set to the number of frames in the synced chunks
+         * @return true once those frames are durable
+         */
+        bool Sync(std::uint64_t& numFrames);
+
+        /**
+         * Finalises a stack that was never closed
+         * The array description already covers every finished chunk, only
+         * the capture metadata and leftover temporary files are dealt with
+         *
+         * @param path Path of the stack directory
+         * @param meta Capture metadata stored as array attributes, the frame
+         * count follows the array
+         * @return true on success
+         */
+        static bool Recover(std::string_view path, const TifStackMeta& meta);
+
+        [[nodiscard]] bool IsOpen() const { return !m_threads.empty(); }
+
+        [[nodiscard]] std::uint64_t GetFramesWritten() const
+        {
+            return m_numFrames;
+        }
+
+        [[nodiscard]] uint32_t GetFramesPerChunk() const
+        {
+            return m_framesPerChunk;
+        }
+
+        ~ChunkedStackWriter() { Close(TifStackMeta{}); }
+
+    private:
+        /// Full chunk waiting to be written
+        struct ChunkJob
+        {
+            /// Index into m_buffers
+            std::size_t buffer;
+            /// Chunk index along the frame axis
+            std::uint64_t chunk;
+        };
+
+        /**
+         * Chunk thread function, writes full chunks until the queue is closed
+         */
+        void Main();
+
+        /**
+         * Compresses a chunk and writes it to its file
+         *
+         * @param job Chunk to write
+         * @param encoded Scratch buffer for the compressed chunk
+         * @return true on success
+         */
+        bool WriteChunk(const ChunkJob& job, std::vector<uint8_t>& encoded);
+
+        /**
+         * Hands the current chunk to the chunk threads
+         */
+        void SubmitChunk();
+
+        /**
+         * Writes the array description
+         *
+         * @param numFrames Frame count given as the array length
+         * @return true on success
+         */
+        bool WriteArrayMeta(std::uint64_t numFrames);
+
+        std::string m_path{};
+        uint32_t m_imageWidth = 0;
+        uint32_t m_imageHeight = 0;
+        std::size_t m_framePixels = 0;
+        uint32_t m_framesPerChunk = 1;
+        Compression m_compression = NO_COMPRESSION;
+
+        /// Chunk buffers, one per thread plus the one being filled
+        std::vector<std::vector<uint16_t>> m_buffers{};
+        BoundedQueue<std::size_t> m_freeBuffers{};
+        BoundedQueue<ChunkJob> m_fullChunks{};
+        /// Buffer being filled, valid while m_framesInChunk > 0
+        std::size_t m_currentBuffer = 0;
+        uint32_t m_framesInChunk = 0;
+        std::atomic<std::uint64_t> m_numFrames = 0;
+
+        /// Guards the chunk bookkeeping and the array description
+        std::mutex m_mutex{};
+        /// Completion flag of every submitted chunk
+        std::vector<bool> m_chunkDone{};
+        /// Number of leading chunks that are complete
+        std::uint64_t m_leadingChunksDone = 0;
+        /// Number of leading chunks forced onto the disk by Sync
+        std::uint64_t m_syncedChunks = 0;
+        std::uint64_t m_encodedBytes = 0;
+
+        std::atomic<bool> m_errorOccurred = false;
+
+        std::vector<std::jthread> m_threads{};
+    };
+
+    /**
+     * Reader of chunked stacks written by ChunkedStackWriter
+     * Chunks are independent files, so any number of threads can read and
+     * decode them at once
+     */
+    class ChunkedStackReader
+    {
+    public:
+        /**
+         * Tells if a path points at a chunked stack
+         *
+         * @param path Stack directory or the array description inside it
+         * @return true for chunked stacks
+         */
+        static bool IsChunkedStack(std::string_view path);
+
+        /**
+         * Reads the array description
+         *
+         * @param path Stack directory or the array description inside it
+         * @return true on success
+         */
+        bool Open(std::string_view path);
+
+        [[nodiscard]] std::uint64_t GetNumFrames() const { return m_numFrames; }
+        [[nodiscard]] uint32_t GetImageWidth() const { return m_imageWidth; }
+        [[nodiscard]] uint32_t GetImageHeight() const { return m_imageHeight; }
+
+        [[nodiscard]] uint32_t GetFramesPerChunk() const
+        {
+            return m_framesPerChunk;
+        }
+
+        [[nodiscard]] Compression GetCompression() const
+        {
+            return m_compression;
+        }
+
+        [[nodiscard]] std::uint64_t GetNumChunks() const
+        {
+            return (m_numFrames + m_framesPerChunk - 1) / m_framesPerChunk;
+        }
+
+        /**
+         * Reads and decodes a whole chunk
+         * Safe to call from several threads at once
+         *
+         * @param chunk Chunk index
+         * @param pixels Pixels of all the frames in the chunk, resized to fit
+         * @return true on success
+         */
+        bool ReadChunk(std::uint64_t chunk, std::vector<uint16_t>& pixels) const;
+
+        /**
+         * Gives the capture metadata stored as array attributes
+         *
+         * @return Capture metadata, the frame count follows the array
+         */
+        [[nodiscard]] TifStackMeta GetMeta() const;
+
+    private:
+        std::string m_path{};
+        uint32_t m_imageWidth = 0;
+        uint32_t m_imageHeight = 0;
+        uint32_t m_framesPerChunk = 1;
+        std::uint64_t m_numFrames = 0;
+        Compression m_compression = NO_COMPRESSION;
+    };
+}// namespace prm
@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define PRM_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "DisplayConverter.h"
+
+namespace prm
+{
+    /// Number of distinct 16 bit pixel values
+    const std::size_t LUT_SIZE = 1 << 16;
+    /// Number of interleaved partial histograms
+    const std::size_t NUM_PARTIAL_HISTOGRAMS = 4;
+    /// Smallest gamma, lower values are raised to it
+    const float MIN_GAMMA = 0.01f;
+    /// Gamma changes smaller than this keep the current LUT
+    const float GAMMA_TOLERANCE = 1e-6f;
+
+    /**
+     * Adds pixels to the interleaved partial histograms
+     *
+     * @param pixels Pixel values
+     * @param numPixels Number of pixels
+     * @param histograms NUM_PARTIAL_HISTOGRAMS histograms laid out one after another
+     * @param binShift Number of low bits dropped to get the bin of a value
+     * @return Sum of the pixel values
+     */
+    static uint64_t AccumulateHistogram(const uint16_t* pixels,
+                                        std::size_t numPixels,
+                                        uint32_t* histograms, int binShift)
+    {
+        uint64_t sum = 0;
+        for (std::size_t i = 0; i < numPixels; ++i)
+        {
+            const auto bin = std::min<std::size_t>(pixels[i] >> binShift,
+                                                   HISTOGRAM_BINS - 1);
+            ++histograms[(i % NUM_PARTIAL_HISTOGRAMS) * HISTOGRAM_BINS + bin];
+            sum += pixels[i];
+        }
+        return sum;
+    }
+
+    uint16_t FrameStats::Percentile(double fraction) const
+    {
+        const auto target = static_cast<uint64_t>(
+                std::clamp(fraction, 0.0, 1.0) *
+                static_cast<double>(numPixels));
+        uint64_t count = 0;
+        for (std::size_t bin = 0; bin < HISTOGRAM_BINS; ++bin)
+        {
+            count += histogram[bin];
+            if (count > target || count == numPixels)
+            {
+                return static_cast<uint16_t>(bin << binShift);
+            }
+        }
+        return max;
+    }
+
+    void DisplayConverter::SetWindow(uint32_t minVal, uint32_t maxVal,
+                                     DisplayCurve curve, float gamma)
+    {
+        minVal = std::min<uint32_t>(minVal, LUT_SIZE - 1);
+        maxVal = std::clamp<uint32_t>(maxVal, minVal, LUT_SIZE - 1);
+        gamma = std::max(gamma, MIN_GAMMA);
+        if (m_isLutValid && minVal == m_minVal && maxVal == m_maxVal &&
+            curve == m_curve &&
+            (curve != GAMMA || std::abs(gamma - m_gamma) < GAMMA_TOLERANCE))
+        {
+            return;
+        }
+
+        m_minVal = minVal;
+        m_maxVal = maxVal;
+        m_curve = curve;
+        m_gamma = gamma;
+        RebuildLut();
+    }
+
+    void DisplayConverter::RebuildLut()
+    {
+        m_lut8.resize(LUT_SIZE);
+        m_lutRgba.resize(LUT_SIZE);
+
+        const auto range = static_cast<float>(m_maxVal - m_minVal + 1);
+        const auto logRange = std::log1p(range);
+        for (std::size_t val = 0; val < LUT_SIZE; ++val)
+        {
+            const auto clamped =
+                    std::clamp<std::size_t>(val, m_minVal, m_maxVal);
+            const auto offset = static_cast<float>(clamped - m_minVal);
+
+            float t = offset / range;
+            switch (m_curve)
+            {
+                case GAMMA:
+                    t = std::pow(t, 1.f / m_gamma);
+                    break;
+                case LOG:
+                    t = std::log1p(offset) / logRange;
+                    break;
+                default:
+                    break;
+            }
+
+            const auto val8 = static_cast<uint8_t>(
+                    std::clamp(static_cast<int>(t * 256.f), 0, 255));
+            m_lut8[val] = val8;
+            // RGBA bytes in memory order on a little endian machine
+            m_lutRgba[val] = 0xFF000000u | uint32_t{val8} << 16 |
+                             uint32_t{val8} << 8 | uint32_t{val8};
+        }
+        m_isLutValid = true;
+    }
+
+    void DisplayConverter::SetBitDepth(int bitDepth)
+    {
+        bitDepth = std::clamp(bitDepth, 1, 16);
+        m_saturationValue = static_cast<uint16_t>((1u << bitDepth) - 1);
+        m_stats.binShift = std::max(bitDepth - 12, 0);
+    }
+
+    const uint8_t* DisplayConverter::Convert(const uint16_t* frame,
+                                             uint16_t imageWidth,
+                                             uint16_t imageHeight)
+    {
+        if (!m_isLutValid) { RebuildLut(); }
+
+        const auto numPixels = static_cast<std::size_t>(imageWidth) *
+                               imageHeight;
+        m_rgba.resize(numPixels * 4);
+        m_partialHistograms.assign(NUM_PARTIAL_HISTOGRAMS * HISTOGRAM_BINS, 0);
+        m_stats.numSaturated = 0;
+
+#if defined(__AVX2__)
+        const auto sum = ConvertAvx2(frame, numPixels);
+#elif defined(PRM_HAS_SSE2)
+        const auto sum = ConvertSse2(frame, numPixels);
+#else
+        const auto sum = ConvertScalar(frame, numPixels);
+#endif
+
+        for (std::size_t bin = 0; bin < HISTOGRAM_BINS; ++bin)
+        {
+            uint32_t count = 0;
+            for (std::size_t h = 0; h < NUM_PARTIAL_HISTOGRAMS; ++h)
+            {
+                count += m_partialHistograms[h * HISTOGRAM_BINS + bin];
+            }
+            m_stats.histogram[bin] = count;
+        }
+        m_stats.numPixels = numPixels;
+        m_stats.mean = numPixels > 0 ? static_cast<double>(sum) /
+                                               static_cast<double>(numPixels)
+                                     : 0.0;
+        if (numPixels == 0)
+        {
+            m_stats.min = 0;
+            m_stats.max = 0;
+        }
+        return m_rgba.data();
+    }
+
+    uint64_t DisplayConverter::ConvertScalar(const uint16_t* frame,
+                                             std::size_t numPixels)
+    {
+        auto* out = reinterpret_cast<uint32_t*>(m_rgba.data());
+        uint16_t minVal = UINT16_MAX;
+        uint16_t maxVal = 0;
+        uint64_t sum = 0;
+
+        // Blocks small enough to still be in cache for the histogram
+        for (std::size_t i = 0; i < numPixels; i += 16)
+        {
+            const auto blockSize = std::min<std::size_t>(16, numPixels - i);
+            for (std::size_t j = i; j < i + blockSize; ++j)
+            {
+                out[j] = m_lutRgba[frame[j]];
+                minVal = std::min(minVal, frame[j]);
+                maxVal = std::max(maxVal, frame[j]);
+                m_stats.numSaturated += frame[j] >= m_saturationValue;
+            }
+            sum += AccumulateHistogram(frame + i, blockSize,
+                                       m_partialHistograms.data(),
+                                       m_stats.binShift);
+        }
+        m_stats.min = minVal;
+        m_stats.max = maxVal;
+        return sum;
+    }
+
+    uint64_t DisplayConverter::ConvertSse2(const uint16_t* frame,
+                                           std::size_t numPixels)
+    {
+#if defined(PRM_HAS_SSE2) || defined(__AVX2__)
+        // SSE2 has no gather, so look up the gray levels one by one and
+        // expand 16 of them to RGBA at a time with byte interleaving
+        const auto alpha = _mm_set1_epi8(-1);
+        auto* out = reinterpret_cast<__m128i*>(m_rgba.data());
+        alignas(16) uint8_t gray[16];
+
+        // SSE2 only compares signed words, flipping the top bit maps
+        // unsigned order onto signed order
+        const auto bias = _mm_set1_epi16(INT16_MIN);
+        const auto satBelow = _mm_xor_si128(
+                _mm_set1_epi16(static_cast<int16_t>(m_saturationValue - 1)),
+                bias);
+        auto minVec = _mm_set1_epi16(INT16_MAX);
+        auto maxVec = _mm_set1_epi16(INT16_MIN);
+        uint64_t numSaturated = 0;
+        uint64_t sum = 0;
+
+        std::size_t i = 0;
+        for (; i + 16 <= numPixels; i += 16)
+        {
+            for (std::size_t k = 0; k < 16; ++k)
+            {
+                gray[k] = m_lut8[frame[i + k]];
+            }
+            sum += AccumulateHistogram(frame + i, 16, m_partialHistograms.data(),
+                                       m_stats.binShift);
+
+            const auto g = _mm_load_si128(reinterpret_cast<const __m128i*>(gray));
+            const auto ggLo = _mm_unpacklo_epi8(g, g);
+            const auto ggHi = _mm_unpackhi_epi8(g, g);
+            const auto gaLo = _mm_unpacklo_epi8(g, alpha);
+            const auto gaHi = _mm_unpackhi_epi8(g, alpha);
+
+            _mm_storeu_si128(out++, _mm_unpacklo_epi16(ggLo, gaLo));
+            _mm_storeu_si128(out++, _mm_unpackhi_epi16(ggLo, gaLo));
+            _mm_storeu_si128(out++, _mm_unpacklo_epi16(ggHi, gaHi));
+            _mm_storeu_si128(out++, _mm_unpackhi_epi16(ggHi, gaHi));
+
+            const auto* src = reinterpret_cast<const __m128i*>(frame + i);
+            for (int half = 0; half < 2; ++half)
+            {
+                const auto px = _mm_xor_si128(_mm_loadu_si128(src + half), bias);
+                minVec = _mm_min_epi16(minVec, px);
+                maxVec = _mm_max_epi16(maxVec, px);
+                const auto mask = static_cast<uint32_t>(
+                        _mm_movemask_epi8(_mm_cmpgt_epi16(px, satBelow)));
+                numSaturated += static_cast<uint64_t>(std::popcount(mask)) / 2;
+            }
+        }
+
+        alignas(16) uint16_t lanes[8];
+        uint16_t minVal = UINT16_MAX;
+        uint16_t maxVal = 0;
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes),
+                        _mm_xor_si128(minVec, bias));
+        for (const auto lane: lanes) { minVal = std::min(minVal, lane); }
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes),
+                        _mm_xor_si128(maxVec, bias));
+        for (const auto lane: lanes) { maxVal = std::max(maxVal, lane); }
+
+        auto* tail = reinterpret_cast<uint32_t*>(m_rgba.data());
+        for (std::size_t j = i; j < numPixels; ++j)
+        {
+            tail[j] = m_lutRgba[frame[j]];
+            minVal = std::min(minVal, frame[j]);
+            maxVal = std::max(maxVal, frame[j]);
+            numSaturated += frame[j] >= m_saturationValue;
+        }
+        sum += AccumulateHistogram(frame + i, numPixels - i,
+                                   m_partialHistograms.data(),
+                                   m_stats.binShift);
+
+        m_stats.min = minVal;
+        m_stats.max = maxVal;
+        m_stats.numSaturated = numSaturated;
+        return sum;
+#else
+        return ConvertScalar(frame, numPixels);
+#endif
+    }
+
+    uint64_t DisplayConverter::ConvertAvx2(const uint16_t* frame,
+                                           std::size_t numPixels)
+    {
+#if defined(__AVX2__)
+        const auto* lut = reinterpret_cast<const int*>(m_lutRgba.data());
+        auto* out = reinterpret_cast<__m256i*>(m_rgba.data());
+
+        const auto satVec =
+                _mm256_set1_epi16(static_cast<int16_t>(m_saturationValue));
+        auto minVec = _mm256_set1_epi16(-1);
+        auto maxVec = _mm256_setzero_si256();
+        uint64_t numSaturated = 0;
+        uint64_t sum = 0;
+
+        std::size_t i = 0;
+        for (; i + 16 <= numPixels; i += 16)
+        {
+            const auto px = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(frame + i));
+            const auto lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(px));
+            const auto hi =
+                    _mm256_cvtepu16_epi32(_mm256_extracti128_si256(px, 1));
+
+            _mm256_storeu_si256(out++, _mm256_i32gather_epi32(lut, lo, 4));
+            _mm256_storeu_si256(out++, _mm256_i32gather_epi32(lut, hi, 4));
+
+            minVec = _mm256_min_epu16(minVec, px);
+            maxVec = _mm256_max_epu16(maxVec, px);
+            // px >= sat exactly when max(px, sat) == px
+            const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+                    _mm256_cmpeq_epi16(_mm256_max_epu16(px, satVec), px)));
+            numSaturated += static_cast<uint64_t>(std::popcount(mask)) / 2;
+
+            sum += AccumulateHistogram(frame + i, 16, m_partialHistograms.data(),
+                                       m_stats.binShift);
+        }
+
+        alignas(32) uint16_t lanes[16];
+        uint16_t minVal = UINT16_MAX;
+        uint16_t maxVal = 0;
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), minVec);
+        for (const auto lane: lanes) { minVal = std::min(minVal, lane); }
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), maxVec);
+        for (const auto lane: lanes) { maxVal = std::max(maxVal, lane); }
+
+        auto* tail = reinterpret_cast<uint32_t*>(m_rgba.data());
+        for (std::size_t j = i; j < numPixels; ++j)
+        {
+            tail[j] = m_lutRgba[frame[j]];
+            minVal = std::min(minVal, frame[j]);
+            maxVal = std::max(maxVal, frame[j]);
+            numSaturated += frame[j] >= m_saturationValue;
+        }
+        sum += AccumulateHistogram(frame + i, numPixels - i,
+                                   m_partialHistograms.data(),
+                                   m_stats.binShift);
+
+        m_stats.min = minVal;
+        m_stats.max = maxVal;
+        m_stats.numSaturated = numSaturated;
+        return sum;
+#else
+        return ConvertSse2(frame, numPixels);
+#endif
+    }
+
+    void DisplayConverter::UpdateTexture(sf::Texture& texture,
+                                         const uint8_t* rgba,
+                                         uint16_t imageWidth,
+                                         uint16_t imageHeight)
+    {
+        if (texture.getSize() != sf::Vector2u{imageWidth, imageHeight})
+        {
+            if (!texture.create(imageWidth, imageHeight)) { return; }
+        }
+        texture.update(rgba);
+    }
+
+    const char* DisplayConverter::GetKernelName()
+    {
+#if defined(__AVX2__)
+        return "AVX2";
+#elif defined(PRM_HAS_SSE2)
+        return "SSE2";
+#else
+        return "scalar";
+#endif
+    }
+}// namespace prm
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace prm
+{
+    /// Mapping from the display window to screen brightness
+    enum DisplayCurve
+    {
+        LINEAR = 0,
+        GAMMA = 1,
+        LOG = 2
+    };
+
+    /// Number of bins in the frame histogram
+    const std::size_t HISTOGRAM_BINS = 4096;
+
+    /// Frame statistics gathered during the display conversion
+    struct FrameStats
+    {
+        uint16_t min = 0;
+        uint16_t max = 0;
+        double mean = 0.0;
+        /// Number of pixels at the top of the sensor range
+        uint64_t numSaturated = 0;
+        uint64_t numPixels = 0;
+        /// Number of low bits dropped to get the histogram bin of a value
+        int binShift = 0;
+        std::array<uint32_t, HISTOGRAM_BINS> histogram{};
+
+        /**
+         * Estimates a percentile of the pixel values from the histogram
+         *
+         * @param fraction Percentile as a fraction from 0 to 1
+         * @return Lowest value of the bin the percentile falls into
+         */
+        [[nodiscard]] uint16_t Percentile(double fraction) const;
+    };
+
+    /**
+     * Converts 16 bit mono frames to RGBA for display
+     * Every possible pixel value is mapped through a lookup table that is only
+     * rebuilt when the display window or curve changes, the result goes into a
+     * reused RGBA buffer that can be uploaded straight into a texture. Frame
+     * statistics are gathered in the same pass, so the frame is read only once
+     */
+    class DisplayConverter
+    {
+    public:
+        DisplayConverter() = default;
+
+        /**
+         * Sets up the display window, rebuilds the lookup table on change
+         *
+         * @param minVal Pixel value shown as black
+         * @param maxVal Pixel value shown as white
+         * @param curve Curve applied between minVal and maxVal
+         * @param gamma Gamma value for the GAMMA curve
+         */
+        void SetWindow(uint32_t minVal, uint32_t maxVal,
+                       DisplayCurve curve = LINEAR, float gamma = 1.f);
+
+        /**
+         * Sets the sensor bit depth that defines saturation and histogram bins
+         *
+         * @param bitDepth Number of significant bits in each pixel
+         */
+        void SetBitDepth(int bitDepth);
+
+        /**
+         * Converts a frame to RGBA and updates the frame statistics
+         *
+         * @param frame Frame pixels
+         * @param imageWidth Frame width
+         * @param imageHeight Frame height
+         * @return Pointer to imageWidth * imageHeight RGBA pixels, valid until the next call
+         */
+        const uint8_t* Convert(const uint16_t* frame, uint16_t imageWidth,
+                               uint16_t imageHeight);
+
+        /**
+         * Gives the statistics of the last converted frame
+         *
+         * @return Frame statistics
+         */
+        [[nodiscard]] const FrameStats& GetStats() const { return m_stats; }
+
+        /**
+         * Uploads RGBA pixels into a texture, recreating it on size change
+         * The caller is responsible for the texture synchronisation
+         *
+         * @param texture Texture to update
+         * @param rgba RGBA pixels
+         * @param imageWidth Image width
+         * @param imageHeight Image height
+         */
+        static void UpdateTexture(sf::Texture& texture, const uint8_t* rgba,
+                                  uint16_t imageWidth, uint16_t imageHeight);
+
+        /**
+         * Gives the name of the conversion kernel picked at compile time
+         *
+         * @return "AVX2", "SSE2" or "scalar"
+         */
+        static const char* GetKernelName();
+
+    private:
+        /**
+         * Fills both lookup tables for the current window
+         */
+        void RebuildLut();
+
+        /**
+         * Kernels convert the frame and fill in the min, max, saturated pixel
+         * count and the histogram, returning the pixel sum
+         */
+        uint64_t ConvertScalar(const uint16_t* frame, std::size_t numPixels);
+        uint64_t ConvertSse2(const uint16_t* frame, std::size_t numPixels);
+        uint64_t ConvertAvx2(const uint16_t* frame, std::size_t numPixels);
+
+        uint32_t m_minVal = 0;
+        uint32_t m_maxVal = 0;
+        DisplayCurve m_curve = LINEAR;
+        float m_gamma = 1.f;
+        bool m_isLutValid = false;
+
+        /// Screen brightness for every 16 bit value
+        std::vector<uint8_t> m_lut8{};
+        /// Packed RGBA pixel for every 16 bit value
+        std::vector<uint32_t> m_lutRgba{};
+
+        /// Output buffer reused between frames
+        std::vector<uint8_t> m_rgba{};
+
+        /// Value at which a pixel counts as saturated
+        uint16_t m_saturationValue = UINT16_MAX;
+        /// Statistics of the last converted frame
+        FrameStats m_stats{};
+        /**
+         * Interleaved partial histograms, consecutive pixels go to different
+         * copies so equal neighbours don't serialize on the same counter
+         */
+        std::vector<uint32_t> m_partialHistograms{};
+    };
+}// namespace prm
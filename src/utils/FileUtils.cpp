@@ -1,11 +1,24 @@
 #include <OpenImageIO/imageio.h>
+#include <algorithm>
 #include <ctime>
+#include <filesystem>
 #include <fmt/format.h>
 #include <fstream>
 #include <iomanip>
 #include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
 
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "ChunkedStack.h"
 #include "FileUtils.h"
+#include "RawStack.h"
+#include "TiffStackWriter.h"
 
 namespace prm
 {
@@ -31,6 +44,8 @@ namespace prm
                 videoPath.append(".mp4");
                 break;
             case DIR:
+            case RAW:
+            case CHUNKED:
                 break;
             default:
                 return std::string{};
@@ -38,47 +53,231 @@ namespace prm
         return videoPath;
     }
 
-    bool FileUtils::WritePvcamStack(const void* data, uint16_t imageWidth,
-                                    uint16_t imageHeight, uint32_t imageSize,
-                                    std::string_view filePath,
-                                    uint16_t numImages)
+    bool FileUtils::WriteTifMetadata(std::string_view filePath,
+                                     const TifStackMeta& meta)
+    {
+        if (auto ofs =
+                    std::ofstream{fmt::format("{}{}", filePath, "\\meta.json")})
+        {
+            ofs << nlohmann::json{meta}.dump(4) << '\n';
+        }
+
+        return true;
+    }
+
+    bool FileUtils::ConvertTifToRaw(std::string_view tifPath,
+                                    std::string_view rawPath)
     {
         using namespace OIIO;
-        const auto tifPath = fmt::format("{}{}", filePath, "\\stack.tif");
 
-        std::unique_ptr<ImageOutput> out = ImageOutput::create(tifPath);
-        if (!out) return false;
-        ImageSpec spec(imageWidth, imageHeight, 1, TypeDesc::UINT16);
-        spec.attribute("compression", "none");
+        auto inp = ImageInput::open(std::string{tifPath});
+        if (!inp)
+        {
+            spdlog::error("Couldn't open {}", tifPath);
+            return false;
+        }
+        const auto& spec = inp->spec();
+        const auto imageWidth = static_cast<uint32_t>(spec.width);
+        const auto imageHeight = static_cast<uint32_t>(spec.height);
+        const auto bitDepth = static_cast<uint32_t>(
+                spec.get_int_attribute("oiio:BitsPerSample", 16));
+
+        TifStackMeta meta{};
+        const auto metaPath =
+                std::filesystem::path{tifPath}.parent_path() / "meta.json";
+        if (std::filesystem::exists(metaPath))
+        {
+            try
+            {
+                nlohmann::json::parse(ReadFileToString(metaPath.string()))
+                        .get_to(meta);
+            }
+            catch (const std::exception& e)
+            {
+                spdlog::warn("Ignoring unreadable {}: {}", metaPath.string(),
+                             e.what());
+                meta = TifStackMeta{};
+            }
+        }
 
-        if (!out->supports("multiimage") || !out->supports("appendsubimage"))
+        RawStackWriter writer{};
+        const auto compression = StripCodec::IsSupported(meta.compression)
+                                         ? meta.compression
+                                         : NO_COMPRESSION;
+        if (!writer.Open(rawPath, imageWidth, imageHeight,
+                         {.bitDepth = bitDepth,
+                          .compression = compression,
+                          .patchThreshold = meta.patchThreshold}))
         {
             return false;
         }
+        std::vector<uint16_t> frame(std::size_t{imageWidth} * imageHeight);
+        for (int i = 0; inp->seek_subimage(i, 0); ++i)
+        {
+            if (!inp->read_image(TypeDesc::UINT16, frame.data()) ||
+                !writer.WriteFrame(frame.data()))
+            {
+                spdlog::error("Failed converting frame {} of {}", i, tifPath);
+                writer.Close(meta);
+                return false;
+            }
+        }
+        return writer.Close(meta);
+    }
 
-        ImageOutput::OpenMode appendmode = ImageOutput::Create;
+    bool FileUtils::ConvertRawToTif(std::string_view rawPath,
+                                    std::string_view tifPath)
+    {
+        RawStackReader reader{};
+        if (!reader.Open(rawPath)) { return false; }
 
-        for (std::size_t s = 0; s < numImages; ++s)
+        // Tif frames have to decode on their own, temporal and patch stacks
+        // convert to the per frame compression of their coder, patch frames
+        // rebuilt over their background
+        const auto& header = reader.GetHeader();
+        const auto compression = StripCodec::FrameCompression(
+                static_cast<Compression>(header.compression));
+        TiffStackWriter writer{};
+        if (!writer.Open(tifPath, header.imageWidth, header.imageHeight,
+                         reader.GetNumFrames(), compression))
         {
-            out->open(tifPath, spec, appendmode);
-            out->write_image(TypeDesc::UINT16, (uint8_t*) data + imageSize * s);
-            appendmode = ImageOutput::AppendSubimage;
+            return false;
         }
-        return true;
+        std::vector<uint16_t> frame(std::size_t{header.imageWidth} *
+                                    header.imageHeight);
+        RawDecodeState state{};
+        for (std::uint64_t i = 0; i < reader.GetNumFrames(); ++i)
+        {
+            if (!reader.ReadFrame(i, frame.data(), state) ||
+                !writer.WriteFrame(frame.data()))
+            {
+                spdlog::error("Failed converting frame {} of {}", i, rawPath);
+                writer.Close();
+                return false;
+            }
+        }
+        return writer.Close();
     }
 
-    bool FileUtils::WriteTifMetadata(std::string_view filePath,
-                                     const TifStackMeta& meta)
+    bool FileUtils::ConvertChunkedToTif(std::string_view chunkedPath,
+                                        std::string_view tifPath)
     {
-        if (auto ofs =
-                    std::ofstream{fmt::format("{}{}", filePath, "\\meta.json")})
+        ChunkedStackReader reader{};
+        if (!reader.Open(chunkedPath)) { return false; }
+
+        TiffStackWriter writer{};
+        if (!writer.Open(tifPath, reader.GetImageWidth(),
+                         reader.GetImageHeight(), reader.GetNumFrames(),
+                         reader.GetCompression()))
         {
-            ofs << nlohmann::json{meta}.dump(4) << '\n';
+            return false;
+        }
+        const auto framePixels =
+                std::size_t{reader.GetImageWidth()} * reader.GetImageHeight();
+        std::vector<uint16_t> chunk{};
+        for (std::uint64_t i = 0; i < reader.GetNumFrames(); ++i)
+        {
+            const auto inChunk = i % reader.GetFramesPerChunk();
+            if ((inChunk == 0 &&
+                 !reader.ReadChunk(i / reader.GetFramesPerChunk(), chunk)) ||
+                !writer.WriteFrame(chunk.data() + inChunk * framePixels))
+            {
+                spdlog::error("Failed converting frame {} of {}", i,
+                              chunkedPath);
+                writer.Close();
+                return false;
+            }
+        }
+        return writer.Close();
+    }
+
+    bool FileUtils::ReadFrameSidecar(std::string_view path,
+                                     FrameColumns& columns)
+    {
+        columns.Clear();
+        auto sidecarPath = std::filesystem::path{path};
+        if (std::filesystem::is_directory(sidecarPath))
+        {
+            sidecarPath /= FRAME_SIDECAR_FILE;
+        }
+
+        std::ifstream ifs{sidecarPath, std::ios::binary};
+        char magic[sizeof(FRAME_SIDECAR_MAGIC)]{};
+        uint32_t version = 0;
+        ifs.read(magic, sizeof(magic));
+        ifs.read(reinterpret_cast<char*>(&version), sizeof(version));
+        if (!ifs ||
+            !std::equal(std::begin(magic), std::end(magic),
+                        std::begin(FRAME_SIDECAR_MAGIC)) ||
+            version != FRAME_SIDECAR_VERSION)
+        {
+            spdlog::error("{} is not a frame sidecar", sidecarPath.string());
+            return false;
         }
 
+        const auto readColumn = [&ifs](auto& column, uint32_t numRecords)
+        {
+            column.resize(numRecords);
+            ifs.read(reinterpret_cast<char*>(column.data()),
+                     static_cast<std::streamsize>(
+                             numRecords * sizeof(column.front())));
+        };
+
+        FrameColumns block{};
+        uint32_t numRecords = 0;
+        while (ifs.read(reinterpret_cast<char*>(&numRecords),
+                        sizeof(numRecords)))
+        {
+            readColumn(block.frameNr, numRecords);
+            readColumn(block.bofTime, numRecords);
+            readColumn(block.eofTime, numRecords);
+            readColumn(block.loopLatency, numRecords);
+            readColumn(block.minValue, numRecords);
+            readColumn(block.maxValue, numRecords);
+            readColumn(block.meanValue, numRecords);
+            readColumn(block.droppedBefore, numRecords);
+            if (!ifs)
+            {
+                // A block cut short by an interrupted capture is left out
+                spdlog::warn("{} is truncated", sidecarPath.string());
+                break;
+            }
+            columns.Append(block);
+        }
         return true;
     }
 
+    bool FileUtils::SyncFile(std::string_view path)
+    {
+        const std::string pathStr{path};
+#ifdef _WIN32
+        // Flushing needs write access, the writer's handle shares it
+        auto* file = CreateFileA(pathStr.c_str(), GENERIC_WRITE,
+                                 FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                         FILE_SHARE_DELETE,
+                                 nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                                 nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            spdlog::error("Couldn't open {} to sync it", pathStr);
+            return false;
+        }
+        const bool synced = FlushFileBuffers(file) != 0;
+        CloseHandle(file);
+#else
+        const int fd = open(pathStr.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            spdlog::error("Couldn't open {} to sync it", pathStr);
+            return false;
+        }
+        const bool synced = fsync(fd) == 0;
+        close(fd);
+#endif
+        if (!synced) { spdlog::error("Couldn't sync {}", pathStr); }
+        return synced;
+    }
+
     std::string FileUtils::ReadFileToString(const std::string_view file_path)
     {
         if (auto ifs = std::ifstream{file_path.data()})
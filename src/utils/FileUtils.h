@@ -1,6 +1,10 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include "misc/Meta.h"
+#include "utils/FrameSidecar.h"
 
 namespace prm
 {
@@ -11,7 +15,9 @@ namespace prm
     {
         TIF = 0,///< tiff stack
         MP4 = 1,///< mp4
-        DIR = 2///< separate directory with tif stack and metadata
+        DIR = 2,///< separate directory with tif stack and metadata
+        RAW = 3,///< separate directory with raw stack and metadata
+        CHUNKED = 4///< separate directory with chunked zarr stack and metadata
     };
 
     /**
@@ -32,22 +38,6 @@ namespace prm
                                              std::string_view prefix,
                                              SAVE_FORMAT format);
 
-        /**
-         * Writes a tiff stack of 16 bit images captured by pvcam
-         *
-         * @param data Byte array containing captured images
-         * @param imageWidth Width of each image
-         * @param imageHeight Height of each image
-         * @param imageSize Size of each image in bytes
-         * @param filePath Path where to save the stack file
-         * @param numImages Number of images to save in the stack
-         * @return
-         */
-        static bool WritePvcamStack(const void* data, uint16_t imageWidth,
-                                    uint16_t imageHeight, uint32_t imageSize,
-                                    std::string_view filePath,
-                                    uint16_t numImages);
-
         /**
          * Writes tif stack capture metadata in json file
          *
@@ -58,6 +48,59 @@ namespace prm
         static bool WriteTifMetadata(std::string_view filePath,
                                      const TifStackMeta& meta);
 
+        /**
+         * Converts a 16 bit tif stack to a raw stack
+         * Capture metadata and compression are taken from meta.json next to
+         * the tif stack if there is one
+         *
+         * @param tifPath Path of the tif stack
+         * @param rawPath Path of the raw stack to create
+         * @return true on success
+         */
+        static bool ConvertTifToRaw(std::string_view tifPath,
+                                    std::string_view rawPath);
+
+        /**
+         * Converts a raw stack to a 16 bit tif stack with the same compression
+         *
+         * @param rawPath Path of the raw stack
+         * @param tifPath Path of the tif stack to create
+         * @return true on success
+         */
+        static bool ConvertRawToTif(std::string_view rawPath,
+                                    std::string_view tifPath);
+
+        /**
+         * Converts a chunked stack to a 16 bit tif stack with the same compression
+         *
+         * @param chunkedPath Path of the chunked stack directory
+         * @param tifPath Path of the tif stack to create
+         * @return true on success
+         */
+        static bool ConvertChunkedToTif(std::string_view chunkedPath,
+                                        std::string_view tifPath);
+
+        /**
+         * Reads the per frame metadata written next to a saved stack
+         * A sidecar of an interrupted capture gives every record flushed
+         * before the interruption
+         *
+         * @param path Capture directory or path of the sidecar file
+         * @param columns Filled with one entry per saved frame
+         * @return true on success
+         */
+        static bool ReadFrameSidecar(std::string_view path,
+                                     FrameColumns& columns);
+
+        /**
+         * Forces the written data of a file out of the OS cache onto the disk
+         * Other handles to the file may stay open and keep writing
+         *
+         * @param path Path of the file
+         * @return true once the data is on disk
+         */
+        static bool SyncFile(std::string_view path);
+
         static std::string ReadFileToString(const std::string_view file_path);
         static std::vector<std::string> Tokenize(const std::string& string);
     };
@@ -0,0 +1,147 @@
+#include <spdlog/spdlog.h>
+
+#include "FileUtils.h"
+#include "FrameSidecar.h"
+
+namespace prm
+{
+    namespace
+    {
+        template<typename T>
+        void WriteColumn(std::ofstream& ofs, const std::vector<T>& column)
+        {
+            ofs.write(reinterpret_cast<const char*>(column.data()),
+                      static_cast<std::streamsize>(column.size() * sizeof(T)));
+        }
+
+        template<typename T>
+        void AppendColumn(std::vector<T>& column, const std::vector<T>& other)
+        {
+            column.insert(column.end(), other.begin(), other.end());
+        }
+    }// namespace
+
+    void FrameColumns::Append(const FrameRecord& record)
+    {
+        frameNr.push_back(record.frameNr);
+        bofTime.push_back(record.bofTime);
+        eofTime.push_back(record.eofTime);
+        loopLatency.push_back(record.loopLatency);
+        minValue.push_back(record.minValue);
+        maxValue.push_back(record.maxValue);
+        meanValue.push_back(record.meanValue);
+        droppedBefore.push_back(record.droppedBefore);
+    }
+
+    void FrameColumns::Append(const FrameColumns& other)
+    {
+        AppendColumn(frameNr, other.frameNr);
+        AppendColumn(bofTime, other.bofTime);
+        AppendColumn(eofTime, other.eofTime);
+        AppendColumn(loopLatency, other.loopLatency);
+        AppendColumn(minValue, other.minValue);
+        AppendColumn(maxValue, other.maxValue);
+        AppendColumn(meanValue, other.meanValue);
+        AppendColumn(droppedBefore, other.droppedBefore);
+    }
+
+    FrameRecord FrameColumns::Get(std::size_t index) const
+    {
+        return FrameRecord{.frameNr = frameNr[index],
+                           .bofTime = bofTime[index],
+                           .eofTime = eofTime[index],
+                           .loopLatency = loopLatency[index],
+                           .minValue = minValue[index],
+                           .maxValue = maxValue[index],
+                           .meanValue = meanValue[index],
+                           .droppedBefore = droppedBefore[index]};
+    }
+
+    void FrameColumns::Clear()
+    {
+        frameNr.clear();
+        bofTime.clear();
+        eofTime.clear();
+        loopLatency.clear();
+        minValue.clear();
+        maxValue.clear();
+        meanValue.clear();
+        droppedBefore.clear();
+    }
+
+    bool FrameSidecarWriter::Open(std::string_view path)
+    {
+        if (IsOpen())
+        {
+            spdlog::error("Frame sidecar writer is already open");
+            return false;
+        }
+
+        m_path = path;
+        m_pending.Clear();
+        m_errorOccurred = false;
+
+        m_ofs.open(m_path, std::ios::binary | std::ios::trunc);
+        if (!m_ofs)
+        {
+            spdlog::error("Couldn't create {}", m_path);
+            return false;
+        }
+        m_ofs.write(FRAME_SIDECAR_MAGIC, sizeof(FRAME_SIDECAR_MAGIC));
+        m_ofs.write(reinterpret_cast<const char*>(&FRAME_SIDECAR_VERSION),
+                    sizeof(FRAME_SIDECAR_VERSION));
+        return static_cast<bool>(m_ofs);
+    }
+
+    bool FrameSidecarWriter::Append(const FrameRecord& record)
+    {
+        if (!IsOpen()) { return false; }
+
+        m_pending.Append(record);
+        if (m_pending.Size() >= FRAME_SIDECAR_BLOCK_RECORDS) { return Flush(); }
+        return !m_errorOccurred;
+    }
+
+    bool FrameSidecarWriter::Flush()
+    {
+        if (!IsOpen()) { return false; }
+        if (m_pending.Size() == 0) { return !m_errorOccurred; }
+
+        const auto numRecords = static_cast<uint32_t>(m_pending.Size());
+        m_ofs.write(reinterpret_cast<const char*>(&numRecords),
+                    sizeof(numRecords));
+        WriteColumn(m_ofs, m_pending.frameNr);
+        WriteColumn(m_ofs, m_pending.bofTime);
+        WriteColumn(m_ofs, m_pending.eofTime);
+        WriteColumn(m_ofs, m_pending.loopLatency);
+        WriteColumn(m_ofs, m_pending.minValue);
+        WriteColumn(m_ofs, m_pending.maxValue);
+        WriteColumn(m_ofs, m_pending.meanValue);
+        WriteColumn(m_ofs, m_pending.droppedBefore);
+        m_ofs.flush();
+        m_pending.Clear();
+
+        if (!m_ofs && !m_errorOccurred)
+        {
+            spdlog::error("Failed writing frame metadata to {}", m_path);
+            m_errorOccurred = true;
+        }
+        return !m_errorOccurred;
+    }
+
+    bool FrameSidecarWriter::Sync()
+    {
+        return Flush() && FileUtils::SyncFile(m_path);
+    }
+
+    bool FrameSidecarWriter::Close()
+    {
+        if (!IsOpen()) { return true; }
+
+        Flush();
+        m_ofs.close();
+        if (m_ofs.fail()) { m_errorOccurred = true; }
+        m_ofs.clear();
+        return !m_errorOccurred;
+    }
+}// namespace prm
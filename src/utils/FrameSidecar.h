@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace prm
+{
+    /// Name of the per frame metadata file in a capture directory
+    const char FRAME_SIDECAR_FILE[] = "frames.bin";
+    /// Identifies frame sidecar files, the line break catches text mode transfers
+    const char FRAME_SIDECAR_MAGIC[8] = {'P', 'R', 'M', 'F', 'R', 'M', '\r', '\n'};
+    const uint32_t FRAME_SIDECAR_VERSION = 1;
+    /// A block is written once it holds this many records
+    const std::size_t FRAME_SIDECAR_BLOCK_RECORDS = 4096;
+
+    /**
+     * Capture conditions and pixel statistics of one saved frame
+     * Time stamps are in seconds on the camera clock if the camera gives
+     * them, on the host steady clock otherwise
+     */
+    struct FrameRecord
+    {
+        /// Frame number as counted by the source
+        int64_t frameNr;
+        /// Start of readout, 0 if the source has no such time stamp
+        double bofTime;
+        /// End of readout
+        double eofTime;
+        /// Host time from the end of readout to the hand over to the writer
+        double loopLatency;
+        uint16_t minValue;
+        uint16_t maxValue;
+        float meanValue;
+        /// Frames lost right before this one, dropped by the camera or not saved
+        uint32_t droppedBefore;
+    };
+
+    /**
+     * Per frame metadata of a capture, one vector per FrameRecord field
+     */
+    struct FrameColumns
+    {
+        std::vector<int64_t> frameNr{};
+        std::vector<double> bofTime{};
+        std::vector<double> eofTime{};
+        std::vector<double> loopLatency{};
+        std::vector<uint16_t> minValue{};
+        std::vector<uint16_t> maxValue{};
+        std::vector<float> meanValue{};
+        std::vector<uint32_t> droppedBefore{};
+
+        [[nodiscard]] std::size_t Size() const { return frameNr.size(); }
+
+        /**
+         * Appends one record to every column
+         *
+         * @param record Record to append
+         */
+        void Append(const FrameRecord& record);
+
+        /**
+         * Appends all the records of other columns
+         *
+         * @param other Columns to append
+         */
+        void Append(const FrameColumns& other);
+
+        /**
+         * Gathers one record from the columns
+         *
+         * @param index Record index
+         * @return Record at the index
+         */
+        [[nodiscard]] FrameRecord Get(std::size_t index) const;
+
+        void Clear();
+    };
+
+    /**
+     * Writer of the binary per frame metadata of a capture
+     * The file is a short header followed by blocks, each block holds a
+     * record count and then every column of those records in turn. Blocks
+     * are appended while capturing, so a file that was never closed still has
+     * every flushed record
+     */
+    class FrameSidecarWriter
+    {
+    public:
+        FrameSidecarWriter() = default;
+
+        FrameSidecarWriter(const FrameSidecarWriter&) = delete;
+        FrameSidecarWriter& operator=(const FrameSidecarWriter&) = delete;
+
+        /**
+         * Creates the sidecar file
+         *
+         * @param path Path of the sidecar file
+         * @return true on success
+         */
+        bool Open(std::string_view path);
+
+        /**
+         * Adds a record, writing a block once enough records are collected
+         *
+         * @param record Record of the next saved frame
+         * @return true on success
+         */
+        bool Append(const FrameRecord& record);
+
+        /**
+         * Writes the collected records as a block and flushes the file
+         *
+         * @return true on success
+         */
+        bool Flush();
+
+        /**
+         * Flushes and forces the file onto the disk
+         *
+         * @return true once every record so far is durable
+         */
+        bool Sync();
+
+        /**
+         * Flushes and closes the file
+         *
+         * @return true if every record made it to disk
+         */
+        bool Close();
+
+        [[nodiscard]] bool IsOpen() const { return m_ofs.is_open(); }
+
+        ~FrameSidecarWriter() { Close(); }
+
+    private:
+        std::string m_path{};
+        std::ofstream m_ofs{};
+        /// Records not written yet
+        FrameColumns m_pending{};
+        bool m_errorOccurred = false;
+    };
+}// namespace prm
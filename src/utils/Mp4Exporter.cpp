@@ -0,0 +1,296 @@
+#include <OpenImageIO/imageio.h>
+#include <algorithm>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <opencv2/opencv.hpp>
+#include <spdlog/spdlog.h>
+#include <thread>
+
+#include "Mp4Exporter.h"
+#include "utils/ChunkedStack.h"
+#include "utils/Exec.h"
+#include "utils/RawStack.h"
+
+namespace prm
+{
+    bool Mp4Exporter::Export(const uint16_t* frames, uint16_t imageWidth,
+                             uint16_t imageHeight, std::size_t numFrames,
+                             std::string_view outPath,
+                             const Mp4ExportOptions& options)
+    {
+        const auto frameSize = static_cast<std::size_t>(imageWidth) * imageHeight;
+        const auto makeReader = [frames, frameSize]() -> FrameReader
+        {
+            return [frames, frameSize](std::size_t index, uint16_t* out)
+            {
+                std::copy_n(frames + index * frameSize, frameSize, out);
+                return true;
+            };
+        };
+        return Export(makeReader, imageWidth, imageHeight, numFrames, outPath,
+                      options);
+    }
+
+    bool Mp4Exporter::ExportTifStack(std::string_view tifPath,
+                                     std::string_view outPath,
+                                     const Mp4ExportOptions& options)
+    {
+        using namespace OIIO;
+
+        const std::string path{tifPath};
+        auto inp = ImageInput::open(path);
+        if (!inp)
+        {
+            spdlog::error("Couldn't open {}", path);
+            return false;
+        }
+        const auto imageWidth = static_cast<uint16_t>(inp->spec().width);
+        const auto imageHeight = static_cast<uint16_t>(inp->spec().height);
+
+        std::size_t numFrames = 1;
+        while (inp->seek_subimage(static_cast<int>(numFrames), 0))
+        {
+            ++numFrames;
+        }
+        inp->close();
+
+        // Every segment seeks through its own handle, so the reads run in
+        // parallel like the encoding
+        const auto makeReader = [path]() -> FrameReader
+        {
+            std::shared_ptr<ImageInput> segmentInput = ImageInput::open(path);
+            return [segmentInput](std::size_t index, uint16_t* out)
+            {
+                return segmentInput &&
+                       segmentInput->seek_subimage(static_cast<int>(index),
+                                                   0) &&
+                       segmentInput->read_image(TypeDesc::UINT16, out);
+            };
+        };
+        return Export(makeReader, imageWidth, imageHeight, numFrames, outPath,
+                      options);
+    }
+
+    bool Mp4Exporter::ExportRawStack(std::string_view rawPath,
+                                     std::string_view outPath,
+                                     const Mp4ExportOptions& options)
+    {
+        RawStackReader reader{};
+        if (!reader.Open(rawPath)) { return false; }
+
+        const auto& header = reader.GetHeader();
+        const auto makeReader = [&reader]() -> FrameReader
+        {
+            // Each reader keeps its own place in temporally compressed stacks
+            return [&reader, state = RawDecodeState{}](
+                           std::size_t index, uint16_t* out) mutable
+            { return reader.ReadFrame(index, out, state); };
+        };
+        return Export(makeReader, static_cast<uint16_t>(header.imageWidth),
+                      static_cast<uint16_t>(header.imageHeight),
+                      reader.GetNumFrames(), outPath, options);
+    }
+
+    bool Mp4Exporter::ExportChunkedStack(std::string_view chunkedPath,
+                                         std::string_view outPath,
+                                         const Mp4ExportOptions& options)
+    {
+        ChunkedStackReader reader{};
+        if (!reader.Open(chunkedPath)) { return false; }
+
+        const auto framePixels =
+                std::size_t{reader.GetImageWidth()} * reader.GetImageHeight();
+        const auto makeReader = [&reader, framePixels]() -> FrameReader
+        {
+            // Segments read consecutive frames, so one decoded chunk is enough
+            return [&reader, framePixels,
+                    chunk = std::vector<uint16_t>{},
+                    chunkIndex = ~std::uint64_t{0}](std::size_t index,
+                                                   uint16_t* out) mutable
+            {
+                const auto wanted = index / reader.GetFramesPerChunk();
+                if (wanted != chunkIndex)
+                {
+                    if (!reader.ReadChunk(wanted, chunk)) { return false; }
+                    chunkIndex = wanted;
+                }
+                std::copy_n(chunk.data() +
+                                    index % reader.GetFramesPerChunk() *
+                                            framePixels,
+                            framePixels, out);
+                return true;
+            };
+        };
+        return Export(makeReader, static_cast<uint16_t>(reader.GetImageWidth()),
+                      static_cast<uint16_t>(reader.GetImageHeight()),
+                      reader.GetNumFrames(), outPath, options);
+    }
+
+    bool Mp4Exporter::Export(const std::function<FrameReader()>& makeReader,
+                             uint16_t imageWidth, uint16_t imageHeight,
+                             std::size_t numFrames, std::string_view outPath,
+                             const Mp4ExportOptions& options)
+    {
+        if (numFrames == 0)
+        {
+            spdlog::warn("Nothing to export");
+            return false;
+        }
+
+        auto numSegments = options.numSegments > 0
+                                   ? options.numSegments
+                                   : std::max(std::thread::hardware_concurrency(),
+                                              1u);
+        numSegments = static_cast<unsigned>(
+                std::min<std::size_t>(numSegments, numFrames));
+
+        std::vector<std::string> segmentPaths{};
+        for (unsigned i = 0; i < numSegments; ++i)
+        {
+            segmentPaths.push_back(
+                    numSegments == 1 ? std::string{outPath}
+                                     : fmt::format("{}.part{}.mp4", outPath, i));
+        }
+
+        spdlog::info("Exporting {} frames to {} in {} segments", numFrames,
+                     outPath, numSegments);
+
+        std::atomic<std::size_t> framesDone = 0;
+        std::vector<char> results(numSegments, 0);
+        {
+            std::vector<std::jthread> workers{};
+            for (unsigned i = 0; i < numSegments; ++i)
+            {
+                const auto first = numFrames * i / numSegments;
+                const auto last = numFrames * (i + 1) / numSegments;
+                workers.emplace_back(
+                        [&, i, first, last]()
+                        {
+                            results[i] = EncodeSegment(
+                                    makeReader(), imageWidth, imageHeight,
+                                    first, last, segmentPaths[i], options,
+                                    framesDone);
+                        });
+            }
+        }
+
+        bool success = std::all_of(results.begin(), results.end(),
+                                   [](char result) { return result != 0; });
+        if (success && numSegments > 1)
+        {
+            success = ConcatSegments(segmentPaths, outPath);
+        }
+
+        if (!success)
+        {
+            // The encoded segments are kept for a manual join
+            spdlog::error("Export to {} failed", outPath);
+            return false;
+        }
+
+        if (numSegments > 1)
+        {
+            std::error_code ec;
+            for (const auto& segmentPath: segmentPaths)
+            {
+                std::filesystem::remove(segmentPath, ec);
+            }
+        }
+        spdlog::info("Exported {} frames to {}", framesDone.load(), outPath);
+        return true;
+    }
+
+    bool Mp4Exporter::EncodeSegment(const FrameReader& reader,
+                                    uint16_t imageWidth, uint16_t imageHeight,
+                                    std::size_t first, std::size_t last,
+                                    const std::string& segmentPath,
+                                    const Mp4ExportOptions& options,
+                                    std::atomic<std::size_t>& framesDone)
+    {
+        cv::VideoWriter writer{segmentPath,
+                               cv::VideoWriter::fourcc('X', '2', '6', '4'),
+                               options.fps, cv::Size{imageWidth, imageHeight}};
+        if (!writer.isOpened())
+        {
+            spdlog::error("Couldn't open video writer for {}", segmentPath);
+            return false;
+        }
+
+        // Each segment tone maps with its own lookup table
+        DisplayConverter converter{};
+        converter.SetBitDepth(options.bitDepth);
+        converter.SetWindow(options.minValue, options.maxValue, options.curve,
+                            options.gamma);
+
+        std::vector<uint16_t> frame(static_cast<std::size_t>(imageWidth) *
+                                    imageHeight);
+        cv::Mat bgr{};
+        for (auto index = first; index < last; ++index)
+        {
+            if (!reader(index, frame.data()))
+            {
+                spdlog::error("Couldn't read frame {}", index);
+                return false;
+            }
+
+            const auto* rgba =
+                    converter.Convert(frame.data(), imageWidth, imageHeight);
+            cv::cvtColor(cv::Mat(imageHeight, imageWidth, CV_8UC4,
+                                 const_cast<uint8_t*>(rgba)),
+                         bgr, cv::COLOR_RGBA2BGR);
+            writer.write(bgr);
+            ++framesDone;
+        }
+        writer.release();
+        return true;
+    }
+
+    bool Mp4Exporter::ConcatSegments(const std::vector<std::string>& segmentPaths,
+                                     std::string_view outPath)
+    {
+        const auto listPath = fmt::format("{}.segments.txt", outPath);
+        if (auto ofs = std::ofstream{listPath})
+        {
+            for (const auto& segmentPath: segmentPaths)
+            {
+                const auto fileName =
+                        std::filesystem::path{segmentPath}.filename().string();
+                ofs << "file '" << fileName << "'\n";
+            }
+        }
+        else
+        {
+            spdlog::error("Couldn't write the segment list {}", listPath);
+            return false;
+        }
+
+        std::error_code ec;
+        const std::filesystem::path out{outPath};
+        std::filesystem::remove(out, ec);
+
+        // Stream copy only rewrites the container, the encoded frames stay as they are
+        const auto cmd = fmt::format("ffmpeg -hide_banner -loglevel error -y -f "
+                                     "concat -safe 0 -i \"{}\" -c copy \"{}\" 2>&1",
+                                     listPath, outPath);
+        std::string output{};
+        try
+        {
+            output = Exec(cmd.c_str());
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::error("Couldn't run ffmpeg: {}", e.what());
+        }
+
+        std::filesystem::remove(listPath, ec);
+
+        if (!std::filesystem::exists(out, ec) ||
+            std::filesystem::file_size(out, ec) == 0)
+        {
+            spdlog::error("Joining the segments with ffmpeg failed: {}", output);
+            return false;
+        }
+        return true;
+    }
+}// namespace prm
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "utils/DisplayConverter.h"
+
+namespace prm
+{
+    /// Frame rate of exported videos when the capture rate is unknown
+    const double EXPORT_DEFAULT_FPS = 30.0;
+
+    /// Settings of an mp4 export
+    struct Mp4ExportOptions
+    {
+        /// Pixel value shown as black
+        uint32_t minValue = 0;
+        /// Pixel value shown as white
+        uint32_t maxValue = 4095;
+        /// Curve applied between minValue and maxValue
+        DisplayCurve curve = LINEAR;
+        /// Gamma value for the GAMMA curve
+        float gamma = 2.2f;
+        /// Number of significant bits in each pixel
+        int bitDepth = 16;
+
+        /// Frame rate stored in the video
+        double fps = EXPORT_DEFAULT_FPS;
+        /// Number of segments encoded in parallel, 0 uses one per core
+        unsigned numSegments = 0;
+    };
+
+    /**
+     * Exports 16 bit mono stacks to mp4 for review
+     * The frame range is cut into segments that are tone mapped and encoded
+     * on their own threads, each into its own file starting with a key frame.
+     * The segment files are then joined without re-encoding by the ffmpeg
+     * concat demuxer, so the export time scales with the number of cores
+     */
+    class Mp4Exporter
+    {
+    public:
+        /**
+         * Reads frames of one segment, every segment gets its own reader
+         * Takes the frame index and the buffer to read the frame into
+         */
+        using FrameReader = std::function<bool(std::size_t, uint16_t*)>;
+
+        /**
+         * Exports frames that are already in memory
+         *
+         * @param frames Frames one after another
+         * @param imageWidth Width of each frame
+         * @param imageHeight Height of each frame
+         * @param numFrames Number of frames
+         * @param outPath Path of the mp4 file
+         * @param options Export settings
+         * @return true on success
+         */
+        static bool Export(const uint16_t* frames, uint16_t imageWidth,
+                           uint16_t imageHeight, std::size_t numFrames,
+                           std::string_view outPath,
+                           const Mp4ExportOptions& options);
+
+        /**
+         * Exports a 16 bit tif stack, every segment reads the file on its own
+         *
+         * @param tifPath Path of the tif stack
+         * @param outPath Path of the mp4 file
+         * @param options Export settings
+         * @return true on success
+         */
+        static bool ExportTifStack(std::string_view tifPath,
+                                   std::string_view outPath,
+                                   const Mp4ExportOptions& options);
+
+        /**
+         * Exports a raw stack, the segments read and decode the shared file mapping
+         *
+         * @param rawPath Path of the raw stack
+         * @param outPath Path of the mp4 file
+         * @param options Export settings
+         * @return true on success
+         */
+        static bool ExportRawStack(std::string_view rawPath,
+                                   std::string_view outPath,
+                                   const Mp4ExportOptions& options);
+
+        /**
+         * Exports a chunked stack, every segment decodes its own chunks
+         *
+         * @param chunkedPath Path of the chunked stack directory
+         * @param outPath Path of the mp4 file
+         * @param options Export settings
+         * @return true on success
+         */
+        static bool ExportChunkedStack(std::string_view chunkedPath,
+                                       std::string_view outPath,
+                                       const Mp4ExportOptions& options);
+
+        /**
+         * Exports frames from any source
+         *
+         * @param makeReader Creates the frame reader of one segment
+         * @param imageWidth Width of each frame
+         * @param imageHeight Height of each frame
+         * @param numFrames Number of frames
+         * @param outPath Path of the mp4 file
+         * @param options Export settings
+         * @return true on success
+         */
+        static bool Export(const std::function<FrameReader()>& makeReader,
+                           uint16_t imageWidth, uint16_t imageHeight,
+                           std::size_t numFrames, std::string_view outPath,
+                           const Mp4ExportOptions& options);
+
+    private:
+        /**
+         * Tone maps and encodes one segment into its own file
+         *
+         * @param reader Frame reader of the segment
+         * @param imageWidth Width of each frame
+         * @param imageHeight Height of each frame
+         * @param first Index of the first frame of the segment
+         * @param last Index one past the last frame of the segment
+         * @param segmentPath Path of the segment file
+         * @param options Export settings
+         * @param framesDone Counter of encoded frames shared by all segments
+         * @return true on success
+         */
+        static bool EncodeSegment(const FrameReader& reader,
+                                  uint16_t imageWidth, uint16_t imageHeight,
+                                  std::size_t first, std::size_t last,
+                                  const std::string& segmentPath,
+                                  const Mp4ExportOptions& options,
+                                  std::atomic<std::size_t>& framesDone);
+
+        /**
+         * Joins the segment files into one without re-encoding
+         *
+         * @param segmentPaths Segment files in order
+         * @param outPath Path of the joined file
+         * @return true on success
+         */
+        static bool ConcatSegments(const std::vector<std::string>& segmentPaths,
+                                   std::string_view outPath);
+    };
+}// namespace prm
@@ -0,0 +1,174 @@
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "PixelPacking.h"
+
+namespace prm
+{
+    namespace
+    {
+        /**
+         * Packs pairs of pixels one by one, an odd last pixel takes two bytes
+         */
+        void Pack12Scalar(const uint16_t* src, std::size_t numPixels,
+                          uint8_t* dst)
+        {
+            std::size_t i = 0;
+            for (; i + 2 <= numPixels; i += 2)
+            {
+                const auto a = src[i] & 0x0FFFu;
+                const auto b = src[i + 1] & 0x0FFFu;
+                *dst++ = static_cast<uint8_t>(a);
+                *dst++ = static_cast<uint8_t>(a >> 8 | b << 4);
+                *dst++ = static_cast<uint8_t>(b >> 4);
+            }
+            if (i < numPixels)
+            {
+                const auto a = src[i] & 0x0FFFu;
+                *dst++ = static_cast<uint8_t>(a);
+                *dst = static_cast<uint8_t>(a >> 8);
+            }
+        }
+
+        /**
+         * Undoes Pack12Scalar
+         */
+        void Unpack12Scalar(const uint8_t* src, std::size_t numPixels,
+                            uint16_t* dst)
+        {
+            std::size_t i = 0;
+            for (; i + 2 <= numPixels; i += 2, src += 3)
+            {
+                dst[i] = static_cast<uint16_t>(src[0] | (src[1] & 0x0F) << 8);
+                dst[i + 1] = static_cast<uint16_t>(src[1] >> 4 | src[2] << 4);
+            }
+            if (i < numPixels)
+            {
+                dst[i] = static_cast<uint16_t>(src[0] | (src[1] & 0x0F) << 8);
+            }
+        }
+
+#if defined(__AVX2__)
+        // 16 pixels make 24 bytes, each 128 bit lane handles 8 of them. The
+        // 16 byte loads and stores of the upper lane reach 4 bytes past the
+        // block, so the vector loops stop 4 pixels early
+        const std::size_t PACK_BLOCK_PIXELS = 16;
+        const std::size_t PACK_BLOCK_SLACK = 4;
+
+        std::size_t Pack12Avx2(const uint16_t* src, std::size_t numPixels,
+                               uint8_t* dst)
+        {
+            const auto mask = _mm256_set1_epi32(0x0FFF);
+            // Three low bytes of every 32 bit pair word, packed to the front
+            const auto gather = _mm256_setr_epi8(
+                    0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                    0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+            std::size_t i = 0;
+            for (; i + PACK_BLOCK_PIXELS + PACK_BLOCK_SLACK <= numPixels;
+                 i += PACK_BLOCK_PIXELS)
+            {
+                const auto pixels = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(src + i));
+                const auto a = _mm256_and_si256(pixels, mask);
+                const auto b = _mm256_and_si256(_mm256_srli_epi32(pixels, 16),
+                                                mask);
+                const auto pairs = _mm256_shuffle_epi8(
+                        _mm256_or_si256(a, _mm256_slli_epi32(b, 12)), gather);
+
+                // The upper lane overwrites the 4 spare bytes of the lower one
+                auto* block = dst + i / 2 * 3;
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(block),
+                                 _mm256_castsi256_si128(pairs));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(block + 12),
+                                 _mm256_extracti128_si256(pairs, 1));
+            }
+            return i;
+        }
+
+        std::size_t Unpack12Avx2(const uint8_t* src, std::size_t numPixels,
+                                 uint16_t* dst)
+        {
+            const auto mask = _mm256_set1_epi16(0x0FFF);
+            // Bytes 0 1 of each pair for the first pixel, 1 2 for the second
+            const auto spread = _mm256_setr_epi8(
+                    0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11,
+                    0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+
+            std::size_t i = 0;
+            for (; i + PACK_BLOCK_PIXELS + PACK_BLOCK_SLACK <= numPixels;
+                 i += PACK_BLOCK_PIXELS)
+            {
+                const auto* block = src + i / 2 * 3;
+                const auto bytes = _mm256_inserti128_si256(
+                        _mm256_castsi128_si256(_mm_loadu_si128(
+                                reinterpret_cast<const __m128i*>(block))),
+                        _mm_loadu_si128(
+                                reinterpret_cast<const __m128i*>(block + 12)),
+                        1);
+                const auto words = _mm256_shuffle_epi8(bytes, spread);
+                const auto even = _mm256_and_si256(words, mask);
+                const auto odd = _mm256_srli_epi16(words, 4);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                                    _mm256_blend_epi16(even, odd, 0xAA));
+            }
+            return i;
+        }
+#endif
+    }// namespace
+
+    PixelPacking PackingFor(int bitDepth, bool packed)
+    {
+        return packed && bitDepth <= PACKED_12_MAX_BIT_DEPTH ? PACKED_12
+                                                              : UNPACKED_16;
+    }
+
+    std::size_t PackedBytes(PixelPacking packing, std::size_t numPixels)
+    {
+        if (packing == PACKED_12) { return numPixels / 2 * 3 + numPixels % 2 * 2; }
+        return numPixels * sizeof(uint16_t);
+    }
+
+    void PackPixels(PixelPacking packing, const uint16_t* src,
+                    std::size_t numPixels, uint8_t* dst)
+    {
+        if (packing != PACKED_12)
+        {
+            std::memcpy(dst, src, numPixels * sizeof(uint16_t));
+            return;
+        }
+#if defined(__AVX2__)
+        const auto done = Pack12Avx2(src, numPixels, dst);
+        Pack12Scalar(src + done, numPixels - done, dst + done / 2 * 3);
+#else
+        Pack12Scalar(src, numPixels, dst);
+#endif
+    }
+
+    void UnpackPixels(PixelPacking packing, const uint8_t* src,
+                      std::size_t numPixels, uint16_t* dst)
+    {
+        if (packing != PACKED_12)
+        {
+            std::memcpy(dst, src, numPixels * sizeof(uint16_t));
+            return;
+        }
+#if defined(__AVX2__)
+        const auto done = Unpack12Avx2(src, numPixels, dst);
+        Unpack12Scalar(src + done / 2 * 3, numPixels - done, dst + done);
+#else
+        Unpack12Scalar(src, numPixels, dst);
+#endif
+    }
+
+    bool FitsPacked12(const uint16_t* pixels, std::size_t numPixels)
+    {
+        // A plain loop the compiler vectorises, no early exit to stop it
+        uint16_t bits = 0;
+        for (std::size_t i = 0; i < numPixels; ++i) { bits |= pixels[i]; }
+        return bits >> PACKED_12_MAX_BIT_DEPTH == 0;
+    }
+}// namespace prm
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace prm
+{
+    /// Storage layout of the pixels of a frame
+    enum PixelPacking
+    {
+        UNPACKED_16 = 0,///< one 16 bit word per pixel
+        PACKED_12 = 1   ///< two 12 bit pixels in three bytes, little endian
+    };
+
+    /// Highest bit depth that PACKED_12 holds without loss
+    const int PACKED_12_MAX_BIT_DEPTH = 12;
+
+    /**
+     * Gives the packing frames of a bit depth are kept in
+     *
+     * @param bitDepth Number of significant bits in each pixel
+     * @param packed Pack pixels that fit in 12 bits
+     * @return PACKED_12 if requested and lossless, otherwise UNPACKED_16
+     */
+    PixelPacking PackingFor(int bitDepth, bool packed);
+
+    /**
+     * Gives the size of pixels in a packing
+     *
+     * @param packing Pixel packing
+     * @param numPixels Number of pixels
+     * @return Size in bytes, an odd last 12 bit pixel takes two bytes
+     */
+    std::size_t PackedBytes(PixelPacking packing, std::size_t numPixels);
+
+    /**
+     * Stores 16 bit pixels in a packing
+     * Pixel a and b of each pair become the 24 bit word a | b << 12, the same
+     * layout as Mono12p of GenICam cameras. Bits above 12 are dropped
+     *
+     * @param packing Pixel packing
+     * @param src Pixels to pack
+     * @param numPixels Number of pixels
+     * @param dst Packed pixels, PackedBytes(packing, numPixels) long
+     */
+    void PackPixels(PixelPacking packing, const uint16_t* src,
+                    std::size_t numPixels, uint8_t* dst);
+
+    /**
+     * Turns packed pixels back into 16 bit pixels
+     *
+     * @param packing Pixel packing
+     * @param src Packed pixels, PackedBytes(packing, numPixels) long
+     * @param numPixels Number of pixels
+     * @param dst Unpacked pixels
+     */
+    void UnpackPixels(PixelPacking packing, const uint8_t* src,
+                      std::size_t numPixels, uint16_t* dst);
+
+    /**
+     * Tells if pixels keep their values in PACKED_12
+     *
+     * @param pixels Pixels to check
+     * @param numPixels Number of pixels
+     * @return true if no pixel is above 4095
+     */
+    bool FitsPacked12(const uint16_t* pixels, std::size_t numPixels);
+}// namespace prm
@@ -0,0 +1,792 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "FileUtils.h"
+#include "RawStack.h"
+
+namespace prm
+{
+    namespace
+    {
+        std::uint64_t AlignToPage(std::uint64_t size)
+        {
+            return (size + RAW_STACK_PAGE_SIZE - 1) / RAW_STACK_PAGE_SIZE *
+                   RAW_STACK_PAGE_SIZE;
+        }
+
+        void FillHeaderMeta(RawStackHeader& header, const TifStackMeta& meta)
+        {
+            header.droppedFrames = meta.droppedFrames;
+            header.fps = meta.fps;
+            header.frametimeAvg = meta.frametimeAvg;
+            header.frametimeMin = meta.frametimeMin;
+            header.frametimeMax = meta.frametimeMax;
+            header.frametimeStd = meta.frametimeStd;
+            header.exposure = meta.exposure;
+            header.binning = meta.binning;
+            header.lens = meta.lens;
+        }
+    }// namespace
+
+    bool RawStackWriter::Open(std::string_view path, uint32_t imageWidth,
+                              uint32_t imageHeight,
+                              const RawStackOptions& options)
+    {
+        if (IsOpen())
+        {
+            spdlog::error("Raw stack writer is already open");
+            return false;
+        }
+
+        const auto compression = options.compression;
+        auto packing = options.packing;
+        // Packing would only get in the way of the differencing
+        if (packing != UNPACKED_16 && compression != NO_COMPRESSION)
+        {
+            spdlog::warn("Compressed frames of {} are stored unpacked", path);
+            packing = UNPACKED_16;
+        }
+
+        m_path = path;
+        m_frameBytes =
+                PackedBytes(packing, std::size_t{imageWidth} * imageHeight);
+        m_bWithTimestamps = options.withTimestamps;
+        m_timestamps.clear();
+        m_recordOffsets.clear();
+        m_bytesWritten = 0;
+        m_errorOccurred = false;
+
+        m_header = RawStackHeader{};
+        std::memcpy(m_header.magic, RAW_STACK_MAGIC, sizeof(RAW_STACK_MAGIC));
+        m_header.version = RAW_STACK_VERSION;
+        m_header.imageWidth = imageWidth;
+        m_header.imageHeight = imageHeight;
+        m_header.bitDepth = options.bitDepth;
+        m_header.bytesPerPixel = sizeof(uint16_t);
+        m_header.compression = compression;
+        m_header.pixelPacking = packing;
+        m_header.patchThreshold =
+                compression == PATCHES ? options.patchThreshold : 0;
+        m_header.dataOffset = AlignToPage(sizeof(RawStackHeader));
+        m_nextOffset = m_header.dataOffset;
+
+        if (compression != NO_COMPRESSION)
+        {
+            if (!m_codec.Configure(compression, imageWidth, imageHeight,
+                                   StripCodec::DefaultNumThreads(),
+                                   options.patchThreshold))
+            {
+                return false;
+            }
+            m_header.frameStride = 0;
+            m_header.rowsPerStrip = m_codec.GetRowsPerStrip();
+            m_stripBytes.resize(m_codec.GetNumStrips());
+            m_padding.clear();
+        }
+        else
+        {
+            m_header.frameStride = AlignToPage(m_frameBytes);
+            m_header.rowsPerStrip = imageHeight;
+            m_padding.assign(m_header.frameStride - m_frameBytes, 0);
+            m_packed.resize(packing != UNPACKED_16 ? m_frameBytes : 0);
+        }
+
+        if (options.unbuffered && compression == NO_COMPRESSION)
+        {
+            if (!m_headerPage.Allocate(m_header.dataOffset))
+            {
+                spdlog::error("Unable to allocate write buffers for {}", m_path);
+                return false;
+            }
+            m_freeStaging.Reset(m_staging.size());
+            m_bStagingAllocated = false;
+            return m_async.Open(m_path, true) && WriteHeaderPage();
+        }
+
+        // The buffer has to be in place before the file is opened to take effect
+        m_streamBuffer.resize(RAW_STACK_WRITE_BUFFER_SIZE);
+        m_ofs.rdbuf()->pubsetbuf(m_streamBuffer.data(),
+                                 static_cast<std::streamsize>(m_streamBuffer.size()));
+        m_ofs.open(m_path, std::ios::binary | std::ios::trunc);
+        if (!m_ofs)
+        {
+            spdlog::error("Couldn't create {}", m_path);
+            return false;
+        }
+
+        // Header page with no frames until Close fills in the count
+        std::vector<char> headerPage(m_header.dataOffset, 0);
+        std::memcpy(headerPage.data(), &m_header, sizeof(m_header));
+        m_ofs.write(headerPage.data(),
+                    static_cast<std::streamsize>(headerPage.size()));
+        return static_cast<bool>(m_ofs);
+    }
+
+    bool RawStackWriter::WriteFrame(const uint16_t* frame, double timestamp)
+    {
+        if (!IsOpen() || m_errorOccurred) { return false; }
+
+        const auto numPixels =
+                std::size_t{m_header.imageWidth} * m_header.imageHeight;
+        if (m_async.IsOpen())
+        {
+            if (!m_bStagingAllocated && !AllocateStaging()) { return false; }
+
+            // Waits for a write to finish if every slot is in flight
+            const auto slot = m_freeStaging.Pop();
+            if (!slot) { return false; }
+
+            // The staging padding stays zero, only the pixels are replaced
+            auto& staging = m_staging[*slot];
+            PackPixels(GetPacking(), frame, numPixels, staging.Data());
+            return SubmitFrame(staging.Data(), timestamp,
+                               [this, slot = *slot]
+                               { m_freeStaging.TryPush(slot); });
+        }
+
+        if (m_header.compression == NO_COMPRESSION)
+        {
+            if (m_packed.empty())
+            {
+                return WriteStoredFrame(reinterpret_cast<const uint8_t*>(frame),
+                                        timestamp);
+            }
+            PackPixels(GetPacking(), frame, numPixels, m_packed.data());
+            return WriteStoredFrame(m_packed.data(), timestamp);
+        }
+
+        if (!m_codec.Encode(frame))
+        {
+            spdlog::error("Failed compressing frame {} for {}",
+                          m_header.numFrames, m_path);
+            m_errorOccurred = true;
+            return false;
+        }
+        for (uint32_t i = 0; i < m_codec.GetNumStrips(); ++i)
+        {
+            m_stripBytes[i] = static_cast<uint32_t>(m_codec.GetStripSize(i));
+        }
+
+        m_ofs.write(reinterpret_cast<const char*>(m_stripBytes.data()),
+                    static_cast<std::streamsize>(m_stripBytes.size() *
+                                                 sizeof(uint32_t)));
+        for (uint32_t i = 0; i < m_codec.GetNumStrips(); ++i)
+        {
+            m_ofs.write(reinterpret_cast<const char*>(m_codec.GetStripData(i)),
+                        static_cast<std::streamsize>(m_codec.GetStripSize(i)));
+        }
+        m_recordOffsets.push_back(m_nextOffset);
+        m_nextOffset += m_stripBytes.size() * sizeof(uint32_t) +
+                        m_codec.GetEncodedBytes();
+        m_bytesWritten += m_codec.GetEncodedBytes();
+        if (!m_ofs)
+        {
+            spdlog::error("Failed writing frame {} to {}", m_header.numFrames,
+                          m_path);
+            m_errorOccurred = true;
+            return false;
+        }
+
+        if (m_bWithTimestamps) { m_timestamps.push_back(timestamp); }
+        ++m_header.numFrames;
+        return true;
+    }
+
+    bool RawStackWriter::WriteStoredFrame(const uint8_t* frame,
+                                          double timestamp)
+    {
+        m_ofs.write(reinterpret_cast<const char*>(frame),
+                    static_cast<std::streamsize>(m_frameBytes));
+        m_ofs.write(m_padding.data(),
+                    static_cast<std::streamsize>(m_padding.size()));
+        m_nextOffset += m_header.frameStride;
+        m_bytesWritten += m_frameBytes;
+        if (!m_ofs)
+        {
+            spdlog::error("Failed writing frame {} to {}", m_header.numFrames,
+                          m_path);
+            m_errorOccurred = true;
+            return false;
+        }
+
+        if (m_bWithTimestamps) { m_timestamps.push_back(timestamp); }
+        ++m_header.numFrames;
+        return true;
+    }
+
+    bool RawStackWriter::SubmitFrame(const uint8_t* frame, double timestamp,
+                                     const FrameWritten& onWritten)
+    {
+        if (!m_async.IsOpen())
+        {
+            // Uncompressed frames are already laid out as they are stored
+            const bool written =
+                    m_header.compression == NO_COMPRESSION
+                            ? IsOpen() && !m_errorOccurred &&
+                                      WriteStoredFrame(frame, timestamp)
+                            : WriteFrame(reinterpret_cast<const uint16_t*>(frame),
+                                         timestamp);
+            if (onWritten) { onWritten(); }
+            return written;
+        }
+
+        const auto done = [onWritten](bool)
+        {
+            if (onWritten) { onWritten(); }
+        };
+        if (m_errorOccurred ||
+            !m_async.Submit(m_nextOffset, frame, m_header.frameStride, done))
+        {
+            spdlog::error("Failed writing frame {} to {}", m_header.numFrames,
+                          m_path);
+            m_errorOccurred = true;
+            if (onWritten) { onWritten(); }
+            return false;
+        }
+
+        m_nextOffset += m_header.frameStride;
+        m_bytesWritten += m_frameBytes;
+        if (m_bWithTimestamps) { m_timestamps.push_back(timestamp); }
+        ++m_header.numFrames;
+        return true;
+    }
+
+    bool RawStackWriter::Sync()
+    {
+        if (!IsOpen() || m_errorOccurred) { return false; }
+        if (m_async.IsOpen()) { return m_async.Sync(); }
+
+        m_ofs.flush();
+        return static_cast<bool>(m_ofs) && FileUtils::SyncFile(m_path);
+    }
+
+    bool RawStackWriter::Close(const TifStackMeta& meta)
+    {
+        if (!IsOpen()) { return true; }
+
+        FillHeaderMeta(m_header, meta);
+
+        if (m_async.IsOpen())
+        {
+            if (!m_async.Flush()) { m_errorOccurred = true; }
+
+            // The time stamp table is padded to whole pages for unbuffered writes
+            AlignedBuffer table{};
+            if (m_bWithTimestamps && !m_timestamps.empty() && !m_errorOccurred &&
+                table.Allocate(m_timestamps.size() * sizeof(double)))
+            {
+                std::memcpy(table.Data(), m_timestamps.data(),
+                            m_timestamps.size() * sizeof(double));
+                if (m_async.Submit(m_nextOffset, table.Data(), table.Size()))
+                {
+                    m_header.timestampOffset = m_nextOffset;
+                }
+            }
+            if (!WriteHeaderPage()) { m_errorOccurred = true; }
+
+            const auto stats = m_async.GetStats();
+            if (!m_async.Close())
+            {
+                spdlog::error("Failed finishing {}", m_path);
+                m_errorOccurred = true;
+            }
+            spdlog::info("Wrote {} frames to {}, {:.1f} MB/s, max {} writes in "
+                         "flight, max latency {:.1f} ms",
+                         m_header.numFrames, m_path, stats.throughputMBps,
+                         stats.maxQueueDepth, stats.maxLatencyMs);
+            return !m_errorOccurred;
+        }
+
+        // Tables go behind the last frame, a failed frame write leaves the
+        // stream position unknown so they are left out then
+        m_ofs.seekp(static_cast<std::streamoff>(m_nextOffset));
+        if (!m_recordOffsets.empty() && !m_errorOccurred)
+        {
+            m_header.indexOffset = m_nextOffset;
+            m_ofs.write(reinterpret_cast<const char*>(m_recordOffsets.data()),
+                        static_cast<std::streamsize>(m_recordOffsets.size() *
+                                                     sizeof(std::uint64_t)));
+            m_nextOffset += m_recordOffsets.size() * sizeof(std::uint64_t);
+        }
+        if (m_bWithTimestamps && !m_timestamps.empty() && !m_errorOccurred)
+        {
+            m_header.timestampOffset = m_nextOffset;
+            m_ofs.write(reinterpret_cast<const char*>(m_timestamps.data()),
+                        static_cast<std::streamsize>(m_timestamps.size() *
+                                                     sizeof(double)));
+        }
+
+        m_ofs.seekp(0);
+        m_ofs.write(reinterpret_cast<const char*>(&m_header),
+                    sizeof(m_header));
+        m_ofs.close();
+        if (m_ofs.fail())
+        {
+            spdlog::error("Failed finishing {}", m_path);
+            m_errorOccurred = true;
+        }
+        m_ofs.clear();
+
+        if (m_header.compression != NO_COMPRESSION && m_bytesWritten > 0)
+        {
+            spdlog::info("Wrote {} frames to {}, compression ratio {:.2f}",
+                         m_header.numFrames, m_path,
+                         static_cast<double>(m_header.numFrames * m_frameBytes) /
+                                 static_cast<double>(m_bytesWritten));
+        }
+        else { spdlog::info("Wrote {} frames to {}", m_header.numFrames, m_path); }
+        return !m_errorOccurred;
+    }
+
+    bool RawStackWriter::Recover(std::string_view path,
+                                 std::uint64_t numFrames,
+                                 std::uint64_t dataEnd,
+                                 const TifStackMeta& meta,
+                                 const std::vector<double>& timestamps)
+    {
+        const std::string pathStr{path};
+        std::fstream fs{pathStr, std::ios::binary | std::ios::in | std::ios::out};
+        RawStackHeader header{};
+        fs.read(reinterpret_cast<char*>(&header), sizeof(header));
+        std::error_code ec;
+        const auto fileSize = std::filesystem::file_size(pathStr, ec);
+        if (!fs ||
+            std::memcmp(header.magic, RAW_STACK_MAGIC,
+                        sizeof(RAW_STACK_MAGIC)) != 0 ||
+            header.version != RAW_STACK_VERSION || ec || fileSize < dataEnd)
+        {
+            spdlog::error("{} is not a raw stack that can be recovered",
+                          pathStr);
+            return false;
+        }
+
+        // Compressed records are found through their strip sizes alone
+        std::vector<std::uint64_t> recordOffsets{};
+        auto offset = header.dataOffset;
+        if (header.compression != NO_COMPRESSION && header.rowsPerStrip > 0)
+        {
+            const auto numStrips =
+                    (header.imageHeight + header.rowsPerStrip - 1) /
+                    header.rowsPerStrip;
+            std::vector<uint32_t> stripBytes(numStrips);
+            for (std::uint64_t i = 0; i < numFrames && fs; ++i)
+            {
+                fs.seekg(static_cast<std::streamoff>(offset));
+                fs.read(reinterpret_cast<char*>(stripBytes.data()),
+                        static_cast<std::streamsize>(numStrips *
+                                                     sizeof(uint32_t)));
+                recordOffsets.push_back(offset);
+                offset += numStrips * sizeof(uint32_t);
+                for (const auto bytes: stripBytes) { offset += bytes; }
+            }
+        }
+        else { offset += numFrames * header.frameStride; }
+        if (!fs || offset > dataEnd)
+        {
+            spdlog::error("{} holds fewer frames than its journal", pathStr);
+            return false;
+        }
+
+        // Anything past the synced frames is a frame cut short by the crash
+        fs.close();
+        std::filesystem::resize_file(pathStr, dataEnd, ec);
+        fs.open(pathStr, std::ios::binary | std::ios::in | std::ios::out);
+        if (ec || !fs)
+        {
+            spdlog::error("Couldn't truncate {}", pathStr);
+            return false;
+        }
+
+        header.numFrames = numFrames;
+        header.indexOffset = 0;
+        header.timestampOffset = 0;
+        FillHeaderMeta(header, meta);
+        offset = dataEnd;
+        fs.seekp(static_cast<std::streamoff>(offset));
+        if (!recordOffsets.empty())
+        {
+            header.indexOffset = offset;
+            fs.write(reinterpret_cast<const char*>(recordOffsets.data()),
+                     static_cast<std::streamsize>(recordOffsets.size() *
+                                                  sizeof(std::uint64_t)));
+            offset += recordOffsets.size() * sizeof(std::uint64_t);
+        }
+        if (numFrames > 0 && timestamps.size() == numFrames)
+        {
+            header.timestampOffset = offset;
+            fs.write(reinterpret_cast<const char*>(timestamps.data()),
+                     static_cast<std::streamsize>(timestamps.size() *
+                                                  sizeof(double)));
+        }
+        fs.seekp(0);
+        fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        fs.close();
+        if (fs.fail())
+        {
+            spdlog::error("Failed finishing {}", pathStr);
+            return false;
+        }
+        return true;
+    }
+
+    bool RawStackWriter::AllocateStaging()
+    {
+        for (std::size_t i = 0; i < m_staging.size(); ++i)
+        {
+            if (!m_staging[i].Allocate(m_header.frameStride))
+            {
+                spdlog::error("Unable to allocate write buffers for {}", m_path);
+                m_errorOccurred = true;
+                return false;
+            }
+            m_freeStaging.TryPush(i);
+        }
+        m_bStagingAllocated = true;
+        return true;
+    }
+
+    bool RawStackWriter::WriteHeaderPage()
+    {
+        std::memcpy(m_headerPage.Data(), &m_header, sizeof(m_header));
+        const bool submitted =
+                m_async.Submit(0, m_headerPage.Data(), m_headerPage.Size());
+        // Waits for every write in flight, which also frees the caller's buffers
+        return m_async.Flush() && submitted;
+    }
+
+    bool RawStackReader::Open(std::string_view path)
+    {
+        Close();
+        const std::string pathStr{path};
+
+#ifdef _WIN32
+        m_file = CreateFileA(pathStr.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                             nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                             nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+        {
+            m_file = nullptr;
+            spdlog::error("Couldn't open {}", pathStr);
+            return false;
+        }
+        LARGE_INTEGER fileSize{};
+        GetFileSizeEx(m_file, &fileSize);
+        m_size = static_cast<std::uint64_t>(fileSize.QuadPart);
+        if (m_size >= sizeof(RawStackHeader))
+        {
+            m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0,
+                                           0, nullptr);
+        }
+        if (m_mapping)
+        {
+            m_data = static_cast<const uint8_t*>(
+                    MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+#else
+        m_fd = open(pathStr.c_str(), O_RDONLY);
+        if (m_fd < 0)
+        {
+            spdlog::error("Couldn't open {}", pathStr);
+            return false;
+        }
+        struct stat st{};
+        fstat(m_fd, &st);
+        m_size = static_cast<std::uint64_t>(st.st_size);
+        if (m_size >= sizeof(RawStackHeader))
+        {
+            void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+            if (data != MAP_FAILED) { m_data = static_cast<const uint8_t*>(data); }
+        }
+#endif
+        if (!m_data)
+        {
+            spdlog::error("Couldn't map {}", pathStr);
+            Close();
+            return false;
+        }
+
+        // Version 1 headers end at indexOffset, the rest of their page is
+        // zeros, which reads as no index, no compression and no packing
+        std::memcpy(&m_header, m_data, sizeof(m_header));
+        if (std::memcmp(m_header.magic, RAW_STACK_MAGIC,
+                        sizeof(RAW_STACK_MAGIC)) != 0 ||
+            m_header.version == 0 || m_header.version > RAW_STACK_VERSION ||
+            m_header.dataOffset > m_size || m_header.pixelPacking > PACKED_12)
+        {
+            spdlog::error("{} is not a raw stack", pathStr);
+            Close();
+            return false;
+        }
+
+        if (IsCompressed())
+        {
+            if (!StripCodec::IsSupported(
+                        static_cast<Compression>(m_header.compression)) ||
+                m_header.rowsPerStrip == 0)
+            {
+                spdlog::error("{} uses a compression this build can't read",
+                              pathStr);
+                Close();
+                return false;
+            }
+            if (!IndexRecords()) { spdlog::warn("{} is truncated", pathStr); }
+            return true;
+        }
+        if (m_header.frameStride == 0)
+        {
+            spdlog::error("{} is not a raw stack", pathStr);
+            Close();
+            return false;
+        }
+
+        // Never trust the count beyond what the file holds. A capture that
+        // wasn't closed has a zero count and gets its frames back this way
+        const auto framesInFile =
+                (m_size - m_header.dataOffset) / m_header.frameStride;
+        if (m_header.numFrames == 0 || m_header.numFrames > framesInFile)
+        {
+            if (m_header.numFrames != 0)
+            {
+                spdlog::warn("{} is truncated", pathStr);
+            }
+            m_header.numFrames = framesInFile;
+            m_header.timestampOffset = 0;
+        }
+        if (m_header.timestampOffset != 0 &&
+            m_header.timestampOffset + m_header.numFrames * sizeof(double) >
+                    m_size)
+        {
+            m_header.timestampOffset = 0;
+        }
+        return true;
+    }
+
+    void RawStackReader::Close()
+    {
+#ifdef _WIN32
+        if (m_data) { UnmapViewOfFile(m_data); }
+        if (m_mapping) { CloseHandle(m_mapping); }
+        if (m_file) { CloseHandle(m_file); }
+        m_mapping = nullptr;
+        m_file = nullptr;
+#else
+        if (m_data) { munmap(const_cast<uint8_t*>(m_data), m_size); }
+        if (m_fd >= 0) { close(m_fd); }
+        m_fd = -1;
+#endif
+        m_data = nullptr;
+        m_size = 0;
+        m_header = RawStackHeader{};
+        m_recordOffsets.clear();
+    }
+
+    bool RawStackReader::IndexRecords()
+    {
+        const auto numFrames = m_header.numFrames;
+        if (numFrames > 0 && m_header.indexOffset != 0 &&
+            m_header.indexOffset + numFrames * sizeof(std::uint64_t) <= m_size)
+        {
+            m_recordOffsets.resize(numFrames);
+            std::memcpy(m_recordOffsets.data(), m_data + m_header.indexOffset,
+                        numFrames * sizeof(std::uint64_t));
+            if (m_header.timestampOffset != 0 &&
+                m_header.timestampOffset + numFrames * sizeof(double) > m_size)
+            {
+                m_header.timestampOffset = 0;
+            }
+            return true;
+        }
+
+        // No index, walk the records up to the last complete one
+        const auto numStrips = (m_header.imageHeight + m_header.rowsPerStrip - 1) /
+                               m_header.rowsPerStrip;
+        const auto sizesBytes = std::uint64_t{numStrips} * sizeof(uint32_t);
+        std::vector<uint32_t> stripBytes(numStrips);
+        for (auto offset = m_header.dataOffset; offset + sizesBytes <= m_size;)
+        {
+            std::memcpy(stripBytes.data(), m_data + offset, sizesBytes);
+            std::uint64_t recordBytes = sizesBytes;
+            for (const auto bytes: stripBytes) { recordBytes += bytes; }
+            if (offset + recordBytes > m_size) { break; }
+
+            m_recordOffsets.push_back(offset);
+            offset += recordBytes;
+        }
+        m_header.timestampOffset = 0;
+        const bool complete = numFrames == 0 || m_recordOffsets.size() >= numFrames;
+        m_header.numFrames = m_recordOffsets.size();
+        return complete;
+    }
+
+    bool RawStackReader::ReadFrame(std::uint64_t index, uint16_t* frame) const
+    {
+        RawDecodeState state{};
+        return ReadFrame(index, frame, state);
+    }
+
+    bool RawStackReader::ReadFrame(std::uint64_t index, uint16_t* frame,
+                                   RawDecodeState& state, WorkerPool* pool) const
+    {
+        if (index >= m_header.numFrames) { return false; }
+
+        if (!IsCompressed())
+        {
+            UnpackPixels(static_cast<PixelPacking>(m_header.pixelPacking),
+                         m_data + m_header.dataOffset +
+                                 index * m_header.frameStride,
+                         std::size_t{m_header.imageWidth} * m_header.imageHeight,
+                         frame);
+            return true;
+        }
+        if (m_header.compression != TEMPORAL &&
+            m_header.compression != PATCHES)
+        {
+            return DecodeRecord(index, frame, nullptr, pool);
+        }
+
+        // Key frames are marked in the first strip of their record
+        const auto numStrips = (m_header.imageHeight + m_header.rowsPerStrip - 1) /
+                               m_header.rowsPerStrip;
+        const auto sizesBytes = std::size_t{numStrips} * sizeof(uint32_t);
+        auto key = index;
+        for (;; --key)
+        {
+            const auto* record = m_data + m_recordOffsets[key];
+            uint32_t stripBytes;
+            std::memcpy(&stripBytes, record, sizeof(uint32_t));
+            if (StripCodec::IsKeyStrip(record + sizesBytes, stripBytes))
+            {
+                break;
+            }
+            if (key == 0) { return false; }
+        }
+
+        const auto numPixels =
+                std::size_t{m_header.imageWidth} * m_header.imageHeight;
+        auto first = key;
+        if (state.background.size() == numPixels && state.nextFrame > key &&
+            state.nextFrame <= index)
+        {
+            first = state.nextFrame;
+        }
+        state.background.resize(numPixels);
+        state.nextFrame = 0;
+        if (m_header.compression == PATCHES)
+        {
+            // Only the key frame moves the background of patch frames
+            if (first == key && index != key &&
+                !DecodeRecord(key, frame, state.background.data(), pool))
+            {
+                return false;
+            }
+            first = index;
+        }
+        for (auto i = first; i <= index; ++i)
+        {
+            if (!DecodeRecord(i, frame, state.background.data(), pool))
+            {
+                return false;
+            }
+        }
+        state.nextFrame = index + 1;
+        return true;
+    }
+
+    bool RawStackReader::DecodeRecord(std::uint64_t index, uint16_t* frame,
+                                      uint32_t* background,
+                                      WorkerPool* pool) const
+    {
+        const auto compression = static_cast<Compression>(m_header.compression);
+        const auto numStrips = (m_header.imageHeight + m_header.rowsPerStrip - 1) /
+                               m_header.rowsPerStrip;
+        const auto* record = m_data + m_recordOffsets[index];
+
+        // Strip offsets first, the strips then decode independently
+        std::vector<const uint8_t*> strips(numStrips);
+        std::vector<uint32_t> stripBytes(numStrips);
+        std::memcpy(stripBytes.data(), record, numStrips * sizeof(uint32_t));
+        const auto* strip = record + std::size_t{numStrips} * sizeof(uint32_t);
+        for (uint32_t i = 0; i < numStrips; ++i)
+        {
+            if (strip + stripBytes[i] > m_data + m_size) { return false; }
+            strips[i] = strip;
+            strip += stripBytes[i];
+        }
+
+        std::atomic<bool> success = true;
+        const auto decodeStrip = [&](std::size_t i)
+        {
+            const auto firstRow = static_cast<uint32_t>(i) * m_header.rowsPerStrip;
+            // Parenthesised against the min macro of Windows.h
+            const auto numRows = (std::min)(m_header.rowsPerStrip,
+                                          m_header.imageHeight - firstRow);
+            const auto offset = std::size_t{m_header.imageWidth} * firstRow;
+            bool decoded = false;
+            switch (compression)
+            {
+                case TEMPORAL:
+                    decoded = StripCodec::DecodeTemporalStrip(
+                            strips[i], stripBytes[i], frame + offset,
+                            background + offset, m_header.imageWidth, numRows);
+                    break;
+                case PATCHES:
+                    decoded = StripCodec::DecodePatchStrip(
+                            strips[i], stripBytes[i], frame + offset,
+                            background + offset, m_header.imageWidth, numRows);
+                    break;
+                default:
+                    decoded = StripCodec::DecodeStrip(
+                            compression, strips[i], stripBytes[i],
+                            frame + offset, m_header.imageWidth, numRows);
+                    break;
+            }
+            if (!decoded) { success = false; }
+        };
+        if (pool) { pool->ParallelFor(numStrips, decodeStrip); }
+        else
+        {
+            for (uint32_t i = 0; i < numStrips; ++i) { decodeStrip(i); }
+        }
+        return success;
+    }
+
+    double RawStackReader::GetTimestamp(std::uint64_t index) const
+    {
+        if (!HasTimestamps() || index >= m_header.numFrames) { return 0.0; }
+        double timestamp;
+        std::memcpy(&timestamp,
+                    m_data + m_header.timestampOffset + index * sizeof(double),
+                    sizeof(double));
+        return timestamp;
+    }
+
+    TifStackMeta RawStackReader::GetMeta() const
+    {
+        return TifStackMeta{
+                .numFrames = static_cast<std::uint32_t>(m_header.numFrames),
+                .exposure = static_cast<std::uint16_t>(m_header.exposure),
+                .fps = m_header.fps,
+                .frametimeAvg = m_header.frametimeAvg,
+                .frametimeMin = m_header.frametimeMin,
+                .frametimeMax = m_header.frametimeMax,
+                .frametimeStd = m_header.frametimeStd,
+                .droppedFrames = m_header.droppedFrames,
+                .binning = static_cast<Binning>(m_header.binning),
+                .lens = static_cast<Lens>(m_header.lens),
+                .compression = static_cast<Compression>(m_header.compression),
+                .patchThreshold =
+                        static_cast<std::uint16_t>(m_header.patchThreshold)};
+    }
+}// namespace prm
@@ -0,0 +1,474 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "messages/BoundedQueue.h"
+#include "misc/Meta.h"
+#include "utils/AsyncFileWriter.h"
+#include "utils/PixelPacking.h"
+#include "utils/StripCodec.h"
+
+namespace prm
+{
+    /// File extension of raw stacks
+    const char RAW_STACK_EXTENSION[] = ".raw";
+    /// Identifies raw stack files, the line break catches text mode transfers
+    const char RAW_STACK_MAGIC[8] = {'P', 'R', 'M', 'R', 'A', 'W', '\r', '\n'};
+    /// Version 2 added compression, version 3 pixel packing. Fields added
+    /// since version 1 follow its 120 byte header, so version 1 files read
+    /// as uncompressed and unpacked
+    const uint32_t RAW_STACK_VERSION = 3;
+    /// Alignment of the header and of every frame in the file
+    const std::uint64_t RAW_STACK_PAGE_SIZE = 4096;
+    /// Size of the stream buffer, frames go to disk in blocks of this size
+    const std::size_t RAW_STACK_WRITE_BUFFER_SIZE = 8 * 1024 * 1024;
+
+    /**
+     * Fixed header at the start of a raw stack file
+     * Uncompressed frame i starts at dataOffset + i * frameStride, its pixels
+     * are 16 bit words or packed to 12 bits as pixelPacking says. Compressed
+     * frames are records of the strip sizes followed by the strips, packed one
+     * after another, and the index table holds the offset of every record.
+     * The optional time stamp table holds numFrames doubles in seconds
+     */
+    struct RawStackHeader
+    {
+        char magic[8];
+        std::uint64_t numFrames;
+        /// Distance between frame starts, a multiple of the page size, 0 if compressed
+        std::uint64_t frameStride;
+        /// Offset of the first frame
+        std::uint64_t dataOffset;
+        /// Offset of the time stamp table, 0 if there is none
+        std::uint64_t timestampOffset;
+
+        // Capture metadata, same meaning as in TifStackMeta
+        std::uint64_t droppedFrames;
+        double fps;
+        double frametimeAvg;
+        double frametimeMin;
+        double frametimeMax;
+        double frametimeStd;
+
+        uint32_t version;
+        uint32_t imageWidth;
+        uint32_t imageHeight;
+        /// Number of significant bits in each pixel
+        uint32_t bitDepth;
+        uint32_t bytesPerPixel;
+        uint32_t exposure;
+        uint32_t binning;
+        uint32_t lens;
+
+        // Added after version 1, zeros in version 1 files
+        /// Offset of the frame record index of compressed stacks, 0 if there is none
+        std::uint64_t indexOffset;
+        /// Compression from the Compression enum
+        uint32_t compression;
+        /// Rows in each compressed strip
+        uint32_t rowsPerStrip;
+        /// Layout of uncompressed pixels from the PixelPacking enum
+        uint32_t pixelPacking;
+        /// Pixels above it kept their surroundings with PATCHES compression
+        uint32_t patchThreshold;
+    };
+    static_assert(std::is_trivially_copyable_v<RawStackHeader> &&
+                          sizeof(RawStackHeader) == 144,
+                  "Raw stack header layout is part of the file format");
+    static_assert(offsetof(RawStackHeader, version) == 88 &&
+                          offsetof(RawStackHeader, indexOffset) == 120,
+                  "Version 1 fields must keep their offsets");
+
+    /// How a RawStackWriter stores the frames of a stack
+    struct RawStackOptions
+    {
+        /// Number of significant bits in each pixel
+        uint32_t bitDepth = 16;
+        /// Store a time stamp table after the frames
+        bool withTimestamps = false;
+        /// Compression of the frames, lossless except PATCHES
+        Compression compression = NO_COMPRESSION;
+        /// Write uncompressed frames past the OS file cache
+        bool unbuffered = false;
+        /// Layout of uncompressed pixels, compressed frames are never packed
+        PixelPacking packing = UNPACKED_16;
+        /// Pixels above it keep their surroundings with PATCHES compression
+        uint16_t patchThreshold = DEFAULT_PATCH_THRESHOLD;
+    };
+
+    /**
+     * Writer of raw stacks of 16 bit mono frames
+     * Uncompressed frames are written as they are, padded to whole pages, so
+     * the file can be mapped and every frame used in place. Frames of up to
+     * 12 bits can be packed instead, which saves a quarter of the disk
+     * traffic and is undone by the reader. Compressed frames
+     * are strips packed by a StripCodec. The header is finalised on Close, a
+     * file that was never closed still has its frames readable.
+     * Uncompressed stacks can be written unbuffered, page aligned frames are
+     * then submitted straight from the caller's memory to an AsyncFileWriter
+     */
+    class RawStackWriter
+    {
+    public:
+        /// Called once a submitted frame is written and its memory can be reused
+        using FrameWritten = std::function<void()>;
+
+        RawStackWriter() = default;
+
+        RawStackWriter(const RawStackWriter&) = delete;
+        RawStackWriter& operator=(const RawStackWriter&) = delete;
+
+        /**
+         * Creates the stack file
+         *
+         * @param path Path of the raw stack
+         * @param imageWidth Width of each image
+         * @param imageHeight Height of each image
+         * @param options Bit depth, time stamps, compression and layout of the
+         * stack
+         * @return true on success
+         */
+        bool Open(std::string_view path, uint32_t imageWidth,
+                  uint32_t imageHeight, const RawStackOptions& options = {});
+
+        /**
+         * Appends one frame to the stack
+         *
+         * @param frame Pixels of the frame
+         * @param timestamp Capture time of the frame in seconds
+         * @return true on success
+         */
+        bool WriteFrame(const uint16_t* frame, double timestamp = 0.0);
+
+        /**
+         * Appends one frame to the stack without waiting for the write
+         * Unbuffered stacks write the frame memory as it is, so it has to be
+         * page aligned, span a whole frame stride and stay untouched until
+         * onWritten runs. Other stacks write the frame before returning
+         *
+         * @param frame Pixels of the frame, already in the packing of the stack
+         * @param timestamp Capture time of the frame in seconds
+         * @param onWritten Called once the frame memory is free again, also on failure
+         * @return true if the frame was accepted
+         */
+        bool SubmitFrame(const uint8_t* frame, double timestamp,
+                         const FrameWritten& onWritten);
+
+        /**
+         * Waits for the frames written so far and forces them onto the disk
+         * The header keeps its zero frame count until Close
+         *
+         * @return true once every frame so far is durable
+         */
+        bool Sync();
+
+        /**
+         * Writes the time stamp table and the final header and closes the file
+         *
+         * @param meta Capture metadata stored in the header
+         * @return true if every frame made it to disk
+         */
+        bool Close(const TifStackMeta& meta);
+
+        /**
+         * Finalises a stack that was never closed from a synced state
+         * Everything past dataEnd is cut off, only the strip sizes of
+         * compressed records are read to rebuild the index, not the pixels
+         *
+         * @param path Path of the raw stack
+         * @param numFrames Frame count at the sync
+         * @param dataEnd End of the frame data at the sync
+         * @param meta Capture metadata stored in the header
+         * @param timestamps Time stamp of every frame, empty for none
+         * @return true on success
+         */
+        static bool Recover(std::string_view path, std::uint64_t numFrames,
+                            std::uint64_t dataEnd, const TifStackMeta& meta,
+                            const std::vector<double>& timestamps);
+
+        [[nodiscard]] bool IsOpen() const
+        {
+            return m_ofs.is_open() || m_async.IsOpen();
+        }
+
+        /**
+         * Tells if frames go through the async writer
+         *
+         * @return true for unbuffered stacks
+         */
+        [[nodiscard]] bool IsUnbuffered() const { return m_async.IsOpen(); }
+
+        /**
+         * Gives the layout SubmitFrame expects the frames in
+         *
+         * @return Pixel packing of the stack
+         */
+        [[nodiscard]] PixelPacking GetPacking() const
+        {
+            return static_cast<PixelPacking>(m_header.pixelPacking);
+        }
+
+        [[nodiscard]] std::uint64_t GetFramesWritten() const
+        {
+            return m_header.numFrames;
+        }
+
+        /**
+         * Gives the end of the frame data, where the next frame goes
+         *
+         * @return File offset past the last frame
+         */
+        [[nodiscard]] std::uint64_t GetDataEnd() const { return m_nextOffset; }
+
+        /**
+         * Gives the disk metrics of an unbuffered stack
+         *
+         * @return Async writer metrics, all zero for buffered stacks
+         */
+        [[nodiscard]] AsyncWriteStats GetWriteStats()
+        {
+            return m_async.IsOpen() ? m_async.GetStats() : AsyncWriteStats{};
+        }
+
+        /**
+         * Gives the number of pixel data bytes written so far
+         *
+         * @return Written bytes without padding and headers
+         */
+        [[nodiscard]] std::uint64_t GetBytesWritten() const
+        {
+            return m_bytesWritten;
+        }
+
+        ~RawStackWriter() { Close(TifStackMeta{}); }
+
+    private:
+        /**
+         * Writes the header page and waits for it, unbuffered stacks only
+         *
+         * @return true on success
+         */
+        bool WriteHeaderPage();
+
+        /**
+         * Allocates the staging slots of WriteFrame on unbuffered stacks
+         *
+         * @return true on success
+         */
+        bool AllocateStaging();
+
+        /**
+         * Writes one uncompressed frame and its padding through the stream
+         *
+         * @param frame Frame in the packing of the stack
+         * @param timestamp Capture time of the frame in seconds
+         * @return true on success
+         */
+        bool WriteStoredFrame(const uint8_t* frame, double timestamp);
+
+        std::string m_path{};
+        std::ofstream m_ofs{};
+        /// Buffer of m_ofs
+        std::vector<char> m_streamBuffer{};
+        /// Writer of unbuffered stacks, m_ofs stays closed then
+        AsyncFileWriter m_async{};
+        /// Aligned copy of the header for unbuffered writes
+        AlignedBuffer m_headerPage{};
+        /// Aligned copies of frames that WriteFrame gets in unaligned memory,
+        /// one per write in flight, allocated by the first WriteFrame
+        std::array<AlignedBuffer, ASYNC_WRITE_QUEUE_DEPTH> m_staging{};
+        /// Staging slots that no write is using
+        BoundedQueue<std::size_t> m_freeStaging{ASYNC_WRITE_QUEUE_DEPTH};
+        bool m_bStagingAllocated = false;
+
+        RawStackHeader m_header{};
+        /// Size of the pixel data of one frame
+        std::uint64_t m_frameBytes = 0;
+        /// Zeros filling each frame up to the stride
+        std::vector<char> m_padding{};
+        /// Packed copy of frames that WriteFrame gets as 16 bit pixels
+        std::vector<uint8_t> m_packed{};
+
+        /// Compressor of the frames, unused without compression
+        StripCodec m_codec{};
+        /// Strip sizes of the current compressed record
+        std::vector<uint32_t> m_stripBytes{};
+        /// Offset of every compressed record
+        std::vector<std::uint64_t> m_recordOffsets{};
+        /// Offset the next frame goes to
+        std::uint64_t m_nextOffset = 0;
+        std::uint64_t m_bytesWritten = 0;
+
+        bool m_bWithTimestamps = false;
+        std::vector<double> m_timestamps{};
+        bool m_errorOccurred = false;
+    };
+
+    /**
+     * Where sequential reads of a temporally compressed or patch stack left off
+     * Frames after a key frame are predicted from the ones before, keeping
+     * the state lets the next frame continue from here instead of the key
+     * frame. Patch frames only need the background of their key frame
+     */
+    struct RawDecodeState
+    {
+        /// Frame the background is ready for
+        std::uint64_t nextFrame = 0;
+        /// Running background of every pixel, empty until a frame was decoded
+        std::vector<uint32_t> background{};
+    };
+
+    /**
+     * Read only view of a raw stack mapped into memory
+     * Uncompressed frames are handed out as pointers into the mapping, no copy
+     * and no decode. Packed and compressed frames are decoded by ReadFrame
+     */
+    class RawStackReader
+    {
+    public:
+        RawStackReader() = default;
+
+        RawStackReader(const RawStackReader&) = delete;
+        RawStackReader& operator=(const RawStackReader&) = delete;
+
+        /**
+         * Maps a raw stack file
+         *
+         * @param path Path of the raw stack
+         * @return true on success
+         */
+        bool Open(std::string_view path);
+
+        /**
+         * Unmaps the file
+         */
+        void Close();
+
+        [[nodiscard]] bool IsOpen() const { return m_data != nullptr; }
+
+        [[nodiscard]] const RawStackHeader& GetHeader() const
+        {
+            return m_header;
+        }
+
+        [[nodiscard]] std::uint64_t GetNumFrames() const
+        {
+            return m_header.numFrames;
+        }
+
+        [[nodiscard]] bool IsCompressed() const
+        {
+            return m_header.compression != NO_COMPRESSION;
+        }
+
+        [[nodiscard]] bool IsPacked() const
+        {
+            return m_header.pixelPacking != UNPACKED_16;
+        }
+
+        /**
+         * Gives a frame of an uncompressed stack
+         *
+         * @param index Frame index
+         * @return Pixels of the frame, valid while the reader is open,
+         * nullptr for compressed and packed stacks
+         */
+        [[nodiscard]] const uint16_t* GetFrame(std::uint64_t index) const
+        {
+            if (IsCompressed() || IsPacked()) { return nullptr; }
+            return reinterpret_cast<const uint16_t*>(
+                    m_data + m_header.dataOffset +
+                    index * m_header.frameStride);
+        }
+
+        /**
+         * Copies a frame out of the stack, decoding it if it is compressed
+         * or packed
+         * Safe to call from several threads at once
+         *
+         * @param index Frame index
+         * @param frame Buffer for the pixels of the frame
+         * @return true on success
+         */
+        bool ReadFrame(std::uint64_t index, uint16_t* frame) const;
+
+        /**
+         * Copies a frame out of the stack and keeps the decoder state
+         * Temporally compressed frames are decoded from the last key frame,
+         * or from the state when it is between the key frame and the index,
+         * so reading frames in order decodes each of them once. Patch frames
+         * are laid over the background of the last key frame
+         *
+         * @param index Frame index
+         * @param frame Buffer for the pixels of the frame
+         * @param state Decoder state of one reading thread
+         * @param pool Decodes the strips of a frame in parallel if set
+         * @return true on success
+         */
+        bool ReadFrame(std::uint64_t index, uint16_t* frame,
+                       RawDecodeState& state, WorkerPool* pool = nullptr) const;
+
+        [[nodiscard]] bool HasTimestamps() const
+        {
+            return m_header.timestampOffset != 0;
+        }
+
+        /**
+         * Gives the capture time of a frame
+         *
+         * @param index Frame index
+         * @return Time stamp in seconds, 0 without a time stamp table
+         */
+        [[nodiscard]] double GetTimestamp(std::uint64_t index) const;
+
+        /**
+         * Gives the capture metadata stored in the header
+         *
+         * @return Capture metadata
+         */
+        [[nodiscard]] TifStackMeta GetMeta() const;
+
+        ~RawStackReader() { Close(); }
+
+    private:
+        /**
+         * Finds the compressed records, from the index table if the file has one
+         *
+         * @return true if at least the index table was consistent
+         */
+        bool IndexRecords();
+
+        /**
+         * Decodes the strips of one compressed record
+         *
+         * @param index Frame index
+         * @param frame Buffer for the pixels of the frame
+         * @param background Background of temporal compression and patches
+         * @param pool Decodes the strips in parallel if set
+         * @return true on success
+         */
+        bool DecodeRecord(std::uint64_t index, uint16_t* frame,
+                          uint32_t* background, WorkerPool* pool) const;
+
+        RawStackHeader m_header{};
+        /// Offset of every compressed record
+        std::vector<std::uint64_t> m_recordOffsets{};
+        const uint8_t* m_data = nullptr;
+        std::uint64_t m_size = 0;
+
+#ifdef _WIN32
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+#else
+        int m_fd = -1;
+#endif
+    };
+}// namespace prm
@@ -0,0 +1,813 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <spdlog/spdlog.h>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+#ifdef PRM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef PRM_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#include "StripCodec.h"
+
+namespace prm
+{
+    namespace
+    {
+        /**
+         * Replaces every pixel but the first in each row by its difference to
+         * the left neighbour, like the tiff horizontal predictor
+         */
+        void DifferenceRows(uint16_t* pixels, uint32_t width, uint32_t rows)
+        {
+            for (uint32_t y = 0; y < rows; ++y)
+            {
+                auto* row = pixels + std::size_t{y} * width;
+                for (uint32_t x = width - 1; x > 0; --x)
+                {
+                    row[x] = static_cast<uint16_t>(row[x] - row[x - 1]);
+                }
+            }
+        }
+
+        /**
+         * Undoes DifferenceRows
+         */
+        void AccumulateRows(uint16_t* pixels, uint32_t width, uint32_t rows)
+        {
+            for (uint32_t y = 0; y < rows; ++y)
+            {
+                auto* row = pixels + std::size_t{y} * width;
+                for (uint32_t x = 1; x < width; ++x)
+                {
+                    row[x] = static_cast<uint16_t>(row[x] + row[x - 1]);
+                }
+            }
+        }
+
+        std::size_t CompressBound(Compression compression, std::size_t bytes)
+        {
+            switch (compression)
+            {
+                case DEFLATE:
+                    return compressBound(static_cast<uLong>(bytes));
+#ifdef PRM_HAVE_ZSTD
+                case ZSTD:
+                    return ZSTD_compressBound(bytes);
+#endif
+#ifdef PRM_HAVE_LZ4
+                case LZ4:
+                    return static_cast<std::size_t>(
+                            LZ4_compressBound(static_cast<int>(bytes)));
+#endif
+                default:
+                    return bytes;
+            }
+        }
+
+        /// Flag in the mode byte of temporal strips predicted from the background
+        const uint8_t TEMPORAL_PREDICTED = 0x80;
+
+        /**
+         * Folds a residual into an unsigned value that stays small for small
+         * residuals of either sign
+         */
+        uint16_t ZigZag(uint16_t residual)
+        {
+            const auto value = static_cast<int16_t>(residual);
+            return static_cast<uint16_t>((value << 1) ^ (value >> 15));
+        }
+
+        /**
+         * Undoes ZigZag
+         */
+        uint16_t UnZigZag(uint16_t value)
+        {
+            return static_cast<uint16_t>((value >> 1) ^ (0u - (value & 1u)));
+        }
+
+        /**
+         * Gives the prediction of a pixel from its fixed point background
+         */
+        uint16_t Predict(uint32_t background)
+        {
+            return static_cast<uint16_t>(
+                    (background + (1u << (TEMPORAL_BACKGROUND_FRACTION - 1))) >>
+                    TEMPORAL_BACKGROUND_FRACTION);
+        }
+
+        /**
+         * Moves a fixed point background towards a pixel
+         */
+        uint32_t UpdateBackground(uint32_t background, uint16_t pixel)
+        {
+            const auto delta =
+                    (static_cast<int32_t>(pixel) << TEMPORAL_BACKGROUND_FRACTION) -
+                    static_cast<int32_t>(background);
+            return static_cast<uint32_t>(static_cast<int32_t>(background) +
+                                         (delta >> TEMPORAL_BACKGROUND_SHIFT));
+        }
+
+        /**
+         * Compresses a block of bytes
+         *
+         * @param dstBytes Capacity of dst on input, compressed size on output
+         * @return true on success
+         */
+        bool CompressBytes(Compression compression, const void* src,
+                           std::size_t srcBytes, uint8_t* dst,
+                           std::size_t& dstBytes)
+        {
+            switch (compression)
+            {
+                case DEFLATE:
+                {
+                    auto deflatedBytes = static_cast<uLongf>(dstBytes);
+                    if (compress2(dst, &deflatedBytes,
+                                  static_cast<const Bytef*>(src),
+                                  static_cast<uLong>(srcBytes),
+                                  DEFLATE_LEVEL) != Z_OK)
+                    {
+                        return false;
+                    }
+                    dstBytes = deflatedBytes;
+                    return true;
+                }
+#ifdef PRM_HAVE_ZSTD
+                case ZSTD:
+                {
+                    const auto compressedBytes = ZSTD_compress(
+                            dst, dstBytes, src, srcBytes, ZSTD_LEVEL);
+                    if (ZSTD_isError(compressedBytes)) { return false; }
+                    dstBytes = compressedBytes;
+                    return true;
+                }
+#endif
+#ifdef PRM_HAVE_LZ4
+                case LZ4:
+                {
+                    const auto compressedBytes = LZ4_compress_default(
+                            static_cast<const char*>(src),
+                            reinterpret_cast<char*>(dst),
+                            static_cast<int>(srcBytes),
+                            static_cast<int>(dstBytes));
+                    if (compressedBytes <= 0) { return false; }
+                    dstBytes = static_cast<std::size_t>(compressedBytes);
+                    return true;
+                }
+#endif
+                default:
+                    return false;
+            }
+        }
+
+        /**
+         * Decompresses a block of bytes of known size
+         *
+         * @return true if exactly dstBytes came out
+         */
+        bool DecompressBytes(Compression compression, const uint8_t* src,
+                             std::size_t srcBytes, void* dst,
+                             std::size_t dstBytes)
+        {
+            switch (compression)
+            {
+                case NO_COMPRESSION:
+                {
+                    if (srcBytes != dstBytes) { return false; }
+                    std::memcpy(dst, src, dstBytes);
+                    return true;
+                }
+                case DEFLATE:
+                {
+                    auto decodedBytes = static_cast<uLongf>(dstBytes);
+                    return uncompress(static_cast<Bytef*>(dst), &decodedBytes,
+                                      src, static_cast<uLong>(srcBytes)) ==
+                                   Z_OK &&
+                           decodedBytes == dstBytes;
+                }
+#ifdef PRM_HAVE_ZSTD
+                case ZSTD:
+                {
+                    const auto decodedBytes =
+                            ZSTD_decompress(dst, dstBytes, src, srcBytes);
+                    return !ZSTD_isError(decodedBytes) &&
+                           decodedBytes == dstBytes;
+                }
+#endif
+#ifdef PRM_HAVE_LZ4
+                case LZ4:
+                {
+                    const auto decodedBytes = LZ4_decompress_safe(
+                            reinterpret_cast<const char*>(src),
+                            static_cast<char*>(dst), static_cast<int>(srcBytes),
+                            static_cast<int>(dstBytes));
+                    return decodedBytes >= 0 &&
+                           static_cast<std::size_t>(decodedBytes) == dstBytes;
+                }
+#endif
+                default:
+                    return false;
+            }
+        }
+    }// namespace
+
+    bool StripCodec::IsSupported(Compression compression)
+    {
+        switch (compression)
+        {
+            case NO_COMPRESSION:
+            case DEFLATE:
+            case TEMPORAL:
+            case PATCHES:
+                return true;
+            case ZSTD:
+#ifdef PRM_HAVE_ZSTD
+                return true;
+#else
+                return false;
+#endif
+            case LZ4:
+#ifdef PRM_HAVE_LZ4
+                return true;
+#else
+                return false;
+#endif
+        }
+        return false;
+    }
+
+    unsigned StripCodec::DefaultNumThreads()
+    {
+        return std::max(std::thread::hardware_concurrency() / 2, 1u);
+    }
+
+    Compression StripCodec::FrameCompression(Compression compression)
+    {
+        if (compression != TEMPORAL && compression != PATCHES)
+        {
+            return compression;
+        }
+#ifdef PRM_HAVE_ZSTD
+        return ZSTD;
+#else
+        return DEFLATE;
+#endif
+    }
+
+    Compression StripCodec::BufferCompression()
+    {
+#if defined(PRM_HAVE_LZ4)
+        return LZ4;
+#elif defined(PRM_HAVE_ZSTD)
+        return ZSTD;
+#else
+        return DEFLATE;
+#endif
+    }
+
+    bool StripCodec::Configure(Compression compression, uint32_t imageWidth,
+                               uint32_t imageHeight, unsigned numThreads,
+                               uint16_t patchThreshold)
+    {
+        if (compression == NO_COMPRESSION || !IsSupported(compression))
+        {
+            spdlog::error("Compression {} is not available in this build",
+                          static_cast<int>(compression));
+            return false;
+        }
+
+        m_compression = compression;
+        m_coder = FrameCompression(compression);
+        m_imageWidth = imageWidth;
+        m_imageHeight = imageHeight;
+        m_numStrips = (imageHeight + COMPRESSION_ROWS_PER_STRIP - 1) /
+                      COMPRESSION_ROWS_PER_STRIP;
+
+        const auto stripPixels =
+                std::size_t{imageWidth} * COMPRESSION_ROWS_PER_STRIP;
+        m_tilesX = (imageWidth + PATCH_TILE_SIZE - 1) / PATCH_TILE_SIZE;
+        m_tilesY = (imageHeight + PATCH_TILE_SIZE - 1) / PATCH_TILE_SIZE;
+        m_patchThreshold = patchThreshold;
+        // Patch strips hold the background, the tile bitmap and the tiles
+        const auto tilesPerStrip =
+                std::size_t{m_tilesX} * (COMPRESSION_ROWS_PER_STRIP /
+                                         PATCH_TILE_SIZE);
+        const auto scratchPixels =
+                compression == PATCHES
+                        ? 2 * stripPixels + (tilesPerStrip + 15) / 16
+                        : stripPixels;
+        // Temporal strips start with their mode byte, patch strips with the
+        // uncompressed size as well
+        std::size_t headerBytes = 0;
+        if (compression == TEMPORAL) { headerBytes = 1; }
+        if (compression == PATCHES) { headerBytes = 1 + sizeof(uint32_t); }
+        m_strips.assign(m_numStrips,
+                        std::vector<uint8_t>(
+                                headerBytes +
+                                CompressBound(m_coder, scratchPixels *
+                                                               sizeof(uint16_t))));
+        m_stripSizes.assign(m_numStrips, 0);
+        m_scratch.assign(m_numStrips, std::vector<uint16_t>(scratchPixels));
+        m_background.assign(compression == TEMPORAL || compression == PATCHES
+                                    ? std::size_t{imageWidth} * imageHeight
+                                    : 0,
+                            0);
+        m_hotBoxes.assign(compression == PATCHES
+                                  ? std::size_t{m_tilesX} * m_tilesY
+                                  : 0,
+                          TileBox{});
+        m_framesSinceKey = 0;
+        m_bHasBackground = false;
+
+        if (!m_pool || m_pool->GetNumThreads() != numThreads)
+        {
+            m_pool = std::make_unique<WorkerPool>(std::max(numThreads, 1u));
+        }
+        return true;
+    }
+
+    bool StripCodec::Encode(const uint16_t* frame)
+    {
+        if (m_compression == PATCHES)
+        {
+            // Tiles are kept for bright pixels in the strips next door too,
+            // so those are all found before any strip is encoded
+            m_pool->ParallelFor(m_numStrips,
+                                [&](std::size_t index)
+                                {
+                                    FindHotPixels(frame,
+                                                  static_cast<uint32_t>(index));
+                                });
+        }
+
+        std::atomic<bool> success = true;
+        m_pool->ParallelFor(m_numStrips,
+                            [&](std::size_t index)
+                            {
+                                const auto strip = static_cast<uint32_t>(index);
+                                bool encoded = false;
+                                switch (m_compression)
+                                {
+                                    case TEMPORAL:
+                                        encoded = EncodeTemporalStrip(frame,
+                                                                      strip);
+                                        break;
+                                    case PATCHES:
+                                        encoded = EncodePatchStrip(frame, strip);
+                                        break;
+                                    default:
+                                        encoded = EncodeStrip(frame, strip);
+                                        break;
+                                }
+                                if (!encoded) { success = false; }
+                            });
+        const auto keyInterval = m_compression == PATCHES
+                                         ? PATCH_BACKGROUND_INTERVAL
+                                         : TEMPORAL_KEYFRAME_INTERVAL;
+        m_framesSinceKey = (m_framesSinceKey + 1) % keyInterval;
+        m_bHasBackground = true;
+        return success;
+    }
+
+    std::uint64_t StripCodec::GetEncodedBytes() const
+    {
+        std::uint64_t bytes = 0;
+        for (const auto size: m_stripSizes) { bytes += size; }
+        return bytes;
+    }
+
+    bool StripCodec::EncodeStrip(const uint16_t* frame, uint32_t index)
+    {
+        const auto firstRow = index * COMPRESSION_ROWS_PER_STRIP;
+        const auto numRows =
+                std::min(COMPRESSION_ROWS_PER_STRIP, m_imageHeight - firstRow);
+        const auto numPixels = std::size_t{m_imageWidth} * numRows;
+
+        auto& scratch = m_scratch[index];
+        std::memcpy(scratch.data(), frame + std::size_t{m_imageWidth} * firstRow,
+                    numPixels * sizeof(uint16_t));
+        DifferenceRows(scratch.data(), m_imageWidth, numRows);
+
+        auto& strip = m_strips[index];
+        auto stripBytes = strip.size();
+        if (!CompressBytes(m_compression, scratch.data(),
+                           numPixels * sizeof(uint16_t), strip.data(),
+                           stripBytes))
+        {
+            return false;
+        }
+        m_stripSizes[index] = stripBytes;
+        return true;
+    }
+
+    bool StripCodec::EncodeTemporalStrip(const uint16_t* frame, uint32_t index)
+    {
+        const auto firstRow = index * COMPRESSION_ROWS_PER_STRIP;
+        const auto numRows =
+                std::min(COMPRESSION_ROWS_PER_STRIP, m_imageHeight - firstRow);
+        const auto numPixels = std::size_t{m_imageWidth} * numRows;
+        const auto* pixels = frame + std::size_t{m_imageWidth} * firstRow;
+        auto* background =
+                m_background.data() + std::size_t{m_imageWidth} * firstRow;
+        const bool isKey = m_framesSinceKey == 0;
+
+        auto& scratch = m_scratch[index];
+        if (isKey)
+        {
+            for (std::size_t i = 0; i < numPixels; ++i)
+            {
+                background[i] = uint32_t{pixels[i]}
+                                << TEMPORAL_BACKGROUND_FRACTION;
+            }
+            std::memcpy(scratch.data(), pixels, numPixels * sizeof(uint16_t));
+            DifferenceRows(scratch.data(), m_imageWidth, numRows);
+        }
+        else
+        {
+            // Low bytes of all residuals first, the high bytes are mostly zero
+            auto* low = reinterpret_cast<uint8_t*>(scratch.data());
+            auto* high = low + numPixels;
+            for (std::size_t i = 0; i < numPixels; ++i)
+            {
+                const auto residual = ZigZag(
+                        static_cast<uint16_t>(pixels[i] - Predict(background[i])));
+                low[i] = static_cast<uint8_t>(residual);
+                high[i] = static_cast<uint8_t>(residual >> 8);
+                background[i] = UpdateBackground(background[i], pixels[i]);
+            }
+        }
+
+        auto& strip = m_strips[index];
+        strip[0] = static_cast<uint8_t>(m_coder) |
+                   (isKey ? uint8_t{0} : TEMPORAL_PREDICTED);
+        auto stripBytes = strip.size() - 1;
+        if (!CompressBytes(m_coder, scratch.data(), numPixels * sizeof(uint16_t),
+                           strip.data() + 1, stripBytes))
+        {
+            return false;
+        }
+        m_stripSizes[index] = stripBytes + 1;
+        return true;
+    }
+
+    void StripCodec::FindHotPixels(const uint16_t* frame, uint32_t index)
+    {
+        const auto firstRow = index * COMPRESSION_ROWS_PER_STRIP;
+        const auto numRows =
+                std::min(COMPRESSION_ROWS_PER_STRIP, m_imageHeight - firstRow);
+        const auto firstTileRow = firstRow / PATCH_TILE_SIZE;
+        const auto lastTileRow = (firstRow + numRows - 1) / PATCH_TILE_SIZE;
+        std::fill(m_hotBoxes.begin() + std::size_t{firstTileRow} * m_tilesX,
+                  m_hotBoxes.begin() + std::size_t{lastTileRow + 1} * m_tilesX,
+                  TileBox{});
+
+        for (auto y = firstRow; y < firstRow + numRows; ++y)
+        {
+            const auto* row = frame + std::size_t{y} * m_imageWidth;
+            auto* boxes = m_hotBoxes.data() +
+                          std::size_t{y / PATCH_TILE_SIZE} * m_tilesX;
+            for (uint32_t x = 0; x < m_imageWidth; ++x)
+            {
+                if (row[x] <= m_patchThreshold) { continue; }
+
+                auto& box = boxes[x / PATCH_TILE_SIZE];
+                if (!box.isHot) { box = TileBox{x, y, x, y, true}; }
+                else
+                {
+                    box.minX = std::min(box.minX, x);
+                    box.maxX = std::max(box.maxX, x);
+                    box.maxY = y;
+                }
+            }
+        }
+    }
+
+    bool StripCodec::IsTileKept(uint32_t tileX, uint32_t tileY) const
+    {
+        const auto minX = tileX * PATCH_TILE_SIZE;
+        const auto minY = tileY * PATCH_TILE_SIZE;
+        const auto maxX = minX + PATCH_TILE_SIZE - 1;
+        const auto maxY = minY + PATCH_TILE_SIZE - 1;
+
+        // The radius never reaches past the neighbouring tiles
+        const auto firstX = tileX > 0 ? tileX - 1 : 0;
+        const auto firstY = tileY > 0 ? tileY - 1 : 0;
+        const auto lastX = std::min(tileX + 1, m_tilesX - 1);
+        const auto lastY = std::min(tileY + 1, m_tilesY - 1);
+        for (auto y = firstY; y <= lastY; ++y)
+        {
+            for (auto x = firstX; x <= lastX; ++x)
+            {
+                const auto& box = m_hotBoxes[std::size_t{y} * m_tilesX + x];
+                if (box.isHot && box.minX <= maxX + PATCH_RADIUS &&
+                    box.maxX + PATCH_RADIUS >= minX &&
+                    box.minY <= maxY + PATCH_RADIUS &&
+                    box.maxY + PATCH_RADIUS >= minY)
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool StripCodec::EncodePatchStrip(const uint16_t* frame, uint32_t index)
+    {
+        const auto firstRow = index * COMPRESSION_ROWS_PER_STRIP;
+        const auto numRows =
+                std::min(COMPRESSION_ROWS_PER_STRIP, m_imageHeight - firstRow);
+        const auto numPixels = std::size_t{m_imageWidth} * numRows;
+        const auto* pixels = frame + std::size_t{m_imageWidth} * firstRow;
+        auto* background =
+                m_background.data() + std::size_t{m_imageWidth} * firstRow;
+        const bool isKey = m_framesSinceKey == 0;
+
+        const auto firstTileRow = firstRow / PATCH_TILE_SIZE;
+        const auto numTileRows = (numRows + PATCH_TILE_SIZE - 1) / PATCH_TILE_SIZE;
+        const auto numTiles = std::size_t{m_tilesX} * numTileRows;
+
+        // Background first on key frames, then the tile bitmap and the tiles
+        auto& scratch = m_scratch[index];
+        auto* bitmap = scratch.data() + (isKey ? numPixels : 0);
+        const auto bitmapWords = (numTiles + 15) / 16;
+        std::fill(bitmap, bitmap + bitmapWords, uint16_t{0});
+        for (std::size_t tile = 0; tile < numTiles; ++tile)
+        {
+            const auto tileX = static_cast<uint32_t>(tile % m_tilesX);
+            const auto tileY = static_cast<uint32_t>(tile / m_tilesX);
+            if (IsTileKept(tileX, firstTileRow + tileY))
+            {
+                bitmap[tile / 16] |= static_cast<uint16_t>(1u << tile % 16);
+            }
+        }
+        const auto isKept = [&](uint32_t x, uint32_t y)
+        {
+            const auto tile =
+                    std::size_t{y / PATCH_TILE_SIZE} * m_tilesX +
+                    x / PATCH_TILE_SIZE;
+            return (bitmap[tile / 16] >> tile % 16 & 1u) != 0;
+        };
+
+        // The background follows the pixels of the dropped tiles, the first
+        // frame fills the kept ones with the mean of the others so no
+        // particle is left behind in it
+        if (!m_bHasBackground)
+        {
+            std::uint64_t sum = 0;
+            std::size_t count = 0;
+            for (uint32_t y = 0; y < numRows; ++y)
+            {
+                for (uint32_t x = 0; x < m_imageWidth; ++x)
+                {
+                    if (isKept(x, y)) { continue; }
+                    sum += pixels[std::size_t{y} * m_imageWidth + x];
+                    ++count;
+                }
+            }
+            const auto mean = static_cast<uint32_t>(
+                    count > 0 ? sum / count : m_patchThreshold);
+            for (uint32_t y = 0; y < numRows; ++y)
+            {
+                for (uint32_t x = 0; x < m_imageWidth; ++x)
+                {
+                    const auto i = std::size_t{y} * m_imageWidth + x;
+                    background[i] = (isKept(x, y) ? mean : uint32_t{pixels[i]})
+                                    << TEMPORAL_BACKGROUND_FRACTION;
+                }
+            }
+        }
+        else
+        {
+            for (uint32_t y = 0; y < numRows; ++y)
+            {
+                for (uint32_t x = 0; x < m_imageWidth; ++x)
+                {
+                    if (isKept(x, y)) { continue; }
+                    const auto i = std::size_t{y} * m_imageWidth + x;
+                    background[i] = UpdateBackground(background[i], pixels[i]);
+                }
+            }
+        }
+
+        if (isKey)
+        {
+            for (std::size_t i = 0; i < numPixels; ++i)
+            {
+                scratch[i] = Predict(background[i]);
+            }
+            DifferenceRows(scratch.data(), m_imageWidth, numRows);
+        }
+
+        auto* tilePixels = bitmap + bitmapWords;
+        for (std::size_t tile = 0; tile < numTiles; ++tile)
+        {
+            if ((bitmap[tile / 16] >> tile % 16 & 1u) == 0) { continue; }
+
+            const auto minX = static_cast<uint32_t>(tile % m_tilesX) *
+                              PATCH_TILE_SIZE;
+            const auto minY = static_cast<uint32_t>(tile / m_tilesX) *
+                              PATCH_TILE_SIZE;
+            const auto width = std::min(PATCH_TILE_SIZE, m_imageWidth - minX);
+            const auto height = std::min(PATCH_TILE_SIZE, numRows - minY);
+            for (auto y = minY; y < minY + height; ++y)
+            {
+                std::memcpy(tilePixels,
+                            pixels + std::size_t{y} * m_imageWidth + minX,
+                            width * sizeof(uint16_t));
+                tilePixels += width;
+            }
+        }
+
+        const auto payloadBytes = static_cast<uint32_t>(
+                static_cast<std::size_t>(tilePixels - scratch.data()) *
+                sizeof(uint16_t));
+        auto& strip = m_strips[index];
+        strip[0] = static_cast<uint8_t>(m_coder) |
+                   (isKey ? uint8_t{0} : TEMPORAL_PREDICTED);
+        std::memcpy(strip.data() + 1, &payloadBytes, sizeof(payloadBytes));
+        const auto headerBytes = 1 + sizeof(payloadBytes);
+        auto stripBytes = strip.size() - headerBytes;
+        if (!CompressBytes(m_coder, scratch.data(), payloadBytes,
+                           strip.data() + headerBytes, stripBytes))
+        {
+            return false;
+        }
+        m_stripSizes[index] = stripBytes + headerBytes;
+        return true;
+    }
+
+    bool StripCodec::EncodeBlock(Compression compression, uint16_t* pixels,
+                                 std::size_t numPixels,
+                                 std::vector<uint8_t>& dst)
+    {
+        const auto srcBytes = numPixels * sizeof(uint16_t);
+        if (compression == NO_COMPRESSION)
+        {
+            dst.assign(reinterpret_cast<const uint8_t*>(pixels),
+                       reinterpret_cast<const uint8_t*>(pixels) + srcBytes);
+            return true;
+        }
+
+        DifferenceRows(pixels, static_cast<uint32_t>(numPixels), 1);
+        dst.resize(CompressBound(compression, srcBytes));
+        auto dstBytes = dst.size();
+        if (!CompressBytes(compression, pixels, srcBytes, dst.data(), dstBytes))
+        {
+            return false;
+        }
+        dst.resize(dstBytes);
+        return true;
+    }
+
+    bool StripCodec::DecodeStrip(Compression compression, const uint8_t* src,
+                                 std::size_t srcBytes, uint16_t* dst,
+                                 uint32_t imageWidth, uint32_t numRows)
+    {
+        const auto dstBytes =
+                std::size_t{imageWidth} * numRows * sizeof(uint16_t);
+        if (!DecompressBytes(compression, src, srcBytes, dst, dstBytes))
+        {
+            return false;
+        }
+        if (compression != NO_COMPRESSION)
+        {
+            AccumulateRows(dst, imageWidth, numRows);
+        }
+        return true;
+    }
+
+    bool StripCodec::IsKeyStrip(const uint8_t* src, std::size_t srcBytes)
+    {
+        return srcBytes > 0 && (src[0] & TEMPORAL_PREDICTED) == 0;
+    }
+
+    bool StripCodec::DecodeTemporalStrip(const uint8_t* src, std::size_t srcBytes,
+                                         uint16_t* dst, uint32_t* background,
+                                         uint32_t imageWidth, uint32_t numRows)
+    {
+        if (srcBytes == 0) { return false; }
+        const auto coder = static_cast<Compression>(src[0] & ~TEMPORAL_PREDICTED);
+        if (coder == NO_COMPRESSION || coder == TEMPORAL || coder == PATCHES ||
+            !IsSupported(coder))
+        {
+            return false;
+        }
+
+        const auto numPixels = std::size_t{imageWidth} * numRows;
+        if (IsKeyStrip(src, srcBytes))
+        {
+            if (!DecodeStrip(coder, src + 1, srcBytes - 1, dst, imageWidth,
+                             numRows))
+            {
+                return false;
+            }
+            for (std::size_t i = 0; i < numPixels; ++i)
+            {
+                background[i] = uint32_t{dst[i]} << TEMPORAL_BACKGROUND_FRACTION;
+            }
+            return true;
+        }
+
+        // Strips are decoded on several threads at once
+        thread_local std::vector<uint8_t> residuals{};
+        residuals.resize(numPixels * sizeof(uint16_t));
+        if (!DecompressBytes(coder, src + 1, srcBytes - 1, residuals.data(),
+                             residuals.size()))
+        {
+            return false;
+        }
+        const auto* low = residuals.data();
+        const auto* high = low + numPixels;
+        for (std::size_t i = 0; i < numPixels; ++i)
+        {
+            const auto residual = UnZigZag(
+                    static_cast<uint16_t>(low[i] | (uint16_t{high[i]} << 8)));
+            dst[i] = static_cast<uint16_t>(Predict(background[i]) + residual);
+            background[i] = UpdateBackground(background[i], dst[i]);
+        }
+        return true;
+    }
+
+    bool StripCodec::DecodePatchStrip(const uint8_t* src, std::size_t srcBytes,
+                                      uint16_t* dst, uint32_t* background,
+                                      uint32_t imageWidth, uint32_t numRows)
+    {
+        uint32_t payloadBytes = 0;
+        const auto headerBytes = 1 + sizeof(payloadBytes);
+        if (srcBytes < headerBytes) { return false; }
+        const auto coder = static_cast<Compression>(src[0] & ~TEMPORAL_PREDICTED);
+        if (coder == NO_COMPRESSION || coder == TEMPORAL || coder == PATCHES ||
+            !IsSupported(coder))
+        {
+            return false;
+        }
+        std::memcpy(&payloadBytes, src + 1, sizeof(payloadBytes));
+
+        const auto numPixels = std::size_t{imageWidth} * numRows;
+        const auto tilesX = (imageWidth + PATCH_TILE_SIZE - 1) / PATCH_TILE_SIZE;
+        const auto numTiles = std::size_t{tilesX} *
+                              ((numRows + PATCH_TILE_SIZE - 1) / PATCH_TILE_SIZE);
+        const auto bitmapWords = (numTiles + 15) / 16;
+        const bool isKey = IsKeyStrip(src, srcBytes);
+        const auto headerWords = (isKey ? numPixels : 0) + bitmapWords;
+        if (payloadBytes % sizeof(uint16_t) != 0 ||
+            payloadBytes / sizeof(uint16_t) < headerWords ||
+            payloadBytes / sizeof(uint16_t) > headerWords + numPixels)
+        {
+            return false;
+        }
+
+        // Strips are decoded on several threads at once
+        thread_local std::vector<uint16_t> payload{};
+        payload.resize(payloadBytes / sizeof(uint16_t));
+        if (!DecompressBytes(coder, src + headerBytes, srcBytes - headerBytes,
+                             payload.data(), payloadBytes))
+        {
+            return false;
+        }
+
+        if (isKey)
+        {
+            AccumulateRows(payload.data(), imageWidth, numRows);
+            for (std::size_t i = 0; i < numPixels; ++i)
+            {
+                background[i] = uint32_t{payload[i]}
+                                << TEMPORAL_BACKGROUND_FRACTION;
+            }
+        }
+        for (std::size_t i = 0; i < numPixels; ++i)
+        {
+            dst[i] = Predict(background[i]);
+        }
+
+        const auto* bitmap = payload.data() + (isKey ? numPixels : 0);
+        const auto* tilePixels = bitmap + bitmapWords;
+        const auto* end = payload.data() + payload.size();
+        for (std::size_t tile = 0; tile < numTiles; ++tile)
+        {
+            if ((bitmap[tile / 16] >> tile % 16 & 1u) == 0) { continue; }
+
+            const auto minX = static_cast<uint32_t>(tile % tilesX) *
+                              PATCH_TILE_SIZE;
+            const auto minY = static_cast<uint32_t>(tile / tilesX) *
+                              PATCH_TILE_SIZE;
+            const auto width = std::min(PATCH_TILE_SIZE, imageWidth - minX);
+            const auto height = std::min(PATCH_TILE_SIZE, numRows - minY);
+            if (tilePixels + std::size_t{width} * height > end) { return false; }
+            for (auto y = minY; y < minY + height; ++y)
+            {
+                std::memcpy(dst + std::size_t{y} * imageWidth + minX,
+                            tilePixels, width * sizeof(uint16_t));
+                tilePixels += width;
+            }
+        }
+        return tilePixels == end;
+    }
+}// namespace prm
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "misc/Meta.h"
+#include "utils/WorkerPool.h"
+
+namespace prm
+{
+    /// Rows in each independently compressed strip of a frame
+    const uint32_t COMPRESSION_ROWS_PER_STRIP = 64;
+    /// zlib level used while capturing, favours speed over ratio
+    const int DEFLATE_LEVEL = 1;
+    /// zstd level used while capturing, favours speed over ratio
+    const int ZSTD_LEVEL = 1;
+    /// Temporal compression starts over from a key frame this often
+    const uint32_t TEMPORAL_KEYFRAME_INTERVAL = 64;
+    /// The running background moves by 1 / 2^shift of its distance to each frame
+    const int TEMPORAL_BACKGROUND_SHIFT = 3;
+    /// Fraction bits of the running background
+    const int TEMPORAL_BACKGROUND_FRACTION = 4;
+    /// Edge of the square tiles that patch storage keeps or drops
+    const uint32_t PATCH_TILE_SIZE = 8;
+    /// Pixels kept on every side of a pixel above the patch threshold
+    const uint32_t PATCH_RADIUS = 4;
+    /// Patch storage saves the whole background this often
+    const uint32_t PATCH_BACKGROUND_INTERVAL = 128;
+    static_assert(COMPRESSION_ROWS_PER_STRIP % PATCH_TILE_SIZE == 0 &&
+                          PATCH_RADIUS <= PATCH_TILE_SIZE,
+                  "Patch tiles have to line up with the strips and only "
+                  "reach into neighbouring tiles");
+
+    /**
+     * Lossless compressor of 16 bit mono frames
+     * A frame is cut into strips of rows that are differenced horizontally
+     * and compressed on their own, in parallel on a worker pool. Differencing
+     * turns the smooth, mostly dark background into runs of small values that
+     * compress well. The strips map directly onto tiff strips with predictor 2.
+     * Temporal compression keeps a running background of every pixel instead
+     * and compresses the difference of each frame to it. Static background
+     * and noise below it cancel out, so only the moving particles and the
+     * remaining noise are left. Every TEMPORAL_KEYFRAME_INTERVAL frames a key
+     * frame is compressed on its own, a strip starts with a byte telling
+     * which kind it is and which coder packed it
+     * Patch storage is lossy. It cuts frames into tiles and keeps only the
+     * tiles within PATCH_RADIUS of a pixel above a threshold, with a bitmap
+     * of their positions. The rest of the frame is taken from a background
+     * that follows the dropped tiles and is saved on key frames every
+     * PATCH_BACKGROUND_INTERVAL frames
+     */
+    class StripCodec
+    {
+    public:
+        StripCodec() = default;
+
+        StripCodec(const StripCodec&) = delete;
+        StripCodec& operator=(const StripCodec&) = delete;
+
+        /**
+         * Tells if the build supports a compression
+         *
+         * @param compression Compression to check
+         * @return true if frames can be compressed with it
+         */
+        static bool IsSupported(Compression compression);
+
+        /**
+         * Gives the number of compression threads that leaves cores for the capture
+         *
+         * @return Number of threads
+         */
+        static unsigned DefaultNumThreads();
+
+        /**
+         * Gives the per frame compression that stands in for a compression
+         * where every frame has to decode on its own, like in tif stacks
+         *
+         * @param compression Requested compression
+         * @return The coder of temporal compression, otherwise compression
+         */
+        static Compression FrameCompression(Compression compression);
+
+        /**
+         * Gives the fastest compression of the build for frames held in RAM
+         *
+         * @return LZ4 if available, otherwise ZSTD or DEFLATE
+         */
+        static Compression BufferCompression();
+
+        /**
+         * Sets up the strip buffers and the worker threads
+         *
+         * @param compression Compression to use, not NO_COMPRESSION
+         * @param imageWidth Width of each image
+         * @param imageHeight Height of each image
+         * @param numThreads Number of compression threads
+         * @param patchThreshold Pixels above it keep their surroundings in
+         * patch storage
+         * @return true on success
+         */
+        bool Configure(Compression compression, uint32_t imageWidth,
+                       uint32_t imageHeight, unsigned numThreads,
+                       uint16_t patchThreshold = DEFAULT_PATCH_THRESHOLD);
+
+        /**
+         * Compresses a frame, the strips stay valid until the next call
+         * Temporal compression predicts the frame from the ones encoded since
+         * Configure, so every frame of the stack has to go through here
+         *
+         * @param frame Pixels of the frame
+         * @return true on success
+         */
+        bool Encode(const uint16_t* frame);
+
+        [[nodiscard]] uint32_t GetNumStrips() const { return m_numStrips; }
+
+        [[nodiscard]] uint32_t GetRowsPerStrip() const
+        {
+            return COMPRESSION_ROWS_PER_STRIP;
+        }
+
+        [[nodiscard]] const uint8_t* GetStripData(uint32_t index) const
+        {
+            return m_strips[index].data();
+        }
+
+        [[nodiscard]] std::size_t GetStripSize(uint32_t index) const
+        {
+            return m_stripSizes[index];
+        }
+
+        /**
+         * Gives the size of the last encoded frame
+         *
+         * @return Sum of the strip sizes in bytes
+         */
+        [[nodiscard]] std::uint64_t GetEncodedBytes() const;
+
+        /**
+         * Differences a block of pixels as one long row and compresses it
+         * Suits blocks of several frames, the result matches the delta filter
+         * of numcodecs followed by its zlib or zstd codec
+         *
+         * @param compression Compression to use, NO_COMPRESSION copies the pixels
+         * @param pixels Pixels of the block, differenced in place
+         * @param numPixels Number of pixels in the block, below 2^32
+         * @param dst Compressed block, resized to fit
+         * @return true on success
+         */
+        static bool EncodeBlock(Compression compression, uint16_t* pixels,
+                                std::size_t numPixels, std::vector<uint8_t>& dst);
+
+        /**
+         * Decompresses one strip and undoes the differencing
+         *
+         * @param compression Compression of the strip
+         * @param src Compressed strip
+         * @param srcBytes Size of the compressed strip
+         * @param dst Pixels of the strip
+         * @param imageWidth Width of each row
+         * @param numRows Number of rows in the strip
+         * @return true on success
+         */
+        static bool DecodeStrip(Compression compression, const uint8_t* src,
+                                std::size_t srcBytes, uint16_t* dst,
+                                uint32_t imageWidth, uint32_t numRows);
+
+        /**
+         * Tells if a temporally compressed or patch strip decodes without
+         * earlier frames
+         *
+         * @param src Compressed strip
+         * @param srcBytes Size of the compressed strip
+         * @return true for strips of key frames
+         */
+        static bool IsKeyStrip(const uint8_t* src, std::size_t srcBytes);
+
+        /**
+         * Decompresses one temporally compressed strip
+         * Strips of frames after a key frame have to be decoded in order,
+         * each one moves the background on
+         *
+         * @param src Compressed strip
+         * @param srcBytes Size of the compressed strip
+         * @param dst Pixels of the strip
+         * @param background Running background of the strip, set by key strips
+         * @param imageWidth Width of each row
+         * @param numRows Number of rows in the strip
+         * @return true on success
+         */
+        static bool DecodeTemporalStrip(const uint8_t* src, std::size_t srcBytes,
+                                        uint16_t* dst, uint32_t* background,
+                                        uint32_t imageWidth, uint32_t numRows);
+
+        /**
+         * Rebuilds one strip of patch storage
+         * Key strips set the background, the others only fill in their tiles
+         *
+         * @param src Compressed strip
+         * @param srcBytes Size of the compressed strip
+         * @param dst Pixels of the strip
+         * @param background Background of the strip, set by key strips
+         * @param imageWidth Width of each row
+         * @param numRows Number of rows in the strip
+         * @return true on success
+         */
+        static bool DecodePatchStrip(const uint8_t* src, std::size_t srcBytes,
+                                     uint16_t* dst, uint32_t* background,
+                                     uint32_t imageWidth, uint32_t numRows);
+
+    private:
+        /// Bounding box of the pixels above the patch threshold in a tile
+        struct TileBox
+        {
+            uint32_t minX;
+            uint32_t minY;
+            uint32_t maxX;
+            uint32_t maxY;
+            bool isHot;
+        };
+
+        /**
+         * Differences and compresses one strip
+         *
+         * @param frame Pixels of the frame
+         * @param index Strip index
+         * @return true on success
+         */
+        bool EncodeStrip(const uint16_t* frame, uint32_t index);
+
+        /**
+         * Compresses one strip against the running background and moves
+         * the background on, or starts it over on key frames
+         *
+         * @param frame Pixels of the frame
+         * @param index Strip index
+         * @return true on success
+         */
+        bool EncodeTemporalStrip(const uint16_t* frame, uint32_t index);
+
+        /**
+         * Finds the pixels above the patch threshold in the tiles of one strip
+         *
+         * @param frame Pixels of the frame
+         * @param index Strip index
+         */
+        void FindHotPixels(const uint16_t* frame, uint32_t index);
+
+        /**
+         * Tells if a tile is within PATCH_RADIUS of a pixel above the threshold
+         *
+         * @param tileX Tile column
+         * @param tileY Tile row
+         * @return true if patch storage keeps the tile
+         */
+        [[nodiscard]] bool IsTileKept(uint32_t tileX, uint32_t tileY) const;
+
+        /**
+         * Compresses the kept tiles of one strip and moves the background on
+         * where tiles are dropped, key frames save the background as well
+         *
+         * @param frame Pixels of the frame
+         * @param index Strip index
+         * @return true on success
+         */
+        bool EncodePatchStrip(const uint16_t* frame, uint32_t index);
+
+        Compression m_compression = NO_COMPRESSION;
+        /// Coder of the residuals of temporal compression
+        Compression m_coder = NO_COMPRESSION;
+        uint32_t m_imageWidth = 0;
+        uint32_t m_imageHeight = 0;
+        uint32_t m_numStrips = 0;
+
+        /// Compressed strips, sized for the worst case
+        std::vector<std::vector<uint8_t>> m_strips{};
+        /// Compressed size of each strip
+        std::vector<std::size_t> m_stripSizes{};
+        /// Differenced rows of each strip
+        std::vector<std::vector<uint16_t>> m_scratch{};
+        /// Running background of temporal compression, fixed point
+        std::vector<uint32_t> m_background{};
+        /// Frames encoded since the last key frame
+        uint32_t m_framesSinceKey = 0;
+        /// Set once the first frame has started the background
+        bool m_bHasBackground = false;
+
+        /// Pixels above it keep their surroundings in patch storage
+        uint16_t m_patchThreshold = DEFAULT_PATCH_THRESHOLD;
+        uint32_t m_tilesX = 0;
+        uint32_t m_tilesY = 0;
+        /// Pixels above the patch threshold in each tile of the frame
+        std::vector<TileBox> m_hotBoxes{};
+
+        std::unique_ptr<WorkerPool> m_pool{};
+    };
+}// namespace prm
@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <spdlog/spdlog.h>
+
+#include "FileUtils.h"
+#include "TiffStackWriter.h"
+
+namespace prm
+{
+    static_assert(std::endian::native == std::endian::little,
+                  "Tif stacks are written in the host byte order");
+
+    namespace
+    {
+        /// Field types used in the image directories
+        enum TiffType : uint16_t
+        {
+            TIFF_SHORT = 3,
+            TIFF_LONG = 4,
+            TIFF_LONG8 = 16
+        };
+
+        /// Directory entry with its values
+        struct TiffEntry
+        {
+            uint16_t tag;
+            TiffType type;
+            std::vector<std::uint64_t> values;
+        };
+
+        template<typename T>
+        void Put(char*& dst, T value)
+        {
+            std::memcpy(dst, &value, sizeof(T));
+            dst += sizeof(T);
+        }
+
+        std::size_t TypeSize(TiffType type)
+        {
+            switch (type)
+            {
+                case TIFF_SHORT:
+                    return 2;
+                case TIFF_LONG:
+                    return 4;
+                default:
+                    return 8;
+            }
+        }
+
+        void PutValue(char*& dst, TiffType type, std::uint64_t value)
+        {
+            switch (type)
+            {
+                case TIFF_SHORT:
+                    Put<uint16_t>(dst, static_cast<uint16_t>(value));
+                    break;
+                case TIFF_LONG:
+                    Put<uint32_t>(dst, static_cast<uint32_t>(value));
+                    break;
+                case TIFF_LONG8:
+                    Put<std::uint64_t>(dst, value);
+                    break;
+            }
+        }
+
+        uint16_t CompressionTag(Compression compression)
+        {
+            switch (compression)
+            {
+                case DEFLATE:
+                    return 8;// Adobe deflate
+                case ZSTD:
+                    return 50000;
+                default:
+                    return 1;
+            }
+        }
+    }// namespace
+
+    bool TiffStackWriter::Open(std::string_view path, uint32_t imageWidth,
+                               uint32_t imageHeight,
+                               std::uint64_t expectedFrames,
+                               Compression compression)
+    {
+        if (IsOpen())
+        {
+            spdlog::error("Tif stack writer is already open");
+            return false;
+        }
+
+        m_path = path;
+        m_imageWidth = imageWidth;
+        m_imageHeight = imageHeight;
+        m_frameBytes = std::uint64_t{imageWidth} * imageHeight * sizeof(uint16_t);
+        m_compression = compression;
+        m_ifdOffsets.clear();
+        m_stripBytes.clear();
+        m_bytesWritten = 0;
+        m_errorOccurred = false;
+
+        if (m_compression != NO_COMPRESSION)
+        {
+            if (!m_codec.Configure(m_compression, imageWidth, imageHeight,
+                                   StripCodec::DefaultNumThreads()))
+            {
+                return false;
+            }
+            m_numStrips = m_codec.GetNumStrips();
+            m_rowsPerStrip = m_codec.GetRowsPerStrip();
+        }
+        else
+        {
+            m_numStrips = 1;
+            m_rowsPerStrip = imageHeight;
+        }
+
+        // Strip arrays that don't fit into the entries follow the directory
+        auto slotSize = TIFF_IFD_SLOT;
+        if (m_numStrips > 1) { slotSize += (m_numStrips * 16 + 15) / 16 * 16; }
+        m_ifd.assign(slotSize, 0);
+
+        m_nextIfdOffset = TIFF_HEADER_SLOT;
+        m_bBigTiff = m_compression == NO_COMPRESSION && expectedFrames > 0 &&
+                     TIFF_HEADER_SLOT + expectedFrames * (slotSize + m_frameBytes) >
+                             TIFF_MAX_CLASSIC_OFFSET;
+
+        // The buffer has to be in place before the file is opened to take effect
+        m_streamBuffer.resize(TIFF_WRITE_BUFFER_SIZE);
+        m_ofs.rdbuf()->pubsetbuf(m_streamBuffer.data(),
+                                 static_cast<std::streamsize>(m_streamBuffer.size()));
+        m_ofs.open(m_path, std::ios::binary | std::ios::trunc);
+        if (!m_ofs)
+        {
+            spdlog::error("Couldn't create {}", m_path);
+            return false;
+        }
+        return WriteHeader();
+    }
+
+    bool TiffStackWriter::WriteFrame(const uint16_t* frame)
+    {
+        if (!IsOpen() || m_errorOccurred) { return false; }
+
+        if (m_compression != NO_COMPRESSION)
+        {
+            if (!m_codec.Encode(frame))
+            {
+                spdlog::error("Failed compressing frame {} for {}",
+                              m_ifdOffsets.size(), m_path);
+                m_errorOccurred = true;
+                return false;
+            }
+            for (uint32_t i = 0; i < m_numStrips; ++i)
+            {
+                m_stripBytes.push_back(
+                        static_cast<uint32_t>(m_codec.GetStripSize(i)));
+            }
+        }
+        else { m_stripBytes.push_back(static_cast<uint32_t>(m_frameBytes)); }
+
+        const auto index = m_ifdOffsets.size();
+        const auto dataBytes = m_compression != NO_COMPRESSION
+                                       ? m_codec.GetEncodedBytes()
+                                       : m_frameBytes;
+        const auto ifdOffset = m_nextIfdOffset;
+        const auto nextOffset = ifdOffset + m_ifd.size() + dataBytes;
+        m_ifdOffsets.push_back(ifdOffset);
+
+        if (!m_bBigTiff && nextOffset > TIFF_MAX_CLASSIC_OFFSET)
+        {
+            if (!PromoteToBigTiff())
+            {
+                m_errorOccurred = true;
+                return false;
+            }
+        }
+
+        EncodeIfd(index, nextOffset);
+        m_ofs.write(m_ifd.data(), static_cast<std::streamsize>(m_ifd.size()));
+        if (m_compression != NO_COMPRESSION)
+        {
+            for (uint32_t i = 0; i < m_numStrips; ++i)
+            {
+                m_ofs.write(reinterpret_cast<const char*>(m_codec.GetStripData(i)),
+                            static_cast<std::streamsize>(m_codec.GetStripSize(i)));
+            }
+        }
+        else
+        {
+            m_ofs.write(reinterpret_cast<const char*>(frame),
+                        static_cast<std::streamsize>(m_frameBytes));
+        }
+        if (!m_ofs)
+        {
+            spdlog::error("Failed writing frame {} to {}", index, m_path);
+            m_errorOccurred = true;
+            return false;
+        }
+
+        m_nextIfdOffset = nextOffset;
+        m_bytesWritten += dataBytes;
+        return true;
+    }
+
+    bool TiffStackWriter::Sync()
+    {
+        if (!IsOpen() || m_errorOccurred) { return false; }
+
+        m_ofs.flush();
+        return static_cast<bool>(m_ofs) && FileUtils::SyncFile(m_path);
+    }
+
+    bool TiffStackWriter::Close()
+    {
+        if (!IsOpen()) { return true; }
+
+        const auto numFrames = m_ifdOffsets.size();
+        if (numFrames > 0 && !m_errorOccurred)
+        {
+            // Only the last directory still points past the end of the file
+            EncodeIfd(numFrames - 1, 0);
+            m_ofs.seekp(static_cast<std::streamoff>(m_ifdOffsets.back()));
+            m_ofs.write(m_ifd.data(), static_cast<std::streamsize>(m_ifd.size()));
+        }
+        else if (numFrames == 0) { spdlog::warn("Closing {} without frames", m_path); }
+
+        m_ofs.close();
+        if (m_ofs.fail())
+        {
+            spdlog::error("Failed finishing {}", m_path);
+            m_errorOccurred = true;
+        }
+        m_ofs.clear();
+
+        if (m_compression != NO_COMPRESSION && m_bytesWritten > 0)
+        {
+            spdlog::info("Wrote {} frames to {} as {}, compression ratio {:.2f}",
+                         numFrames, m_path, m_bBigTiff ? "bigtiff" : "tiff",
+                         static_cast<double>(numFrames * m_frameBytes) /
+                                 static_cast<double>(m_bytesWritten));
+        }
+        else
+        {
+            spdlog::info("Wrote {} frames to {} as {}", numFrames, m_path,
+                         m_bBigTiff ? "bigtiff" : "tiff");
+        }
+        return !m_errorOccurred;
+    }
+
+    bool TiffStackWriter::Recover(std::string_view path,
+                                  std::uint64_t lastFrameOffset,
+                                  std::uint64_t dataEnd)
+    {
+        const std::string pathStr{path};
+        std::error_code ec;
+        const auto fileSize = std::filesystem::file_size(pathStr, ec);
+        if (ec || fileSize < dataEnd || lastFrameOffset < TIFF_HEADER_SLOT ||
+            lastFrameOffset >= dataEnd)
+        {
+            spdlog::error("{} is shorter than its journal", pathStr);
+            return false;
+        }
+        std::filesystem::resize_file(pathStr, dataEnd, ec);
+        std::fstream fs{pathStr, std::ios::binary | std::ios::in | std::ios::out};
+        if (ec || !fs)
+        {
+            spdlog::error("Couldn't truncate {}", pathStr);
+            return false;
+        }
+
+        // The header tells the variant, which sets the directory layout
+        char byteOrder[2]{};
+        uint16_t version = 0;
+        fs.read(byteOrder, sizeof(byteOrder));
+        fs.read(reinterpret_cast<char*>(&version), sizeof(version));
+        if (!fs || byteOrder[0] != 'I' || byteOrder[1] != 'I' ||
+            (version != 42 && version != 43))
+        {
+            spdlog::error("{} is not a tif stack", pathStr);
+            return false;
+        }
+        const bool bigTiff = version == 43;
+
+        std::uint64_t numEntries = 0;
+        fs.seekg(static_cast<std::streamoff>(lastFrameOffset));
+        fs.read(reinterpret_cast<char*>(&numEntries), bigTiff ? 8 : 2);
+        const auto linkOffset = lastFrameOffset + (bigTiff ? 8 + numEntries * 20
+                                                           : 2 + numEntries * 12);
+        const std::uint64_t noNext = 0;
+        fs.seekp(static_cast<std::streamoff>(linkOffset));
+        fs.write(reinterpret_cast<const char*>(&noNext), bigTiff ? 8 : 4);
+        fs.close();
+        if (fs.fail() || linkOffset >= dataEnd)
+        {
+            spdlog::error("Failed finishing {}", pathStr);
+            return false;
+        }
+        return true;
+    }
+
+    void TiffStackWriter::EncodeIfd(std::uint64_t index,
+                                    std::uint64_t nextOffset)
+    {
+        const auto ifdOffset = m_ifdOffsets[index];
+        const auto* stripBytes = &m_stripBytes[index * m_numStrips];
+
+        std::vector<std::uint64_t> stripOffsets(m_numStrips);
+        std::vector<std::uint64_t> stripCounts(m_numStrips);
+        auto offset = ifdOffset + m_ifd.size();
+        for (uint32_t i = 0; i < m_numStrips; ++i)
+        {
+            stripOffsets[i] = offset;
+            stripCounts[i] = stripBytes[i];
+            offset += stripBytes[i];
+        }
+
+        std::vector<TiffEntry> entries = {
+                {256, TIFF_LONG, {m_imageWidth}},                 // ImageWidth
+                {257, TIFF_LONG, {m_imageHeight}},                // ImageLength
+                {258, TIFF_SHORT, {16}},                          // BitsPerSample
+                {259, TIFF_SHORT, {CompressionTag(m_compression)}},// Compression
+                {262, TIFF_SHORT, {1}},                           // Photometric, black is zero
+                {273, m_bBigTiff ? TIFF_LONG8 : TIFF_LONG,
+                 std::move(stripOffsets)},                        // StripOffsets
+                {277, TIFF_SHORT, {1}},                           // SamplesPerPixel
+                {278, TIFF_LONG, {m_rowsPerStrip}},               // RowsPerStrip
+                {279, TIFF_LONG, std::move(stripCounts)},         // StripByteCounts
+                {284, TIFF_SHORT, {1}}};                          // PlanarConfiguration
+        if (m_compression != NO_COMPRESSION)
+        {
+            entries.push_back({317, TIFF_SHORT, {2}});// Predictor, horizontal
+        }
+        entries.push_back({339, TIFF_SHORT, {1}});// SampleFormat, unsigned
+
+        std::fill(m_ifd.begin(), m_ifd.end(), 0);
+        auto* dst = m_ifd.data();
+        // Values that don't fit into their entry go behind the directory
+        auto* arrayDst = m_ifd.data() + TIFF_IFD_SLOT;
+        const std::size_t valueSize = m_bBigTiff ? 8 : 4;
+
+        if (m_bBigTiff) { Put<std::uint64_t>(dst, entries.size()); }
+        else { Put<uint16_t>(dst, static_cast<uint16_t>(entries.size())); }
+
+        for (const auto& entry: entries)
+        {
+            Put<uint16_t>(dst, entry.tag);
+            Put<uint16_t>(dst, entry.type);
+            if (m_bBigTiff) { Put<std::uint64_t>(dst, entry.values.size()); }
+            else { Put<uint32_t>(dst, static_cast<uint32_t>(entry.values.size())); }
+
+            auto* valueEnd = dst + valueSize;
+            if (entry.values.size() * TypeSize(entry.type) <= valueSize)
+            {
+                // Values are left justified in the value field
+                for (const auto value: entry.values)
+                {
+                    PutValue(dst, entry.type, value);
+                }
+            }
+            else
+            {
+                const auto arrayOffset =
+                        ifdOffset + static_cast<std::uint64_t>(arrayDst - m_ifd.data());
+                if (m_bBigTiff) { Put<std::uint64_t>(dst, arrayOffset); }
+                else { Put<uint32_t>(dst, static_cast<uint32_t>(arrayOffset)); }
+                for (const auto value: entry.values)
+                {
+                    PutValue(arrayDst, entry.type, value);
+                }
+            }
+            dst = valueEnd;
+        }
+
+        if (m_bBigTiff) { Put<std::uint64_t>(dst, nextOffset); }
+        else { Put<uint32_t>(dst, static_cast<uint32_t>(nextOffset)); }
+    }
+
+    bool TiffStackWriter::WriteHeader()
+    {
+        char header[TIFF_HEADER_SLOT]{};
+        auto* dst = header;
+        Put<char>(dst, 'I');
+        Put<char>(dst, 'I');
+        if (m_bBigTiff)
+        {
+            Put<uint16_t>(dst, 43);
+            Put<uint16_t>(dst, 8);// Offset size
+            Put<uint16_t>(dst, 0);
+            Put<std::uint64_t>(dst, TIFF_HEADER_SLOT);
+        }
+        else
+        {
+            Put<uint16_t>(dst, 42);
+            Put<uint32_t>(dst, static_cast<uint32_t>(TIFF_HEADER_SLOT));
+        }
+
+        m_ofs.seekp(0);
+        m_ofs.write(header, sizeof(header));
+        return static_cast<bool>(m_ofs);
+    }
+
+    bool TiffStackWriter::PromoteToBigTiff()
+    {
+        spdlog::info("{} grows past 4 GB, switching to bigtiff", m_path);
+        m_bBigTiff = true;
+
+        // The frame being written has its offset recorded but isn't on disk yet
+        for (std::size_t i = 0; i + 1 < m_ifdOffsets.size(); ++i)
+        {
+            EncodeIfd(i, m_ifdOffsets[i + 1]);
+            m_ofs.seekp(static_cast<std::streamoff>(m_ifdOffsets[i]));
+            m_ofs.write(m_ifd.data(), static_cast<std::streamsize>(m_ifd.size()));
+        }
+        const bool success = WriteHeader();
+        m_ofs.seekp(0, std::ios::end);
+
+        if (!success || !m_ofs)
+        {
+            spdlog::error("Failed switching {} to bigtiff", m_path);
+            return false;
+        }
+        return true;
+    }
+}// namespace prm
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "misc/Meta.h"
+#include "utils/StripCodec.h"
+
+namespace prm
+{
+    /// Size of the stream buffer, frames go to disk in blocks of this size
+    const std::size_t TIFF_WRITE_BUFFER_SIZE = 8 * 1024 * 1024;
+    /// Space reserved for the file header, fits both the tiff and bigtiff one
+    const std::size_t TIFF_HEADER_SLOT = 16;
+    /// Space reserved for every image directory, fits both variants
+    const std::size_t TIFF_IFD_SLOT = 256;
+    /// Largest offset a classic tiff can address
+    const std::uint64_t TIFF_MAX_CLASSIC_OFFSET = 0xFFFFFFFFull;
+
+    /**
+     * Streaming writer of 16 bit mono tif stacks
+     * Every frame goes to disk as one block of a directory slot followed by
+     * the pixel data. The size of a frame is known before it is written, so
+     * the offset of the next directory is known too and the directories are
+     * chained without seeking back. Only Close patches the last link. A stack
+     * starts as classic tiff and is promoted to bigtiff in place once it grows
+     * past 4 GB, the directory slots fit both variants.
+     * Compressed frames are written as strips with the horizontal predictor,
+     * compressed in parallel by a StripCodec
+     */
+    class TiffStackWriter
+    {
+    public:
+        TiffStackWriter() = default;
+
+        TiffStackWriter(const TiffStackWriter&) = delete;
+        TiffStackWriter& operator=(const TiffStackWriter&) = delete;
+
+        /**
+         * Creates the stack file
+         *
+         * @param path Path of the tif stack
+         * @param imageWidth Width of each image
+         * @param imageHeight Height of each image
+         * @param expectedFrames Number of frames if known up front, 0 otherwise.
+         * Uncompressed stacks known to exceed 4 GB start as bigtiff
+         * @param compression Lossless compression of the frames
+         * @return true on success
+         */
+        bool Open(std::string_view path, uint32_t imageWidth,
+                  uint32_t imageHeight, std::uint64_t expectedFrames = 0,
+                  Compression compression = NO_COMPRESSION);
+
+        /**
+         * Appends one frame to the stack
+         *
+         * @param frame Pixels of the frame
+         * @return true on success
+         */
+        bool WriteFrame(const uint16_t* frame);
+
+        /**
+         * Forces the frames written so far onto the disk
+         * The last directory still points past the end of the file until Close
+         *
+         * @return true once every frame so far is durable
+         */
+        bool Sync();
+
+        /**
+         * Terminates the directory chain and closes the file
+         *
+         * @return true if every frame made it to disk
+         */
+        bool Close();
+
+        /**
+         * Finalises a stack that was never closed from a synced state
+         * Everything past dataEnd is cut off and the directory of the last
+         * synced frame becomes the end of the chain, no pixels are read
+         *
+         * @param path Path of the tif stack
+         * @param lastFrameOffset Directory offset of the last synced frame
+         * @param dataEnd End of the last synced frame
+         * @return true on success
+         */
+        static bool Recover(std::string_view path,
+                            std::uint64_t lastFrameOffset,
+                            std::uint64_t dataEnd);
+
+        [[nodiscard]] bool IsOpen() const { return m_ofs.is_open(); }
+
+        [[nodiscard]] bool IsBigTiff() const { return m_bBigTiff; }
+
+        [[nodiscard]] std::uint64_t GetFramesWritten() const
+        {
+            return m_ifdOffsets.size();
+        }
+
+        /**
+         * Gives the directory offset of the last written frame
+         *
+         * @return File offset, 0 before the first frame
+         */
+        [[nodiscard]] std::uint64_t GetLastFrameOffset() const
+        {
+            return m_ifdOffsets.empty() ? 0 : m_ifdOffsets.back();
+        }
+
+        /**
+         * Gives the end of the frame data, where the next directory goes
+         *
+         * @return File offset past the last frame
+         */
+        [[nodiscard]] std::uint64_t GetDataEnd() const
+        {
+            return m_nextIfdOffset;
+        }
+
+        /**
+         * Gives the number of pixel data bytes written so far
+         *
+         * @return Written bytes without the directories
+         */
+        [[nodiscard]] std::uint64_t GetBytesWritten() const
+        {
+            return m_bytesWritten;
+        }
+
+        ~TiffStackWriter() { Close(); }
+
+    private:
+        /**
+         * Fills m_ifd with the directory of a frame
+         *
+         * @param index Frame index
+         * @param nextOffset Offset of the next directory, 0 for the last one
+         */
+        void EncodeIfd(std::uint64_t index, std::uint64_t nextOffset);
+
+        /**
+         * Writes the file header for the current variant at the file start
+         *
+         * @return true on success
+         */
+        bool WriteHeader();
+
+        /**
+         * Rewrites the header and every written directory as bigtiff
+         *
+         * @return true on success
+         */
+        bool PromoteToBigTiff();
+
+        std::string m_path{};
+        std::ofstream m_ofs{};
+        /// Buffer of m_ofs
+        std::vector<char> m_streamBuffer{};
+        /// Directory slot of the current frame
+        std::vector<char> m_ifd{};
+
+        uint32_t m_imageWidth = 0;
+        uint32_t m_imageHeight = 0;
+        /// Size of the pixel data of one uncompressed frame
+        std::uint64_t m_frameBytes = 0;
+
+        Compression m_compression = NO_COMPRESSION;
+        /// Compressor of the frames, unused without compression
+        StripCodec m_codec{};
+        uint32_t m_numStrips = 1;
+        uint32_t m_rowsPerStrip = 0;
+
+        /// Directory offset of every written frame
+        std::vector<std::uint64_t> m_ifdOffsets{};
+        /// Strip sizes of every written frame, m_numStrips per frame
+        std::vector<uint32_t> m_stripBytes{};
+        /// Offset the next frame's directory goes to
+        std::uint64_t m_nextIfdOffset = 0;
+        std::uint64_t m_bytesWritten = 0;
+
+        bool m_bBigTiff = false;
+        bool m_errorOccurred = false;
+    };
+}// namespace prm
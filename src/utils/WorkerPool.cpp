@@ -0,0 +1,68 @@
+#include "WorkerPool.h"
+
+namespace prm
+{
+    WorkerPool::WorkerPool(unsigned numThreads)
+    {
+        for (unsigned i = 1; i < numThreads; ++i)
+        {
+            m_threads.emplace_back(&WorkerPool::Main, this);
+        }
+    }
+
+    void WorkerPool::ParallelFor(std::size_t numTasks,
+                                 const std::function<void(std::size_t)>& task)
+    {
+        if (numTasks == 0) { return; }
+
+        std::unique_lock lock{m_mutex};
+        m_task = &task;
+        m_numTasks = numTasks;
+        m_nextTask = 0;
+        m_tasksDone = 0;
+        ++m_generation;
+        m_loopStarted.notify_all();
+
+        RunTasks(lock);
+        m_loopFinished.wait(lock, [this] { return m_tasksDone == m_numTasks; });
+        m_task = nullptr;
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        {
+            std::scoped_lock lock{m_mutex};
+            m_bStop = true;
+        }
+        m_loopStarted.notify_all();
+    }
+
+    void WorkerPool::Main()
+    {
+        std::size_t generation = 0;
+        std::unique_lock lock{m_mutex};
+        while (true)
+        {
+            m_loopStarted.wait(lock, [&]
+                               { return m_bStop || m_generation != generation; });
+            if (m_bStop) { return; }
+            generation = m_generation;
+            RunTasks(lock);
+        }
+    }
+
+    void WorkerPool::RunTasks(std::unique_lock<std::mutex>& lock)
+    {
+        while (m_nextTask < m_numTasks)
+        {
+            const auto index = m_nextTask++;
+            const auto* task = m_task;
+
+            lock.unlock();
+            (*task)(index);
+            lock.lock();
+
+            if (++m_tasksDone == m_numTasks) { m_loopFinished.notify_all(); }
+        }
+    }
+}// namespace prm
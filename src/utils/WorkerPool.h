@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace prm
+{
+    /**
+     * Fixed set of worker threads running parallel loops
+     * The threads are started once and sleep between loops, so a loop per
+     * captured frame costs no thread creation. The calling thread takes part in
+     * the loop as well
+     */
+    class WorkerPool
+    {
+    public:
+        /**
+         * Starts the worker threads
+         *
+         * @param numThreads Number of threads running a loop including the caller
+         */
+        explicit WorkerPool(unsigned numThreads);
+
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        /**
+         * Runs a task for every index and waits until all of them are done
+         * Only one loop runs at a time
+         *
+         * @param numTasks Number of task indices
+         * @param task Task taking the index to work on
+         */
+        void ParallelFor(std::size_t numTasks,
+                         const std::function<void(std::size_t)>& task);
+
+        [[nodiscard]] unsigned GetNumThreads() const
+        {
+            return static_cast<unsigned>(m_threads.size()) + 1;
+        }
+
+        ~WorkerPool();
+
+    private:
+        /**
+         * Worker thread function, joins every loop until the pool is destroyed
+         */
+        void Main();
+
+        /**
+         * Takes task indices of the current loop until none are left
+         *
+         * @param lock Lock of m_mutex, released while a task runs
+         */
+        void RunTasks(std::unique_lock<std::mutex>& lock);
+
+        std::mutex m_mutex{};
+        /// Wakes the workers when a loop starts
+        std::condition_variable m_loopStarted{};
+        /// Wakes the caller when the last task is finished
+        std::condition_variable m_loopFinished{};
+
+        /// Task of the current loop
+        const std::function<void(std::size_t)>* m_task = nullptr;
+        std::size_t m_numTasks = 0;
+        std::size_t m_nextTask = 0;
+        std::size_t m_tasksDone = 0;
+        /// Incremented for every loop, so the workers notice a new one
+        std::size_t m_generation = 0;
+        bool m_bStop = false;
+
+        std::vector<std::jthread> m_threads{};
+    };
+}// namespace prm